@@ -8,6 +8,8 @@
 
 #include "BVHAccelerator.h"
 
+#include <algorithm>
+
 BVHAccelerator::Node::Node()
 : boundingBox(), children(), splitDimension(0), primitivesOffset(0), primitivesCount(0) {
     children[0] = children[1] = nullptr;
@@ -55,7 +57,7 @@ bool BVHAccelerator::ComparePoints::operator()(const BuildPrimitiveInfo& a,
 }
 
 BVHAccelerator::BVHAccelerator(SplitMethod splitMethod)
-: _splitMethod(splitMethod), _primitives(), _root(nullptr) {
+: _splitMethod(splitMethod), _primitives(), _root(nullptr), _keepLayout(false), _primitivesOrder() {
     
 }
 
@@ -91,6 +93,31 @@ void BVHAccelerator::preprocess() {
     orderedPrimitives.reserve(_primitives.size());
     _root = recursiveBuild(buildData, 0, _primitives.size(), orderedPrimitives);
     _primitives.swap(orderedPrimitives);
+    
+    // The leaves take the primitives in build data order
+    _primitivesOrder.clear();
+    if (_keepLayout) {
+        _primitivesOrder.reserve(buildData.size());
+        for (const BuildPrimitiveInfo& info : buildData) {
+            _primitivesOrder.push_back(info.primitiveIndex);
+        }
+    }
+    
+    // Shadow rays stop at the first hit, test the cheap opaque primitives first
+    _partitionLeaves(_root);
+}
+
+void BVHAccelerator::_partitionLeaves(Node* node) {
+    if (node->primitivesCount > 0) {
+        std::stable_partition(_primitives.begin() + node->primitivesOffset,
+                              _primitives.begin() + node->primitivesOffset + node->primitivesCount,
+                              [] (const std::shared_ptr<Primitive>& p) {
+            return p->isOpaque();
+        });
+        return;
+    }
+    _partitionLeaves(node->children[0]);
+    _partitionLeaves(node->children[1]);
 }
 
 void BVHAccelerator::rebuild() {
@@ -100,6 +127,117 @@ void BVHAccelerator::rebuild() {
     preprocess();
 }
 
+void BVHAccelerator::setKeepLayout(bool keep) {
+    _keepLayout = keep;
+    if (!keep) {
+        std::vector<uint32_t>().swap(_primitivesOrder);
+    }
+}
+
+bool BVHAccelerator::getLayout(std::vector<LinearNode>* nodes,
+                               std::vector<uint32_t>* primitivesOrder) const {
+    if (!_root || _primitivesOrder.size() != _primitives.size()) {
+        return false;
+    }
+    nodes->clear();
+    _flattenNode(_root, nodes);
+    *primitivesOrder = _primitivesOrder;
+    return true;
+}
+
+void BVHAccelerator::_flattenNode(const Node* node, std::vector<LinearNode>* nodes) const {
+    uint32_t index = nodes->size();
+    LinearNode linear;
+    linear.min = node->boundingBox.min;
+    linear.max = node->boundingBox.max;
+    linear.secondChildOffset = 0;
+    linear.splitDimension = node->splitDimension;
+    linear.primitivesOffset = node->primitivesOffset;
+    linear.primitivesCount = node->primitivesCount;
+    nodes->push_back(linear);
+    if (node->primitivesCount == 0) {
+        _flattenNode(node->children[0], nodes);
+        (*nodes)[index].secondChildOffset = nodes->size();
+        _flattenNode(node->children[1], nodes);
+    }
+}
+
+// Check the subtree starting at index is stored in depth-first order, and set
+// end to the index following it
+static bool CheckLinearNode(const BVHAccelerator::LinearNode* nodes, uint32_t nodesCount,
+                            uint32_t primitivesCount, uint32_t index, uint32_t* end) {
+    if (index >= nodesCount) {
+        return false;
+    }
+    const BVHAccelerator::LinearNode& node = nodes[index];
+    if (node.primitivesCount > 0) {
+        *end = index + 1;
+        return (node.primitivesOffset <= primitivesCount
+                && node.primitivesCount <= primitivesCount - node.primitivesOffset);
+    }
+    uint32_t firstEnd = 0;
+    return (node.splitDimension < 3
+            && CheckLinearNode(nodes, nodesCount, primitivesCount, index + 1, &firstEnd)
+            && node.secondChildOffset == firstEnd
+            && CheckLinearNode(nodes, nodesCount, primitivesCount, firstEnd, end));
+}
+
+bool BVHAccelerator::setLayout(uint32_t nodesCount, const LinearNode* nodes,
+                               uint32_t primitivesCount, const uint32_t* primitivesOrder) {
+    std::vector<std::shared_ptr<Primitive>> refined;
+    for (const std::shared_ptr<Primitive>& p : _primitives) {
+        p->fullyRefine(refined);
+    }
+    if (refined.empty() || refined.size() != primitivesCount || nodesCount == 0) {
+        return false;
+    }
+    
+    // Check the order is a permutation and the nodes stay in the arrays
+    std::vector<bool> ordered(primitivesCount, false);
+    for (uint32_t i = 0; i < primitivesCount; ++i) {
+        if (primitivesOrder[i] >= primitivesCount || ordered[primitivesOrder[i]]) {
+            return false;
+        }
+        ordered[primitivesOrder[i]] = true;
+    }
+    uint32_t end = 0;
+    if (!CheckLinearNode(nodes, nodesCount, primitivesCount, 0, &end) || end != nodesCount) {
+        return false;
+    }
+    
+    if (_root) {
+        delete _root;
+    }
+    _primitives.clear();
+    _primitives.reserve(primitivesCount);
+    for (uint32_t i = 0; i < primitivesCount; ++i) {
+        _primitives.push_back(refined[primitivesOrder[i]]);
+    }
+    _root = _buildNode(0, nodes);
+    _primitivesOrder.clear();
+    if (_keepLayout) {
+        _primitivesOrder.assign(primitivesOrder, primitivesOrder + primitivesCount);
+    }
+    
+    // Opacity depends on the materials, so partition again
+    _partitionLeaves(_root);
+    return true;
+}
+
+BVHAccelerator::Node* BVHAccelerator::_buildNode(uint32_t index, const LinearNode* nodes) const {
+    const LinearNode& linear = nodes[index];
+    Node* node = new Node();
+    node->boundingBox = AABB(linear.min, linear.max);
+    node->splitDimension = linear.splitDimension;
+    node->primitivesOffset = linear.primitivesOffset;
+    node->primitivesCount = linear.primitivesCount;
+    if (linear.primitivesCount == 0) {
+        node->children[0] = _buildNode(index + 1, nodes);
+        node->children[1] = _buildNode(linear.secondChildOffset, nodes);
+    }
+    return node;
+}
+
 /*
  * Structure used by SAH split
  */
@@ -384,11 +522,15 @@ bool BVHAccelerator::intersect(const Ray& ray, Intersection* intersection) const
 }
 
 bool BVHAccelerator::intersectP(const Ray& ray) const {
+    return findOccluder(ray) != nullptr;
+}
+
+const Primitive* BVHAccelerator::findOccluder(const Ray& ray) const {
     if (!_root) {
-        return false;
+        return nullptr;
     }
     
-    // Follow ray through BVH nodes to find primitives intersections
+    // Follow ray through BVH nodes, any hit will do so children are not ordered
     uint32_t todoOffset = 0;
     Node* todo[64];
     Node* currentNode = _root;
@@ -399,10 +541,11 @@ bool BVHAccelerator::intersectP(const Ray& ray) const {
         // Check ray against current node
         if (currentNode->boundingBox.intersectP(ray, &t0, &t1)) {
             if (currentNode->primitivesCount > 0) {
-                // Leaf node, check ray against primitives
+                // Leaf node, check ray against primitives, opaque ones come first
                 for (uint32_t i = 0; i < currentNode->primitivesCount; ++i) {
-                    if (_primitives[currentNode->primitivesOffset+i]->intersectP(ray)) {
-                        return true;
+                    const Primitive* primitive = _primitives[currentNode->primitivesOffset+i].get();
+                    if (primitive->intersectP(ray)) {
+                        return primitive;
                     }
                 }
                 if (todoOffset == 0) {
@@ -410,9 +553,60 @@ bool BVHAccelerator::intersectP(const Ray& ray) const {
                     break;
                 }
                 currentNode = todo[--todoOffset];
+            } else {
+                todo[todoOffset++] = currentNode->children[1];
+                currentNode = currentNode->children[0];
+            }
+        } else {
+            if (todoOffset == 0) {
+                // Stack is empty, no more node to check
+                break;
+            }
+            currentNode = todo[--todoOffset];
+        }
+    }
+    
+    return nullptr;
+}
+
+void BVHAccelerator::intersectPacket(const RayPacket& packet, Intersection* intersections,
+                                     bool* hits) const {
+    if (!_root) {
+        return;
+    }
+    
+    // Diverging rays can't be bounded together, trace them one by one
+    RayPacket::Bounds bounds;
+    if (!packet.getBounds(&bounds)) {
+        Primitive::intersectPacket(packet, intersections, hits);
+        return;
+    }
+    
+    // Follow the packet through BVH nodes, all rays share the same traversal order
+    uint32_t todoOffset = 0;
+    Node* todo[64];
+    Node* currentNode = _root;
+    
+    while (true) {
+        // Check packet against current node
+        if (bounds.intersectP(currentNode->boundingBox)) {
+            if (currentNode->primitivesCount > 0) {
+                // Leaf node, check packet against primitives
+                for (uint32_t i = 0; i < currentNode->primitivesCount; ++i) {
+                    _primitives[currentNode->primitivesOffset+i]->intersectPacket(packet,
+                                                                                 intersections,
+                                                                                 hits);
+                }
+                // Closer hits shrink the packet interval
+                bounds.updateMaxDistance(packet);
+                if (todoOffset == 0) {
+                    // Stack is empty, no more node to check
+                    break;
+                }
+                currentNode = todo[--todoOffset];
             } else {
                 // Put far BVH node onto stack, advance to near node
-                if (ray.direction[currentNode->splitDimension] < 0) {
+                if (bounds.negativeDirection[currentNode->splitDimension]) {
                     todo[todoOffset++] = currentNode->children[0];
                     currentNode = currentNode->children[1];
                 } else {
@@ -428,6 +622,57 @@ bool BVHAccelerator::intersectP(const Ray& ray) const {
             currentNode = todo[--todoOffset];
         }
     }
+}
+
+void BVHAccelerator::intersectPacketP(const RayPacket& packet, bool* occluded) const {
+    if (!_root) {
+        return;
+    }
+    
+    // Diverging rays can't be bounded together, trace them one by one
+    RayPacket::Bounds bounds;
+    if (!packet.getBounds(&bounds)) {
+        Primitive::intersectPacketP(packet, occluded);
+        return;
+    }
+    
+    // Any hit will do, children are not ordered
+    uint32_t todoOffset = 0;
+    Node* todo[64];
+    Node* currentNode = _root;
     
-    return false;
-}
\ No newline at end of file
+    while (true) {
+        // Check packet against current node
+        if (bounds.intersectP(currentNode->boundingBox)) {
+            if (currentNode->primitivesCount > 0) {
+                // Leaf node, check packet against primitives
+                for (uint32_t i = 0; i < currentNode->primitivesCount; ++i) {
+                    _primitives[currentNode->primitivesOffset+i]->intersectPacketP(packet,
+                                                                                  occluded);
+                }
+                // Stop as soon as all the rays are occluded
+                uint_t occludedCount = 0;
+                for (uint_t i = 0; i < packet.size(); ++i) {
+                    occludedCount += occluded[i] ? 1 : 0;
+                }
+                if (occludedCount == packet.size()) {
+                    return;
+                }
+                if (todoOffset == 0) {
+                    // Stack is empty, no more node to check
+                    break;
+                }
+                currentNode = todo[--todoOffset];
+            } else {
+                todo[todoOffset++] = currentNode->children[1];
+                currentNode = currentNode->children[0];
+            }
+        } else {
+            if (todoOffset == 0) {
+                // Stack is empty, no more node to check
+                break;
+            }
+            currentNode = todo[--todoOffset];
+        }
+    }
+}
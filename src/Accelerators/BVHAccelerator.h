@@ -32,9 +32,31 @@ public:
     BVHAccelerator(SplitMethod splitMethod=SplitSAH);
     ~BVHAccelerator();
     
+    // Flattened node of a built tree, in depth-first order. The first child of
+    // an interior node follows it, the second one is at secondChildOffset
+    struct LinearNode {
+        vec3        min;
+        vec3        max;
+        uint32_t    secondChildOffset;
+        uint32_t    splitDimension;
+        uint32_t    primitivesOffset;
+        uint32_t    primitivesCount;
+    };
+    
     virtual void preprocess();
     virtual void rebuild();
     
+    // Keep the build order of the refined primitives so getLayout can be called
+    void setKeepLayout(bool keep);
+    
+    // Tree built by preprocess, and the refined index of each ordered primitive
+    bool getLayout(std::vector<LinearNode>* nodes, std::vector<uint32_t>* primitivesOrder) const;
+    
+    // Refine the primitives and set a tree returned by getLayout for the same
+    // primitives instead of building it. Fails without changes if it doesn't match
+    bool setLayout(uint32_t nodesCount, const LinearNode* nodes,
+                   uint32_t primitivesCount, const uint32_t* primitivesOrder);
+    
     virtual void addPrimitive(const std::shared_ptr<Primitive>& primitive);
 
     virtual std::shared_ptr<Primitive> findPrimitive(const std::string& name);
@@ -45,6 +67,10 @@ public:
     
     virtual bool intersect(const Ray& ray, Intersection* intersection) const;
     virtual bool intersectP(const Ray& ray) const;
+    virtual const Primitive* findOccluder(const Ray& ray) const;
+    virtual void intersectPacket(const RayPacket& packet, Intersection* intersections,
+                                 bool* hits) const;
+    virtual void intersectPacketP(const RayPacket& packet, bool* occluded) const;
     
 private:
     
@@ -93,10 +119,16 @@ private:
     Node* recursiveBuild(std::vector<BuildPrimitiveInfo>& buildData,
                          uint32_t start, uint32_t end,
                          std::vector<std::shared_ptr<Primitive>>& orderedPrimitives);
+    void _partitionLeaves(Node* node);
+    void _flattenNode(const Node* node, std::vector<LinearNode>* nodes) const;
+    Node* _buildNode(uint32_t index, const LinearNode* nodes) const;
     
     SplitMethod                             _splitMethod;
     std::vector<std::shared_ptr<Primitive>> _primitives;
     Node*                                   _root;
+    bool                                    _keepLayout;
+    // Refined index of each primitive before the leaves are partitioned
+    std::vector<uint32_t>                   _primitivesOrder;
 };
 
 #endif /* defined(__CSE168_Rendering__BVHAccelerator__) */
@@ -68,18 +68,25 @@ float PerspectiveCamera::generateRay(const CameraSample& sample, Ray* ray) {
     
     ray->origin = d;
     
-    // Plane center
-    ray->direction = ray->origin - c;
-
-    // Point on plane
-    ray->direction += (a*planeWidth*sample.position.x - a*(planeWidth/2)
-                       + b*planeHeight*sample.position.y - b*(planeHeight/2));
+    // Direction through a point of the image plane: plane center and point on plane
+    auto planeDirection = [&] (const vec2& position) {
+        return (-c + a*planeWidth*position.x - a*(planeWidth/2)
+                + b*planeHeight*position.y - b*(planeHeight/2));
+    };
+    
+    ray->direction = planeDirection(sample.position);
     
-    ray->direction = ray->direction - ray->origin;
+    // Rays through the next pixels on x and y
+    vec2 pixelSize = _film ? 1.f / _film->resolution : vec2(0.f);
+    vec3 rxDirection = planeDirection(sample.position + vec2(pixelSize.x, 0.f));
+    vec3 ryDirection = planeDirection(sample.position + vec2(0.f, pixelSize.y));
+    ray->hasDifferentials = (bool)_film;
     
     // Add depth of field
     if (_apertureSize > 0.f) {
         vec3 focusPoint = ray->origin + ray->direction*_focusDistance;
+        vec3 rxFocusPoint = ray->origin + rxDirection*_focusDistance;
+        vec3 ryFocusPoint = ray->origin + ryDirection*_focusDistance;
         
         // Sample in a disc
         float s = (float)rand()/RAND_MAX;
@@ -89,9 +96,15 @@ float PerspectiveCamera::generateRay(const CameraSample& sample, Ray* ray) {
         
         ray->origin += _apertureSize*(x*a + y*b);
         ray->direction = normalize(focusPoint - ray->origin);
+        ray->rxDirection = normalize(rxFocusPoint - ray->origin);
+        ray->ryDirection = normalize(ryFocusPoint - ray->origin);
     } else {
         ray->direction = normalize(ray->direction);
+        ray->rxDirection = normalize(rxDirection);
+        ray->ryDirection = normalize(ryDirection);
     }
+    ray->rxOrigin = ray->origin;
+    ray->ryOrigin = ray->origin;
     
     ray->time = time;
     
@@ -32,4 +32,12 @@ void Aggregate::removePrimitive(const std::string&) {
 
 const std::vector<std::shared_ptr<Primitive>> Aggregate::getPrimitives() const {
     return std::vector<std::shared_ptr<Primitive>>();
-}
\ No newline at end of file
+}
+
+bool Aggregate::isOpaque() const {
+    return false;
+}
+
+const Primitive* Aggregate::findOccluder(const Ray& ray) const {
+    return intersectP(ray) ? this : nullptr;
+}
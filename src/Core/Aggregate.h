@@ -26,6 +26,12 @@ public:
     virtual std::shared_ptr<Primitive> findPrimitive(const std::string& name);
     virtual void removePrimitive(const std::string& name);
     virtual const std::vector<std::shared_ptr<Primitive>> getPrimitives() const;
+    
+    // Aggregates may contain alpha tested primitives
+    virtual bool isOpaque() const;
+    
+    // Primitive blocking the ray, nullptr if the ray is unoccluded
+    virtual const Primitive* findOccluder(const Ray& ray) const;
 };
 
 #endif /* defined(__CSE168_Rendering__Aggregate__) */
@@ -11,7 +11,7 @@
 #include "Ray.h"
 
 AnimatedTransform::AnimatedTransform() :
-_actuallyAnimated(false), _transforms(),
+_actuallyAnimated(false), _transforms(), _inverseTransforms(),
 _translations(), _rotations(), _scales() {
     
 }
@@ -23,12 +23,15 @@ AnimatedTransform::~AnimatedTransform() {
 void AnimatedTransform::setTransform(const Transform& t) {
     _actuallyAnimated = false;
     _transforms[0] = t;
+    _inverseTransforms[0] = Transform::Inverse(t);
 }
 
 void AnimatedTransform::setTransforms(const Transform& t1, const Transform& t2) {
     _actuallyAnimated = true;
     _transforms[0] = t1;
     _transforms[1] = t2;
+    _inverseTransforms[0] = Transform::Inverse(t1);
+    _inverseTransforms[1] = Transform::Inverse(t2);
     // Decompose matrices
     decompose(t1.getMatrix(), &_translations[0], &_rotations[0], &_scales[0]);
     decompose(t2.getMatrix(), &_translations[1], &_rotations[1], &_scales[1]);
@@ -45,6 +48,10 @@ const Transform& AnimatedTransform::operator[](int i) const {
     return _transforms[i];
 }
 
+const Transform& AnimatedTransform::getInverse(int i) const {
+    return _inverseTransforms[i];
+}
+
 Transform AnimatedTransform::interpolate(float time) const {
     if (!_actuallyAnimated || time <= 0.f) {
         return _transforms[0];
@@ -53,14 +60,10 @@ Transform AnimatedTransform::interpolate(float time) const {
         return _transforms[1];
     }
     
-    // Interpolate translation
-    vec3 t = mix(_translations[0], _translations[1], time);
-    
-    // Interpolate rotation
-    quat r = mix(_rotations[0], _rotations[1], time);
-    
-    // Interpolate scale
-    mat4x4 s = mix(_scales[0], _scales[1], time);
+    vec3 t;
+    quat r;
+    mat4x4 s;
+    _interpolateDecomposition(time, &t, &r, &s);
     
     // Recompose interpolated matrix
     mat4x4 m;
@@ -68,19 +71,62 @@ Transform AnimatedTransform::interpolate(float time) const {
     return m;
 }
 
+Transform AnimatedTransform::interpolateInverse(float time) const {
+    Transform transform, inverse;
+    interpolate(time, &transform, &inverse);
+    return inverse;
+}
+
+void AnimatedTransform::interpolate(float time, Transform* transform, Transform* inverse) const {
+    if (!_actuallyAnimated || time <= 0.f) {
+        *transform = _transforms[0];
+        *inverse = _inverseTransforms[0];
+        return;
+    }
+    if (time >= 1.f) {
+        *transform = _transforms[1];
+        *inverse = _inverseTransforms[1];
+        return;
+    }
+    
+    vec3 t;
+    quat r;
+    mat4x4 s;
+    _interpolateDecomposition(time, &t, &r, &s);
+    
+    mat4x4 m;
+    *transform = glm::translate(m, t) * mat4_cast(r) * s;
+    
+    // Invert each part instead of the whole matrix: (T R S)^-1 = S^-1 R^T T^-1,
+    // only the 3x3 scale part needs a real inversion
+    mat4x4 inverseScale = mat4x4(glm::inverse(mat3x3(s)));
+    mat4x4 inverseRotation = mat4_cast(glm::conjugate(r));
+    *inverse = inverseScale * inverseRotation * glm::translate(m, -t);
+}
+
+void AnimatedTransform::_interpolateDecomposition(float time, vec3* translation, quat* rotation,
+                                                  mat4x4* scale) const {
+    // Interpolate translation
+    *translation = mix(_translations[0], _translations[1], time);
+    
+    // Interpolate rotation
+    *rotation = mix(_rotations[0], _rotations[1], time);
+    
+    // Interpolate scale
+    *scale = mix(_scales[0], _scales[1], time);
+}
+
 AABB AnimatedTransform::motionBounds(const AABB& box, bool useInverse) const {
     if (!_actuallyAnimated) {
-        return useInverse ? Transform::Inverse(_transforms[0])(box) : _transforms[0](box);
+        return useInverse ? _inverseTransforms[0](box) : _transforms[0](box);
     }
     
     AABB bounds;
     
     const int steps = 128;
     for (int i = 0; i < steps; ++i) {
-        Transform t = interpolate((float)i/(steps-1));
-        if (useInverse) {
-            t = Transform::Inverse(t);
-        }
+        float time = (float)i/(steps-1);
+        Transform t = useInverse ? interpolateInverse(time) : interpolate(time);
         bounds = AABB::Union(bounds, t(box));
     }
     return bounds;
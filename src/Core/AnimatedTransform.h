@@ -22,16 +22,24 @@ public:
     bool isActuallyAnimated() const;
     
     const Transform& operator[](int i) const;
+    const Transform& getInverse(int i) const;
     
     Transform interpolate(float time) const;
+    Transform interpolateInverse(float time) const;
+    // Interpolated transform and its inverse, sharing the interpolation of the decomposition
+    void      interpolate(float time, Transform* transform, Transform* inverse) const;
     
     AABB motionBounds(const AABB& box, bool useInverse) const;
     
     static void decompose(const mat4x4& m, vec3* translation, quat* rotation, mat4x4* scale);
     
 private:
+    void _interpolateDecomposition(float time, vec3* translation, quat* rotation,
+                                   mat4x4* scale) const;
+    
     bool        _actuallyAnimated;
     Transform   _transforms[2];
+    Transform   _inverseTransforms[2];
     vec3        _translations[2];
     quat        _rotations[2];
     mat4x4      _scales[2];
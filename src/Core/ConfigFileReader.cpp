@@ -8,7 +8,8 @@
 
 #include "ConfigFileReader.h"
 
-#include <fstream>
+#include "Core/JSONFileStream.h"
+#include "Utilities/TextureCache.h"
 
 using namespace rapidjson;
 
@@ -19,20 +20,26 @@ ConfigFileReader::~ConfigFileReader() {
 }
 
 bool ConfigFileReader::readFile(const std::string &filename) {
-    // Open and read config file
-    std::string contents;
-    LoadFileContents(filename, contents);
+    // Open config file
+    JSONFileStream stream(filename);
+    if (!stream.isOpen()) {
+        std::cerr << "ConfigFileReader error: cannot open file \"" << filename << "\"" << std::endl;
+        return false;
+    }
     
-    // Parse json file
+    // Parse json file while it is read
     Document json;
-    json.Parse<0>(contents.c_str());
+    json.ParseStream<0>(stream);
     if (json.HasParseError()) {
         std::cerr << json.GetErrorOffset() << ": " << json.GetParseError() << std::endl;
-        std::cerr << contents.substr(json.GetErrorOffset(), 30) << std::endl;
+        std::cerr << stream.readAt(json.GetErrorOffset(), 30) << std::endl;
         return false;
     }
     
     // Import configuration
+    if (json.HasMember("textureCache")) {
+        TextureCache::Load(json["textureCache"]);
+    }
     if (json.HasMember("film")) {
         _film = Film::Load(json["film"]);
         if (!_film) {
@@ -67,26 +74,6 @@ std::shared_ptr<Scene> ConfigFileReader::getScene() const {
     return _scene;
 }
 
-bool ConfigFileReader::LoadFileContents(std::string filename, std::string& contents) {
-    if (filename[0] != '/') {
-        filename = Core::baseDirectory + filename;
-    }
-    
-    std::ifstream file (filename);
-    
-    if (!file.is_open()) {
-        std::cerr << "ConfigFileReader error: cannot open file \"" << contents << std::endl;
-        return false;
-    }
-    
-    file.seekg(0, std::ios::end);
-    contents.resize(file.tellg());
-    file.seekg (0, std::ios::beg);
-    file.read(&contents[0], contents.size());
-    file.close();
-    return true;
-}
-
 vec3 ConfigFileReader::LoadVec3(const rapidjson::Value& value) {
     if (!value.IsArray() || value.Size() != 3) {
         std::cerr << "ConfigFileReader error: Invalid vector specified" << std::endl;
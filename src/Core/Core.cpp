@@ -8,6 +8,16 @@
 
 #include "Core.h"
 
+#include <cstring>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+
 const float Core::Epsilon = 0.0001f;
 
 int Core::roundUpPow2(int n) {
@@ -20,6 +30,154 @@ int Core::roundUpPow2(int n) {
     return n+1;
 }
 
+const uint64_t Core::HashSeed = 14695981039346656037ULL;
+
+uint64_t Core::hash(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Indices of a parallelFor, shared by the calling thread and its pool tasks
+struct ParallelForState {
+    ParallelForState(uint_t count, const std::function<void (uint_t)>& function) :
+    next(0), count(count), function(function), mutex(), finished(), runningTasks(0), closed(false) {
+        
+    }
+    
+    void run() {
+        for (uint_t i = next++; i < count; i = next++) {
+            function(i);
+        }
+    }
+    
+    std::atomic<uint_t>                     next;
+    uint_t                                  count;
+    const std::function<void (uint_t)>&     function;
+    QMutex                                  mutex;
+    QWaitCondition                          finished;
+    uint_t                                  runningTasks;
+    bool                                    closed;
+};
+
+// Tasks starting after the calling thread returned find the state closed
+class ParallelForTask : public QRunnable {
+public:
+    
+    ParallelForTask(const std::shared_ptr<ParallelForState>& state) : _state(state) {
+        
+    }
+    
+    virtual void run() {
+        {
+            QMutexLocker locker(&_state->mutex);
+            if (_state->closed) {
+                return;
+            }
+            ++_state->runningTasks;
+        }
+        _state->run();
+        QMutexLocker locker(&_state->mutex);
+        if (--_state->runningTasks == 0) {
+            _state->finished.wakeAll();
+        }
+    }
+    
+private:
+    std::shared_ptr<ParallelForState> _state;
+};
+
+void Core::parallelFor(uint_t count, const std::function<void (uint_t)>& function) {
+    QThreadPool* pool = QThreadPool::globalInstance();
+    uint_t threadsCount = std::min(count, (uint_t)std::max(1, pool->maxThreadCount()));
+    if (threadsCount <= 1) {
+        for (uint_t i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+    // The calling thread takes indices too, so nested calls progress even when
+    // all the pool threads are busy with the outer one
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>(count, function);
+    for (uint_t t = 1; t < threadsCount; ++t) {
+        pool->start(new ParallelForTask(state));
+    }
+    state->run();
+    
+    QMutexLocker locker(&state->mutex);
+    state->closed = true;
+    while (state->runningTasks > 0) {
+        state->finished.wait(&state->mutex);
+    }
+}
+
+uint16_t Core::floatToHalf(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t mantissa = bits & 0x7fffff;
+    int exponent = (int)((bits >> 23) & 0xff);
+    // Infinity and NaN
+    if (exponent == 0xff) {
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    exponent += 15 - 127;
+    if (exponent >= 31) {
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) {
+        // Too small even for a subnormal half
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift-1)) & 1) {
+            half += 1;
+        }
+        return sign | half;
+    }
+    // Rounding may carry into the exponent, which is the expected result
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) {
+        half += 1;
+    }
+    return half;
+}
+
+float Core::halfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Normalize the subnormal half
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            mantissa &= 0x3ff;
+            bits = sign | (exponent << 23) | (mantissa << 13);
+        }
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
 std::string Core::baseDirectory = "";
 
 void Core::setBaseDirectory(const std::string& dir) {
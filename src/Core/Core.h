@@ -17,6 +17,7 @@
 using namespace glm;
 
 #include <memory>
+#include <functional>
 #include <rapidjson/document.h>
 #include <iostream>
 
@@ -39,6 +40,19 @@ public:
     
     static int roundUpPow2(int n);
     
+    // FNV-1a hash, pass a previous hash as seed to combine values
+    static const uint64_t HashSeed;
+    static uint64_t hash(const void* data, size_t size, uint64_t seed=HashSeed);
+    
+    // IEEE 754 half precision conversions (round to nearest)
+    static uint16_t floatToHalf(float f);
+    static float    halfToFloat(uint16_t h);
+    
+    // Call function for each index in [0, count) on the calling thread and the
+    // global thread pool, each thread taking the next index until all are
+    // processed. Nested calls don't start new threads
+    static void parallelFor(uint_t count, const std::function<void (uint_t)>& function);
+    
     static std::string baseDirectory;
     static void setBaseDirectory(const std::string& dir);
 };
@@ -29,6 +29,10 @@ bool GeometricPrimitive::canIntersect() const {
     return _shape->canIntersect();
 }
 
+bool GeometricPrimitive::isOpaque() const {
+    return _shape->isOpaque();
+}
+
 bool GeometricPrimitive::intersect(const Ray& ray, Intersection* intersection) const {
     if (!_shape->intersect(ray, intersection)) {
         return false;
@@ -29,6 +29,7 @@ public:
     virtual bool canIntersect() const;
     virtual bool intersect(const Ray& ray, Intersection* intersection) const;
     virtual bool intersectP(const Ray& ray) const;
+    virtual bool isOpaque() const;
     virtual AABB getBoundingBox() const;
     
     virtual void refine(std::vector<std::shared_ptr<Primitive>> &refined) const;
@@ -11,75 +11,157 @@
 #include "Core/Scene.h"
 #include "Core/Light.h"
 #include "Core/Material.h"
+#include "Core/RayPacket.h"
+
+Integrator::Integrator() : _lightSampler() {
+    
+}
 
 Integrator::~Integrator() {
     
 }
 
-void Integrator::preprocess(const Scene&, const Camera*, const Renderer&) {
+void Integrator::preprocess(const Scene& scene, const Camera*, const Renderer&) {
+    if (_lightSampler) {
+        _lightSampler->preprocess(scene);
+    }
+}
+
+void Integrator::setLightSampler(const std::shared_ptr<LightSampler>& sampler) {
+    _lightSampler = sampler;
+}
+
+float Integrator::PowerHeuristic(int nf, float fPdf, int ng, float gPdf) {
+    float f = nf * fPdf, g = ng * gPdf;
+    if (f == 0.f) {
+        return 0.f;
+    }
+    return (f*f) / (f*f + g*g);
+}
+
+Spectrum Integrator::getDirectLighting(const Scene& scene, const Renderer& renderer,
+                                       const Ray& ray, const Intersection& intersection,
+                                       bool useMIS) const {
+    Spectrum l(0.f);
+    
+    vec3 n = intersection.normal;
+    if (dot(n, -ray.direction) < 0) {
+        n = -n;
+    }
     
+    // Sample a single light, weighted by the probability of choosing it
+    if (_lightSampler) {
+        float selectionPdf;
+        const Light* light = _lightSampler->sample(intersection.point, n,
+                                                   (float)rand()/RAND_MAX, &selectionPdf);
+        if (light && selectionPdf > 0.f) {
+            l = _SampleLight(scene, renderer, ray, intersection, n, light, selectionPdf, useMIS);
+        }
+        return l;
+    }
+    
+    // Add contribution of each light source
+    for (const Light* light : scene.getLights()) {
+        l += _SampleLight(scene, renderer, ray, intersection, n, light, 1.f, useMIS);
+    }
+    return l;
+}
+
+float Integrator::getLightSelectionPdf(const vec3& point, const vec3& normal,
+                                       const Light* light) const {
+    if (_lightSampler) {
+        return _lightSampler->pdf(point, normal, light);
+    }
+    return 1.f;
 }
 
-Spectrum Integrator::GetDirectLighting(const Scene& scene, const Renderer& renderer,
-                                       const Ray& ray, const Intersection& intersection) {
+Spectrum Integrator::_SampleLight(const Scene& scene, const Renderer& renderer,
+                                  const Ray& ray, const Intersection& intersection,
+                                  const vec3& n, const Light* light,
+                                  float selectionPdf, bool useMIS) {
     Spectrum l(0.f);
     
     // Initialize common variables
     const vec3& point = intersection.point;
-    vec3 n = intersection.normal;
     vec3 wo = -ray.direction;
     
-    if (dot(n, wo) < 0) {
-        n = -n;
-    }
+    // Shadow rays toward a light are coherent, they are traced by packets
+    RayPacket shadowRays;
+    Spectrum contributions[RayPacket::MaxSize];
+    auto traceShadowRays = [&] () {
+        bool occluded[RayPacket::MaxSize] = {false};
+        scene.intersectPacketP(shadowRays, occluded, light);
+        for (uint_t k = 0; k < shadowRays.size(); ++k) {
+            if (!occluded[k]) {
+                l += contributions[k];
+            }
+        }
+        shadowRays.clear();
+    };
     
-    // Add contribution of each light source
-    for (Light* light : scene.getLights()) {
-        // Sample light
-        const SamplingConfig& sampling = light->getSamplingConfig();
-        int samplesCount = sampling.count;
-        for (int i = 0; i < samplesCount; ++i) {
-            for (int j = 0; j < samplesCount; ++j) {
-                LightSample sample;
-                vec3 wi;
-                VisibilityTester vt(ray);
-                
-                sample.u = (float)i/samplesCount;
-                sample.v = (float)j/samplesCount;
-                
-                if (sampling.jittered) {
-                    sample.u += ((float)rand()/RAND_MAX) / samplesCount;
-                    sample.v += ((float)rand()/RAND_MAX) / samplesCount;
-                } else {
-                    sample.u += 0.5f / samplesCount;
-                    sample.v += 0.5f / samplesCount;
-                }
-                
-                Spectrum li = light->sampleL(point, intersection.rayEpsilon, sample, &wi, &vt);
-                
-                if (li.isBlack()) {
-                    continue;
-                }
-                
-                // Apply attenuation from scene volumes
-                li *= vt.transmittance(scene, renderer);
-                
-                if (li.isBlack()) {
-                    continue;
-                }
-                
-                float cosine = dot(wi, n);
-                if (cosine < 0) {
-                    continue;
+    // Sample light
+    const SamplingConfig& sampling = light->getSamplingConfig();
+    int samplesCount = sampling.count;
+    for (int i = 0; i < samplesCount; ++i) {
+        for (int j = 0; j < samplesCount; ++j) {
+            LightSample sample;
+            vec3 wi;
+            VisibilityTester vt(ray);
+            
+            sample.u = (float)i/samplesCount;
+            sample.v = (float)j/samplesCount;
+            
+            if (sampling.jittered) {
+                sample.u += ((float)rand()/RAND_MAX) / samplesCount;
+                sample.v += ((float)rand()/RAND_MAX) / samplesCount;
+            } else {
+                sample.u += 0.5f / samplesCount;
+                sample.v += 0.5f / samplesCount;
+            }
+            
+            Spectrum li = light->sampleL(point, intersection.rayEpsilon, sample, &wi, &vt);
+            
+            if (li.isBlack()) {
+                continue;
+            }
+            
+            // Apply attenuation from scene volumes
+            li *= vt.transmittance(scene, renderer);
+            
+            if (li.isBlack()) {
+                continue;
+            }
+            
+            float cosine = dot(wi, n);
+            if (cosine < 0) {
+                continue;
+            }
+            
+            Spectrum f = intersection.material->evaluateBSDF(wo, wi, intersection);
+            
+            if (cosine > 0 && !f.isBlack()) {
+                float weight = 1.f;
+                // Share the contribution with BSDF sampling for non-delta lights
+                if (useMIS) {
+                    float lightPdf = light->pdfL(point, wi);
+                    if (lightPdf > 0.f) {
+                        float bsdfPdf = intersection.material->pdfBSDF(wo, wi, intersection);
+                        weight = PowerHeuristic(samplesCount*samplesCount, selectionPdf*lightPdf,
+                                                1, bsdfPdf);
+                    }
                 }
-                
-                Spectrum f = intersection.material->evaluateBSDF(wo, wi, intersection);
-                
-                if (cosine > 0 && !f.isBlack() && vt.unoccluded(scene)) {
-                    l += li * f * cosine * (1.0f / (samplesCount*samplesCount));
+                contributions[shadowRays.size()] = (li * f * cosine
+                                                    * (weight / (samplesCount*samplesCount
+                                                                 * selectionPdf)));
+                shadowRays.push(vt.getRay());
+                if (shadowRays.isFull()) {
+                    traceShadowRays();
                 }
             }
         }
     }
+    if (shadowRays.size() > 0) {
+        traceShadowRays();
+    }
     return l;
-}
\ No newline at end of file
+}
@@ -10,16 +10,37 @@
 #define CSE168_Rendering_Integrator_h
 
 #include "Core.h"
+#include "LightSampler.h"
+
+class Light;
 
 class Integrator {
-public:    
+public:
+    Integrator();
     virtual ~Integrator();
     
-    virtual void preprocess(const Scene&, const Camera*, const Renderer&);
+    virtual void preprocess(const Scene& scene, const Camera*, const Renderer&);
+    
+    // Sample every light, or a single one if a light sampler is set
+    void setLightSampler(const std::shared_ptr<LightSampler>& sampler);
+    
+    Spectrum getDirectLighting(const Scene& scene, const Renderer& renderer,
+                               const Ray& ray,
+                               const Intersection& intersection,
+                               bool useMIS=false) const;
+    float    getLightSelectionPdf(const vec3& point, const vec3& normal,
+                                  const Light* light) const;
+    
+    // Multiple importance sampling weight of nf samples from f against ng samples from g
+    static float PowerHeuristic(int nf, float fPdf, int ng, float gPdf);
+    
+private:
+    static Spectrum _SampleLight(const Scene& scene, const Renderer& renderer,
+                                 const Ray& ray, const Intersection& intersection,
+                                 const vec3& n, const Light* light,
+                                 float selectionPdf, bool useMIS);
     
-    static Spectrum GetDirectLighting(const Scene& scene, const Renderer& renderer,
-                                      const Ray& ray,
-                                      const Intersection& intersection);
+    std::shared_ptr<LightSampler>   _lightSampler;
 };
 
 #endif
\ No newline at end of file
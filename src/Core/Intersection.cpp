@@ -8,11 +8,15 @@
 
 #include "Intersection.h"
 
+#include <cmath>
+
 #include "Core/Material.h"
+#include "Core/Ray.h"
 
 Intersection::Intersection() :
 t(INFINITY), rayEpsilon(Core::Epsilon), point(), normal(), uv(0),
-tangentU(0.f), tangentV(0.f),
+tangentU(0.f), tangentV(0.f), dpdu(0.f), dpdv(0.f),
+dudx(0.f), dvdx(0.f), dudy(0.f), dvdy(0.f),
 material(nullptr), primitive(nullptr) {
     
 }
@@ -32,9 +36,61 @@ void Intersection::applyNormalMapping() {
         return;
     }
     
-    vec3 newNormal = normalMap->evaluateVec3(uv);
+    vec3 newNormal = normalMap->evaluateVec3(*this);
     newNormal = normalize(newNormal - vec3(0.5f));
     newNormal = normalize(tangentU*newNormal.x + tangentV*newNormal.y
                           + normal*newNormal.z);
     normal = newNormal;
-}
\ No newline at end of file
+}
+
+void Intersection::computePositionDerivatives(const vec3& p0, const vec3& p1, const vec3& p2,
+                                              const vec2& uv0, const vec2& uv1, const vec2& uv2) {
+    vec2 duv02 = uv0 - uv2, duv12 = uv1 - uv2;
+    vec3 dp02 = p0 - p2, dp12 = p1 - p2;
+    float det = duv02.x*duv12.y - duv02.y*duv12.x;
+    if (det == 0.f) {
+        dpdu = vec3(0.f);
+        dpdv = vec3(0.f);
+        return;
+    }
+    float invDet = 1.f / det;
+    dpdu = (duv12.y*dp02 - duv02.y*dp12) * invDet;
+    dpdv = (duv02.x*dp12 - duv12.x*dp02) * invDet;
+}
+
+void Intersection::computeDifferentials(const Ray& ray) {
+    dudx = dvdx = dudy = dvdy = 0.f;
+    if (!ray.hasDifferentials) {
+        return;
+    }
+    
+    // Intersect the offset rays with the tangent plane
+    float d = dot(normal, point);
+    float tx = (d - dot(normal, ray.rxOrigin)) / dot(normal, ray.rxDirection);
+    float ty = (d - dot(normal, ray.ryOrigin)) / dot(normal, ray.ryDirection);
+    if (!std::isfinite(tx) || !std::isfinite(ty)) {
+        return;
+    }
+    vec3 dpdx = ray.rxOrigin + tx*ray.rxDirection - point;
+    vec3 dpdy = ray.ryOrigin + ty*ray.ryDirection - point;
+    
+    // Solve dp = dpdu*du + dpdv*dv on the two axes the most aligned with the plane
+    vec3 n = abs(normal);
+    int axis0, axis1;
+    if (n.x > n.y && n.x > n.z) {
+        axis0 = 1; axis1 = 2;
+    } else if (n.y > n.z) {
+        axis0 = 0; axis1 = 2;
+    } else {
+        axis0 = 0; axis1 = 1;
+    }
+    float det = dpdu[axis0]*dpdv[axis1] - dpdv[axis0]*dpdu[axis1];
+    if (fabsf(det) < 1e-12f) {
+        return;
+    }
+    float invDet = 1.f / det;
+    dudx = (dpdv[axis1]*dpdx[axis0] - dpdv[axis0]*dpdx[axis1]) * invDet;
+    dvdx = (dpdu[axis0]*dpdx[axis1] - dpdu[axis1]*dpdx[axis0]) * invDet;
+    dudy = (dpdv[axis1]*dpdy[axis0] - dpdv[axis0]*dpdy[axis1]) * invDet;
+    dvdy = (dpdu[axis0]*dpdy[axis1] - dpdu[axis1]*dpdy[axis0]) * invDet;
+}
@@ -19,6 +19,12 @@ public:
     
     void applyNormalMapping();
     
+    // Set dpdu and dpdv from the corners of a triangle
+    void computePositionDerivatives(const vec3& p0, const vec3& p1, const vec3& p2,
+                                    const vec2& uv0, const vec2& uv1, const vec2& uv2);
+    // Compute the uv footprint of a pixel from the ray differentials
+    void computeDifferentials(const Ray& ray);
+    
     float               t;
     float               rayEpsilon;
     vec3                point;
@@ -26,6 +32,8 @@ public:
     vec2                uv;
     vec3                tangentU;
     vec3                tangentV;
+    vec3                dpdu, dpdv;
+    float               dudx, dvdx, dudy, dvdy;
     Material*           material;
     const Primitive*    primitive;
 };
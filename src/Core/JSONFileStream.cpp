@@ -0,0 +1,65 @@
+//
+//  JSONFileStream.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#include "JSONFileStream.h"
+
+#include <algorithm>
+
+static const size_t JSONFileStreamBufferSize = 64*1024;
+
+JSONFileStream::JSONFileStream(const std::string& filename) :
+_file(), _buffer(JSONFileStreamBufferSize), _current(nullptr), _end(nullptr), _offset(0) {
+    std::string path = filename;
+    if (!path.empty() && path[0] != '/') {
+        path = Core::baseDirectory + path;
+    }
+    _file.setFileName(path.c_str());
+    if (_file.open(QIODevice::ReadOnly)) {
+        _current = _buffer.data();
+        _end = _current;
+        _fill();
+    }
+}
+
+JSONFileStream::~JSONFileStream() {
+    
+}
+
+bool JSONFileStream::isOpen() const {
+    return _file.isOpen();
+}
+
+JSONFileStream::Ch JSONFileStream::Take() {
+    if (_current == _end) {
+        return '\0';
+    }
+    Ch c = *_current++;
+    if (_current == _end) {
+        _fill();
+    }
+    return c;
+}
+
+void JSONFileStream::_fill() {
+    _offset += _end - _buffer.data();
+    qint64 size = _file.read(_buffer.data(), _buffer.size());
+    _current = _buffer.data();
+    _end = _current + std::max(size, (qint64)0);
+}
+
+std::string JSONFileStream::readAt(size_t offset, size_t length) {
+    if (!_file.isOpen() || !_file.seek(offset)) {
+        return std::string();
+    }
+    // Reading moves the file position, the stream can't be read after this
+    std::string text(length, '\0');
+    qint64 size = _file.read(&text[0], length);
+    text.resize(std::max(size, (qint64)0));
+    _current = _end;
+    return text;
+}
@@ -0,0 +1,58 @@
+//
+//  JSONFileStream.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#ifndef __CSE168_Rendering__JSONFileStream__
+#define __CSE168_Rendering__JSONFileStream__
+
+#include <vector>
+
+#include <QFile>
+
+#include "Core/Core.h"
+
+/*
+ * Buffered read stream over a file, following the rapidjson stream concept.
+ * JSON files are parsed while they are read, so the parser doesn't need the
+ * whole file contents in memory.
+ */
+class JSONFileStream {
+public:
+    
+    typedef char Ch;
+    
+    // Relative filenames are resolved from the base directory
+    JSONFileStream(const std::string& filename);
+    ~JSONFileStream();
+    
+    bool isOpen() const;
+    
+    // Text of the file at an offset, used to show where parsing failed
+    std::string readAt(size_t offset, size_t length);
+    
+    // rapidjson input stream interface
+    Ch      Peek() const { return _current < _end ? *_current : '\0'; }
+    Ch      Take();
+    size_t  Tell() const { return _offset + (_current - _buffer.data()); }
+    
+    // Write functions are only used by in situ parsing, which isn't supported
+    Ch*     PutBegin() { return nullptr; }
+    void    Put(Ch) {}
+    void    Flush() {}
+    size_t  PutEnd(Ch*) { return 0; }
+    
+private:
+    void _fill();
+    
+    QFile               _file;
+    std::vector<Ch>     _buffer;
+    const Ch*           _current;
+    const Ch*           _end;
+    size_t              _offset;
+};
+
+#endif /* defined(__CSE168_Rendering__JSONFileStream__) */
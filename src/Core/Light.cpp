@@ -32,6 +32,18 @@ void Light::setSamplingConfig(const SamplingConfig& sc) {
     _samplingConfig = sc;
 }
 
+float Light::pdfL(const vec3&, const vec3&) const {
+    return 0.f;
+}
+
+bool Light::getBounds(LightBounds*) const {
+    return false;
+}
+
+void Light::preprocess(const Scene&) {
+    
+}
+
 Spectrum Light::samplePhoton(vec3*, vec3*) const {
     return Spectrum(0.f);
 }
\ No newline at end of file
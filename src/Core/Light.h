@@ -15,6 +15,7 @@
 #include "Ray.h"
 #include "VisibilityTester.h"
 #include "LightSample.h"
+#include "LightBounds.h"
 
 class Light {
 public:
@@ -27,6 +28,17 @@ public:
                              const LightSample& lightSample,
                              vec3* wi, VisibilityTester* vt) const = 0;
     
+    // Solid angle density of sampleL choosing wi from point, 0 for delta lights
+    virtual float pdfL(const vec3& point, const vec3& wi) const;
+    
+    // Total emitted power, used to choose which lights to sample
+    virtual Spectrum power(const Scene& scene) const = 0;
+    // Emission bounds of finite lights, returns false for lights at infinity
+    virtual bool getBounds(LightBounds* bounds) const;
+    
+    // Called before rendering, to build sampling data
+    virtual void preprocess(const Scene& scene);
+    
     virtual Spectrum samplePhoton(vec3* p, vec3* direction) const;
     
     void    setName(const std::string& name);
@@ -0,0 +1,134 @@
+//
+//  LightBounds.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/8/14.
+//
+//
+
+#include "LightBounds.h"
+
+static float SafeSqrt(float v) {
+    return sqrt(glm::max(0.f, v));
+}
+
+static float SafeAcos(float v) {
+    return acos(glm::clamp(v, -1.f, 1.f));
+}
+
+// Cosine and sine of max(0, a-b)
+static float CosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB) {
+        return 1.f;
+    }
+    return cosA*cosB + sinA*sinB;
+}
+
+static float SinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB) {
+        return 0.f;
+    }
+    return sinA*cosB - cosA*sinB;
+}
+
+LightBounds LightBounds::Union(const LightBounds& a, const LightBounds& b) {
+    if (a.isEmpty()) {
+        return b;
+    }
+    if (b.isEmpty()) {
+        return a;
+    }
+    
+    LightBounds u;
+    u.bounds = AABB::Union(a.bounds, b.bounds);
+    u.power = a.power + b.power;
+    u.cosThetaE = glm::min(a.cosThetaE, b.cosThetaE);
+    u.twoSided = a.twoSided || b.twoSided;
+    
+    // Find the smallest cone containing both cones
+    float thetaA = SafeAcos(a.cosThetaO), thetaB = SafeAcos(b.cosThetaO);
+    float thetaD = SafeAcos(dot(a.axis, b.axis));
+    if (glm::min(thetaD + thetaB, (float)M_PI) <= thetaA) {
+        u.axis = a.axis;
+        u.cosThetaO = a.cosThetaO;
+    } else if (glm::min(thetaD + thetaA, (float)M_PI) <= thetaB) {
+        u.axis = b.axis;
+        u.cosThetaO = b.cosThetaO;
+    } else {
+        float thetaO = (thetaA + thetaD + thetaB) / 2.f;
+        vec3 rotationAxis = cross(a.axis, b.axis);
+        if (thetaO >= M_PI || dot(rotationAxis, rotationAxis) == 0.f) {
+            u.axis = a.axis;
+            u.cosThetaO = -1.f;
+        } else {
+            // Rotate a's axis toward b's one
+            u.axis = angleAxis(thetaO - thetaA, normalize(rotationAxis)) * a.axis;
+            u.cosThetaO = cos(thetaO);
+        }
+    }
+    return u;
+}
+
+LightBounds::LightBounds()
+: bounds(), axis(0.f, 1.f, 0.f), cosThetaO(1.f), cosThetaE(1.f), power(0.f), twoSided(false) {
+    
+}
+
+LightBounds::LightBounds(const AABB& b, const vec3& a, float cosO, float cosE, bool ts)
+: bounds(b), axis(normalize(a)), cosThetaO(cosO), cosThetaE(cosE), power(0.f), twoSided(ts) {
+    
+}
+
+bool LightBounds::isEmpty() const {
+    return bounds.min.x > bounds.max.x;
+}
+
+vec3 LightBounds::getCentroid() const {
+    return (bounds.min + bounds.max) * 0.5f;
+}
+
+float LightBounds::importance(const vec3& point, const vec3& normal) const {
+    if (isEmpty()) {
+        return 0.f;
+    }
+    
+    // Clamp the distance to the bounds size to avoid huge values close to the lights
+    vec3 center = getCentroid();
+    vec3 diagonal = bounds.max - bounds.min;
+    float d2 = dot(point - center, point - center);
+    d2 = glm::max(d2, length(diagonal) / 2.f);
+    
+    // Angle between the cone axis and the direction to the point
+    vec3 wi = normalize(point - center);
+    float cosThetaW = dot(axis, wi);
+    if (twoSided) {
+        cosThetaW = glm::abs(cosThetaW);
+    }
+    float sinThetaW = SafeSqrt(1.f - cosThetaW*cosThetaW);
+    
+    // Angle subtended by the bounds seen from the point
+    float radius2 = dot(diagonal, diagonal) / 4.f;
+    float cosThetaB = -1.f;
+    if (dot(point - center, point - center) > radius2) {
+        cosThetaB = SafeSqrt(1.f - radius2 / dot(point - center, point - center));
+    }
+    float sinThetaB = SafeSqrt(1.f - cosThetaB*cosThetaB);
+    
+    // Minimal angle between the emission cone and the point
+    float sinThetaO = SafeSqrt(1.f - cosThetaO*cosThetaO);
+    float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+    float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= cosThetaE) {
+        return 0.f;
+    }
+    
+    float importance = power * cosThetaP / d2;
+    
+    // Account for the incident angle at the point
+    float cosThetaI = glm::abs(dot(wi, normal));
+    float sinThetaI = SafeSqrt(1.f - cosThetaI*cosThetaI);
+    importance *= CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    
+    return glm::max(importance, 0.f);
+}
@@ -0,0 +1,43 @@
+//
+//  LightBounds.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/8/14.
+//
+//
+
+#ifndef __CSE168_Rendering__LightBounds__
+#define __CSE168_Rendering__LightBounds__
+
+#include "Core.h"
+#include "AABB.h"
+
+/*
+ * Spatial and directional bounds of the light emitted by one or several lights:
+ * light leaves from inside the box, in directions within thetaO of the axis,
+ * and spreads up to thetaE around those directions
+ */
+class LightBounds {
+public:
+    
+    static LightBounds Union(const LightBounds& a, const LightBounds& b);
+    
+    LightBounds();
+    LightBounds(const AABB& bounds, const vec3& axis, float cosThetaO, float cosThetaE,
+                bool twoSided=false);
+    
+    bool    isEmpty() const;
+    vec3    getCentroid() const;
+    
+    // Estimate of the light received at a point with the given normal
+    float   importance(const vec3& point, const vec3& normal) const;
+    
+    AABB    bounds;
+    vec3    axis;
+    float   cosThetaO;
+    float   cosThetaE;
+    float   power;
+    bool    twoSided;
+};
+
+#endif /* defined(__CSE168_Rendering__LightBounds__) */
@@ -0,0 +1,43 @@
+//
+//  LightSampler.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/7/14.
+//
+//
+
+#include "LightSampler.h"
+
+#include "LightSamplers/PowerLightSampler.h"
+#include "LightSamplers/BVHLightSampler.h"
+
+std::shared_ptr<LightSampler> LightSampler::Load(const rapidjson::Value& value) {
+    std::shared_ptr<LightSampler> sampler;
+    
+    std::string type;
+    
+    if (value.IsString()) {
+        type = value.GetString();
+    } else if (value.IsObject() && value.HasMember("type")) {
+        type = value["type"].GetString();
+    } else {
+        std::cerr << "LightSampler error: no type given" << std::endl;
+        return sampler;
+    }
+    
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    
+    if (type == "power") {
+        sampler = std::make_shared<PowerLightSampler>();
+    } else if (type == "bvh") {
+        sampler = std::make_shared<BVHLightSampler>();
+    } else if (type != "all") {
+        std::cerr << "LightSampler error: unknown type \"" << type << "\"" << std::endl;
+    }
+    
+    return sampler;
+}
+
+LightSampler::~LightSampler() {
+    
+}
@@ -0,0 +1,35 @@
+//
+//  LightSampler.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/7/14.
+//
+//
+
+#ifndef __CSE168_Rendering__LightSampler__
+#define __CSE168_Rendering__LightSampler__
+
+#include "Core.h"
+
+class Light;
+
+/*
+ * Chooses a single light to sample for a shading point
+ */
+class LightSampler {
+public:
+    
+    static std::shared_ptr<LightSampler> Load(const rapidjson::Value& value);
+    
+    virtual ~LightSampler();
+    
+    virtual void preprocess(const Scene& scene) = 0;
+    
+    // Pick a light for a shading point, returns nullptr if no light can be sampled
+    virtual const Light* sample(const vec3& point, const vec3& normal, float u,
+                                float* pdf) const = 0;
+    // Probability of choosing the given light for a shading point
+    virtual float pdf(const vec3& point, const vec3& normal, const Light* light) const = 0;
+};
+
+#endif /* defined(__CSE168_Rendering__LightSampler__) */
@@ -67,10 +67,14 @@ bool ListAggregate::intersect(const Ray& ray, Intersection* intersection) const
 }
 
 bool ListAggregate::intersectP(const Ray& ray) const {
+    return findOccluder(ray) != nullptr;
+}
+
+const Primitive* ListAggregate::findOccluder(const Ray& ray) const {
     for (const std::shared_ptr<Primitive>& p : _primitives) {
         if (p->intersectP(ray)) {
-            return true;
+            return p.get();
         }
     }
-    return false;
+    return nullptr;
 }
\ No newline at end of file
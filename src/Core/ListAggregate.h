@@ -32,6 +32,7 @@ public:
     
     virtual bool intersect(const Ray& ray, Intersection* intersection) const;
     virtual bool intersectP(const Ray& ray) const;
+    virtual const Primitive* findOccluder(const Ray& ray) const;
     
 private:
     std::vector<std::shared_ptr<Primitive>> _primitives;
@@ -169,6 +169,11 @@ float Material::refracted(float cosi, const vec3 &wo, vec3 n,
     return fr;
 }
 
+float Material::pdfBSDF(const vec3&, const vec3& wi, const Intersection& intersection) const {
+    // Every material samples its diffuse lobe with cosineSampleHemisphere
+    return glm::max(0.f, dot(wi, intersection.normal)) / (float)M_PI;
+}
+
 vec3 Material::cosineSampleHemisphere() {
     // Sample hemisphere
     float s = (float)rand()/RAND_MAX;
@@ -21,7 +21,9 @@ public:
         BSDFReflection      = 1 << 0,
         BSDFTransmission    = 1 << 1,
         BSDFDiffuse         = 1 << 2,
-        BSDFAll             = BSDFReflection | BSDFTransmission | BSDFDiffuse
+        BSDFAll             = BSDFReflection | BSDFTransmission | BSDFDiffuse,
+        // Set on sampled reflections that are not a delta lobe
+        BSDFGlossy          = 1 << 3
     };
     
     static std::shared_ptr<Material> Load(const rapidjson::Value& value);
@@ -57,6 +59,10 @@ public:
     virtual Spectrum sampleBSDF(const vec3& wo, vec3* wi,
                                 const Intersection& intersection,
                                 BxDFType type, BxDFType* sampledType) const = 0;
+    // Density of the directions sampled by sampleBSDF over its non-delta lobes,
+    // each weighted by the probability of choosing it
+    virtual float pdfBSDF(const vec3& wo, const vec3& wi,
+                          const Intersection& intersection) const;
     virtual BxDFType getBSDFType() const { return (BxDFType)0; };
     
     // Utility functions for computing material bsdf's
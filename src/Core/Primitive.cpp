@@ -7,10 +7,11 @@
 //
 
 #include "Primitive.h"
+#include "Intersection.h"
 
 #include <sstream>
 
-int Primitive::nextPrimitiveId = 1;
+std::atomic<int> Primitive::nextPrimitiveId(1);
 
 Primitive::Primitive() : _primitiveId(nextPrimitiveId++), _name() {
 }
@@ -23,6 +24,27 @@ bool Primitive::canIntersect() const {
     return true;
 }
 
+bool Primitive::isOpaque() const {
+    return true;
+}
+
+void Primitive::intersectPacket(const RayPacket& packet, Intersection* intersections,
+                                bool* hits) const {
+    for (uint_t i = 0; i < packet.size(); ++i) {
+        if (intersect(packet[i], &intersections[i])) {
+            hits[i] = true;
+        }
+    }
+}
+
+void Primitive::intersectPacketP(const RayPacket& packet, bool* occluded) const {
+    for (uint_t i = 0; i < packet.size(); ++i) {
+        if (!occluded[i] && intersectP(packet[i])) {
+            occluded[i] = true;
+        }
+    }
+}
+
 void Primitive::refine(std::vector<std::shared_ptr<Primitive>> &) const {
     abort();
 }
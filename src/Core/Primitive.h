@@ -11,14 +11,17 @@
 
 #include "Core.h"
 #include "Lights/AreaLight.h"
+#include "RayPacket.h"
 
 #include <string>
 #include <vector>
+#include <atomic>
 
 class Primitive : public std::enable_shared_from_this<Primitive> {
 public:
     
-    static int nextPrimitiveId;
+    // Primitives can be created by several importing threads
+    static std::atomic<int> nextPrimitiveId;
 
     Primitive();
     virtual ~Primitive();
@@ -28,6 +31,15 @@ public:
     virtual bool canIntersect() const;
     virtual bool intersect(const Ray& ray, Intersection* intersection) const = 0;
     virtual bool intersectP(const Ray& ray) const = 0;
+    // Opaque primitives are cheaper to test for occlusion
+    virtual bool isOpaque() const;
+    
+    // Intersect a packet of rays, setting hits[i] for the rays that hit the primitive.
+    // The default implementation traces rays one by one.
+    virtual void intersectPacket(const RayPacket& packet, Intersection* intersections,
+                                 bool* hits) const;
+    // Set occluded[i] for the rays that are blocked, rays already occluded are skipped
+    virtual void intersectPacketP(const RayPacket& packet, bool* occluded) const;
     
     virtual void refine(std::vector<std::shared_ptr<Primitive>>& refined) const;
     void fullyRefine(std::vector<std::shared_ptr<Primitive>>& refined);
@@ -9,13 +9,16 @@
 #include "Ray.h"
 
 Ray::Ray() :
-origin(), direction(), tmin(Core::Epsilon), tmax(INFINITY), depth(0), time(0), type(Primary) {
+origin(), direction(), tmin(Core::Epsilon), tmax(INFINITY), depth(0), time(0), type(Primary),
+nonDeltaBounce(false), hasDifferentials(false), rxOrigin(), ryOrigin(), rxDirection(), ryDirection() {
     
 }
 
 Ray::Ray(const Ray& ray) :
 origin(ray.origin), direction(ray.direction),
-tmin(ray.tmin), tmax(ray.tmax), depth(ray.depth), time(ray.time), type(ray.type) {
+tmin(ray.tmin), tmax(ray.tmax), depth(ray.depth), time(ray.time), type(ray.type),
+nonDeltaBounce(ray.nonDeltaBounce), hasDifferentials(ray.hasDifferentials),
+rxOrigin(ray.rxOrigin), ryOrigin(ray.ryOrigin), rxDirection(ray.rxDirection), ryDirection(ray.ryDirection) {
     
 }
 
@@ -34,6 +34,14 @@ public:
     int             depth;
     float           time;
     Type            type;
+    // Set when the ray was sampled from a non-delta BSDF lobe, lights that can be
+    // sampled were then gathered at its origin
+    bool            nonDeltaBounce;
+    
+    // Rays offset by one pixel on the film, used to filter textures
+    bool    hasDifferentials;
+    vec3    rxOrigin, ryOrigin;
+    vec3    rxDirection, ryDirection;
 };
 
 #endif
@@ -0,0 +1,107 @@
+//
+//  RayPacket.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/9/14.
+//
+//
+
+#include "RayPacket.h"
+
+const uint_t RayPacket::MaxSize;
+
+RayPacket::RayPacket() : _size(0) {
+    
+}
+
+RayPacket::~RayPacket() {
+    
+}
+
+void RayPacket::clear() {
+    _size = 0;
+}
+
+void RayPacket::push(const Ray& ray) {
+    _rays[_size++] = ray;
+}
+
+uint_t RayPacket::size() const {
+    return _size;
+}
+
+bool RayPacket::isFull() const {
+    return _size == MaxSize;
+}
+
+const Ray& RayPacket::operator[](uint_t i) const {
+    return _rays[i];
+}
+
+bool RayPacket::getBounds(Bounds* bounds) const {
+    if (_size == 0) {
+        return false;
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        bounds->negativeDirection[axis] = _rays[0].direction[axis] < 0;
+    }
+    bounds->originMin = bounds->originMax = _rays[0].origin;
+    bounds->invDirectionMin = bounds->invDirectionMax = 1.0f / _rays[0].direction;
+    bounds->tmin = _rays[0].tmin;
+    bounds->tmax = _rays[0].tmax;
+    
+    for (uint_t i = 0; i < _size; ++i) {
+        const Ray& ray = _rays[i];
+        for (int axis = 0; axis < 3; ++axis) {
+            // Intervals of inverse directions must not contain 0 or infinity
+            if (ray.direction[axis] == 0
+                || (ray.direction[axis] < 0) != bounds->negativeDirection[axis]) {
+                return false;
+            }
+        }
+        vec3 invDirection = 1.0f / ray.direction;
+        bounds->originMin = glm::min(bounds->originMin, ray.origin);
+        bounds->originMax = glm::max(bounds->originMax, ray.origin);
+        bounds->invDirectionMin = glm::min(bounds->invDirectionMin, invDirection);
+        bounds->invDirectionMax = glm::max(bounds->invDirectionMax, invDirection);
+        bounds->tmin = glm::min(bounds->tmin, ray.tmin);
+        bounds->tmax = glm::max(bounds->tmax, ray.tmax);
+    }
+    return true;
+}
+
+void RayPacket::Bounds::updateMaxDistance(const RayPacket& packet) {
+    tmax = packet[0].tmax;
+    for (uint_t i = 1; i < packet.size(); ++i) {
+        tmax = glm::max(tmax, packet[i].tmax);
+    }
+}
+
+bool RayPacket::Bounds::intersectP(const AABB& box) const {
+    float hit0 = tmin;
+    float hit1 = tmax;
+    
+    for (int i = 0; i < 3; ++i) {
+        // Rays enter the slab on the near plane and leave it on the far plane
+        float nearPlane = negativeDirection[i] ? box.max[i] : box.min[i];
+        float farPlane = negativeDirection[i] ? box.min[i] : box.max[i];
+        
+        // Lower bound of the entry distances and upper bound of the exit distances,
+        // products of the (plane - origin) and inverse direction intervals
+        float nearMin = nearPlane - originMax[i], nearMax = nearPlane - originMin[i];
+        float farMin = farPlane - originMax[i], farMax = farPlane - originMin[i];
+        float tNear = glm::min(glm::min(nearMin * invDirectionMin[i], nearMin * invDirectionMax[i]),
+                               glm::min(nearMax * invDirectionMin[i], nearMax * invDirectionMax[i]));
+        float tFar = glm::max(glm::max(farMin * invDirectionMin[i], farMin * invDirectionMax[i]),
+                              glm::max(farMax * invDirectionMin[i], farMax * invDirectionMax[i]));
+        
+        hit0 = tNear > hit0 ? tNear : hit0;
+        hit1 = tFar < hit1 ? tFar : hit1;
+        
+        // No ray of the packet can hit the box
+        if (hit0 > hit1) {
+            return false;
+        }
+    }
+    return true;
+}
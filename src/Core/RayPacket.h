@@ -0,0 +1,58 @@
+//
+//  RayPacket.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/9/14.
+//
+//
+
+#ifndef __CSE168_Rendering__RayPacket__
+#define __CSE168_Rendering__RayPacket__
+
+#include "Core.h"
+#include "Ray.h"
+#include "AABB.h"
+
+/*
+ * Small group of coherent rays (sub-samples of a pixel, shadow rays toward a light)
+ * traversing acceleration structures together
+ */
+class RayPacket {
+public:
+    
+    static const uint_t MaxSize = 16;
+    
+    // Conservative bounds of the packet rays, used to cull nodes with interval arithmetic
+    struct Bounds {
+        bool intersectP(const AABB& box) const;
+        void updateMaxDistance(const RayPacket& packet);
+        
+        vec3    originMin;
+        vec3    originMax;
+        vec3    invDirectionMin;
+        vec3    invDirectionMax;
+        bool    negativeDirection[3];
+        float   tmin;
+        float   tmax;
+    };
+    
+    RayPacket();
+    ~RayPacket();
+    
+    void    clear();
+    void    push(const Ray& ray);
+    uint_t  size() const;
+    bool    isFull() const;
+    
+    const Ray& operator[](uint_t i) const;
+    
+    // Returns false if the rays directions don't share the same signs, the packet
+    // must then be traced ray by ray
+    bool getBounds(Bounds* bounds) const;
+    
+private:
+    Ray     _rays[MaxSize];
+    uint_t  _size;
+};
+
+#endif /* defined(__CSE168_Rendering__RayPacket__) */
@@ -0,0 +1,124 @@
+//
+//  RayQueue.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/9/14.
+//
+//
+
+#include "RayQueue.h"
+
+#include <algorithm>
+
+// Spread the 10 lowest bits of v so that they are separated by two zeros
+static uint32_t LeftShift3(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+RayQueue::RayQueue() :
+origins(), directions(), tmin(), tmax(), times(), depths(), types() {
+    
+}
+
+RayQueue::~RayQueue() {
+    
+}
+
+void RayQueue::clear() {
+    origins.clear();
+    directions.clear();
+    tmin.clear();
+    tmax.clear();
+    times.clear();
+    depths.clear();
+    types.clear();
+}
+
+void RayQueue::reserve(uint_t capacity) {
+    origins.reserve(capacity);
+    directions.reserve(capacity);
+    tmin.reserve(capacity);
+    tmax.reserve(capacity);
+    times.reserve(capacity);
+    depths.reserve(capacity);
+    types.reserve(capacity);
+}
+
+uint_t RayQueue::size() const {
+    return origins.size();
+}
+
+uint_t RayQueue::push(const Ray& ray) {
+    origins.push_back(ray.origin);
+    directions.push_back(ray.direction);
+    tmin.push_back(ray.tmin);
+    tmax.push_back(ray.tmax);
+    times.push_back(ray.time);
+    depths.push_back(ray.depth);
+    types.push_back(ray.type);
+    return origins.size() - 1;
+}
+
+Ray RayQueue::getRay(uint_t i) const {
+    Ray ray;
+    ray.origin = origins[i];
+    ray.direction = directions[i];
+    ray.tmin = tmin[i];
+    ray.tmax = tmax[i];
+    ray.time = times[i];
+    ray.depth = depths[i];
+    ray.type = types[i];
+    return ray;
+}
+
+void RayQueue::setRay(uint_t i, const Ray& ray) {
+    origins[i] = ray.origin;
+    directions[i] = ray.direction;
+    tmin[i] = ray.tmin;
+    tmax[i] = ray.tmax;
+    times[i] = ray.time;
+    depths[i] = ray.depth;
+    types[i] = ray.type;
+}
+
+void RayQueue::gather(const std::vector<uint_t>& indices) {
+    Gather(origins, indices);
+    Gather(directions, indices);
+    Gather(tmin, indices);
+    Gather(tmax, indices);
+    Gather(times, indices);
+    Gather(depths, indices);
+    Gather(types, indices);
+}
+
+void RayQueue::getSortOrder(const AABB& bounds, std::vector<uint_t>* order) const {
+    // Quantize origins on a 1024^3 grid over the bounds
+    const float gridSize = 1023.f;
+    vec3 extent = bounds.max - bounds.min;
+    vec3 scale;
+    for (int axis = 0; axis < 3; ++axis) {
+        scale[axis] = extent[axis] > 0 ? gridSize / extent[axis] : 0.f;
+    }
+    
+    std::vector<std::pair<uint64_t, uint_t>> keys(size());
+    for (uint_t i = 0; i < size(); ++i) {
+        vec3 cell = glm::clamp((origins[i] - bounds.min) * scale, vec3(0.f), vec3(gridSize));
+        uint64_t morton = ((LeftShift3((uint32_t)cell.z) << 2)
+                           | (LeftShift3((uint32_t)cell.y) << 1)
+                           | LeftShift3((uint32_t)cell.x));
+        uint64_t octant = ((directions[i].x < 0 ? 1 : 0)
+                           | (directions[i].y < 0 ? 2 : 0)
+                           | (directions[i].z < 0 ? 4 : 0));
+        keys[i] = std::make_pair((octant << 30) | morton, i);
+    }
+    std::sort(keys.begin(), keys.end());
+    
+    order->resize(keys.size());
+    for (uint_t i = 0; i < keys.size(); ++i) {
+        (*order)[i] = keys[i].second;
+    }
+}
@@ -0,0 +1,62 @@
+//
+//  RayQueue.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/9/14.
+//
+//
+
+#ifndef __CSE168_Rendering__RayQueue__
+#define __CSE168_Rendering__RayQueue__
+
+#include <vector>
+
+#include "Core.h"
+#include "Ray.h"
+#include "AABB.h"
+
+/*
+ * Queue of rays stored as a structure of arrays, each ray attribute
+ * being contiguous in memory for the stages that only need some of them
+ */
+class RayQueue {
+public:
+    
+    // Reorder or compact an array: the i-th element becomes array[indices[i]]
+    template <typename T>
+    static void Gather(std::vector<T>& array, const std::vector<uint_t>& indices) {
+        std::vector<T> gathered;
+        gathered.reserve(indices.size());
+        for (uint_t index : indices) {
+            gathered.push_back(array[index]);
+        }
+        array.swap(gathered);
+    }
+    
+    RayQueue();
+    ~RayQueue();
+    
+    void    clear();
+    void    reserve(uint_t capacity);
+    uint_t  size() const;
+    
+    uint_t  push(const Ray& ray);
+    Ray     getRay(uint_t i) const;
+    void    setRay(uint_t i, const Ray& ray);
+    
+    void    gather(const std::vector<uint_t>& indices);
+    
+    // Order of the rays sorted by direction octant, then by Morton code of their origin
+    // in the given bounds: consecutive rays tend to traverse the same acceleration nodes
+    void    getSortOrder(const AABB& bounds, std::vector<uint_t>* order) const;
+    
+    std::vector<vec3>       origins;
+    std::vector<vec3>       directions;
+    std::vector<float>      tmin;
+    std::vector<float>      tmax;
+    std::vector<float>      times;
+    std::vector<int>        depths;
+    std::vector<Ray::Type>  types;
+};
+
+#endif /* defined(__CSE168_Rendering__RayQueue__) */
@@ -9,13 +9,35 @@
 #include "Renderer.h"
 
 #include "Core/Intersection.h"
+#include "Renderers/WavefrontRenderer.h"
 
 #include <QThreadPool>
 #include <random>
 #include <algorithm>
 
 std::shared_ptr<Renderer> Renderer::Load(const rapidjson::Value& value) {
-    std::shared_ptr<Renderer> renderer = std::make_shared<Renderer>();
+    std::shared_ptr<Renderer> renderer;
+    
+    std::string type = "default";
+    if (value.HasMember("type")) {
+        type = value["type"].GetString();
+        std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    }
+    
+    // The wavefront renderer does its own path tracing, it doesn't need a surface integrator
+    bool needsSurfaceIntegrator = true;
+    if (type == "default") {
+        renderer = std::make_shared<Renderer>();
+    } else if (type == "wavefront") {
+        renderer = WavefrontRenderer::Load(value);
+        needsSurfaceIntegrator = false;
+    } else {
+        std::cerr << "Renderer error: unknown type \"" << type << "\"" << std::endl;
+        return std::shared_ptr<Renderer>();
+    }
+    if (!renderer) {
+        return std::shared_ptr<Renderer>();
+    }
     
     if (value.HasMember("maxThreadsCount")) {
         renderer->setMaxThreadsCount(value["maxThreadsCount"].GetInt());
@@ -26,7 +48,7 @@ std::shared_ptr<Renderer> Renderer::Load(const rapidjson::Value& value) {
 
     if (value.HasMember("surfaceIntegrator")) {
         renderer->setSurfaceIntegrator(SurfaceIntegrator::Load(value["surfaceIntegrator"]));
-    } else {
+    } else if (needsSurfaceIntegrator) {
         std::cerr << "Renderer error: no surface integrator given" << std::endl;
         return std::shared_ptr<Renderer>();
     }
@@ -63,9 +85,7 @@ void Renderer::Task::run() {
     }
     
     // Render samples
-    for (int i = 0; i < samplesCount; ++i) {
-        renderer->renderSample(*scene, camera, samples[i]);
-    }
+    renderer->renderSamples(*scene, camera, samples, samplesCount);
     
     // Delete samples
     delete[] samples;
@@ -107,8 +127,15 @@ void Renderer::reset() {
 }
 
 void Renderer::preprocess(const Scene& scene, Camera* camera) {
+    // Let lights build their sampling data
+    for (Light* light : scene.getLights()) {
+        light->preprocess(scene);
+    }
+    
     // Let integrators preprocess scene
-    _surfaceIntegrator->preprocess(scene, camera, *this);
+    if (_surfaceIntegrator) {
+        _surfaceIntegrator->preprocess(scene, camera, *this);
+    }
     _volumeIntegrator->preprocess(scene, camera, *this);
 }
 
@@ -116,10 +143,8 @@ void Renderer::render(const Scene& scene, Camera* camera) {
     _samplesCount += 1;
     
     // Determine number of tasks
-     // Compute ideal task count
     int pixelsCount = camera->getFilm()->resolution.x * camera->getFilm()->resolution.y;
-    int tasksCount = glm::max(32 * Task::NumSystemCores(), pixelsCount / (16 * 16));
-    tasksCount = Core::roundUpPow2(tasksCount);
+    int tasksCount = Core::roundUpPow2(_getTasksCount(pixelsCount));
     
     // Create tasks
     Renderer::Task** tasks = new Renderer::Task*[tasksCount];
@@ -159,6 +184,11 @@ void Renderer::render(const Scene& scene, Camera* camera) {
     delete[] tasks;
 }
 
+int Renderer::_getTasksCount(int pixelsCount) const {
+    // Small tiles balance the load between threads
+    return glm::max(32 * Task::NumSystemCores(), pixelsCount / (16 * 16));
+}
+
 CameraSample* Renderer::getSamples(Renderer::Task *task, int* samplesCount) const {
     const vec2& resolution = task->camera->getFilm()->resolution;
     
@@ -220,84 +250,133 @@ CameraSample* Renderer::getSamples(Renderer::Task *task, int* samplesCount) cons
     return samples;
 }
 
+void Renderer::renderSamples(const Scene& scene, Camera* camera,
+                             const CameraSample* samples, int samplesCount) const {
+    for (int i = 0; i < samplesCount; ++i) {
+        renderSample(scene, camera, samples[i]);
+    }
+}
+
 void Renderer::renderSample(const Scene& scene, Camera* camera, const CameraSample& sample) const {
     Spectrum ls;
     
+    // Primary rays of a pixel are coherent, trace them by packets
+    RayPacket packet;
+    float rayWeights[RayPacket::MaxSize];
+    
     // Create sub-samples for anti-aliasing
     int samplesCount = _antialiasingSampling.count;
     for (int subSampleX = 0; subSampleX < samplesCount; ++subSampleX) {
         for (int subSampleY = 0; subSampleY < samplesCount; ++subSampleY) {
-            // Create sub sample based on sampling method
-            CameraSample subSample = sample;
-            
-            vec2 subSampleDelta = vec2((float)subSampleX/samplesCount,
-                                       (float)subSampleY/samplesCount);
-            
-            vec2 subSampleSize = vec2(1.0f) / (float)samplesCount;
-            
-            if (_antialiasingSampling.jittered) {
-                subSampleDelta += (vec2((float)rand()/RAND_MAX, (float)rand()/RAND_MAX)
-                                   * subSampleSize);
-            } else {
-                subSampleDelta += (vec2(0.5f, 0.5f) * subSampleSize);
-            }
-
-            switch (_antialiasingSampling.distribution) {
-                case SamplingConfig::GaussDistribution: {
-                    float a = 0.4f * sqrt(-2*log(subSampleDelta.x));
-                    float b = 2.0f * M_PI * subSampleDelta.y;
-                    subSampleDelta.x = 0.5f + a * sin(b);
-                    subSampleDelta.y = 0.5f + a * cos(b);
-                    break;
-                }
-                case SamplingConfig::ShirleyDistribution: {
-                    if (subSampleDelta.x < 0.5f) {
-                        subSampleDelta.x = -0.5f + sqrt(2*subSampleDelta.x);
-                    } else {
-                        subSampleDelta.x = 1.5f - sqrt(2-2*subSampleDelta.x);
-                    }
-                    
-                    if (subSampleDelta.y < 0.5f) {
-                        subSampleDelta.y = -0.5f + sqrt(2*subSampleDelta.y);
-                    } else {
-                        subSampleDelta.y = 1.5f - sqrt(2-2*subSampleDelta.y);
-                    }
-                    break;
-                }
-                default: {
-                    break;
-                }
-            }
-            
-            subSample.position += subSampleDelta * sample.pixelSize;
+            CameraSample subSample = _getSubSample(sample, subSampleX, subSampleY);
             
             // Generate primary ray
             Ray ray;
             float rayWeight = camera->generateRay(subSample, &ray);
             
             // Scale ray weight by sample contribution
-            rayWeight *= 1.0f / ((float)(samplesCount*samplesCount));
+            rayWeights[packet.size()] = rayWeight / ((float)(samplesCount*samplesCount));
+            packet.push(ray);
             
-            // Compute amount of light arriving along the ray
-            ls += rayWeight * li(scene, ray);
+            if (packet.isFull()) {
+                ls += _packetLi(scene, packet, rayWeights);
+                packet.clear();
+            }
         }
     }
+    if (packet.size() > 0) {
+        ls += _packetLi(scene, packet, rayWeights);
+    }
     
     // Add sample contribution to camera film
     camera->getFilm()->addSample(sample, ls, 1.0f/(float)_samplesCount);
 }
 
+CameraSample Renderer::_getSubSample(const CameraSample& sample,
+                                     int subSampleX, int subSampleY) const {
+    // Create sub sample based on sampling method
+    int samplesCount = _antialiasingSampling.count;
+    CameraSample subSample = sample;
+    
+    vec2 subSampleDelta = vec2((float)subSampleX/samplesCount,
+                               (float)subSampleY/samplesCount);
+    
+    vec2 subSampleSize = vec2(1.0f) / (float)samplesCount;
+    
+    if (_antialiasingSampling.jittered) {
+        subSampleDelta += (vec2((float)rand()/RAND_MAX, (float)rand()/RAND_MAX)
+                           * subSampleSize);
+    } else {
+        subSampleDelta += (vec2(0.5f, 0.5f) * subSampleSize);
+    }
+    
+    switch (_antialiasingSampling.distribution) {
+        case SamplingConfig::GaussDistribution: {
+            float a = 0.4f * sqrt(-2*log(subSampleDelta.x));
+            float b = 2.0f * M_PI * subSampleDelta.y;
+            subSampleDelta.x = 0.5f + a * sin(b);
+            subSampleDelta.y = 0.5f + a * cos(b);
+            break;
+        }
+        case SamplingConfig::ShirleyDistribution: {
+            if (subSampleDelta.x < 0.5f) {
+                subSampleDelta.x = -0.5f + sqrt(2*subSampleDelta.x);
+            } else {
+                subSampleDelta.x = 1.5f - sqrt(2-2*subSampleDelta.x);
+            }
+            
+            if (subSampleDelta.y < 0.5f) {
+                subSampleDelta.y = -0.5f + sqrt(2*subSampleDelta.y);
+            } else {
+                subSampleDelta.y = 1.5f - sqrt(2-2*subSampleDelta.y);
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+    
+    subSample.position += subSampleDelta * sample.pixelSize;
+    return subSample;
+}
+
+Spectrum Renderer::_packetLi(const Scene& scene, const RayPacket& packet,
+                             const float* rayWeights) const {
+    Intersection intersections[RayPacket::MaxSize];
+    bool hits[RayPacket::MaxSize] = {false};
+    scene.intersectPacket(packet, intersections, hits);
+    
+    // Compute amount of light arriving along each ray
+    Spectrum l(0);
+    for (uint_t i = 0; i < packet.size(); ++i) {
+        l += rayWeights[i] * _li(scene, packet[i], hits[i], intersections[i]);
+    }
+    return l;
+}
+
 Spectrum Renderer::li(const Scene &scene, const Ray &ray) const {
     Intersection intersection;
-    Spectrum li(0);
     
     // Intersect ray with scene geometry
-    if (scene.intersect(ray, &intersection)) {
+    bool hit = scene.intersect(ray, &intersection);
+    return _li(scene, ray, hit, intersection);
+}
+
+Spectrum Renderer::_li(const Scene& scene, const Ray& ray, bool hit,
+                       Intersection& intersection) const {
+    Spectrum li(0);
+    
+    if (hit) {
         intersection.applyNormalMapping();
         li = _surfaceIntegrator->li(scene, *this, ray, intersection);
     } else {
-        // Handle ray that doesn't intersect any geometry
+        // Handle ray that doesn't intersect any geometry, lights that can be sampled
+        // were already gathered at the last bounce if it wasn't specular
         for (Light* light : scene.getLights()) {
+            if (ray.nonDeltaBounce && light->pdfL(ray.origin, ray.direction) > 0.f) {
+                continue;
+            }
             li += light->le(ray);
         }
     }
@@ -314,6 +393,10 @@ Spectrum Renderer::li(const Scene &scene, const Ray &ray) const {
     return t * li + lv;
 }
 
+Spectrum Renderer::volumeLi(const Scene& scene, const Ray& ray, Spectrum* transmittance) const {
+    return _volumeIntegrator->li(scene, *this, ray, transmittance);
+}
+
 Spectrum Renderer::transmittance(const Scene &scene, const Ray &ray) const {
     return _volumeIntegrator->transmittance(scene, *this, ray);
 }
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "Camera.h"
 #include "SurfaceIntegrator.h"
 #include "VolumeIntegrator.h"
+#include "RayPacket.h"
 
 class Renderer {
 public:
@@ -43,7 +44,7 @@ public:
     };
     
     Renderer();
-    ~Renderer();
+    virtual ~Renderer();
     
     void setMaxThreadsCount(int count);
     void setAntialiasingSampling(const SamplingConfig& config);
@@ -53,16 +54,27 @@ public:
     uint_t getIdealThreadCount() const;
     
     void            reset();
-    void            preprocess(const Scene& scene, Camera* camera);
+    virtual void    preprocess(const Scene& scene, Camera* camera);
     void            render(const Scene& scene, Camera* camera);
     CameraSample*   getSamples(Renderer::Task* task, int* samplesCount) const;
     
+    // Render all the samples of a task, one after the other by default
+    virtual void renderSamples(const Scene& scene, Camera* camera,
+                               const CameraSample* samples, int samplesCount) const;
     void renderSample(const Scene& scene, Camera* camera, const CameraSample& sample) const;
     
     Spectrum li(const Scene& scene, const Ray& ray) const;
+    Spectrum volumeLi(const Scene& scene, const Ray& ray, Spectrum* transmittance) const;
     Spectrum transmittance(const Scene& scene, const Ray& ray) const;
 
-private:
+protected:
+    virtual int     _getTasksCount(int pixelsCount) const;
+    CameraSample    _getSubSample(const CameraSample& sample, int subSampleX, int subSampleY) const;
+    Spectrum        _packetLi(const Scene& scene, const RayPacket& packet,
+                              const float* rayWeights) const;
+    Spectrum        _li(const Scene& scene, const Ray& ray, bool hit,
+                        Intersection& intersection) const;
+    
     int                                 _maxThreadsCount;
     SamplingConfig                      _antialiasingSampling;
     std::shared_ptr<SurfaceIntegrator>  _surfaceIntegrator;
@@ -8,6 +8,8 @@
 
 #include "Sampling.h"
 
+#include <algorithm>
+
 SamplingConfig SamplingConfig::Load(const rapidjson::Value& value) {
     SamplingConfig config;
     
@@ -34,4 +36,175 @@ SamplingConfig SamplingConfig::Load(const rapidjson::Value& value) {
 SamplingConfig::SamplingConfig(int sc, bool jit, SamplingDistribution dist) :
 count(sc), jittered(jit), distribution(dist) {
     
-}
\ No newline at end of file
+}
+
+AliasTable::AliasTable() : _bins() {
+    
+}
+
+void AliasTable::build(const std::vector<float>& weights) {
+    _bins.clear();
+    _bins.resize(weights.size());
+    
+    float sum = 0.f;
+    for (float w : weights) {
+        sum += w;
+    }
+    if (sum <= 0.f) {
+        _bins.clear();
+        return;
+    }
+    
+    // Split bins between under and over-full ones, scaled so that the mean is 1
+    std::vector<int> under, over;
+    std::vector<float> scaled(weights.size());
+    for (uint_t i = 0; i < weights.size(); ++i) {
+        _bins[i].pdf = weights[i] / sum;
+        _bins[i].alias = i;
+        scaled[i] = _bins[i].pdf * weights.size();
+        if (scaled[i] < 1.f) {
+            under.push_back(i);
+        } else {
+            over.push_back(i);
+        }
+    }
+    
+    // Fill each under-full bin with an over-full one
+    while (!under.empty() && !over.empty()) {
+        int u = under.back(), o = over.back();
+        under.pop_back();
+        _bins[u].probability = scaled[u];
+        _bins[u].alias = o;
+        scaled[o] -= 1.f - scaled[u];
+        if (scaled[o] < 1.f) {
+            over.pop_back();
+            under.push_back(o);
+        }
+    }
+    // Remaining bins are full, up to rounding errors
+    for (int i : under) {
+        _bins[i].probability = 1.f;
+    }
+    for (int i : over) {
+        _bins[i].probability = 1.f;
+    }
+}
+
+uint_t AliasTable::size() const {
+    return _bins.size();
+}
+
+int AliasTable::sample(float u, float* pdf) const {
+    if (_bins.empty()) {
+        *pdf = 0.f;
+        return -1;
+    }
+    // Use the integer part to pick the bin and the rest to pick the alias
+    float scaled = u * _bins.size();
+    int index = glm::min((int)scaled, (int)_bins.size()-1);
+    float remainder = scaled - index;
+    if (remainder >= _bins[index].probability) {
+        index = _bins[index].alias;
+    }
+    *pdf = _bins[index].pdf;
+    return index;
+}
+
+float AliasTable::pdf(int index) const {
+    return _bins[index].pdf;
+}
+
+Distribution1D::Distribution1D() : _values(), _cdf(), _integral(0.f) {
+    
+}
+
+void Distribution1D::build(const float* values, int count) {
+    _values.assign(values, values + count);
+    _cdf.resize(count + 1);
+    
+    // Integrate the step function
+    _cdf[0] = 0.f;
+    for (int i = 1; i <= count; ++i) {
+        _cdf[i] = _cdf[i-1] + _values[i-1] / count;
+    }
+    _integral = _cdf[count];
+    
+    // Normalize, falling back to a uniform distribution if empty
+    for (int i = 1; i <= count; ++i) {
+        _cdf[i] = (_integral == 0.f) ? (float)i / count : _cdf[i] / _integral;
+    }
+}
+
+int Distribution1D::size() const {
+    return _values.size();
+}
+
+float Distribution1D::getIntegral() const {
+    return _integral;
+}
+
+float Distribution1D::sampleContinuous(float u, float* pdf, int* offset) const {
+    // Find the segment where the cdf crosses u
+    int index = std::upper_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin() - 1;
+    index = glm::clamp(index, 0, (int)_values.size() - 1);
+    if (offset) {
+        *offset = index;
+    }
+    
+    float du = u - _cdf[index];
+    if (_cdf[index+1] - _cdf[index] > 0.f) {
+        du /= _cdf[index+1] - _cdf[index];
+    }
+    if (pdf) {
+        *pdf = (_integral > 0.f) ? _values[index] / _integral : 1.f;
+    }
+    return (index + du) / size();
+}
+
+float Distribution1D::pdf(float x) const {
+    int index = glm::clamp((int)(x * size()), 0, size() - 1);
+    return (_integral > 0.f) ? _values[index] / _integral : 1.f;
+}
+
+Distribution2D::Distribution2D() : _conditionals(), _marginal() {
+    
+}
+
+void Distribution2D::resize(int nu, int nv) {
+    _conditionals.clear();
+    _conditionals.resize(nv);
+    for (Distribution1D& d : _conditionals) {
+        std::vector<float> empty(nu, 0.f);
+        d.build(empty.data(), nu);
+    }
+}
+
+void Distribution2D::buildRow(int v, const float* values) {
+    _conditionals[v].build(values, _conditionals[v].size());
+}
+
+void Distribution2D::buildMarginal() {
+    std::vector<float> integrals;
+    for (const Distribution1D& d : _conditionals) {
+        integrals.push_back(d.getIntegral());
+    }
+    _marginal.build(integrals.data(), integrals.size());
+}
+
+bool Distribution2D::isEmpty() const {
+    return _conditionals.empty() || _marginal.getIntegral() == 0.f;
+}
+
+vec2 Distribution2D::sampleContinuous(float u0, float u1, float* pdf) const {
+    float pdfs[2];
+    int v;
+    float d1 = _marginal.sampleContinuous(u1, &pdfs[1], &v);
+    float d0 = _conditionals[v].sampleContinuous(u0, &pdfs[0]);
+    *pdf = pdfs[0] * pdfs[1];
+    return vec2(d0, d1);
+}
+
+float Distribution2D::pdf(const vec2& p) const {
+    int v = glm::clamp((int)(p.y * _marginal.size()), 0, _marginal.size() - 1);
+    return _conditionals[v].pdf(p.x) * _marginal.pdf(p.y);
+}
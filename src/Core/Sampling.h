@@ -9,6 +9,8 @@
 #ifndef __CSE168_Rendering__Sampling__
 #define __CSE168_Rendering__Sampling__
 
+#include <vector>
+
 #include "Core.h"
 
 struct SamplingConfig {
@@ -29,4 +31,72 @@ struct SamplingConfig {
     SamplingDistribution    distribution;
 };
 
+/*
+ * Walker/Vose alias table: samples an index proportionally to its weight in O(1)
+ */
+class AliasTable {
+public:
+    
+    AliasTable();
+    
+    void    build(const std::vector<float>& weights);
+    
+    uint_t  size() const;
+    int     sample(float u, float* pdf) const;
+    float   pdf(int index) const;
+    
+private:
+    struct Bin {
+        float   probability;
+        int     alias;
+        float   pdf;
+    };
+    
+    std::vector<Bin>    _bins;
+};
+
+/*
+ * Piecewise-constant 1D distribution over [0, 1]
+ */
+class Distribution1D {
+public:
+    
+    Distribution1D();
+    
+    void    build(const float* values, int count);
+    
+    int     size() const;
+    float   getIntegral() const;
+    float   sampleContinuous(float u, float* pdf, int* offset=nullptr) const;
+    float   pdf(float x) const;
+    
+private:
+    std::vector<float>  _values;
+    std::vector<float>  _cdf;
+    float               _integral;
+};
+
+/*
+ * Piecewise-constant 2D distribution over [0, 1]^2, sampled with the marginal
+ * density in v and the conditional density in u for each row
+ */
+class Distribution2D {
+public:
+    
+    Distribution2D();
+    
+    // Values are stored by rows of width nu, each row is built by buildRow
+    void    resize(int nu, int nv);
+    void    buildRow(int v, const float* values);
+    void    buildMarginal();
+    
+    bool    isEmpty() const;
+    vec2    sampleContinuous(float u0, float u1, float* pdf) const;
+    float   pdf(const vec2& p) const;
+    
+private:
+    std::vector<Distribution1D> _conditionals;
+    Distribution1D              _marginal;
+};
+
 #endif /* defined(__CSE168_Rendering__Sampling__) */
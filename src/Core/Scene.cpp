@@ -8,6 +8,10 @@
 
 #include "Scene.h"
 
+#include <atomic>
+
+#include <QThreadStorage>
+
 #include "Intersection.h"
 #include "Ray.h"
 
@@ -16,9 +20,38 @@
 #include "accelerators/BVHAccelerator.h"
 #include "Material.h"
 
+// Versions are unique across scenes, so cached primitives of a deleted scene are never used
+static std::atomic<uint64_t> NextSceneVersion(1);
+
+// Last primitive that blocked a shadow ray toward each light, per thread
+struct OccluderCache {
+    static const int Size = 64;
+    
+    OccluderCache() {
+        for (int i = 0; i < Size; ++i) {
+            entries[i].version = 0;
+        }
+    }
+    
+    struct Entry {
+        uint64_t            version;
+        const Light*        light;
+        const Primitive*    occluder;
+    };
+    
+    Entry entries[Size];
+};
+
+static QThreadStorage<OccluderCache> ThreadOccluderCache;
+
+static OccluderCache::Entry& GetOccluderCacheEntry(const Light* light) {
+    size_t index = ((size_t)light / sizeof(void*)) % OccluderCache::Size;
+    return ThreadOccluderCache.localData().entries[index];
+}
+
 Scene::Scene(Aggregate* aggregate) :
 _lights(), _aggregate(aggregate), _volume(nullptr), _materials(), _cameras(), _defaultCamera(),
-_animationEvaluators() {
+_animationEvaluators(), _version(NextSceneVersion++) {
     
 }
 
@@ -36,15 +69,91 @@ Scene::~Scene() {
 }
 
 bool Scene::intersect(const Ray& ray, Intersection* intersection) const {
-    return _aggregate->intersect(ray, intersection);
+    if (!_aggregate->intersect(ray, intersection)) {
+        return false;
+    }
+    intersection->computeDifferentials(ray);
+    return true;
 }
 
 bool Scene::intersectP(const Ray& ray) const {
     return _aggregate->intersectP(ray);
 }
 
+void Scene::intersectPacket(const RayPacket& packet, Intersection* intersections,
+                            bool* hits) const {
+    _aggregate->intersectPacket(packet, intersections, hits);
+    for (uint_t i = 0; i < packet.size(); ++i) {
+        if (hits[i]) {
+            intersections[i].computeDifferentials(packet[i]);
+        }
+    }
+}
+
+void Scene::intersectPacketP(const RayPacket& packet, bool* occluded) const {
+    _aggregate->intersectPacketP(packet, occluded);
+}
+
+bool Scene::intersectP(const Ray& ray, const Light* light) const {
+    const Primitive* occluder = _getCachedOccluder(light);
+    if (occluder && occluder->intersectP(ray)) {
+        return true;
+    }
+    occluder = _aggregate->findOccluder(ray);
+    if (occluder) {
+        _setCachedOccluder(light, occluder);
+        return true;
+    }
+    return false;
+}
+
+void Scene::intersectPacketP(const RayPacket& packet, bool* occluded, const Light* light) const {
+    const Primitive* occluder = _getCachedOccluder(light);
+    uint_t occludedCount = 0;
+    if (occluder) {
+        occluder->intersectPacketP(packet, occluded);
+        for (uint_t i = 0; i < packet.size(); ++i) {
+            occludedCount += occluded[i] ? 1 : 0;
+        }
+        if (occludedCount == packet.size()) {
+            return;
+        }
+    }
+    bool occluderHit = occludedCount > 0;
+    _aggregate->intersectPacketP(packet, occluded);
+    
+    // Find the occluder of one of the blocked rays for the next packets
+    if (!occluderHit) {
+        for (uint_t i = 0; i < packet.size(); ++i) {
+            if (occluded[i]) {
+                _setCachedOccluder(light, _aggregate->findOccluder(packet[i]));
+                break;
+            }
+        }
+    }
+}
+
+const Primitive* Scene::_getCachedOccluder(const Light* light) const {
+    const OccluderCache::Entry& entry = GetOccluderCacheEntry(light);
+    if (entry.version != _version || entry.light != light) {
+        return nullptr;
+    }
+    return entry.occluder;
+}
+
+void Scene::_setCachedOccluder(const Light* light, const Primitive* occluder) const {
+    if (!occluder) {
+        return;
+    }
+    OccluderCache::Entry& entry = GetOccluderCacheEntry(light);
+    entry.version = _version;
+    entry.light = light;
+    entry.occluder = occluder;
+}
+
 void Scene::preprocess() {
     _aggregate->preprocess();
+    _version = NextSceneVersion++;
 }
 
 void Scene::addLight(Light* light) {
@@ -82,6 +191,10 @@ Scene& Scene::operator<<(Volume* volume) {
     return *this;
 }
 
+uint64_t Scene::getVersion() const {
+    return _version;
+}
+
 const Aggregate* Scene::getAggregate() const {
     return _aggregate;
 }
@@ -110,6 +223,10 @@ std::shared_ptr<Material> Scene::getMaterial(const std::string& name) const {
     return std::shared_ptr<Material>();
 }
 
+const std::map<std::string, std::shared_ptr<Material>>& Scene::getMaterials() const {
+    return _materials;
+}
+
 void Scene::addCamera(const std::shared_ptr<Camera>& camera) {
     _cameras[camera->getName()] = camera;
 }
@@ -145,6 +262,7 @@ void Scene::evaluateAnimation(float tstart, float tend) {
     }
     // Re-build scene aggregate
     _aggregate->rebuild();
+    _version = NextSceneVersion++;
 }
 
 std::shared_ptr<Scene> Scene::Load(const rapidjson::Value& value) {
@@ -27,6 +27,13 @@ public:
     
     bool intersect(const Ray& ray, Intersection* intersection) const;
     bool intersectP(const Ray& ray) const;
+    void intersectPacket(const RayPacket& packet, Intersection* intersections, bool* hits) const;
+    void intersectPacketP(const RayPacket& packet, bool* occluded) const;
+    
+    // Occlusion of shadow rays toward a light, the primitive that last blocked this light
+    // on the calling thread is tested before traversing the aggregate
+    bool intersectP(const Ray& ray, const Light* light) const;
+    void intersectPacketP(const RayPacket& packet, bool* occluded, const Light* light) const;
     
     void preprocess();
     
@@ -39,12 +46,15 @@ public:
     Scene& operator<<(const std::shared_ptr<Primitive>& primitive);
     Scene& operator<<(Volume* volume);
     
+    // Changes each time the aggregate is rebuilt
+    uint64_t                        getVersion() const;
     const Aggregate*                getAggregate() const;
     const std::vector<Light*>&      getLights() const;
     Volume*                         getVolume() const;
     
     void addMaterial(const std::shared_ptr<Material>& mtl);
     std::shared_ptr<Material> getMaterial(const std::string& name) const;
+    const std::map<std::string, std::shared_ptr<Material>>& getMaterials() const;
     
     void                    addCamera(const std::shared_ptr<Camera>& camera);
     std::shared_ptr<Camera> getCamera(const std::string& name="") const;
@@ -57,6 +67,9 @@ public:
     static std::shared_ptr<Scene> Load(const rapidjson::Value& value);
     
 private:
+    const Primitive*    _getCachedOccluder(const Light* light) const;
+    void                _setCachedOccluder(const Light* light, const Primitive* occluder) const;
+    
     std::vector<Light*>                                 _lights;
     Aggregate*                                          _aggregate;
     Volume*                                             _volume;
@@ -64,6 +77,7 @@ private:
     std::map<std::string, std::shared_ptr<Camera>>      _cameras;
     std::string                                         _defaultCamera;
     std::vector<std::shared_ptr<AnimationEvaluator>>    _animationEvaluators;
+    uint64_t                                            _version;
 };
 
 #endif /* defined(__CSE168_Rendering__Scene__) */
\ No newline at end of file
@@ -0,0 +1,278 @@
+//
+//  SceneCache.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#include "SceneCache.h"
+
+#include <algorithm>
+
+#include <QFileInfo>
+#include <QDateTime>
+
+static const char       SceneCacheFileMagic[4] = {'S', 'C', 'N', 'C'};
+static const uint32_t   SceneCacheFileVersion = 3;
+
+// Mesh arrays start on 16 bytes boundaries in the file
+static uint64_t AlignOffset(uint64_t offset) {
+    return (offset + 15) & ~(uint64_t)15;
+}
+
+size_t SceneCache::GetAttributesSize(const MeshEntry& entry) {
+    return entry.hasPackedAttributes ? sizeof(PackedVertexAttributes) : sizeof(VertexAttributes);
+}
+
+uint64_t SceneCache::GetFileKey(const std::string& filename) {
+    QFileInfo info(filename.c_str());
+    if (!info.exists()) {
+        return 0;
+    }
+    qint64 size = info.size();
+    qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    uint64_t key = Core::hash(filename.data(), filename.size());
+    key = Core::hash(&size, sizeof(size), key);
+    key = Core::hash(&modified, sizeof(modified), key);
+    return key;
+}
+
+uint64_t SceneCache::GetContentHash(const std::string& filename) {
+    QFile file(filename.c_str());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    // Catch files replaced with the same size and modification time
+    uint64_t hash = Core::HashSeed;
+    const uchar* data = file.size() > 0 ? file.map(0, file.size()) : nullptr;
+    if (data) {
+        hash = Core::hash(data, file.size(), hash);
+        file.unmap((uchar*)data);
+    }
+    return hash;
+}
+
+SceneCache::SceneCache() :
+_file(), _data(nullptr), _entries(nullptr), _meshesCount(0), _sceneData(), _hasSceneData(false),
+_addedMeshes(), _addedSceneData() {
+    
+}
+
+SceneCache::~SceneCache() {
+    _clear();
+}
+
+void SceneCache::_clear() {
+    if (_file.isOpen()) {
+        _file.close();
+    }
+    _data = nullptr;
+    _entries = nullptr;
+    _meshesCount = 0;
+    _sceneData = DataReader();
+    _hasSceneData = false;
+}
+
+bool SceneCache::load(const std::string& filename, uint64_t key, const std::string& sceneFilename) {
+    _clear();
+    
+    _file.setFileName(filename.c_str());
+    if (!_file.exists() || !_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    // Check the header before mapping the meshes
+    FileHeader header;
+    if (_file.read((char*)&header, sizeof(header)) != sizeof(header)
+        || !std::equal(SceneCacheFileMagic, SceneCacheFileMagic + 4, header.magic)
+        || header.version != SceneCacheFileVersion || header.key != key
+        || header.attributesSize != sizeof(VertexAttributes)
+        || header.packedAttributesSize != sizeof(PackedVertexAttributes)
+        || header.indexSize != sizeof(uint_t)
+        || header.layoutNodeSize != sizeof(BVHAccelerator::LinearNode)
+        || sizeof(header) + sizeof(MeshEntry) * header.meshesCount > (uint64_t)_file.size()
+        || header.sceneDataOffset > (uint64_t)_file.size()
+        || header.sceneDataSize > (uint64_t)_file.size() - header.sceneDataOffset
+        || header.contentHash != GetContentHash(sceneFilename)) {
+        _clear();
+        return false;
+    }
+    uint64_t entriesEnd = sizeof(header) + sizeof(MeshEntry) * header.meshesCount;
+    const uchar* data = _file.map(0, _file.size());
+    if (!data) {
+        std::cerr << "SceneCache error: cannot map file \"" << filename << "\"" << std::endl;
+        _clear();
+        return false;
+    }
+    // Check all the meshes arrays are inside the file
+    const MeshEntry* entries = (const MeshEntry*)(data + sizeof(header));
+    for (uint64_t i = 0; i < header.meshesCount; ++i) {
+        const MeshEntry& entry = entries[i];
+        uint64_t end = AlignOffset(entry.offset + sizeof(vec3) * entry.verticesCount);
+        end = AlignOffset(end + GetAttributesSize(entry) * entry.verticesCount);
+        end = AlignOffset(end + sizeof(uint_t) * entry.indicesCount);
+        if (entry.hasMaterialIndices) {
+            end = AlignOffset(end + sizeof(uint_t) * (entry.indicesCount/3));
+        }
+        if (entry.layoutNodesCount > 0) {
+            end = AlignOffset(end + sizeof(BVHAccelerator::LinearNode) * entry.layoutNodesCount);
+            end += sizeof(uint32_t) * (entry.indicesCount/3);
+        }
+        if (entry.offset < entriesEnd || end > (uint64_t)_file.size()) {
+            std::cerr << "SceneCache error: corrupted file \"" << filename << "\"" << std::endl;
+            _clear();
+            return false;
+        }
+    }
+    _data = data;
+    _entries = entries;
+    _meshesCount = header.meshesCount;
+    _sceneData = DataReader(data + header.sceneDataOffset, header.sceneDataSize);
+    _hasSceneData = (header.sceneDataSize > 0);
+    return true;
+}
+
+bool SceneCache::save(const std::string& filename, uint64_t key, const std::string& sceneFilename) const {
+    QFile file(filename.c_str());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "SceneCache error: cannot write file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+    FileHeader header;
+    std::copy(SceneCacheFileMagic, SceneCacheFileMagic + 4, header.magic);
+    header.version = SceneCacheFileVersion;
+    header.key = key;
+    header.contentHash = GetContentHash(sceneFilename);
+    header.attributesSize = sizeof(VertexAttributes);
+    header.packedAttributesSize = sizeof(PackedVertexAttributes);
+    header.indexSize = sizeof(uint_t);
+    header.layoutNodeSize = sizeof(BVHAccelerator::LinearNode);
+    header.meshesCount = _addedMeshes.size();
+    
+    // Lay out the meshes arrays after the entries table
+    std::vector<MeshEntry> entries(_addedMeshes.size());
+    uint64_t offset = AlignOffset(sizeof(header) + sizeof(MeshEntry) * entries.size());
+    for (size_t i = 0; i < _addedMeshes.size(); ++i) {
+        const AddedMesh& mesh = _addedMeshes[i];
+        MeshEntry& entry = entries[i];
+        entry.nameHash = mesh.nameHash;
+        entry.offset = offset;
+        entry.verticesCount = mesh.positions.size();
+        entry.indicesCount = mesh.indices.size();
+        entry.hasMaterialIndices = !mesh.materialIndices.empty();
+        entry.hasPackedAttributes = !mesh.packedAttributes.empty();
+        entry.layoutNodesCount = mesh.layoutNodes.size();
+        entry.padding = 0;
+        offset = AlignOffset(offset + sizeof(vec3) * mesh.positions.size());
+        offset = AlignOffset(offset + GetAttributesSize(entry) * mesh.positions.size());
+        offset = AlignOffset(offset + sizeof(uint_t) * mesh.indices.size());
+        offset = AlignOffset(offset + sizeof(uint_t) * mesh.materialIndices.size());
+        offset = AlignOffset(offset + sizeof(BVHAccelerator::LinearNode) * mesh.layoutNodes.size());
+        offset = AlignOffset(offset + sizeof(uint32_t) * mesh.layoutPrimitivesOrder.size());
+    }
+    header.sceneDataOffset = offset;
+    header.sceneDataSize = _addedSceneData.size();
+    
+    bool success = (file.write((const char*)&header, sizeof(header)) == sizeof(header));
+    qint64 entriesSize = sizeof(MeshEntry) * entries.size();
+    success = success && file.write((const char*)entries.data(), entriesSize) == entriesSize;
+    auto writeArray = [&] (const void* data, qint64 size) {
+        success = success && file.seek(AlignOffset(file.pos())) && file.write((const char*)data, size) == size;
+    };
+    for (const AddedMesh& mesh : _addedMeshes) {
+        writeArray(mesh.positions.data(), sizeof(vec3) * mesh.positions.size());
+        writeArray(mesh.attributes.data(), sizeof(VertexAttributes) * mesh.attributes.size());
+        writeArray(mesh.packedAttributes.data(),
+                   sizeof(PackedVertexAttributes) * mesh.packedAttributes.size());
+        writeArray(mesh.indices.data(), sizeof(uint_t) * mesh.indices.size());
+        writeArray(mesh.materialIndices.data(), sizeof(uint_t) * mesh.materialIndices.size());
+        writeArray(mesh.layoutNodes.data(), sizeof(BVHAccelerator::LinearNode) * mesh.layoutNodes.size());
+        writeArray(mesh.layoutPrimitivesOrder.data(),
+                   sizeof(uint32_t) * mesh.layoutPrimitivesOrder.size());
+    }
+    writeArray(_addedSceneData.data(), _addedSceneData.size());
+    if (!success) {
+        std::cerr << "SceneCache error: cannot write file \"" << filename << "\"" << std::endl;
+        file.close();
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+bool SceneCache::isLoaded() const {
+    return _data != nullptr;
+}
+
+bool SceneCache::getMesh(uint_t index, const std::string& name, MeshData* data) const {
+    if (index >= _meshesCount || _entries[index].nameHash != Core::hash(name.data(), name.size())) {
+        return false;
+    }
+    const MeshEntry& entry = _entries[index];
+    uint64_t offset = entry.offset;
+    VertexStreams& streams = data->streams;
+    streams.verticesCount = entry.verticesCount;
+    streams.positions = (const vec3*)(_data + offset);
+    offset = AlignOffset(offset + sizeof(vec3) * entry.verticesCount);
+    const void* attributes = _data + offset;
+    streams.attributes = entry.hasPackedAttributes ? nullptr : (const VertexAttributes*)attributes;
+    streams.packedAttributes = (entry.hasPackedAttributes ?
+                                (const PackedVertexAttributes*)attributes : nullptr);
+    offset = AlignOffset(offset + GetAttributesSize(entry) * entry.verticesCount);
+    data->indicesCount = entry.indicesCount;
+    data->indices = (const uint_t*)(_data + offset);
+    offset = AlignOffset(offset + sizeof(uint_t) * entry.indicesCount);
+    data->materialIndices = entry.hasMaterialIndices ? (const uint_t*)(_data + offset) : nullptr;
+    if (entry.hasMaterialIndices) {
+        offset = AlignOffset(offset + sizeof(uint_t) * (entry.indicesCount/3));
+    }
+    data->layoutNodesCount = entry.layoutNodesCount;
+    data->layoutNodes = nullptr;
+    data->layoutPrimitivesOrder = nullptr;
+    if (entry.layoutNodesCount > 0) {
+        data->layoutNodes = (const BVHAccelerator::LinearNode*)(_data + offset);
+        offset = AlignOffset(offset + sizeof(BVHAccelerator::LinearNode) * entry.layoutNodesCount);
+        data->layoutPrimitivesOrder = (const uint32_t*)(_data + offset);
+    }
+    return true;
+}
+
+uint_t SceneCache::addMesh(const std::string& name, const MeshData& data) {
+    AddedMesh mesh;
+    mesh.nameHash = Core::hash(name.data(), name.size());
+    const VertexStreams& streams = data.streams;
+    mesh.positions.assign(streams.positions, streams.positions + streams.verticesCount);
+    if (streams.packedAttributes) {
+        mesh.packedAttributes.assign(streams.packedAttributes,
+                                     streams.packedAttributes + streams.verticesCount);
+    } else {
+        mesh.attributes.assign(streams.attributes, streams.attributes + streams.verticesCount);
+    }
+    mesh.indices.assign(data.indices, data.indices + data.indicesCount);
+    if (data.materialIndices) {
+        mesh.materialIndices.assign(data.materialIndices, data.materialIndices + data.indicesCount/3);
+    }
+    _addedMeshes.push_back(mesh);
+    return _addedMeshes.size() - 1;
+}
+
+void SceneCache::setMeshLayout(uint_t index, const BVHAccelerator& bvh) {
+    AddedMesh& mesh = _addedMeshes[index];
+    if (!bvh.getLayout(&mesh.layoutNodes, &mesh.layoutPrimitivesOrder)
+        || mesh.layoutPrimitivesOrder.size() != mesh.indices.size()/3) {
+        mesh.layoutNodes.clear();
+        mesh.layoutPrimitivesOrder.clear();
+    }
+}
+
+bool SceneCache::getSceneData(DataReader* reader) const {
+    if (!_hasSceneData) {
+        return false;
+    }
+    *reader = _sceneData;
+    return true;
+}
+
+void SceneCache::setSceneData(const std::vector<char>& data) {
+    _addedSceneData = data;
+}
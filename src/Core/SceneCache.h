@@ -0,0 +1,167 @@
+//
+//  SceneCache.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#ifndef __CSE168_Rendering__SceneCache__
+#define __CSE168_Rendering__SceneCache__
+
+#include <vector>
+#include <cstring>
+
+#include <QFile>
+
+#include "Core/Core.h"
+#include "Shapes/Vertex.h"
+#include "Accelerators/BVHAccelerator.h"
+
+/*
+ * Binary cache of an imported scene file. It stores the meshes as they are
+ * after vertices expansion, tangents generation and quantization, the mesh
+ * BVHs and a description of the imported materials, lights, cameras and
+ * primitives written by the importer. The cache file is memory-mapped so
+ * cached meshes can use their vertex streams and indices in place. A cache
+ * holding the scene description replaces the import of the scene file, other
+ * caches only skip the per-mesh processing.
+ */
+class SceneCache {
+public:
+    
+    struct MeshData {
+        VertexStreams   streams;
+        uint_t          indicesCount;
+        const uint_t*   indices;
+        // Null when the mesh has a single material
+        const uint_t*   materialIndices;
+        // Tree of the mesh BVH, null when it isn't cached
+        uint32_t                            layoutNodesCount;
+        const BVHAccelerator::LinearNode*   layoutNodes;
+        const uint32_t*                     layoutPrimitivesOrder;
+    };
+    
+    // Scene description values serialized by the importer
+    class DataWriter {
+    public:
+        template<class T> void write(const T& value) {
+            const char* bytes = (const char*)&value;
+            data.insert(data.end(), bytes, bytes + sizeof(T));
+        }
+        void write(const std::string& value) {
+            write((uint32_t)value.size());
+            data.insert(data.end(), value.begin(), value.end());
+        }
+        
+        std::vector<char>   data;
+    };
+    
+    // Reads values back in the order they were written, fails past the end
+    class DataReader {
+    public:
+        DataReader(const uchar* data=nullptr, uint64_t size=0) : _data(data), _size(size), _offset(0) {}
+        
+        template<class T> bool read(T* value) {
+            if (sizeof(T) > _size - _offset) {
+                return false;
+            }
+            std::memcpy(value, _data + _offset, sizeof(T));
+            _offset += sizeof(T);
+            return true;
+        }
+        bool read(std::string* value) {
+            uint32_t size = 0;
+            if (!read(&size) || size > _size - _offset) {
+                return false;
+            }
+            value->assign((const char*)_data + _offset, size);
+            _offset += size;
+            return true;
+        }
+        
+    private:
+        const uchar*    _data;
+        uint64_t        _size;
+        uint64_t        _offset;
+    };
+    
+    // Key of a scene file, from its path, size and modification time
+    static uint64_t GetFileKey(const std::string& filename);
+    // Hash of the contents of a scene file
+    static uint64_t GetContentHash(const std::string& filename);
+    
+    SceneCache();
+    ~SceneCache();
+    
+    // The scene file contents are only hashed when the keys match
+    bool load(const std::string& filename, uint64_t key, const std::string& sceneFilename);
+    bool save(const std::string& filename, uint64_t key, const std::string& sceneFilename) const;
+    
+    bool isLoaded() const;
+    
+    // Data of the index-th loaded mesh, fails if it doesn't have the given name
+    bool getMesh(uint_t index, const std::string& name, MeshData* data) const;
+    
+    // Copy a mesh to be saved and return its index, meshes must be added in import order
+    uint_t addMesh(const std::string& name, const MeshData& data);
+    // Copy the built BVH of an added mesh
+    void setMeshLayout(uint_t index, const BVHAccelerator& bvh);
+    
+    // Scene description of the loaded cache, fails when it has none
+    bool getSceneData(DataReader* reader) const;
+    void setSceneData(const std::vector<char>& data);
+    
+private:
+    struct FileHeader {
+        char        magic[4];
+        uint32_t    version;
+        uint64_t    key;
+        uint64_t    contentHash;
+        uint32_t    attributesSize;
+        uint32_t    packedAttributesSize;
+        uint32_t    indexSize;
+        uint32_t    layoutNodeSize;
+        uint64_t    meshesCount;
+        // Scene description, its size is 0 when there is none
+        uint64_t    sceneDataOffset;
+        uint64_t    sceneDataSize;
+    };
+    
+    struct MeshEntry {
+        uint64_t    nameHash;
+        uint64_t    offset;
+        uint32_t    verticesCount;
+        uint32_t    indicesCount;
+        uint32_t    hasMaterialIndices;
+        uint32_t    hasPackedAttributes;
+        uint32_t    layoutNodesCount;
+        uint32_t    padding;
+    };
+    
+    struct AddedMesh {
+        uint64_t                                nameHash;
+        std::vector<vec3>                       positions;
+        std::vector<VertexAttributes>           attributes;
+        std::vector<PackedVertexAttributes>     packedAttributes;
+        std::vector<uint_t>                     indices;
+        std::vector<uint_t>                     materialIndices;
+        std::vector<BVHAccelerator::LinearNode> layoutNodes;
+        std::vector<uint32_t>                   layoutPrimitivesOrder;
+    };
+    
+    static size_t GetAttributesSize(const MeshEntry& entry);
+    
+    void _clear();
+    
+    QFile                   _file;
+    const uchar*            _data;
+    const MeshEntry*        _entries;
+    uint64_t                _meshesCount;
+    DataReader              _sceneData;
+    bool                    _hasSceneData;
+    std::vector<AddedMesh>  _addedMeshes;
+    std::vector<char>       _addedSceneData;
+};
+
+#endif /* defined(__CSE168_Rendering__SceneCache__) */
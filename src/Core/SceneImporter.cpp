@@ -13,6 +13,15 @@
 #include "Accelerators/BVHAccelerator.h"
 #include "Lights/AreaLight.h"
 #include "Lights/Skylight.h"
+#include "Lights/PointLight.h"
+#include "Lights/DirectionalLight.h"
+#include "Utilities/TextureRegistry.h"
+
+#include <sstream>
+#include <iomanip>
+
+#include <QDir>
+#include <QFileInfo>
 
 #include "SceneImporter.h"
 
@@ -47,6 +56,19 @@ std::shared_ptr<SceneImporter> SceneImporter::Load(const rapidjson::Value& value
     }
     importer->setFilename(filename);
     
+    if (value.HasMember("cacheDirectory")) {
+        importer->setCacheDirectory(value["cacheDirectory"].GetString());
+    }
+    if (value.HasMember("quantizeVertices")) {
+        importer->setQuantizeVertices(value["quantizeVertices"].GetBool());
+    }
+    if (value.HasMember("optimizeMeshes")) {
+        importer->setOptimizeMeshes(value["optimizeMeshes"].GetBool());
+    }
+    if (value.HasMember("cacheAccelerationStructures")) {
+        importer->setCacheAccelerationStructures(value["cacheAccelerationStructures"].GetBool());
+    }
+    
     // Load scene overrides
     if (value.HasMember("overrides")) {
         const rapidjson::Value& overridesValue = value["overrides"];
@@ -282,7 +304,11 @@ SceneImporter::LightOverride SceneImporter::LightOverride::Load(const rapidjson:
 }
 
 SceneImporter::SceneImporter() :
-_filename(), _meshAccelerationStructure(BVHAccelerationStructure),
+_filename(), _cacheDirectory(), _cache(), _cacheKey(0), _cachedMeshesCount(0),
+_cacheAccelerationStructures(true), _cachedSceneEnabled(false), _cachedMaterials(),
+_cachedMaterialsCount(0), _cachedNodes(), _cachedNodesCount(0), _cachedMaterialIndices(),
+_quantizeVertices(false), _optimizeMeshes(true), _vertexStatistics(),
+_meshAccelerationStructure(BVHAccelerationStructure),
 _materialsOverrides(), _primitivesOverrides(), _lightsOverrides() {
     
 }
@@ -295,10 +321,387 @@ void SceneImporter::setFilename(const std::string& filename) {
     _filename = filename;
 }
 
+void SceneImporter::setCacheDirectory(const std::string& directory) {
+    _cacheDirectory = directory;
+    if (!_cacheDirectory.empty() && _cacheDirectory[0] != '/') {
+        _cacheDirectory = Core::baseDirectory + _cacheDirectory;
+    }
+    if (!_cacheDirectory.empty() && _cacheDirectory[_cacheDirectory.size()-1] != '/') {
+        _cacheDirectory += '/';
+    }
+}
+
+void SceneImporter::setQuantizeVertices(bool quantize) {
+    _quantizeVertices = quantize;
+}
+
+void SceneImporter::setOptimizeMeshes(bool optimize) {
+    _optimizeMeshes = optimize;
+}
+
 void SceneImporter::setMeshAccelerationStructure(MeshAccelerationStructure s) {
     _meshAccelerationStructure = s;
 }
 
+void SceneImporter::setCacheAccelerationStructures(bool cache) {
+    _cacheAccelerationStructures = cache;
+}
+
+// Texture slots of the imported materials and their texel types, in cache order
+typedef std::shared_ptr<Texture> SceneImporter::ImportedMaterialAttributes::* TextureSlot;
+static const std::pair<TextureSlot, TextureRegistry::TexelType> CachedTextureSlots[] = {
+    {&SceneImporter::ImportedMaterialAttributes::diffuseTexture, TextureRegistry::ColorTexels},
+    {&SceneImporter::ImportedMaterialAttributes::diffuseIntensityTexture, TextureRegistry::FloatTexels},
+    {&SceneImporter::ImportedMaterialAttributes::specularTexture, TextureRegistry::ColorTexels},
+    {&SceneImporter::ImportedMaterialAttributes::specularIntensityTexture, TextureRegistry::FloatTexels},
+    {&SceneImporter::ImportedMaterialAttributes::normalMap, TextureRegistry::ColorTexels},
+    {&SceneImporter::ImportedMaterialAttributes::alphaTexture, TextureRegistry::FloatTexels}
+};
+static const uint_t CachedTextureSlotsCount = 6;
+
+enum CachedNodeType {
+    CachedLightNode = 0,
+    CachedCameraNode = 1,
+    CachedPrimitiveNode = 2
+};
+
+struct CachedPrimitive {
+    std::string             name;
+    Transform               transform;
+    SceneCache::MeshData    meshData;
+    std::vector<int>        materials;
+};
+
+void SceneImporter::_openCache() {
+    _cache.reset();
+    _cachedMeshesCount = 0;
+    _cachedSceneEnabled = true;
+    _cachedMaterials = SceneCache::DataWriter();
+    _cachedMaterialsCount = 0;
+    _cachedNodes = SceneCache::DataWriter();
+    _cachedNodesCount = 0;
+    _cachedMaterialIndices.clear();
+    if (_cacheDirectory.empty()) {
+        return;
+    }
+    QDir().mkpath(_cacheDirectory.c_str());
+    
+    // Cached meshes are stored as optimized and quantized by the import, meshes of
+    // area lights aren't optimized
+    _cacheKey = SceneCache::GetFileKey(_filename);
+    _cacheKey = Core::hash(&_quantizeVertices, sizeof(_quantizeVertices), _cacheKey);
+    _cacheKey = Core::hash(&_optimizeMeshes, sizeof(_optimizeMeshes), _cacheKey);
+    for (const PrimitiveOverride& override : _primitivesOverrides) {
+        if (override.light.isSet && override.light.value.type == PrimitiveLightOverride::Area) {
+            _cacheKey = Core::hash(override.namePattern.data(), override.namePattern.size(), _cacheKey);
+        }
+    }
+    _cache = std::make_shared<SceneCache>();
+    if (_cache->load(_getCacheFilename(), _cacheKey, _filename)) {
+        qDebug() << "Loaded scene cache" << _getCacheFilename().c_str();
+    }
+}
+
+void SceneImporter::_closeCache() {
+    if (_cache && !_cache->isLoaded()) {
+        if (_cachedSceneEnabled) {
+            SceneCache::DataWriter writer;
+            writer.write(_cachedMaterialsCount);
+            writer.data.insert(writer.data.end(), _cachedMaterials.data.begin(),
+                               _cachedMaterials.data.end());
+            writer.write(_cachedNodesCount);
+            writer.data.insert(writer.data.end(), _cachedNodes.data.begin(), _cachedNodes.data.end());
+            _cache->setSceneData(writer.data);
+        }
+        _cache->save(_getCacheFilename(), _cacheKey, _filename);
+    }
+    // Meshes read in place keep the loaded cache alive
+    _cache.reset();
+    _cachedMaterials = SceneCache::DataWriter();
+    _cachedNodes = SceneCache::DataWriter();
+    _cachedMaterialIndices.clear();
+}
+
+std::string SceneImporter::_getCacheFilename() const {
+    // Scene files with the same name in different directories have their own cache
+    std::ostringstream filename;
+    filename << _cacheDirectory << QFileInfo(_filename.c_str()).fileName().toStdString() << "-"
+    << std::hex << std::setw(16) << std::setfill('0') << Core::hash(_filename.data(), _filename.size())
+    << ".cache";
+    return filename.str();
+}
+
+bool SceneImporter::_getCachedMesh(const std::string& name, SceneCache::MeshData* data) {
+    if (!_cache || !_cache->isLoaded() || !_cache->getMesh(_cachedMeshesCount, name, data)) {
+        return false;
+    }
+    ++_cachedMeshesCount;
+    return true;
+}
+
+int SceneImporter::_addCachedMesh(const std::string& name, const MeshBase& mesh) {
+    if (!_cache || _cache->isLoaded()) {
+        return -1;
+    }
+    SceneCache::MeshData data;
+    data.streams = mesh.getVertexStreams();
+    data.indicesCount = mesh.getIndicesCount();
+    data.indices = mesh.getIndices();
+    data.materialIndices = mesh.getMaterialIndices();
+    return _cache->addMesh(name, data);
+}
+
+void SceneImporter::_buildMeshAccelerationStructure(const std::shared_ptr<Aggregate>& aggregate,
+                                                    const SceneCache::MeshData* cachedData,
+                                                    int cachedMeshIndex) {
+    BVHAccelerator* bvh = dynamic_cast<BVHAccelerator*>(aggregate.get());
+    if (bvh && _cacheAccelerationStructures && cachedData && cachedData->layoutNodesCount > 0
+        && bvh->setLayout(cachedData->layoutNodesCount, cachedData->layoutNodes,
+                          cachedData->indicesCount/3, cachedData->layoutPrimitivesOrder)) {
+        return;
+    }
+    
+    // Meshes are added before their structures are built in parallel, the cache isn't resized
+    bool saveLayout = (bvh && _cacheAccelerationStructures && cachedMeshIndex >= 0
+                       && _cache && !_cache->isLoaded());
+    if (saveLayout) {
+        bvh->setKeepLayout(true);
+    }
+    aggregate->preprocess();
+    if (saveLayout) {
+        _cache->setMeshLayout(cachedMeshIndex, *bvh);
+        bvh->setKeepLayout(false);
+    }
+}
+
+bool SceneImporter::_importCachedScene(Scene& scene) {
+    SceneCache::DataReader reader;
+    if (!_cache || !_cache->getSceneData(&reader)) {
+        return false;
+    }
+    
+    // Read the whole description before changing the scene
+    bool success = true;
+    uint32_t materialsCount = 0;
+    success = success && reader.read(&materialsCount);
+    std::vector<ImportedMaterialAttributes> materialsAttrs;
+    std::vector<std::string> texturePaths;
+    for (uint32_t i = 0; success && i < materialsCount; ++i) {
+        ImportedMaterialAttributes attrs = ImportedMaterialAttributes();
+        uint32_t shadingMode = 0;
+        success = (reader.read(&attrs.name) && reader.read(&shadingMode)
+                   && reader.read(&attrs.diffuseColor) && reader.read(&attrs.diffuseIntensity)
+                   && reader.read(&attrs.specularColor));
+        attrs.shadingMode = (ImportedMaterialAttributes::ShadingMode)shadingMode;
+        for (uint_t j = 0; success && j < CachedTextureSlotsCount; ++j) {
+            texturePaths.push_back(std::string());
+            success = reader.read(&texturePaths.back());
+        }
+        materialsAttrs.push_back(attrs);
+    }
+    
+    uint32_t nodesCount = 0;
+    success = success && reader.read(&nodesCount);
+    std::vector<uint32_t> nodeTypes;
+    std::vector<ImportedLightAttributes> lights;
+    std::vector<ImportedCameraAttributes> cameras;
+    std::vector<CachedPrimitive> primitives;
+    for (uint32_t i = 0; success && i < nodesCount; ++i) {
+        uint32_t type = 0;
+        mat4x4 matrix;
+        success = reader.read(&type);
+        nodeTypes.push_back(type);
+        if (success && type == CachedLightNode) {
+            ImportedLightAttributes attrs;
+            uint32_t lightType = 0, noDecay = 0;
+            success = (reader.read(&attrs.name) && reader.read(&lightType)
+                       && reader.read(&attrs.position) && reader.read(&attrs.direction)
+                       && reader.read(&attrs.color) && reader.read(&attrs.intensity)
+                       && reader.read(&noDecay));
+            attrs.type = (ImportedLightAttributes::Type)lightType;
+            attrs.noDecay = (noDecay != 0);
+            lights.push_back(attrs);
+        } else if (success && type == CachedCameraNode) {
+            ImportedCameraAttributes attrs;
+            success = (reader.read(&attrs.name) && reader.read(&matrix)
+                       && reader.read(&attrs.vfov) && reader.read(&attrs.aspect)
+                       && reader.read(&attrs.focusDistance));
+            attrs.transform = Transform(matrix);
+            cameras.push_back(attrs);
+        } else if (success && type == CachedPrimitiveNode) {
+            CachedPrimitive primitive;
+            uint32_t meshIndex = 0, primitiveMaterialsCount = 0;
+            success = (reader.read(&primitive.name) && reader.read(&matrix)
+                       && reader.read(&meshIndex) && reader.read(&primitiveMaterialsCount)
+                       && primitiveMaterialsCount > 0
+                       && _cache->getMesh(meshIndex, primitive.name, &primitive.meshData));
+            primitive.transform = Transform(matrix);
+            for (uint32_t j = 0; success && j < primitiveMaterialsCount; ++j) {
+                int32_t material = 0;
+                success = (reader.read(&material) && material >= -1 && material < (int)materialsCount);
+                primitive.materials.push_back(material);
+            }
+            primitives.push_back(primitive);
+        } else {
+            success = false;
+        }
+    }
+    if (!success) {
+        std::cerr << "SceneImporter error: invalid scene description in cache \""
+        << _getCacheFilename() << "\"" << std::endl;
+        return false;
+    }
+    
+    // Load the textures in parallel, then add the materials in import order
+    std::vector<TextureRegistry::Request> requests;
+    for (uint_t i = 0; i < texturePaths.size(); ++i) {
+        requests.push_back(std::make_pair(texturePaths[i],
+                                          CachedTextureSlots[i % CachedTextureSlotsCount].second));
+    }
+    std::vector<std::shared_ptr<Texture>> textures = TextureRegistry::Instance().prefetch(requests);
+    std::vector<std::shared_ptr<Material>> materials;
+    for (uint_t i = 0; i < materialsAttrs.size(); ++i) {
+        ImportedMaterialAttributes& attrs = materialsAttrs[i];
+        for (uint_t j = 0; j < CachedTextureSlotsCount; ++j) {
+            const TextureRegistry::Request& request = requests[i*CachedTextureSlotsCount + j];
+            if (request.first.empty()) {
+                continue;
+            }
+            attrs.*CachedTextureSlots[j].first = TextureRegistry::Instance().getTexture(request.first,
+                                                                                       request.second);
+            if (!(attrs.*CachedTextureSlots[j].first)) {
+                std::cerr << "SceneImporter error: couldn't load texture \"" << request.first << "\""
+                << std::endl;
+            }
+        }
+        materials.push_back(addImportedMaterial(attrs, scene));
+    }
+    
+    // Add the nodes in import order, overrides are applied as by the importer
+    std::vector<std::pair<std::shared_ptr<Aggregate>, const SceneCache::MeshData*>> aggregates;
+    uint_t lightIndex = 0, cameraIndex = 0, primitiveIndex = 0;
+    for (uint32_t type : nodeTypes) {
+        if (type == CachedLightNode) {
+            addImportedLight(lights[lightIndex++], scene);
+        } else if (type == CachedCameraNode) {
+            addImportedCamera(cameras[cameraIndex++], scene);
+        } else {
+            const CachedPrimitive& cached = primitives[primitiveIndex++];
+            const SceneCache::MeshData& data = cached.meshData;
+            
+            // Nodes without materials got a default one from the importer
+            std::vector<std::shared_ptr<Material>> meshMaterials;
+            std::vector<ImportedMaterialAttributes> meshMaterialsAttrs;
+            for (int material : cached.materials) {
+                if (material >= 0) {
+                    meshMaterials.push_back(materials[material]);
+                    meshMaterialsAttrs.push_back(materialsAttrs[material]);
+                } else {
+                    meshMaterials.push_back(std::make_shared<Matte>());
+                    meshMaterialsAttrs.push_back(ImportedMaterialAttributes());
+                }
+            }
+            
+            std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+            mesh->setSharedData(_cache, data.streams, data.indicesCount, data.indices,
+                                data.materialIndices);
+            _addVertexStatistics(*mesh);
+            if (data.materialIndices) {
+                mesh->setMaterials(meshMaterials);
+            }
+            if (meshMaterials.size() == 1 && meshMaterialsAttrs[0].alphaTexture) {
+                mesh->setAlphaTexture(meshMaterialsAttrs[0].alphaTexture);
+            }
+            
+            std::shared_ptr<GeometricPrimitive> primitive =
+            std::make_shared<GeometricPrimitive>(mesh, meshMaterials[0]);
+            std::shared_ptr<Aggregate> aggregate = createMeshAccelerationStructure();
+            std::shared_ptr<TransformedPrimitive> transformedPrimitive =
+            std::make_shared<TransformedPrimitive>(aggregate, cached.transform);
+            transformedPrimitive->setName(cached.name);
+            
+            bool addToScene = applyPrimitiveOverrides(scene, cached.name, transformedPrimitive, *primitive,
+                                                      &meshMaterialsAttrs[0], mesh.get());
+            *aggregate << primitive;
+            if (addToScene) {
+                aggregates.push_back(std::make_pair(aggregate, &data));
+                scene << transformedPrimitive;
+            }
+        }
+    }
+    
+    // Set the cached acceleration structures, or build them in parallel
+    Core::parallelFor(aggregates.size(), [&] (uint_t i) {
+        _buildMeshAccelerationStructure(aggregates[i].first, aggregates[i].second, -1);
+    });
+    
+    qDebug() << "Imported scene from cache" << _getCacheFilename().c_str();
+    return true;
+}
+
+void SceneImporter::_addCachedPrimitive(const std::string& name, const Transform& transform,
+                                        int cachedMeshIndex,
+                                        const std::vector<std::shared_ptr<Material>>& materials) {
+    if (!_cache || _cache->isLoaded() || !_cachedSceneEnabled) {
+        return;
+    }
+    if (cachedMeshIndex < 0 || materials.empty()) {
+        _disableCachedScene();
+        return;
+    }
+    _cachedNodes.write((uint32_t)CachedPrimitiveNode);
+    _cachedNodes.write(name);
+    _cachedNodes.write(transform.getMatrix());
+    _cachedNodes.write((uint32_t)cachedMeshIndex);
+    _cachedNodes.write((uint32_t)materials.size());
+    for (const std::shared_ptr<Material>& material : materials) {
+        // Materials not added by addImportedMaterial are importer defaults
+        auto it = _cachedMaterialIndices.find(material.get());
+        _cachedNodes.write((int32_t)(it != _cachedMaterialIndices.end() ? it->second : -1));
+    }
+    ++_cachedNodesCount;
+}
+
+void SceneImporter::_disableCachedScene() {
+    _cachedSceneEnabled = false;
+}
+
+bool SceneImporter::_shouldOptimizeMesh(const std::string& name) const {
+    if (!_optimizeMeshes) {
+        return false;
+    }
+    for (const PrimitiveOverride& override : _primitivesOverrides) {
+        if (override.light.isSet && override.light.value.type == PrimitiveLightOverride::Area
+            && MatchName(override.namePattern, name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SceneImporter::_addVertexStatistics(const MeshBase& mesh) {
+    _vertexStatistics.meshesCount += 1;
+    _vertexStatistics.quantizedMeshesCount += mesh.isQuantized() ? 1 : 0;
+    _vertexStatistics.verticesCount += mesh.getVerticesCount();
+    _vertexStatistics.positionsSize += mesh.getPositionsSize();
+    _vertexStatistics.attributesSize += mesh.getAttributesSize();
+}
+
+SceneImporter::VertexStatistics SceneImporter::getVertexStatistics() const {
+    return _vertexStatistics;
+}
+
+void SceneImporter::printVertexStatistics() const {
+    const VertexStatistics& statistics = _vertexStatistics;
+    uint64_t size = statistics.positionsSize + statistics.attributesSize;
+    float bytesPerVertex = statistics.verticesCount > 0 ? (float)size / statistics.verticesCount : 0.f;
+    std::cout << "Vertex streams: " << statistics.meshesCount << " meshes ("
+    << statistics.quantizedMeshesCount << " quantized), " << statistics.verticesCount << " vertices, "
+    << statistics.positionsSize / (1024*1024) << " MB of positions, "
+    << statistics.attributesSize / (1024*1024) << " MB of attributes ("
+    << bytesPerVertex << " bytes per vertex)" << std::endl;
+}
+
 void SceneImporter::addOverride(const SceneImporter::MaterialOverride& override) {
     _materialsOverrides.push_back(override);
 }
@@ -441,9 +844,87 @@ std::shared_ptr<Material> SceneImporter::addImportedMaterial(const SceneImporter
     }
     
     scene.addMaterial(material);
+    
+    // Describe the material with the files of its textures
+    if (_cache && !_cache->isLoaded() && _cachedSceneEnabled) {
+        _cachedMaterials.write(attrs.name);
+        _cachedMaterials.write((uint32_t)attrs.shadingMode);
+        _cachedMaterials.write(attrs.diffuseColor);
+        _cachedMaterials.write(attrs.diffuseIntensity);
+        _cachedMaterials.write(attrs.specularColor);
+        for (const auto& slot : CachedTextureSlots) {
+            const std::shared_ptr<Texture>& texture = attrs.*slot.first;
+            std::string path = TextureRegistry::Instance().getFilename(texture);
+            if (texture && path.empty()) {
+                _disableCachedScene();
+            }
+            _cachedMaterials.write(path);
+        }
+        _cachedMaterialIndices[material.get()] = _cachedMaterialsCount++;
+    }
     return material;
 }
 
+void SceneImporter::addImportedLight(const ImportedLightAttributes& attrs, Scene& scene) {
+    Light* light = nullptr;
+    if (attrs.type == ImportedLightAttributes::Point) {
+        PointLight* point = new PointLight();
+        point->setPosition(attrs.position);
+        point->setSpectrum(Spectrum(attrs.color));
+        point->setIntensity(attrs.intensity);
+        point->setNoDecay(attrs.noDecay);
+        light = point;
+    } else {
+        DirectionalLight* directional = new DirectionalLight();
+        directional->setDirection(attrs.direction);
+        directional->setSpectrum(Spectrum(attrs.color));
+        directional->setIntensity(attrs.intensity);
+        light = directional;
+    }
+    light->setName(attrs.name);
+    
+    // Apply light overrides
+    if (applyLightOverrides(scene, light)) {
+        scene << light;
+    }
+    
+    if (_cache && !_cache->isLoaded() && _cachedSceneEnabled) {
+        _cachedNodes.write((uint32_t)CachedLightNode);
+        _cachedNodes.write(attrs.name);
+        _cachedNodes.write((uint32_t)attrs.type);
+        _cachedNodes.write(attrs.position);
+        _cachedNodes.write(attrs.direction);
+        _cachedNodes.write(attrs.color);
+        _cachedNodes.write(attrs.intensity);
+        _cachedNodes.write((uint32_t)attrs.noDecay);
+        ++_cachedNodesCount;
+    }
+}
+
+std::shared_ptr<PerspectiveCamera> SceneImporter::addImportedCamera(const ImportedCameraAttributes& attrs,
+                                                                    Scene& scene) {
+    std::shared_ptr<PerspectiveCamera> camera = std::make_shared<PerspectiveCamera>();
+    camera->setName(attrs.name);
+    camera->setTransform(attrs.transform);
+    camera->setVFov(attrs.vfov);
+    camera->setAspect(attrs.aspect);
+    camera->setFocusDistance(attrs.focusDistance);
+    
+    // Add camera to the scene
+    scene << camera;
+    
+    if (_cache && !_cache->isLoaded() && _cachedSceneEnabled) {
+        _cachedNodes.write((uint32_t)CachedCameraNode);
+        _cachedNodes.write(attrs.name);
+        _cachedNodes.write(attrs.transform.getMatrix());
+        _cachedNodes.write(attrs.vfov);
+        _cachedNodes.write(attrs.aspect);
+        _cachedNodes.write(attrs.focusDistance);
+        ++_cachedNodesCount;
+    }
+    return camera;
+}
+
 bool SceneImporter::applyPrimitiveOverrides(Scene& scene, const std::string& name,
                                             const std::shared_ptr<TransformedPrimitive>& transformedPrimitive,
                                             GeometricPrimitive& p,
@@ -10,6 +10,7 @@
 #define __CSE168_Rendering__SceneImporter__
 
 #include <vector>
+#include <map>
 
 #include "Core.h"
 #include "Aggregate.h"
@@ -19,7 +20,9 @@
 #include "Shapes/Mesh.h"
 #include "Volumes/HomogeneousVolume.h"
 #include "Volumes/GridVolume.h"
+#include "Cameras/PerspectiveCamera.h"
 #include "Core/AnimationEvaluator.h"
+#include "Core/SceneCache.h"
 
 class SceneImporter {
 public:
@@ -119,17 +122,58 @@ public:
         std::shared_ptr<Texture>    alphaTexture;
     };
     
+    struct ImportedLightAttributes {
+        enum Type {
+            Point,
+            Directional
+        };
+        
+        ImportedLightAttributes()
+        : name(), type(Point), position(), direction(), color(1.f), intensity(1.f), noDecay(false) {}
+        
+        std::string name;
+        Type        type;
+        vec3        position;
+        vec3        direction;
+        vec3        color;
+        float       intensity;
+        bool        noDecay;
+    };
+    
+    struct ImportedCameraAttributes {
+        ImportedCameraAttributes()
+        : name(), transform(), vfov(40.f), aspect(1.33f), focusDistance(1.f) {}
+        
+        std::string name;
+        Transform   transform;
+        float       vfov;
+        float       aspect;
+        float       focusDistance;
+    };
+    
     enum MeshAccelerationStructure {
         BVHAccelerationStructure
     };
     
+    struct VertexStatistics {
+        uint_t      meshesCount;
+        uint_t      quantizedMeshesCount;
+        uint64_t    verticesCount;
+        uint64_t    positionsSize;
+        uint64_t    attributesSize;
+    };
+    
     SceneImporter();
     virtual ~SceneImporter();
     
     virtual bool import(Scene& scene) = 0;
     
     void setFilename(const std::string& filename);
+    void setCacheDirectory(const std::string& directory);
+    void setQuantizeVertices(bool quantize);
+    void setOptimizeMeshes(bool optimize);
     void setMeshAccelerationStructure(MeshAccelerationStructure s);
+    void setCacheAccelerationStructures(bool cache);
     void addOverride(const MaterialOverride& override);
     void addOverride(const PrimitiveOverride& override);
     void addOverride(const LightOverride& override);
@@ -138,6 +182,8 @@ public:
     
     std::shared_ptr<Material> getOverridenMaterial(const ImportedMaterialAttributes& attrs, const Scene& scene) const;
     std::shared_ptr<Material> addImportedMaterial(const ImportedMaterialAttributes& attrs, Scene& scene);
+    void addImportedLight(const ImportedLightAttributes& attrs, Scene& scene);
+    std::shared_ptr<PerspectiveCamera> addImportedCamera(const ImportedCameraAttributes& attrs, Scene& scene);
     
     bool applyPrimitiveOverrides(Scene& scene, const std::string& name,
                                  const std::shared_ptr<TransformedPrimitive>& transformedPrimitive,
@@ -146,6 +192,10 @@ public:
                                  MeshBase* mesh=nullptr) const;
     bool applyLightOverrides(Scene& scene, Light* light) const;
     
+    // Vertex streams of the imported meshes
+    VertexStatistics getVertexStatistics() const;
+    void printVertexStatistics() const;
+    
 protected:
     
     class GridVolumeAnimationEvaluator : public AnimationEvaluator {
@@ -158,7 +208,52 @@ protected:
         GridVolume* volume;
     };
     
+    // Scene cache of the imported file, open during an import. Meshes missing
+    // from the cache are added to it and the cache is saved when closed
+    void _openCache();
+    void _closeCache();
+    std::string _getCacheFilename() const;
+    bool _getCachedMesh(const std::string& name, SceneCache::MeshData* data);
+    int _addCachedMesh(const std::string& name, const MeshBase& mesh);
+    
+    // Build a mesh acceleration structure from the cached tree of the mesh when
+    // there is one, trees built for a mesh added to the cache are saved with it
+    void _buildMeshAccelerationStructure(const std::shared_ptr<Aggregate>& aggregate,
+                                         const SceneCache::MeshData* cachedData,
+                                         int cachedMeshIndex);
+    
+    // The imported materials, lights, cameras and primitives are described in
+    // the saved cache, so later imports can be made from the cache only. Scenes
+    // that need the importer after the import, to evaluate animations from the
+    // scene file, must not be described
+    bool _importCachedScene(Scene& scene);
+    void _addCachedPrimitive(const std::string& name, const Transform& transform,
+                             int cachedMeshIndex,
+                             const std::vector<std::shared_ptr<Material>>& materials);
+    void _disableCachedScene();
+    
+    // Area lights are created from the vertex order of their meshes, which the
+    // mesh optimizer would change
+    bool _shouldOptimizeMesh(const std::string& name) const;
+    
+    void _addVertexStatistics(const MeshBase& mesh);
+    
     std::string                     _filename;
+    std::string                     _cacheDirectory;
+    std::shared_ptr<SceneCache>     _cache;
+    uint64_t                        _cacheKey;
+    uint_t                          _cachedMeshesCount;
+    bool                            _cacheAccelerationStructures;
+    // Description of the imported scene, not saved once disabled
+    bool                            _cachedSceneEnabled;
+    SceneCache::DataWriter          _cachedMaterials;
+    uint32_t                        _cachedMaterialsCount;
+    SceneCache::DataWriter          _cachedNodes;
+    uint32_t                        _cachedNodesCount;
+    std::map<const Material*, int>  _cachedMaterialIndices;
+    bool                            _quantizeVertices;
+    bool                            _optimizeMeshes;
+    VertexStatistics                _vertexStatistics;
     MeshAccelerationStructure       _meshAccelerationStructure;
     std::vector<MaterialOverride>   _materialsOverrides;
     std::vector<PrimitiveOverride>  _primitivesOverrides;
@@ -30,4 +30,8 @@ void SceneNode::setTransform(const Transform& transform) {
 
 const Transform& SceneNode::getTransform() const {
     return _transform[0];
+}
+
+const Transform& SceneNode::getInverseTransform() const {
+    return _transform.getInverse(0);
 }
\ No newline at end of file
@@ -23,6 +23,7 @@ public:
     
     void setTransform(const Transform& transform);
     const Transform& getTransform() const;
+    const Transform& getInverseTransform() const;
     
 protected:
     AnimatedTransform   _transform;
@@ -31,6 +31,10 @@ void Shape::refine(std::vector<std::shared_ptr<Shape>> &) const {
     abort();
 }
 
+bool Shape::isOpaque() const {
+    return true;
+}
+
 bool Shape::hasMaterial() const {
     return false;
 }
\ No newline at end of file
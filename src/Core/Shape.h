@@ -25,6 +25,8 @@ public:
     virtual bool canIntersect() const;
     virtual bool intersect(const Ray& ray, Intersection* intersection) const;
     virtual bool intersectP(const Ray& ray) const;
+    // False if intersections can be rejected by an alpha texture
+    virtual bool isOpaque() const;
     
     virtual void refine(std::vector<std::shared_ptr<Shape>> &refined) const;
     
@@ -43,6 +43,10 @@ std::shared_ptr<SurfaceIntegrator> SurfaceIntegrator::Load(const rapidjson::Valu
         integrator->setMaxRayDepth(value["maxRayDepth"].GetInt());
     }
     
+    if (value.IsObject() && value.HasMember("lightSampling")) {
+        integrator->setLightSampler(LightSampler::Load(value["lightSampling"]));
+    }
+    
     return integrator;
 }
 
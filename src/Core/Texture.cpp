@@ -7,12 +7,146 @@
 //
 
 #include <sstream>
+#include <algorithm>
 
 #include "Texture.h"
 
 #include "Spectrum.h"
+#include "Intersection.h"
 #include "Utilities/ImageLoading.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Gaussian filter weights of EWA lookups, indexed by squared radius
+static const int EWAWeightsSize = 128;
+
+static const std::vector<float>& GetEWAWeights() {
+    static const std::vector<float> weights = [] {
+        std::vector<float> w(EWAWeightsSize);
+        const float alpha = 2.f;
+        for (int i = 0; i < EWAWeightsSize; ++i) {
+            float r2 = (float)i / (EWAWeightsSize - 1);
+            w[i] = expf(-alpha * r2) - expf(-alpha);
+        }
+        return w;
+    }();
+    return weights;
+}
+
+static inline int WrapTexel(int x, int size) {
+    x %= size;
+    return x < 0 ? x + size : x;
+}
+
+// Bilinear lookup of the first level of an image at a texture space position,
+// fetch writing the Channels values of a texel index
+template <int Channels, typename Fetch>
+static inline void BilinearLookup(const vec2& p, int width, int height, const Fetch& fetch,
+                                  float* values) {
+    float s = p.s - floorf(p.s), t = (1.f-p.t) - floorf(1.f-p.t);
+    float x = s * width - 0.5f, y = t * height - 0.5f;
+    int x0 = (int)floorf(x), y0 = (int)floorf(y);
+    float dx = x - x0, dy = y - y0;
+    int x1 = WrapTexel(x0+1, width), y1 = WrapTexel(y0+1, height);
+    x0 = WrapTexel(x0, width);
+    y0 = WrapTexel(y0, height);
+    float c00[Channels], c10[Channels], c01[Channels], c11[Channels];
+    fetch(y0*width + x0, c00);
+    fetch(y0*width + x1, c10);
+    fetch(y1*width + x0, c01);
+    fetch(y1*width + x1, c11);
+    for (int c = 0; c < Channels; ++c) {
+        float v0 = c00[c] + (c10[c] - c00[c]) * dx;
+        float v1 = c01[c] + (c11[c] - c01[c]) * dx;
+        values[c] = v0 + (v1 - v0) * dy;
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128 Floor4(__m128 x) {
+    // Truncation rounds negative values up, step them back down
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.f)));
+}
+
+// Wrapped integer coordinates of the two texels around x, and the weight of the second one
+static inline void BilinearCoordinates4(__m128 x, int size, __m128i* i0, __m128i* i1, __m128* d) {
+    __m128 f = Floor4(x);
+    *d = _mm_sub_ps(x, f);
+    __m128i sizes = _mm_set1_epi32(size);
+    // Positions are wrapped first so only -1 and size need to be wrapped
+    __m128i i = _mm_cvttps_epi32(f);
+    i = _mm_add_epi32(i, _mm_and_si128(_mm_cmplt_epi32(i, _mm_setzero_si128()), sizes));
+    __m128i j = _mm_add_epi32(i, _mm_set1_epi32(1));
+    j = _mm_sub_epi32(j, _mm_andnot_si128(_mm_cmplt_epi32(j, sizes), sizes));
+    *i0 = i;
+    *i1 = j;
+}
+#endif
+
+// Bilinear lookups of the first level of an image, four at a time with SSE2
+template <int Channels, typename Fetch>
+static void BilinearBatch(uint_t count, const vec2* positions, int width, int height,
+                          const Fetch& fetch, float* values) {
+    uint_t i = 0;
+#ifdef __SSE2__
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 widths = _mm_set1_ps((float)width), heights = _mm_set1_ps((float)height);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= count; i += 4) {
+        const vec2* p = positions + i;
+        __m128 s = _mm_set_ps(p[3].s, p[2].s, p[1].s, p[0].s);
+        __m128 t = _mm_sub_ps(one, _mm_set_ps(p[3].t, p[2].t, p[1].t, p[0].t));
+        s = _mm_sub_ps(s, Floor4(s));
+        t = _mm_sub_ps(t, Floor4(t));
+        
+        __m128i x0, x1, y0, y1;
+        __m128 dx, dy;
+        BilinearCoordinates4(_mm_sub_ps(_mm_mul_ps(s, widths), half), width, &x0, &x1, &dx);
+        BilinearCoordinates4(_mm_sub_ps(_mm_mul_ps(t, heights), half), height, &y0, &y1, &dy);
+        
+        // SSE2 has no gather, fetch the corners lane by lane
+        int32_t ix0[4], ix1[4], iy0[4], iy1[4];
+        _mm_storeu_si128((__m128i*)ix0, x0);
+        _mm_storeu_si128((__m128i*)ix1, x1);
+        _mm_storeu_si128((__m128i*)iy0, y0);
+        _mm_storeu_si128((__m128i*)iy1, y1);
+        float corners[4][Channels][4];
+        for (int lane = 0; lane < 4; ++lane) {
+            float c[4][Channels];
+            fetch(iy0[lane]*width + ix0[lane], c[0]);
+            fetch(iy0[lane]*width + ix1[lane], c[1]);
+            fetch(iy1[lane]*width + ix0[lane], c[2]);
+            fetch(iy1[lane]*width + ix1[lane], c[3]);
+            for (int k = 0; k < 4; ++k) {
+                for (int ch = 0; ch < Channels; ++ch) {
+                    corners[k][ch][lane] = c[k][ch];
+                }
+            }
+        }
+        
+        float result[Channels][4];
+        for (int ch = 0; ch < Channels; ++ch) {
+            __m128 c00 = _mm_loadu_ps(corners[0][ch]), c10 = _mm_loadu_ps(corners[1][ch]);
+            __m128 c01 = _mm_loadu_ps(corners[2][ch]), c11 = _mm_loadu_ps(corners[3][ch]);
+            __m128 v0 = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), dx));
+            __m128 v1 = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), dx));
+            _mm_storeu_ps(result[ch], _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), dy)));
+        }
+        for (int lane = 0; lane < 4; ++lane) {
+            for (int ch = 0; ch < Channels; ++ch) {
+                values[(i + lane)*Channels + ch] = result[ch][lane];
+            }
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        BilinearLookup<Channels>(positions[i], width, height, fetch, values + i*Channels);
+    }
+}
+
 std::shared_ptr<Texture> Texture::Load(const rapidjson::Value& value) {
     std::shared_ptr<Texture> texture;
     
@@ -70,6 +204,25 @@ std::shared_ptr<Texture> Texture::Load(const rapidjson::Value& value) {
         
         if (!texture) {
             std::cerr << "Texture load error: couldn't load texture \"" << filename << "\"" << std::endl;
+            return texture;
+        }
+        
+        std::shared_ptr<ImageTexture> image = std::dynamic_pointer_cast<ImageTexture>(texture);
+        if (image && value.HasMember("filter")) {
+            std::string filter = value["filter"].GetString();
+            std::transform(filter.begin(), filter.end(), filter.begin(), ::tolower);
+            if (filter == "nearest") {
+                image->setFilterMode(ImageTexture::NearestFilter);
+            } else if (filter == "trilinear") {
+                image->setFilterMode(ImageTexture::TrilinearFilter);
+            } else if (filter == "ewa") {
+                image->setFilterMode(ImageTexture::EWAFilter);
+            } else {
+                std::cerr << "Texture load error: unknown filter \"" << filter << "\"" << std::endl;
+            }
+        }
+        if (image && value.HasMember("maxAnisotropy")) {
+            image->setMaxAnisotropy(value["maxAnisotropy"].GetDouble());
         }
     }
     
@@ -89,7 +242,31 @@ vec3 Texture::evaluateVec3(const vec2&) const {
 }
 
 vec2 Texture::wrap(vec2 pos) const {
-    return glm::mod(pos, vec2(1.f, 1.f));
+    return pos - floor(pos);
+}
+
+float Texture::evaluateFloat(const Intersection& intersection) const {
+    return evaluateFloat(intersection.uv);
+}
+
+vec3 Texture::evaluateVec3(const Intersection& intersection) const {
+    return evaluateVec3(intersection.uv);
+}
+
+ivec2 Texture::getResolution() const {
+    return ivec2(1);
+}
+
+void Texture::evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const {
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = evaluateFloat(positions[i]);
+    }
+}
+
+void Texture::evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const {
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = evaluateVec3(positions[i]);
+    }
 }
 
 UniformFloatTexture::UniformFloatTexture(float value) : Texture(), _value(value) {
@@ -140,7 +317,190 @@ vec3 UniformVec3Texture::evaluateVec3(const vec2&) const {
     return _value;
 }
 
-FloatTexture::FloatTexture() : Texture(),
+int ImageTexture::GetLevelsCount(int width, int height) {
+    int levelsCount = 1;
+    while ((width >> levelsCount) > 0 || (height >> levelsCount) > 0) {
+        ++levelsCount;
+    }
+    return levelsCount;
+}
+
+int ImageTexture::GetTexelsCount(int width, int height, int levelsCount) {
+    int count = 0;
+    for (int i = 0; i < levelsCount; ++i) {
+        count += std::max(1, width >> i) * std::max(1, height >> i);
+    }
+    return count;
+}
+
+ImageTexture::ImageTexture() : Texture(),
+_levels(), _filterMode(TrilinearFilter), _maxAnisotropy(8.f) {
+    
+}
+
+ImageTexture::~ImageTexture() {
+    
+}
+
+void ImageTexture::setFilterMode(FilterMode mode) {
+    _filterMode = mode;
+}
+
+void ImageTexture::setMaxAnisotropy(float anisotropy) {
+    _maxAnisotropy = anisotropy;
+}
+
+ivec2 ImageTexture::getResolution() const {
+    if (_levels.empty()) {
+        return ivec2(0);
+    }
+    return ivec2(_levels[0].width, _levels[0].height);
+}
+
+void ImageTexture::_setLevels(int width, int height, int levelsCount) {
+    _levels.clear();
+    uint_t offset = 0;
+    for (int i = 0; i < levelsCount; ++i) {
+        Level level;
+        level.width = std::max(1, width >> i);
+        level.height = std::max(1, height >> i);
+        level.offset = offset;
+        offset += level.width * level.height;
+        _levels.push_back(level);
+    }
+}
+
+bool ImageTexture::_isFiltered(const Intersection& intersection) const {
+    return (_filterMode != NearestFilter && !_levels.empty()
+            && (intersection.dudx != 0.f || intersection.dvdx != 0.f
+                || intersection.dudy != 0.f || intersection.dvdy != 0.f));
+}
+
+vec3 ImageTexture::_lookup(const Intersection& intersection) const {
+    // Texture space has its t axis flipped
+    vec2 st = wrap(vec2(intersection.uv.s, 1.f-intersection.uv.t));
+    vec2 dst0 = vec2(intersection.dudx, -intersection.dvdx);
+    vec2 dst1 = vec2(intersection.dudy, -intersection.dvdy);
+    
+    if (_filterMode == EWAFilter) {
+        return _ewa(st, dst0, dst1);
+    }
+    float width = 2.f * std::max(std::max(fabsf(dst0.x), fabsf(dst0.y)),
+                                 std::max(fabsf(dst1.x), fabsf(dst1.y)));
+    return _trilinear(st, width);
+}
+
+vec3 ImageTexture::_bilinear(int level, const vec2& st) const {
+    const Level& l = _levels[clamp(level, 0, (int)_levels.size()-1)];
+    float x = st.x * l.width - 0.5f, y = st.y * l.height - 0.5f;
+    int x0 = (int)floorf(x), y0 = (int)floorf(y);
+    float dx = x - x0, dy = y - y0;
+    return mix(mix(_texel(l, x0, y0),   _texel(l, x0+1, y0), dx),
+               mix(_texel(l, x0, y0+1), _texel(l, x0+1, y0+1), dx), dy);
+}
+
+void ImageTexture::_bilinearBatch(uint_t count, const vec2* positions, vec3* values) const {
+    if (_levels.empty()) {
+        std::fill(values, values + count, vec3(0.f));
+        return;
+    }
+    const Level& level = _levels[0];
+    BilinearBatch<3>(count, positions, level.width, level.height, [&] (int i, float* texel) {
+        vec3 value = _texel(level, i % level.width, i / level.width);
+        texel[0] = value.x;
+        texel[1] = value.y;
+        texel[2] = value.z;
+    }, &values[0].x);
+}
+
+vec3 ImageTexture::_trilinear(const vec2& st, float width) const {
+    // Pick the levels where the filter width covers about one texel
+    int resolution = std::max(_levels[0].width, _levels[0].height);
+    float level = log2f(std::max(width * resolution, 1e-8f));
+    if (level <= 0.f) {
+        return _bilinear(0, st);
+    }
+    if (level >= (int)_levels.size()-1) {
+        return _bilinear((int)_levels.size()-1, st);
+    }
+    int i = (int)floorf(level);
+    return mix(_bilinear(i, st), _bilinear(i+1, st), level - i);
+}
+
+vec3 ImageTexture::_ewa(const vec2& st, vec2 dst0, vec2 dst1) const {
+    // Make dst0 the major axis and bound the eccentricity of the ellipse
+    if (dot(dst0, dst0) < dot(dst1, dst1)) {
+        std::swap(dst0, dst1);
+    }
+    float majorLength = length(dst0);
+    float minorLength = length(dst1);
+    if (minorLength * _maxAnisotropy < majorLength && minorLength > 0.f) {
+        float scale = majorLength / (minorLength * _maxAnisotropy);
+        dst1 *= scale;
+        minorLength *= scale;
+    }
+    if (minorLength == 0.f) {
+        return _bilinear(0, st);
+    }
+    
+    // The minor axis selects the levels
+    int resolution = std::max(_levels[0].width, _levels[0].height);
+    float level = std::max(0.f, log2f(minorLength * resolution));
+    int i = (int)floorf(level);
+    return mix(_ewaLevel(i, st, dst0, dst1), _ewaLevel(i+1, st, dst0, dst1), level - i);
+}
+
+vec3 ImageTexture::_ewaLevel(int level, vec2 st, vec2 dst0, vec2 dst1) const {
+    if (level >= (int)_levels.size()) {
+        return _texel(_levels.back(), 0, 0);
+    }
+    const Level& l = _levels[level];
+    
+    // Ellipse in texel coordinates
+    vec2 size = vec2(l.width, l.height);
+    vec2 center = st * size - vec2(0.5f);
+    dst0 *= size;
+    dst1 *= size;
+    float a = dst0.y*dst0.y + dst1.y*dst1.y + 1.f;
+    float b = -2.f * (dst0.x*dst0.y + dst1.x*dst1.y);
+    float c = dst0.x*dst0.x + dst1.x*dst1.x + 1.f;
+    float invF = 1.f / (a*c - b*b*0.25f);
+    a *= invF;
+    b *= invF;
+    c *= invF;
+    
+    // Bounding box of the ellipse
+    float det = -b*b + 4.f*a*c;
+    float invDet = 1.f / det;
+    float uSqrt = sqrtf(det * c), vSqrt = sqrtf(a * det);
+    int s0 = (int)ceilf(center.x - 2.f*invDet*uSqrt);
+    int s1 = (int)floorf(center.x + 2.f*invDet*uSqrt);
+    int t0 = (int)ceilf(center.y - 2.f*invDet*vSqrt);
+    int t1 = (int)floorf(center.y + 2.f*invDet*vSqrt);
+    
+    // Sum the texels inside the ellipse with gaussian weights
+    const std::vector<float>& weights = GetEWAWeights();
+    vec3 sum = vec3(0.f);
+    float sumWeights = 0.f;
+    for (int it = t0; it <= t1; ++it) {
+        float tt = it - center.y;
+        for (int is = s0; is <= s1; ++is) {
+            float ss = is - center.x;
+            float r2 = a*ss*ss + b*ss*tt + c*tt*tt;
+            if (r2 < 1.f) {
+                float weight = weights[std::min((int)(r2 * EWAWeightsSize), EWAWeightsSize-1)];
+                sum += _texel(l, is, it) * weight;
+                sumWeights += weight;
+            }
+        }
+    }
+    if (sumWeights <= 0.f) {
+        return _bilinear(level, st);
+    }
+    return sum / sumWeights;
+}
+
+FloatTexture::FloatTexture() : ImageTexture(),
 _data(nullptr), _width(0), _height(0), _scaleFactor(1.f) {
     
 }
@@ -151,10 +511,11 @@ FloatTexture::~FloatTexture() {
     }
 }
 
-void FloatTexture::setData(int width, int height, float* data) {
+void FloatTexture::setData(int width, int height, float* data, int levelsCount) {
     _width = width;
     _height = height;
     _data = data;
+    _setLevels(width, height, levelsCount);
 }
 
 void FloatTexture::setScaleFactor(float scale) {
@@ -173,7 +534,45 @@ vec3 FloatTexture::evaluateVec3(const vec2& pos) const {
     return vec3(evaluateFloat(pos));
 }
 
-IntTexture::IntTexture() : Texture(),
+float FloatTexture::evaluateFloat(const Intersection& intersection) const {
+    if (!_data || !_isFiltered(intersection)) {
+        return evaluateFloat(intersection.uv);
+    }
+    return _lookup(intersection).x * _scaleFactor;
+}
+
+vec3 FloatTexture::evaluateVec3(const Intersection& intersection) const {
+    return vec3(evaluateFloat(intersection));
+}
+
+void FloatTexture::evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const {
+    if (!_data) {
+        std::fill(values, values + count, 0.f);
+        return;
+    }
+    BilinearBatch<1>(count, positions, _width, _height, [this] (int i, float* texel) {
+        texel[0] = _data[i];
+    }, values);
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] *= _scaleFactor;
+    }
+}
+
+void FloatTexture::evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const {
+    std::vector<float> floats(count);
+    evaluateFloatBatch(count, positions, floats.data());
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = vec3(floats[i]);
+    }
+}
+
+vec3 FloatTexture::_texel(const Level& level, int x, int y) const {
+    x = WrapTexel(x, level.width);
+    y = WrapTexel(y, level.height);
+    return vec3(_data[level.offset + y*level.width + x]);
+}
+
+IntTexture::IntTexture() : ImageTexture(),
 _data(nullptr), _width(0), _height(0), _scaleFactor(1.f) {
     
 }
@@ -184,10 +583,11 @@ IntTexture::~IntTexture() {
     }
 }
 
-void IntTexture::setData(int width, int height, uint32_t* data) {
+void IntTexture::setData(int width, int height, uint32_t* data, int levelsCount) {
     _width = width;
     _height = height;
     _data = data;
+    _setLevels(width, height, levelsCount);
 }
 
 void IntTexture::setScaleFactor(const vec3& scale) {
@@ -210,4 +610,324 @@ vec3 IntTexture::evaluateVec3(const vec2& p) const {
                       (float)components[0]/255.f
                       );
     return value * _scaleFactor;
-}
\ No newline at end of file
+}
+
+float IntTexture::evaluateFloat(const Intersection& intersection) const {
+    return length(evaluateVec3(intersection));
+}
+
+vec3 IntTexture::evaluateVec3(const Intersection& intersection) const {
+    if (!_data || !_isFiltered(intersection)) {
+        return evaluateVec3(intersection.uv);
+    }
+    return _lookup(intersection) * _scaleFactor;
+}
+
+void IntTexture::evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const {
+    std::vector<vec3> colors(count);
+    evaluateVec3Batch(count, positions, colors.data());
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = length(colors[i]);
+    }
+}
+
+void IntTexture::evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const {
+    if (!_data) {
+        std::fill(values, values + count, vec3(0.f));
+        return;
+    }
+    BilinearBatch<3>(count, positions, _width, _height, [this] (int i, float* texel) {
+        uint32_t pixel = _data[i];
+        texel[0] = (float)((pixel >> 16) & 0xff)/255.f;
+        texel[1] = (float)((pixel >> 8) & 0xff)/255.f;
+        texel[2] = (float)(pixel & 0xff)/255.f;
+    }, &values[0].x);
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] *= _scaleFactor;
+    }
+}
+
+vec3 IntTexture::_texel(const Level& level, int x, int y) const {
+    x = WrapTexel(x, level.width);
+    y = WrapTexel(y, level.height);
+    uint32_t pixel = _data[level.offset + y*level.width + x];
+    const uint8_t* components = (const uint8_t*)&pixel;
+    return vec3((float)components[2]/255.f,
+                (float)components[1]/255.f,
+                (float)components[0]/255.f);
+}
+
+ByteTexture::ByteTexture() : ImageTexture(), _data(nullptr), _scaleFactor(1.f) {
+    
+}
+
+ByteTexture::~ByteTexture() {
+    if (_data) {
+        delete[] _data;
+    }
+}
+
+void ByteTexture::setData(int width, int height, uint8_t* data, int levelsCount) {
+    _data = data;
+    _setLevels(width, height, levelsCount);
+}
+
+void ByteTexture::setScaleFactor(float scale) {
+    _scaleFactor = scale;
+}
+
+float ByteTexture::evaluateFloat(const vec2& p) const {
+    if (!_data) {
+        return 0.f;
+    }
+    vec2 pos = wrap(vec2(p.s, 1.f-p.t));
+    const Level& level = _levels[0];
+    return _texel(level, (int)(pos.x*level.width), (int)(pos.y*level.height)).x * _scaleFactor;
+}
+
+vec3 ByteTexture::evaluateVec3(const vec2& pos) const {
+    return vec3(evaluateFloat(pos));
+}
+
+float ByteTexture::evaluateFloat(const Intersection& intersection) const {
+    if (!_data || !_isFiltered(intersection)) {
+        return evaluateFloat(intersection.uv);
+    }
+    return _lookup(intersection).x * _scaleFactor;
+}
+
+vec3 ByteTexture::evaluateVec3(const Intersection& intersection) const {
+    return vec3(evaluateFloat(intersection));
+}
+
+void ByteTexture::evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const {
+    if (!_data) {
+        std::fill(values, values + count, 0.f);
+        return;
+    }
+    const Level& level = _levels[0];
+    BilinearBatch<1>(count, positions, level.width, level.height, [this] (int i, float* texel) {
+        texel[0] = (float)_data[i]/255.f;
+    }, values);
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] *= _scaleFactor;
+    }
+}
+
+void ByteTexture::evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const {
+    std::vector<float> floats(count);
+    evaluateFloatBatch(count, positions, floats.data());
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = vec3(floats[i]);
+    }
+}
+
+vec3 ByteTexture::_texel(const Level& level, int x, int y) const {
+    x = WrapTexel(x, level.width);
+    y = WrapTexel(y, level.height);
+    return vec3((float)_data[level.offset + y*level.width + x]/255.f);
+}
+
+HalfRGBTexture::HalfRGBTexture() : ImageTexture(), _data(nullptr), _scaleFactor(1.f) {
+    
+}
+
+HalfRGBTexture::~HalfRGBTexture() {
+    if (_data) {
+        delete[] _data;
+    }
+}
+
+void HalfRGBTexture::setData(int width, int height, uint16_t* data, int levelsCount) {
+    _data = data;
+    _setLevels(width, height, levelsCount);
+}
+
+void HalfRGBTexture::setScaleFactor(const vec3& scale) {
+    _scaleFactor = scale;
+}
+
+float HalfRGBTexture::evaluateFloat(const vec2& pos) const {
+    return length(evaluateVec3(pos));
+}
+
+vec3 HalfRGBTexture::evaluateVec3(const vec2& p) const {
+    if (!_data) {
+        return vec3(0.f);
+    }
+    vec2 pos = wrap(vec2(p.s, 1.f-p.t));
+    const Level& level = _levels[0];
+    return _texel(level, (int)(pos.x*level.width), (int)(pos.y*level.height)) * _scaleFactor;
+}
+
+float HalfRGBTexture::evaluateFloat(const Intersection& intersection) const {
+    return length(evaluateVec3(intersection));
+}
+
+vec3 HalfRGBTexture::evaluateVec3(const Intersection& intersection) const {
+    if (!_data || !_isFiltered(intersection)) {
+        return evaluateVec3(intersection.uv);
+    }
+    return _lookup(intersection) * _scaleFactor;
+}
+
+void HalfRGBTexture::evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const {
+    std::vector<vec3> colors(count);
+    evaluateVec3Batch(count, positions, colors.data());
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = length(colors[i]);
+    }
+}
+
+void HalfRGBTexture::evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const {
+    _bilinearBatch(count, positions, values);
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] *= _scaleFactor;
+    }
+}
+
+vec3 HalfRGBTexture::_texel(const Level& level, int x, int y) const {
+    x = WrapTexel(x, level.width);
+    y = WrapTexel(y, level.height);
+    const uint16_t* texel = _data + 3*(level.offset + y*level.width + x);
+    return vec3(Core::halfToFloat(texel[0]),
+                Core::halfToFloat(texel[1]),
+                Core::halfToFloat(texel[2]));
+}
+
+// Color of a 5:6:5 packed BC1 endpoint
+static inline vec3 DecodeRGB565(uint16_t c) {
+    return vec3((float)((c >> 11) & 0x1f)/31.f,
+                (float)((c >> 5) & 0x3f)/63.f,
+                (float)(c & 0x1f)/31.f);
+}
+
+static inline vec3 DecodeBC1Texel(const uint8_t* block, int i) {
+    uint16_t c0 = block[0] | (block[1] << 8);
+    uint16_t c1 = block[2] | (block[3] << 8);
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    vec3 color0 = DecodeRGB565(c0), color1 = DecodeRGB565(c1);
+    switch ((indices >> (2*i)) & 0x3) {
+        case 0:
+            return color0;
+        case 1:
+            return color1;
+        case 2:
+            return c0 > c1 ? (2.f*color0 + color1)/3.f : (color0 + color1)*0.5f;
+        default:
+            return c0 > c1 ? (color0 + 2.f*color1)/3.f : vec3(0.f);
+    }
+}
+
+static inline float DecodeBC4Texel(const uint8_t* block, int i) {
+    float a0 = block[0]/255.f, a1 = block[1]/255.f;
+    // 3 bits indices packed in the 6 following bytes
+    uint64_t indices = 0;
+    for (int k = 0; k < 6; ++k) {
+        indices |= (uint64_t)block[2 + k] << (8*k);
+    }
+    int index = (indices >> (3*i)) & 0x7;
+    if (index == 0) {
+        return a0;
+    } else if (index == 1) {
+        return a1;
+    }
+    if (block[0] > block[1]) {
+        return ((8 - index)*a0 + (index - 1)*a1)/7.f;
+    }
+    if (index == 6) {
+        return 0.f;
+    } else if (index == 7) {
+        return 1.f;
+    }
+    return ((6 - index)*a0 + (index - 1)*a1)/5.f;
+}
+
+uint_t BlockTexture::GetLevelSize(BlockFormat format, int width, int height) {
+    uint_t blocksCount = ((width + 3)/4) * ((height + 3)/4);
+    return blocksCount * (format == BC5 ? 16 : 8);
+}
+
+BlockTexture::BlockTexture() : ImageTexture(), _data(nullptr), _format(BC1), _levelsBlockOffset() {
+    
+}
+
+BlockTexture::~BlockTexture() {
+    if (_data) {
+        delete[] _data;
+    }
+}
+
+void BlockTexture::setData(int width, int height, BlockFormat format, uint8_t* data, int levelsCount) {
+    _data = data;
+    _format = format;
+    _setLevels(width, height, levelsCount);
+    _levelsBlockOffset.clear();
+    uint_t offset = 0;
+    for (const Level& level : _levels) {
+        _levelsBlockOffset.push_back(offset);
+        offset += GetLevelSize(format, level.width, level.height);
+    }
+}
+
+float BlockTexture::_toFloat(const vec3& texel) const {
+    // Single channel textures keep their value, colors are averaged like float images
+    if (_format == BC4) {
+        return texel.x;
+    }
+    return (texel.x + texel.y + texel.z) / 3.f;
+}
+
+float BlockTexture::evaluateFloat(const vec2& pos) const {
+    return _toFloat(evaluateVec3(pos));
+}
+
+vec3 BlockTexture::evaluateVec3(const vec2& p) const {
+    if (!_data) {
+        return vec3(0.f);
+    }
+    vec2 pos = wrap(vec2(p.s, 1.f-p.t));
+    const Level& level = _levels[0];
+    return _texel(level, (int)(pos.x*level.width), (int)(pos.y*level.height));
+}
+
+float BlockTexture::evaluateFloat(const Intersection& intersection) const {
+    return _toFloat(evaluateVec3(intersection));
+}
+
+vec3 BlockTexture::evaluateVec3(const Intersection& intersection) const {
+    if (!_data || !_isFiltered(intersection)) {
+        return evaluateVec3(intersection.uv);
+    }
+    return _lookup(intersection);
+}
+
+void BlockTexture::evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const {
+    std::vector<vec3> colors(count);
+    evaluateVec3Batch(count, positions, colors.data());
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = _toFloat(colors[i]);
+    }
+}
+
+void BlockTexture::evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const {
+    _bilinearBatch(count, positions, values);
+}
+
+vec3 BlockTexture::_texel(const Level& level, int x, int y) const {
+    x = WrapTexel(x, level.width);
+    y = WrapTexel(y, level.height);
+    int blockSize = (_format == BC5 ? 16 : 8);
+    uint_t blockIndex = (y/4) * ((level.width + 3)/4) + x/4;
+    const uint8_t* block = _data + _levelsBlockOffset[&level - &_levels[0]] + blockIndex*blockSize;
+    int i = (y%4)*4 + x%4;
+    if (_format == BC1) {
+        return DecodeBC1Texel(block, i);
+    } else if (_format == BC4) {
+        return vec3(DecodeBC4Texel(block, i));
+    }
+    // Rebuild the normal z component, normals are stored in [0, 1]
+    vec2 n = vec2(DecodeBC4Texel(block, i), DecodeBC4Texel(block + 8, i)) * 2.f - vec2(1.f);
+    float z = sqrtf(std::max(0.f, 1.f - dot(n, n)));
+    return vec3(n, z) * 0.5f + vec3(0.5f);
+}
@@ -9,6 +9,8 @@
 #ifndef __CSE168_Rendering__Texture__
 #define __CSE168_Rendering__Texture__
 
+#include <vector>
+
 #include "Core.h"
 
 class Texture {
@@ -21,6 +23,19 @@ public:
     virtual float evaluateFloat(const vec2& pos) const;
     virtual vec3 evaluateVec3(const vec2& pos) const;
     virtual vec2 wrap(vec2 pos) const;
+    
+    // Lookups filtered over the footprint of the intersection, point sampled by default
+    virtual float evaluateFloat(const Intersection& intersection) const;
+    virtual vec3 evaluateVec3(const Intersection& intersection) const;
+    
+    // Number of texels of image textures, 1x1 for constant ones
+    virtual ivec2 getResolution() const;
+    
+    // Evaluate count lookups at once, bilinearly filtered on the full resolution
+    // level of image textures. Byte, float and int images filter four lookups at
+    // a time, constant textures evaluate each position
+    virtual void evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const;
+    virtual void evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const;
 };
 
 class UniformFloatTexture : public Texture {
@@ -55,17 +70,82 @@ private:
     vec3   _value;
 };
 
-class FloatTexture : public Texture {
+/*
+ * Image texture with a MIP pyramid. The levels are stored one after the other
+ * in the texel array, from the full resolution down to 1x1, each level having
+ * half the resolution of the previous one.
+ */
+class ImageTexture : public Texture {
+public:
+    
+    enum FilterMode {
+        NearestFilter,
+        TrilinearFilter,
+        EWAFilter
+    };
+    
+    // Levels of a full pyramid and their total number of texels
+    static int  GetLevelsCount(int width, int height);
+    static int  GetTexelsCount(int width, int height, int levelsCount);
+    
+    ImageTexture();
+    virtual ~ImageTexture();
+    
+    void setFilterMode(FilterMode mode);
+    void setMaxAnisotropy(float anisotropy);
+    
+    using Texture::evaluateFloat;
+    using Texture::evaluateVec3;
+    
+    virtual ivec2 getResolution() const;
+    
+protected:
+    struct Level {
+        int     width;
+        int     height;
+        uint_t  offset;
+    };
+    
+    void _setLevels(int width, int height, int levelsCount);
+    
+    // Unscaled texel of a level, coordinates are wrapped
+    virtual vec3 _texel(const Level& level, int x, int y) const = 0;
+    
+    // Whether the lookup should be filtered, the intersection needs a footprint
+    bool _isFiltered(const Intersection& intersection) const;
+    vec3 _lookup(const Intersection& intersection) const;
+    
+    vec3 _bilinear(int level, const vec2& st) const;
+    // Unscaled bilinear lookups of the first level, for the batches of any image texture
+    void _bilinearBatch(uint_t count, const vec2* positions, vec3* values) const;
+    vec3 _trilinear(const vec2& st, float width) const;
+    vec3 _ewa(const vec2& st, vec2 dst0, vec2 dst1) const;
+    vec3 _ewaLevel(int level, vec2 st, vec2 dst0, vec2 dst1) const;
+    
+    std::vector<Level>  _levels;
+    FilterMode          _filterMode;
+    float               _maxAnisotropy;
+};
+
+class FloatTexture : public ImageTexture {
 public:
     
     FloatTexture();
     ~FloatTexture();
     
-    void setData(int width, int height, float* data);
+    // Takes ownership of data, holding levelsCount pyramid levels
+    void setData(int width, int height, float* data, int levelsCount=1);
     void setScaleFactor(float scale);
     
     virtual float evaluateFloat(const vec2& pos) const;
     virtual vec3 evaluateVec3(const vec2& pos) const;
+    virtual float evaluateFloat(const Intersection& intersection) const;
+    virtual vec3 evaluateVec3(const Intersection& intersection) const;
+    virtual void evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const;
+    virtual void evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const;
+    
+protected:
+    virtual vec3 _texel(const Level& level, int x, int y) const;
     
 private:
     float*  _data;
@@ -74,17 +154,25 @@ private:
     float   _scaleFactor;
 };
 
-class IntTexture : public Texture {
+class IntTexture : public ImageTexture {
 public:
     
     IntTexture();
     ~IntTexture();
     
-    void setData(int width, int height, uint32_t* data);
+    // Takes ownership of data, holding levelsCount pyramid levels
+    void setData(int width, int height, uint32_t* data, int levelsCount=1);
     void setScaleFactor(const vec3& scale);
     
     virtual float evaluateFloat(const vec2& pos) const;
     virtual vec3 evaluateVec3(const vec2& pos) const;
+    virtual float evaluateFloat(const Intersection& intersection) const;
+    virtual vec3 evaluateVec3(const Intersection& intersection) const;
+    virtual void evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const;
+    virtual void evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const;
+    
+protected:
+    virtual vec3 _texel(const Level& level, int x, int y) const;
     
 private:
     uint32_t*   _data;
@@ -93,4 +181,101 @@ private:
     vec3        _scaleFactor;
 };
 
+/*
+ * Single channel texture with 8 bits per texel, for masks and intensity maps
+ */
+class ByteTexture : public ImageTexture {
+public:
+    
+    ByteTexture();
+    ~ByteTexture();
+    
+    // Takes ownership of data, holding levelsCount pyramid levels
+    void setData(int width, int height, uint8_t* data, int levelsCount=1);
+    void setScaleFactor(float scale);
+    
+    virtual float evaluateFloat(const vec2& pos) const;
+    virtual vec3 evaluateVec3(const vec2& pos) const;
+    virtual float evaluateFloat(const Intersection& intersection) const;
+    virtual vec3 evaluateVec3(const Intersection& intersection) const;
+    virtual void evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const;
+    virtual void evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const;
+    
+protected:
+    virtual vec3 _texel(const Level& level, int x, int y) const;
+    
+private:
+    uint8_t*    _data;
+    float       _scaleFactor;
+};
+
+/*
+ * RGB texture with half precision components, for high dynamic range images
+ */
+class HalfRGBTexture : public ImageTexture {
+public:
+    
+    HalfRGBTexture();
+    ~HalfRGBTexture();
+    
+    // Takes ownership of data, three halfs per texel
+    void setData(int width, int height, uint16_t* data, int levelsCount=1);
+    void setScaleFactor(const vec3& scale);
+    
+    virtual float evaluateFloat(const vec2& pos) const;
+    virtual vec3 evaluateVec3(const vec2& pos) const;
+    virtual float evaluateFloat(const Intersection& intersection) const;
+    virtual vec3 evaluateVec3(const Intersection& intersection) const;
+    virtual void evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const;
+    virtual void evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const;
+    
+protected:
+    virtual vec3 _texel(const Level& level, int x, int y) const;
+    
+private:
+    uint16_t*   _data;
+    vec3        _scaleFactor;
+};
+
+/*
+ * Block compressed texture, texels are decoded from their 4x4 block on lookup.
+ * BC1 holds RGB colors, BC4 a single channel and BC5 two channels, used for
+ * normal maps whose z component is rebuilt from x and y.
+ */
+class BlockTexture : public ImageTexture {
+public:
+    
+    enum BlockFormat {
+        BC1,
+        BC4,
+        BC5
+    };
+    
+    // Size in bytes of a level of the given format
+    static uint_t GetLevelSize(BlockFormat format, int width, int height);
+    
+    BlockTexture();
+    ~BlockTexture();
+    
+    // Takes ownership of data, holding the blocks of each level one after the other
+    void setData(int width, int height, BlockFormat format, uint8_t* data, int levelsCount=1);
+    
+    virtual float evaluateFloat(const vec2& pos) const;
+    virtual vec3 evaluateVec3(const vec2& pos) const;
+    virtual float evaluateFloat(const Intersection& intersection) const;
+    virtual vec3 evaluateVec3(const Intersection& intersection) const;
+    virtual void evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const;
+    virtual void evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const;
+    
+protected:
+    virtual vec3 _texel(const Level& level, int x, int y) const;
+    
+private:
+    float _toFloat(const vec3& texel) const;
+    
+    uint8_t*            _data;
+    BlockFormat         _format;
+    std::vector<uint_t> _levelsBlockOffset;
+};
+
 #endif /* defined(__CSE168_Rendering__Texture__) */
@@ -47,15 +47,26 @@ bool TransformedPrimitive::canIntersect() const {
     return _primitive->canIntersect();
 }
 
+bool TransformedPrimitive::isOpaque() const {
+    return _primitive->isOpaque();
+}
+
 bool TransformedPrimitive::intersect(const Ray& ray, Intersection* intersection) const {
-    Transform primitiveToWorld = _transform.interpolate(ray.time);
-    Transform worldToPrimitive = Transform::Inverse(primitiveToWorld);
+    Transform primitiveToWorld, worldToPrimitive;
+    _transform.interpolate(ray.time, &primitiveToWorld, &worldToPrimitive);
     Ray transformedRay = worldToPrimitive(ray);
     
     if (!_primitive->intersect(transformedRay, intersection)) {
         return false;
     }
     
+    _transformIntersection(primitiveToWorld, ray, transformedRay, intersection);
+    return true;
+}
+
+void TransformedPrimitive::_transformIntersection(const Transform& primitiveToWorld,
+                                                  const Ray& ray, const Ray& transformedRay,
+                                                  Intersection* intersection) const {
     // Transform intersection
     
     intersection->point = primitiveToWorld(intersection->point);
@@ -64,6 +75,8 @@ bool TransformedPrimitive::intersect(const Ray& ray, Intersection* intersection)
     intersection->normal = normalize(vec3(normalMatrix * vec4(intersection->normal, 0.0f)));
     intersection->tangentU = normalize(vec3(normalMatrix * vec4(intersection->tangentU, 0.0f)));
     intersection->tangentV = normalize(vec3(normalMatrix * vec4(intersection->tangentV, 0.0f)));
+    intersection->dpdu = primitiveToWorld.applyToVector(intersection->dpdu);
+    intersection->dpdv = primitiveToWorld.applyToVector(intersection->dpdv);
     intersection->t = transformedRay.tmax;
     
     // Transform ray
@@ -73,18 +86,54 @@ bool TransformedPrimitive::intersect(const Ray& ray, Intersection* intersection)
     if (_material) {
         intersection->material = _material;
     }
-    
-    return true;
 }
 
 bool TransformedPrimitive::intersectP(const Ray& ray) const {
-    Transform primitiveToWorld = _transform.interpolate(ray.time);
-    Transform worldToPrimitive = Transform::Inverse(primitiveToWorld);
-    Ray transformedRay = worldToPrimitive(ray);
+    Ray transformedRay = _transform.interpolateInverse(ray.time)(ray);
     
     return _primitive->intersectP(transformedRay);
 }
 
+void TransformedPrimitive::intersectPacket(const RayPacket& packet, Intersection* intersections,
+                                           bool* hits) const {
+    // Rays of an animated primitive need their own transform
+    if (_transform.isActuallyAnimated()) {
+        Primitive::intersectPacket(packet, intersections, hits);
+        return;
+    }
+    
+    const Transform& primitiveToWorld = _transform[0];
+    const Transform& worldToPrimitive = _transform.getInverse(0);
+    RayPacket transformedPacket;
+    for (uint_t i = 0; i < packet.size(); ++i) {
+        transformedPacket.push(worldToPrimitive(packet[i]));
+    }
+    
+    bool transformedHits[RayPacket::MaxSize] = {false};
+    _primitive->intersectPacket(transformedPacket, intersections, transformedHits);
+    for (uint_t i = 0; i < packet.size(); ++i) {
+        if (transformedHits[i]) {
+            _transformIntersection(primitiveToWorld, packet[i], transformedPacket[i],
+                                   &intersections[i]);
+            hits[i] = true;
+        }
+    }
+}
+
+void TransformedPrimitive::intersectPacketP(const RayPacket& packet, bool* occluded) const {
+    if (_transform.isActuallyAnimated()) {
+        Primitive::intersectPacketP(packet, occluded);
+        return;
+    }
+    
+    const Transform& worldToPrimitive = _transform.getInverse(0);
+    RayPacket transformedPacket;
+    for (uint_t i = 0; i < packet.size(); ++i) {
+        transformedPacket.push(worldToPrimitive(packet[i]));
+    }
+    _primitive->intersectPacketP(transformedPacket, occluded);
+}
+
 AABB TransformedPrimitive::getBoundingBox() const {
     return _transform.motionBounds(_primitive->getBoundingBox(), false);
 }
\ No newline at end of file
@@ -29,9 +29,17 @@ public:
     virtual bool canIntersect() const;
     virtual bool intersect(const Ray& ray, Intersection* intersection) const;
     virtual bool intersectP(const Ray& ray) const;
+    virtual bool isOpaque() const;
+    virtual void intersectPacket(const RayPacket& packet, Intersection* intersections,
+                                 bool* hits) const;
+    virtual void intersectPacketP(const RayPacket& packet, bool* occluded) const;
     virtual AABB getBoundingBox() const;
     
 private:
+    void _transformIntersection(const Transform& primitiveToWorld, const Ray& ray,
+                                const Ray& transformedRay, Intersection* intersection) const;
+    
+
     std::shared_ptr<Primitive>  _primitive;
     Material*                   _material;
 };
@@ -23,6 +23,10 @@ bool VisibilityTester::unoccluded(const Scene& scene) const {
     return !scene.intersectP(_ray);
 }
 
+bool VisibilityTester::unoccluded(const Scene& scene, const Light* light) const {
+    return !scene.intersectP(_ray, light);
+}
+
 Spectrum VisibilityTester::transmittance(const Scene &scene, const Renderer &renderer) const {
     return renderer.transmittance(scene, _ray);
 }
@@ -41,4 +45,8 @@ void VisibilityTester::setRay(const vec3& origin, float epsilon, const vec3& dir
     _ray.direction = direction;
     _ray.tmin = epsilon;
     _ray.tmax = INFINITY;
-}
\ No newline at end of file
+}
+
+const Ray& VisibilityTester::getRay() const {
+    return _ray;
+}
@@ -13,6 +13,7 @@
 #include "Ray.h"
 
 class Scene;
+class Light;
 
 class VisibilityTester {
 public:
@@ -21,11 +22,16 @@ public:
     ~VisibilityTester();
     
     bool unoccluded(const Scene& scene) const;
+    // Shadow ray toward the given light, uses the scene occluder cache
+    bool unoccluded(const Scene& scene, const Light* light) const;
     Spectrum transmittance(const Scene& scene, const Renderer& renderer) const;
     
     void setSegment(const vec3& p1, float epsilon, const vec3& p2);
     void setRay(const vec3& origin, float epsilon, const vec3& direction);
     
+    // Shadow ray, for renderers that trace it later
+    const Ray& getRay() const;
+    
 private:
     Ray _ray;
 };
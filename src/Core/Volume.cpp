@@ -8,6 +8,8 @@
 
 #include "Volume.h"
 
+#include "Ray.h"
+
 float Volume::PhaseHenyeyGreenstein(const vec3& wi, const vec3& wo, float g) {
     // Henyey-Greenstein phase function
     float cosTheta = dot(wi, wo);
@@ -16,3 +18,24 @@ float Volume::PhaseHenyeyGreenstein(const vec3& wi, const vec3& wo, float g) {
             (1.f - g2) / (4.f*M_PI*powf(1.f + g2 - 2.f*g*cosTheta, 1.5f))
             );
 }
+
+void Volume::sampleSegment(const Ray& ray, float t0, float stepSize, uint_t count,
+                           Sample* samples) const {
+    for (uint_t i = 0; i < count; ++i) {
+        vec3 p = ray(t0 + i*stepSize);
+        samples[i].sigmaS = sigmaS(p);
+        samples[i].sigmaT = sigmaT(p);
+        samples[i].le = le(p);
+    }
+}
+
+void Volume::getSegments(const Ray& ray, float t0, float t1, std::vector<Segment>& segments) const {
+    segments.clear();
+    if (t0 < t1) {
+        Segment segment;
+        segment.t0 = t0;
+        segment.t1 = t1;
+        segment.maxSigmaT = INFINITY;
+        segments.push_back(segment);
+    }
+}
@@ -9,6 +9,8 @@
 #ifndef __CSE168_Rendering__Volume__
 #define __CSE168_Rendering__Volume__
 
+#include <vector>
+
 #include "Core.h"
 #include "AABB.h"
 #include "Spectrum.h"
@@ -18,6 +20,19 @@ public:
     
     static float PhaseHenyeyGreenstein(const vec3& wi, const vec3& wo, float g);
     
+    // Medium properties at a point
+    struct Sample {
+        Spectrum    sigmaS;
+        Spectrum    sigmaT;
+        Spectrum    le;
+    };
+    
+    // Part of a ray where the medium may be non-empty, with a bound of its extinction
+    struct Segment {
+        float       t0, t1;
+        float       maxSigmaT;
+    };
+    
     virtual ~Volume() {};
     virtual AABB getBoundingBox() const = 0;
     virtual bool intersectP(const Ray& ray, float* t0, float* t1) const = 0;
@@ -28,6 +43,15 @@ public:
     virtual Spectrum sigmaT(const vec3& p) const = 0;
     virtual Spectrum tau(const Ray& ray) const = 0;
     virtual float stepSize() const = 0;
+    
+    // Sample the medium at count points of the ray spaced by stepSize, starting at t0
+    virtual void sampleSegment(const Ray& ray, float t0, float stepSize, uint_t count,
+                               Sample* samples) const;
+    
+    // Find the segments of [t0, t1] along the ray that are not empty space,
+    // in increasing order. By default the whole range with an unknown bound
+    virtual void getSegments(const Ray& ray, float t0, float t1,
+                             std::vector<Segment>& segments) const;
 };
 
 #endif /* defined(__CSE168_Rendering__Volume__) */
\ No newline at end of file
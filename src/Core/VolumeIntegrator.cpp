@@ -9,6 +9,7 @@
 #include "Core/VolumeIntegrator.h"
 
 #include "Integrators/SingleScatteringIntegrator.h"
+#include "Integrators/DeltaTrackingIntegrator.h"
 
 std::shared_ptr<VolumeIntegrator> VolumeIntegrator::Load(const rapidjson::Value& value) {
     std::shared_ptr<VolumeIntegrator> integrator;
@@ -28,6 +29,8 @@ std::shared_ptr<VolumeIntegrator> VolumeIntegrator::Load(const rapidjson::Value&
     
     if (type == "singlescattering") {
         integrator = SingleScatteringIntegrator::Load(value);
+    } else if (type == "deltatracking") {
+        integrator = DeltaTrackingIntegrator::Load(value);
     } else {
         std::cerr << "VolumeIntegrator error: unknown type \"" << type << "\"" << std::endl;
         return integrator;
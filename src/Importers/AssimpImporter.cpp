@@ -8,6 +8,8 @@
 
 #include "AssimpImporter.h"
 
+#include "Shapes/MeshOptimizer.h"
+
 std::shared_ptr<AssimpImporter> AssimpImporter::Load(const rapidjson::Value&) {
     // No configuration to load, just create an importer
     return std::make_shared<AssimpImporter>();
@@ -22,6 +24,14 @@ AssimpImporter::~AssimpImporter() {
 }
 
 bool AssimpImporter::import(Scene& scene) {
+    // A cache describing the whole scene replaces the Assimp import
+    _openCache();
+    if (_importCachedScene(scene)) {
+        _closeCache();
+        printVertexStatistics();
+        return true;
+    }
+    
     // Read the scene from the file
     const aiScene* assimpScene = _importer.ReadFile(_filename, 0
                                                     | aiProcess_Triangulate
@@ -40,8 +50,10 @@ bool AssimpImporter::import(Scene& scene) {
     // Import scene nodes
     _trianglesCount = 0;
     importNode(assimpScene, assimpScene->mRootNode, scene);
+    _closeCache();
     
     std::cout << "AssimImporter: loaded " << _trianglesCount << " triangles" << std::endl;
+    printVertexStatistics();
     
     return true;
 }
@@ -54,18 +66,18 @@ bool AssimpImporter::importCamera(const aiScene *assimpScene, aiNode* assimpNode
         const std::string name = assimpCamera->mName.C_Str();
         
         if (name == std::string(assimpNode->mName.C_Str())) {
-            std::shared_ptr<PerspectiveCamera> camera = std::make_shared<PerspectiveCamera>();
-            camera->setName(name);
+            ImportedCameraAttributes attrs;
+            attrs.name = name;
             
             // Set camera transform
-            camera->setTransform(transform);
+            attrs.transform = transform;
             
             // Load camera fov and aspect
-            camera->setVFov(glm::degrees(assimpCamera->mHorizontalFOV) / assimpCamera->mAspect);
-            camera->setAspect(assimpCamera->mAspect);
+            attrs.vfov = glm::degrees(assimpCamera->mHorizontalFOV) / assimpCamera->mAspect;
+            attrs.aspect = assimpCamera->mAspect;
             
             // Add camera to the scene
-            scene << camera;
+            addImportedCamera(attrs, scene);
             return true;
         }
     }
@@ -80,34 +92,22 @@ bool AssimpImporter::importLight(const aiScene *assimpScene, aiNode* assimpNode,
         const std::string name = assimpLight->mName.C_Str();
         
         if (name == std::string(assimpNode->mName.C_Str())) {
-            Light* light = nullptr;
+            ImportedLightAttributes attrs;
+            attrs.name = name;
+            attrs.color = importColor(assimpLight->mColorDiffuse);
             
             if (assimpLight->mType == aiLightSource_DIRECTIONAL) {
-                DirectionalLight* directional =  new DirectionalLight();
-                
-                directional->setDirection(transform.applyToVector(importVec3(assimpLight->mDirection)));
-                directional->setSpectrum(Spectrum(importColor(assimpLight->mColorDiffuse)));
-                light = directional;
+                attrs.type = ImportedLightAttributes::Directional;
+                attrs.direction = transform.applyToVector(importVec3(assimpLight->mDirection));
             } else if (assimpLight->mType == aiLightSource_POINT) {
-                PointLight* point = new PointLight();
-
-                point->setPosition(transform(importVec3(assimpLight->mPosition)));
-                point->setSpectrum(Spectrum(importColor(assimpLight->mColorDiffuse)));
-                light = point;
-            }
-            
-            if (!light) {
+                attrs.type = ImportedLightAttributes::Point;
+                attrs.position = transform(importVec3(assimpLight->mPosition));
+            } else {
                 continue;
             }
-            light->setName(name);
-            
-            // Apply light overrides
-            bool addToScene = applyLightOverrides(scene, light);
             
-            if (addToScene) {
-                // Add light to the scene
-                scene << light;
-            }
+            // Add light to the scene, light overrides are applied
+            addImportedLight(attrs, scene);
             return true;
         }
     }
@@ -117,6 +117,21 @@ bool AssimpImporter::importLight(const aiScene *assimpScene, aiNode* assimpNode,
 void AssimpImporter::importMaterials(const aiScene* assimpScene, Scene& scene) {
     _importedMaterials.clear();
     _importedMaterials.reserve(assimpScene->mNumMaterials);
+    
+    // Load the textures of all materials in parallel first
+    std::vector<TextureRegistry::Request> requests;
+    for (uint i = 0; i < assimpScene->mNumMaterials; ++i) {
+        aiString assimpDiffuseTexture;
+        aiString assimpAlphaTexture;
+        assimpScene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &assimpDiffuseTexture);
+        assimpScene->mMaterials[i]->GetTexture(aiTextureType_OPACITY, 0, &assimpAlphaTexture);
+        requests.push_back(std::make_pair(std::string(assimpDiffuseTexture.C_Str()),
+                                          TextureRegistry::ColorTexels));
+        requests.push_back(std::make_pair(std::string(assimpAlphaTexture.C_Str()),
+                                          TextureRegistry::FloatTexels));
+    }
+    std::vector<std::shared_ptr<Texture>> textures = TextureRegistry::Instance().prefetch(requests);
+    
     for (uint i = 0; i < assimpScene->mNumMaterials; ++i) {
         aiMaterial* assimpMaterial = assimpScene->mMaterials[i];
         
@@ -140,7 +155,8 @@ void AssimpImporter::importMaterials(const aiScene* assimpScene, Scene& scene) {
         // Load textures
         std::string path = assimpDiffuseTexture.C_Str();
         if (!path.empty()) {
-            std::shared_ptr<Texture> t = ImageLoading::LoadImage(path);
+            std::shared_ptr<Texture> t =
+            TextureRegistry::Instance().getTexture(path, TextureRegistry::ColorTexels);
             if (!t) {
                 std::cerr << "AssimpImporter Error: couldn't load texture " << path << std::endl;
             } else {
@@ -149,7 +165,8 @@ void AssimpImporter::importMaterials(const aiScene* assimpScene, Scene& scene) {
         }
         path = assimpAlphaTexture.C_Str();
         if (!path.empty()) {
-            std::shared_ptr<Texture> t = ImageLoading::LoadFloatImage(path);
+            std::shared_ptr<Texture> t =
+            TextureRegistry::Instance().getTexture(path, TextureRegistry::FloatTexels);
             if (!t) {
                 std::cerr << "AssimpImporter Error: couldn't load texture " << path << std::endl;
             } else {
@@ -185,39 +202,68 @@ void AssimpImporter::importNode(const aiScene* assimpScene, aiNode* assimpNode,
             continue ;
         }
         
-        // Load vertices
-        int verticesCount = assimpMesh->mNumVertices;
-        Vertex* vertices = new Vertex[verticesCount];
-        for (uint j = 0; j < assimpMesh->mNumVertices; ++j) {
-            vertices[j].position = importVec3(assimpMesh->mVertices[j]);
-            if (assimpMesh->mNormals) {
-                vertices[j].normal = importVec3(assimpMesh->mNormals[j]);
+        // Create mesh, read in place from the scene cache when possible
+        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+        SceneCache::MeshData cachedData;
+        bool isCached = _getCachedMesh(name, &cachedData);
+        int cachedMeshIndex = -1;
+        if (isCached) {
+            mesh->setSharedData(_cache, cachedData.streams,
+                                cachedData.indicesCount, cachedData.indices, nullptr);
+            _trianglesCount += cachedData.indicesCount/3;
+        } else {
+            // Load vertices
+            int verticesCount = assimpMesh->mNumVertices;
+            Vertex* vertices = new Vertex[verticesCount];
+            for (uint j = 0; j < assimpMesh->mNumVertices; ++j) {
+                vertices[j].position = importVec3(assimpMesh->mVertices[j]);
+                if (assimpMesh->mNormals) {
+                    vertices[j].normal = importVec3(assimpMesh->mNormals[j]);
+                }
+                if (assimpMesh->mTextureCoords[0]) {
+                    vertices[j].texCoord = vec2(assimpMesh->mTextureCoords[0][j].x,
+                                                assimpMesh->mTextureCoords[0][j].y);
+                }
             }
-            if (assimpMesh->mTextureCoords[0]) {
-                vertices[j].texCoord = vec2(assimpMesh->mTextureCoords[0][j].x,
-                                            assimpMesh->mTextureCoords[0][j].y);
+            
+            // Load triangles
+            int trianglesCount = 0;
+            for (uint j = 0; j < assimpMesh->mNumFaces; ++j) {
+                if (assimpMesh->mFaces[j].mNumIndices == 3) {
+                    trianglesCount += 1;
+                }
             }
-        }
-        
-        // Load triangles
-        int trianglesCount = 0;
-        for (uint j = 0; j < assimpMesh->mNumFaces; ++j) {
-            if (assimpMesh->mFaces[j].mNumIndices == 3) {
-                trianglesCount += 1;
+            _trianglesCount += trianglesCount;
+            uint_t indicesCount = trianglesCount*3;
+            uint_t* indices = new uint_t[indicesCount];
+            uint_t faceId = 0;
+            for (uint_t j = 0; j < assimpMesh->mNumFaces; ++j) {
+                if (assimpMesh->mFaces[j].mNumIndices == 3) {
+                    indices[faceId*3+0] = assimpMesh->mFaces[j].mIndices[0];
+                    indices[faceId*3+1] = assimpMesh->mFaces[j].mIndices[1];
+                    indices[faceId*3+2] = assimpMesh->mFaces[j].mIndices[2];
+                    ++faceId;
+                }
             }
-        }
-        _trianglesCount += trianglesCount;
-        uint_t indicesCount = trianglesCount*3;
-        uint_t* indices = new uint_t[indicesCount];
-        uint_t faceId = 0;
-        for (uint_t j = 0; j < assimpMesh->mNumFaces; ++j) {
-            if (assimpMesh->mFaces[j].mNumIndices == 3) {
-                indices[faceId*3+0] = assimpMesh->mFaces[j].mIndices[0];
-                indices[faceId*3+1] = assimpMesh->mFaces[j].mIndices[1];
-                indices[faceId*3+2] = assimpMesh->mFaces[j].mIndices[2];
-                ++faceId;
+            
+            if (_shouldOptimizeMesh(name)) {
+                verticesCount = MeshOptimizer::Optimize(verticesCount, vertices, indicesCount, indices,
+                                                        nullptr);
+            }
+            
+            mesh->setVertices(verticesCount, vertices);
+            mesh->setIndices(indicesCount, indices);
+            
+            // Generate mesh tangents
+            mesh->generateTangents();
+            
+            if (_quantizeVertices) {
+                mesh->quantizeAttributes();
             }
+            
+            cachedMeshIndex = _addCachedMesh(name, *mesh);
         }
+        _addVertexStatistics(*mesh);
         
         // Get mesh material
         ImportedMaterial material;
@@ -228,15 +274,6 @@ void AssimpImporter::importNode(const aiScene* assimpScene, aiNode* assimpNode,
             return;
         }
         
-        // Create mesh
-        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
-        
-        mesh->setVertices(verticesCount, vertices);
-        mesh->setIndices(indicesCount, indices);
-        
-        // Generate mesh tangents
-        mesh->generateTangents();
-        
         // Create geometric primitive
         if (material.first.alphaTexture) {
             mesh->setAlphaTexture(material.first.alphaTexture);
@@ -257,11 +294,14 @@ void AssimpImporter::importNode(const aiScene* assimpScene, aiNode* assimpNode,
         bool addToScene = applyPrimitiveOverrides(scene, name, transformedPrimitive, *primitive,
                                                   &material.first, mesh.get());
         
+        _addCachedPrimitive(name, transform, cachedMeshIndex,
+                            std::vector<std::shared_ptr<Material>>(1, material.second));
+        
         if (addToScene) {
             *aggregate << primitive;
             
             // Build acceleration structure
-            aggregate->preprocess();
+            _buildMeshAccelerationStructure(aggregate, isCached ? &cachedData : nullptr, cachedMeshIndex);
             
             // Add primitive to scene
             scene << transformedPrimitive;
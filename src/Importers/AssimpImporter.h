@@ -21,7 +21,7 @@
 #include "Core/Camera.h"
 #include "Core/TransformedPrimitive.h"
 #include "Core/GeometricPrimitive.h"
-#include "Utilities/ImageLoading.h"
+#include "Utilities/TextureRegistry.h"
 #include "Cameras/PerspectiveCamera.h"
 #include "Lights/PointLight.h"
 #include "Lights/DirectionalLight.h"
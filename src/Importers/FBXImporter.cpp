@@ -19,8 +19,9 @@
 #include "Lights/PointLight.h"
 #include "Lights/DirectionalLight.h"
 #include "Lights/AreaLight.h"
-#include "Utilities/ImageLoading.h"
+#include "Utilities/TextureRegistry.h"
 #include "Shapes/ShapesUtilities.h"
+#include "Shapes/MeshOptimizer.h"
 
 std::shared_ptr<FBXImporter> FBXImporter::Load(const rapidjson::Value&) {
     // No configuration to load, just create an importer
@@ -37,6 +38,14 @@ FBXImporter::~FBXImporter() {
 }
 
 bool FBXImporter::import(Scene &scene) {
+    // A cache describing the whole scene replaces the FBX SDK import
+    _openCache();
+    if (_importCachedScene(scene)) {
+        _closeCache();
+        printVertexStatistics();
+        return true;
+    }
+    
     FbxImporter* fbxImporter = FbxImporter::Create(_fbxManager, "");
     
     if (!fbxImporter->Initialize(_filename.c_str())) {
@@ -56,7 +65,16 @@ bool FBXImporter::import(Scene &scene) {
         return false;
     }
     
+    // Load the textures of all materials in parallel, they are kept alive
+    // until the nodes using them are imported
+    std::vector<std::shared_ptr<Texture>> textures =
+    TextureRegistry::Instance().prefetch(_textureRequests(fbxScene));
+    
     importNode(rootNode, scene);
+    importMeshes(scene);
+    _closeCache();
+    
+    printVertexStatistics();
     
     return true;
 }
@@ -84,140 +102,219 @@ void FBXImporter::importNodeAttribute(FbxNode* fbxNode, FbxNodeAttribute* fbxAtt
     
     if (type == FbxNodeAttribute::eMesh) {
         FbxMesh* fbxMesh = dynamic_cast<FbxMesh*>(fbxAttribute);
-        importMesh(fbxNode, fbxMesh, scene, transform);
+        importMesh(fbxNode, fbxMesh, transform);
     }
     
     if (type == FbxNodeAttribute::eLight) {
         const FbxLight* fbxLight = dynamic_cast<const FbxLight*>(fbxAttribute);
         
-        Light* light = nullptr;
+        ImportedLightAttributes attrs;
+        attrs.name = fbxNode->GetName();
+        attrs.color = importVec3(fbxLight->Color.Get());
+        attrs.intensity = fbxLight->Intensity.Get() * 0.01f;
         
         if (fbxLight->LightType.Get() == FbxLight::ePoint) {
-            PointLight* point = new PointLight();
-            
             vec3 position = vec3(0.f, 0.f, 0.f);
-            point->setPosition(transform(position));
-            point->setSpectrum(Spectrum(importVec3(fbxLight->Color.Get())));
-            point->setIntensity(fbxLight->Intensity.Get() * 0.01f);
-            point->setNoDecay(fbxLight->DecayType.Get() == FbxLight::eNone);
+            attrs.type = ImportedLightAttributes::Point;
+            attrs.position = transform(position);
+            attrs.noDecay = (fbxLight->DecayType.Get() == FbxLight::eNone);
             
-            light = point;
+            addImportedLight(attrs, scene);
         } else if (fbxLight->LightType.Get() == FbxLight::eDirectional) {
-            DirectionalLight* directional = new DirectionalLight();
-            
             vec3 direction = vec3(0.f, 0.f, -1.f);
-            directional->setDirection(normalize(transform.applyToVector(direction)));
-            directional->setSpectrum(Spectrum(importVec3(fbxLight->Color.Get())));
-            directional->setIntensity(fbxLight->Intensity.Get() * 0.01f);
+            attrs.type = ImportedLightAttributes::Directional;
+            attrs.direction = normalize(transform.applyToVector(direction));
             
-            light = directional;
+            addImportedLight(attrs, scene);
         } else {
             std::cout << "FBXImporter error: unsuported light type for \"" << fbxNode->GetName()
             << "\"" << std::endl;
         }
         
-        if (light) {
-            light->setName(fbxNode->GetName());
-            if (applyLightOverrides(scene, light)) {
-                scene << light;
-            }
-        }
-        
     }
     
     if (type == FbxNodeAttribute::eCamera) {
         FbxCamera* fbxCamera = dynamic_cast<FbxCamera*>(fbxAttribute);
         
-        std::shared_ptr<PerspectiveCamera> camera = std::make_shared<PerspectiveCamera>();
-        camera->setName(fbxNode->GetName());
+        ImportedCameraAttributes attrs;
+        attrs.name = fbxNode->GetName();
         
-        float aspect = fbxCamera->FilmAspectRatio.Get();
-        camera->setAspect(aspect);
+        attrs.aspect = fbxCamera->FilmAspectRatio.Get();
         if (fbxCamera->ApertureMode.Get() == FbxCamera::eFocalLength) {
-            camera->setVFov(fbxCamera->ComputeFieldOfView(fbxCamera->FocalLength.Get())/aspect);
+            attrs.vfov = fbxCamera->ComputeFieldOfView(fbxCamera->FocalLength.Get())/attrs.aspect;
         } else {
-            camera->setVFov(glm::radians(fbxCamera->FieldOfView.Get())/aspect);
+            attrs.vfov = glm::radians(fbxCamera->FieldOfView.Get())/attrs.aspect;
         }
         
-        camera->lookAt(importVec3(fbxCamera->Position.Get()), importVec3(fbxCamera->InterestPosition.Get()),
-                       importVec3(fbxCamera->UpVector.Get()));
-        camera->setFocusDistance(fbxCamera->FocusDistance.Get());
+        attrs.transform.lookAt(importVec3(fbxCamera->Position.Get()),
+                               importVec3(fbxCamera->InterestPosition.Get()),
+                               importVec3(fbxCamera->UpVector.Get()));
+        attrs.focusDistance = fbxCamera->FocusDistance.Get();
+        
+        std::shared_ptr<PerspectiveCamera> camera = addImportedCamera(attrs, scene);
         
         if (isNodeAnimated(fbxNode)) {
+            // The animation is evaluated from the FBX scene
+            _disableCachedScene();
             scene.registerAnimationEvaluator(std::make_shared<CameraAnimationEvaluator>(fbxCamera,
                                                                                         camera,
                                                                                         shared_from_this()));
         }
-        
-        scene << camera;
     }
 }
 
-void FBXImporter::importMesh(FbxNode* fbxNode, FbxMesh* fbxMesh, Scene &scene,
-                             const Transform &transform) {
+void FBXImporter::importMesh(FbxNode* fbxNode, FbxMesh* fbxMesh, const Transform &transform) {
     if (!fbxMesh->IsTriangleMesh()) {
         return;
     }
     
-    std::string name = fbxNode->GetName();
+    MeshJob job;
+    job.fbxNode = fbxNode;
+    job.fbxMesh = fbxMesh;
+    job.transform = transform;
+    job.name = fbxNode->GetName();
+    job.isStatic = (fbxMesh->GetDeformerCount() == 0);
+    job.isCached = false;
+    job.cachedMeshIndex = -1;
+    job.loaded = false;
+    job.verticesCount = 0;
+    job.vertices = nullptr;
+    job.indicesCount = 0;
+    job.indices = nullptr;
+    job.materialIndices = nullptr;
+    job.hasUVs = false;
+    job.addToScene = false;
+    _meshJobs.push_back(job);
+}
+
+void FBXImporter::importMeshes(Scene& scene) {
+    // Look up the cached meshes in traversal order, and copy the others out of
+    // the FBX SDK, which isn't documented to be safe from several threads
+    for (MeshJob& job : _meshJobs) {
+        job.isCached = job.isStatic && _getCachedMesh(job.name, &job.cachedData);
+        job.loaded = job.isCached || _loadMeshData(job.fbxMesh, &job.verticesCount, &job.vertices,
+                                                   &job.indicesCount, &job.indices,
+                                                   &job.materialIndices, &job.hasUVs,
+                                                   FBXSDK_TIME_INFINITE);
+    }
+    
+    // Weld the meshes and generate their tangents in parallel
+    Core::parallelFor(_meshJobs.size(), [this] (uint_t i) {
+        if (_meshJobs[i].loaded) {
+            _convertMesh(_meshJobs[i]);
+        }
+    });
     
-    // Load mesh data
-    uint_t indicesCount, verticesCount;
-    uint_t* indices;
-    uint_t* materialIndices = nullptr;
-    Vertex* vertices;
-    bool hasUVs = false;
+    // Materials and overrides modify the scene, apply them in traversal order
+    for (MeshJob& job : _meshJobs) {
+        if (job.loaded) {
+            _createMeshPrimitive(job, scene);
+        }
+    }
     
-    FbxTime time = FBXSDK_TIME_INFINITE;
-    if (!_loadMeshData(fbxMesh, &verticesCount, &vertices, &indicesCount,
-                       &indices, &materialIndices, &hasUVs, time)) {
-        return;
+    // Build the acceleration structures in parallel, once the overrides are applied
+    Core::parallelFor(_meshJobs.size(), [this] (uint_t i) {
+        MeshJob& job = _meshJobs[i];
+        if (job.loaded) {
+            _buildMeshAccelerationStructure(job.aggregate, job.isCached ? &job.cachedData : nullptr,
+                                            job.cachedMeshIndex);
+        }
+    });
+    
+    for (MeshJob& job : _meshJobs) {
+        if (job.loaded && job.addToScene) {
+            // Add primitive to scene
+            scene << job.transformedPrimitive;
+        }
     }
+    _meshJobs.clear();
+}
+
+void FBXImporter::_convertMesh(MeshJob& job) const {
+    // Static meshes are read in place from the scene cache when possible
+    uint_t indicesCount = job.indicesCount, verticesCount = job.verticesCount;
+    uint_t* indices = job.indices;
+    uint_t* materialIndices = job.materialIndices;
+    Vertex* vertices = job.vertices;
+    bool hasUVs = job.hasUVs;
     
-    // Create mesh
-    std::shared_ptr<MeshBase> mesh;
-    std::shared_ptr<AnimatedMesh> animated;
+    // Weld the vertices expanded by polygon vertex, and reorder them for locality.
+    // Skinned meshes are reloaded unchanged on each evaluation
+    if (!job.isCached && job.isStatic && _shouldOptimizeMesh(job.name)) {
+        verticesCount = MeshOptimizer::Optimize(verticesCount, vertices, indicesCount, indices,
+                                                materialIndices);
+    }
     
-    if (fbxMesh->GetDeformerCount() == 0) {
+    // Create mesh
+    if (job.isStatic) {
         // Create static mesh
-        mesh = std::make_shared<Mesh>();
+        job.mesh = std::make_shared<Mesh>();
     } else {
         // Create animated mesh with same vertices
-        animated = std::make_shared<AnimatedMesh>();
-        
-        // Create end vertices
-        Vertex* endVertices = new Vertex[verticesCount];
+        job.animated = std::make_shared<AnimatedMesh>();
+        job.mesh = job.animated;
+    }
+    
+    // Set mesh base data
+    if (job.isCached) {
+        const SceneCache::MeshData& cached = job.cachedData;
+        job.mesh->setSharedData(_cache, cached.streams,
+                                cached.indicesCount, cached.indices, cached.materialIndices);
+        job.hasMaterialIndices = (cached.materialIndices != nullptr);
+        return;
+    }
+    
+    // Create end vertices
+    Vertex* endVertices = nullptr;
+    if (job.animated) {
+        endVertices = new Vertex[verticesCount];
         for (uint_t i = 0; i < verticesCount; ++i) {
             endVertices[i] = vertices[i];
         }
-        
-        animated->setEndVertices(endVertices);
-        
-        mesh = animated;
     }
     
-    // Set mesh base data
-    mesh->setVertices(verticesCount, vertices);
-    mesh->setIndices(indicesCount, indices);
+    job.mesh->setVertices(verticesCount, vertices);
+    job.mesh->setIndices(indicesCount, indices);
     
     if (materialIndices) {
-        mesh->setMaterialIndices(materialIndices);
+        job.mesh->setMaterialIndices(materialIndices);
+    }
+    job.hasMaterialIndices = (materialIndices != nullptr);
+    
+    if (job.animated) {
+        job.animated->setEndVertices(endVertices);
     }
     
     // Generate mesh tangents
-    mesh->generateTangents(hasUVs);
+    job.mesh->generateTangents(hasUVs);
+    
+    // Skinned meshes regenerate their attributes on each evaluation, they are kept unpacked
+    if (_quantizeVertices && job.isStatic) {
+        job.mesh->quantizeAttributes();
+    }
+}
+
+void FBXImporter::_createMeshPrimitive(MeshJob& job, Scene& scene) {
+    std::shared_ptr<MeshBase>& mesh = job.mesh;
+    
+    // Meshes are added to the scene cache in traversal order
+    if (job.isStatic && !job.isCached) {
+        job.cachedMeshIndex = _addCachedMesh(job.name, *job.mesh);
+    }
+    _addVertexStatistics(*job.mesh);
     
     // Load mesh materials
     std::vector<ImportedMaterial> materials;
-    _importNodeMaterials(materials, fbxNode, scene);
+    _importNodeMaterials(materials, job.fbxNode, scene);
+    
+    std::vector<std::shared_ptr<Material>> meshMaterials;
+    meshMaterials.reserve(materials.size());
+    for (ImportedMaterial& material : materials) {
+        meshMaterials.push_back(material.second);
+    }
     
     // If material indices are providen, assign materials to mesh
-    if (materialIndices) {
-        std::vector<std::shared_ptr<Material>> meshMaterials;
-        meshMaterials.reserve(materials.size());
-        for (ImportedMaterial& material : materials) {
-            meshMaterials.push_back(material.second);
-        }
+    if (job.hasMaterialIndices) {
         mesh->setMaterials(meshMaterials);
     }
     
@@ -228,41 +325,38 @@ void FBXImporter::importMesh(FbxNode* fbxNode, FbxMesh* fbxMesh, Scene &scene,
     std::shared_ptr<GeometricPrimitive> primitive = std::make_shared<GeometricPrimitive>(mesh,
                                                                                          materials[0].second);
     
-    // Create mesh acceleration structure
-    std::shared_ptr<Aggregate> aggregate = createMeshAccelerationStructure();
+    // Create mesh acceleration structure, built once all overrides are applied
+    job.aggregate = createMeshAccelerationStructure();
     
     // Create transformed primitive
-    std::shared_ptr<TransformedPrimitive> transformedPrimitive =
-    std::make_shared<TransformedPrimitive>(aggregate, transform);
+    job.transformedPrimitive = std::make_shared<TransformedPrimitive>(job.aggregate, job.transform);
     
-    transformedPrimitive->setName(name);
+    job.transformedPrimitive->setName(job.name);
     
     // Apply overrides
-    bool addToScene = applyPrimitiveOverrides(scene, name, transformedPrimitive, *primitive,
-                                              &materials[0].first, mesh.get());
+    job.addToScene = applyPrimitiveOverrides(scene, job.name, job.transformedPrimitive, *primitive,
+                                             &materials[0].first, mesh.get());
+    
+    *job.aggregate << primitive;
     
-    // Build acceleration structure
-    *aggregate << primitive;
-    aggregate->preprocess();
+    _addCachedPrimitive(job.name, job.transform, job.cachedMeshIndex, meshMaterials);
     
-    // Create animation evaluators
-    if (isNodeAnimated(fbxNode)) {
-        scene.registerAnimationEvaluator(std::make_shared<MeshAnimationEvaluator>(fbxNode,
-                                                                                  transformedPrimitive,
+    // Create animation evaluators, they are evaluated from the FBX scene
+    if (isNodeAnimated(job.fbxNode) || job.animated) {
+        _disableCachedScene();
+    }
+    if (isNodeAnimated(job.fbxNode)) {
+        scene.registerAnimationEvaluator(std::make_shared<MeshAnimationEvaluator>(job.fbxNode,
+                                                                                  job.transformedPrimitive,
                                                                                   shared_from_this()));
     }
-    if (animated) {
+    if (job.animated) {
         scene
-        .registerAnimationEvaluator(std::make_shared<SkinnedMeshAnimationEvaluator>(fbxMesh,
-                                                                                    animated,
-                                                                                    aggregate,
+        .registerAnimationEvaluator(std::make_shared<SkinnedMeshAnimationEvaluator>(job.fbxMesh,
+                                                                                    job.animated,
+                                                                                    job.aggregate,
                                                                                     shared_from_this()));
     }
-    
-    if (addToScene) {
-        // Add primitive to scene
-        scene << transformedPrimitive;
-    }
 }
 
 void FBXImporter::_importNodeMaterials(std::vector<ImportedMaterial>& materials,
@@ -316,6 +410,37 @@ void FBXImporter::_importNodeMaterials(std::vector<ImportedMaterial>& materials,
     }
 }
 
+static void AddTextureRequest(std::vector<TextureRegistry::Request>& requests,
+                              FbxTexture* fbxTexture, bool isFloat=false) {
+    FbxFileTexture* fbxFileTexture = dynamic_cast<FbxFileTexture*>(fbxTexture);
+    if (fbxFileTexture) {
+        requests.push_back(std::make_pair(std::string(fbxFileTexture->GetFileName()),
+                                          isFloat ? TextureRegistry::FloatTexels
+                                          : TextureRegistry::ColorTexels));
+    }
+}
+
+std::vector<TextureRegistry::Request> FBXImporter::_textureRequests(FbxScene* fbxScene) const {
+    // Same slots as the ones imported by _importNodeMaterials
+    std::vector<TextureRegistry::Request> requests;
+    for (int i = 0; i < fbxScene->GetMaterialCount(); ++i) {
+        FbxSurfaceMaterial* fbxMaterial = fbxScene->GetMaterial(i);
+        FbxSurfaceLambert* fbxLambert = dynamic_cast<FbxSurfaceLambert*>(fbxMaterial);
+        FbxSurfacePhong* fbxPhong = dynamic_cast<FbxSurfacePhong*>(fbxMaterial);
+        if (fbxLambert) {
+            AddTextureRequest(requests, fbxLambert->Diffuse.GetSrcObject<FbxTexture>(0));
+            AddTextureRequest(requests, fbxLambert->DiffuseFactor.GetSrcObject<FbxTexture>(0), true);
+            AddTextureRequest(requests, fbxLambert->TransparentColor.GetSrcObject<FbxTexture>(0), true);
+            AddTextureRequest(requests, fbxLambert->NormalMap.GetSrcObject<FbxTexture>(0));
+        }
+        if (fbxPhong) {
+            AddTextureRequest(requests, fbxPhong->Specular.GetSrcObject<FbxTexture>(0));
+            AddTextureRequest(requests, fbxPhong->ReflectionFactor.GetSrcObject<FbxTexture>(0), true);
+        }
+    }
+    return requests;
+}
+
 bool FBXImporter::_loadMeshData(FbxMesh* fbxMesh, uint_t *verticesCount, Vertex **vertices,
                                 uint_t *indicesCount, uint_t **indices, uint_t** materialIndices,
                                 bool* hasUVs, const FbxTime& time) const {
@@ -675,12 +800,9 @@ std::shared_ptr<Texture> FBXImporter::importTexture(FbxTexture* fbxTexture,
     }
     
     std::string path = fbxFileTexture->GetFileName();
-    std::shared_ptr<Texture> texture;
-    if (isFloat) {
-        texture = ImageLoading::LoadFloatImage(path);
-    } else {
-        texture = ImageLoading::LoadImage(path);
-    }
+    std::shared_ptr<Texture> texture =
+    TextureRegistry::Instance().getTexture(path, isFloat ? TextureRegistry::FloatTexels
+                                           : TextureRegistry::ColorTexels);
     if (!texture) {
         std::cerr << "FbxImporter error: couldn't load texture \"" << path << "\"" << std::endl;
     }
@@ -16,6 +16,7 @@
 #include "Core/AnimationEvaluator.h"
 #include "Cameras/PerspectiveCamera.h"
 #include "Shapes/AnimatedMesh.h"
+#include "Utilities/TextureRegistry.h"
 
 class FBXImporter : public SceneImporter, public std::enable_shared_from_this<FBXImporter> {
 public:
@@ -33,8 +34,11 @@ public:
                              FbxNodeAttribute* fbxAttribute,
                              Scene& scene, const Transform& transform);
     
-    void importMesh(FbxNode* fbxNode, FbxMesh* fbxMesh,
-                    Scene& scene, const Transform& transform);
+    // Queue a mesh, importMeshes reads the queued meshes from the FBX SDK and
+    // converts them in parallel
+    // and added to the scene in the order they were queued
+    void importMesh(FbxNode* fbxNode, FbxMesh* fbxMesh, const Transform& transform);
+    void importMeshes(Scene& scene);
     
     static vec3                     importVec3(const FbxVector4& v);
     static vec2                     importVec2(const FbxVector2& v);
@@ -93,9 +97,40 @@ private:
     
     typedef std::pair<ImportedMaterialAttributes, std::shared_ptr<Material>> ImportedMaterial;
     
+    struct MeshJob {
+        FbxNode*                                fbxNode;
+        FbxMesh*                                fbxMesh;
+        Transform                               transform;
+        std::string                             name;
+        bool                                    isStatic;
+        bool                                    isCached;
+        // Index of the mesh added to the scene cache, -1 if it wasn't added
+        int                                     cachedMeshIndex;
+        bool                                    loaded;
+        bool                                    hasMaterialIndices;
+        SceneCache::MeshData                    cachedData;
+        // Arrays copied out of the FBX SDK by the importing thread
+        uint_t                                  verticesCount;
+        Vertex*                                 vertices;
+        uint_t                                  indicesCount;
+        uint_t*                                 indices;
+        uint_t*                                 materialIndices;
+        bool                                    hasUVs;
+        std::shared_ptr<MeshBase>               mesh;
+        std::shared_ptr<AnimatedMesh>           animated;
+        std::shared_ptr<Aggregate>              aggregate;
+        std::shared_ptr<TransformedPrimitive>   transformedPrimitive;
+        bool                                    addToScene;
+    };
+    
+    void _convertMesh(MeshJob& job) const;
+    void _createMeshPrimitive(MeshJob& job, Scene& scene);
+    
     void _importNodeMaterials(std::vector<ImportedMaterial>& materials,
                               const FbxNode *fbxNode, Scene &scene);
     
+    std::vector<TextureRegistry::Request> _textureRequests(FbxScene* fbxScene) const;
+    
     bool _loadMeshData(FbxMesh* fbxMesh, uint_t* verticesCount, Vertex** vertices,
                        uint_t* indicesCount, uint_t** indices,
                        uint_t** materialIndices, bool* hasUVs,
@@ -106,6 +141,7 @@ private:
     
     FbxManager*                                     _fbxManager;
     std::map<FbxSurfaceMaterial*,ImportedMaterial>  _importedMaterials;
+    std::vector<MeshJob>                            _meshJobs;
 };
 
 #endif /* defined(__CSE168_Rendering__FBXImporter__) */
@@ -0,0 +1,181 @@
+//
+//  DeltaTrackingIntegrator.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/10/14.
+//
+//
+
+#include "DeltaTrackingIntegrator.h"
+
+#include <algorithm>
+
+#include "Core/Renderer.h"
+
+// Below this transmittance, ratio tracking is continued with russian roulette
+static const float RouletteThreshold = 0.1f;
+
+static float Average(const Spectrum& s) {
+    vec3 c = s.getColor();
+    return (c.x + c.y + c.z) / 3.f;
+}
+
+// Weights can be negative when the majorant doesn't bound the extinction
+static float MaxAbsComponent(const Spectrum& s) {
+    vec3 c = glm::abs(s.getColor());
+    return std::max(c.x, std::max(c.y, c.z));
+}
+
+std::shared_ptr<DeltaTrackingIntegrator> DeltaTrackingIntegrator::Load(const rapidjson::Value& value) {
+    std::shared_ptr<DeltaTrackingIntegrator> integrator = std::make_shared<DeltaTrackingIntegrator>();
+    
+    return integrator;
+}
+
+DeltaTrackingIntegrator::DeltaTrackingIntegrator() {
+    
+}
+
+DeltaTrackingIntegrator::~DeltaTrackingIntegrator() {
+    
+}
+
+float DeltaTrackingIntegrator::_GetMajorant(const Volume* volume, const Volume::Segment& segment) {
+    // Segments without a known bound are sampled about once per step, this
+    // majorant may be exceeded and li() then falls back to weighted tracking.
+    // Emissive segments without extinction also need collisions to pick up
+    // their emission
+    if (segment.maxSigmaT > 0.f && segment.maxSigmaT < INFINITY) {
+        return segment.maxSigmaT;
+    }
+    return 1.f / volume->stepSize();
+}
+
+Spectrum DeltaTrackingIntegrator::li(const Scene& scene, const Renderer& renderer,
+                                     const Ray& ray, Spectrum *t) const {
+    Volume* volume = scene.getVolume();
+    float tstart, tend;
+    if (!volume || !volume->intersectP(ray, &tstart, &tend)) {
+        *t = Spectrum(1.f);
+        return Spectrum(0.f);
+    }
+    
+    std::vector<Volume::Segment> segments;
+    volume->getSegments(ray, tstart, tend, segments);
+    
+    Spectrum tr = Spectrum(1.f);
+    Spectrum lv = Spectrum(0.f);
+    Spectrum deltaWeight = Spectrum(1.f);
+    bool collided = false;
+    
+    for (const Volume::Segment& segment : segments) {
+        float majorant = _GetMajorant(volume, segment);
+        float tc = segment.t0;
+        while (true) {
+            tc -= logf(1.f - (float)rand()/RAND_MAX) / majorant;
+            if (tc >= segment.t1) {
+                break;
+            }
+            Volume::Sample sample;
+            volume->sampleSegment(ray, tc, 0.f, 1, &sample);
+            
+            // Emission, weighted by the ratio tracking transmittance
+            lv += tr * sample.le * (1.f / majorant);
+            
+            // Delta tracking, in-scattering is estimated at the first real collision.
+            // Where the extinction exceeds the majorant, the null collision
+            // coefficient is negative and collisions are chosen proportionally to
+            // the absolute coefficients instead, with weights keeping it unbiased
+            if (!collided) {
+                float sigmaT = Average(sample.sigmaT);
+                float pReal = sigmaT / (sigmaT + std::abs(majorant - sigmaT));
+                if (pReal >= 1.f || (float)rand()/RAND_MAX < pReal) {
+                    collided = true;
+                    Spectrum scattering = sample.sigmaS * (1.f / (majorant * pReal));
+                    if (!scattering.isBlack()) {
+                        Spectrum ls = _scatteredLight(scene, renderer, volume, ray, ray(tc));
+                        lv += deltaWeight * scattering * ls;
+                    }
+                } else {
+                    deltaWeight *= (Spectrum(1.f) - sample.sigmaT * (1.f / majorant)) * (1.f / (1.f - pReal));
+                }
+            }
+            
+            // Ratio tracking
+            tr *= Spectrum(1.f) - sample.sigmaT * (1.f / majorant);
+            if (collided && MaxAbsComponent(tr) < RouletteThreshold) {
+                float q = std::max(0.05f, 1.f - MaxAbsComponent(tr));
+                if ((float)rand()/RAND_MAX < q) {
+                    *t = Spectrum(0.f);
+                    return lv;
+                }
+                tr = tr * (1.f / (1.f - q));
+            }
+        }
+    }
+    
+    *t = tr;
+    return lv;
+}
+
+Spectrum DeltaTrackingIntegrator::transmittance(const Scene& scene, const Renderer&,
+                                                const Ray& ray) const {
+    Volume* volume = scene.getVolume();
+    float tstart, tend;
+    if (!volume || !volume->intersectP(ray, &tstart, &tend)) {
+        return Spectrum(1.f);
+    }
+    
+    std::vector<Volume::Segment> segments;
+    volume->getSegments(ray, tstart, tend, segments);
+    
+    // Ratio tracking, empty space between segments is skipped
+    Spectrum tr = Spectrum(1.f);
+    for (const Volume::Segment& segment : segments) {
+        if (segment.maxSigmaT <= 0.f) {
+            continue;
+        }
+        float majorant = _GetMajorant(volume, segment);
+        float tc = segment.t0;
+        while (true) {
+            tc -= logf(1.f - (float)rand()/RAND_MAX) / majorant;
+            if (tc >= segment.t1) {
+                break;
+            }
+            tr *= Spectrum(1.f) - volume->sigmaT(ray(tc)) * (1.f / majorant);
+            if (MaxAbsComponent(tr) < RouletteThreshold) {
+                float q = std::max(0.05f, 1.f - MaxAbsComponent(tr));
+                if ((float)rand()/RAND_MAX < q) {
+                    return Spectrum(0.f);
+                }
+                tr = tr * (1.f / (1.f - q));
+            }
+        }
+    }
+    return tr;
+}
+
+Spectrum DeltaTrackingIntegrator::_scatteredLight(const Scene& scene, const Renderer& renderer,
+                                                  const Volume* volume, const Ray& ray,
+                                                  const vec3& p) const {
+    Spectrum ls = Spectrum(0.f);
+    vec3 wo = -ray.direction;
+    for (Light* light : scene.getLights()) {
+        VisibilityTester vt(ray);
+        LightSample lightSample;
+        lightSample.u = (float)rand()/RAND_MAX;
+        lightSample.v = (float)rand()/RAND_MAX;
+        
+        vec3 wi;
+        Spectrum li = light->sampleL(p, 0.f, lightSample, &wi, &vt);
+        
+        if (li.isBlack()) {
+            continue;
+        }
+        
+        if (vt.unoccluded(scene, light)) {
+            ls += li * vt.transmittance(scene, renderer) * volume->phase(p, -wi, wo);
+        }
+    }
+    return ls;
+}
@@ -0,0 +1,47 @@
+//
+//  DeltaTrackingIntegrator.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/10/14.
+//
+//
+
+#ifndef __CSE168_Rendering__DeltaTrackingIntegrator__
+#define __CSE168_Rendering__DeltaTrackingIntegrator__
+
+#include <vector>
+
+#include "Core/Core.h"
+#include "Core/VolumeIntegrator.h"
+#include "Core/Volume.h"
+#include "Core/Scene.h"
+
+/*
+ * Single scattering integrator for heterogeneous media, driven by the
+ * majorants of the volume segments instead of fixed steps. Tentative
+ * collisions are sampled against the majorant: the first real collision
+ * (delta tracking) estimates in-scattering, while ratio tracking over all
+ * the collisions estimates transmittance and emission.
+ */
+class DeltaTrackingIntegrator : public VolumeIntegrator {
+public:
+    
+    static std::shared_ptr<DeltaTrackingIntegrator> Load(const rapidjson::Value& value);
+    
+    DeltaTrackingIntegrator();
+    virtual ~DeltaTrackingIntegrator();
+    
+    virtual Spectrum li(const Scene& scene, const Renderer& renderer,
+                        const Ray& ray, Spectrum *t) const;
+    virtual Spectrum transmittance(const Scene& scene, const Renderer& renderer,
+                                   const Ray& ray) const;
+    
+private:
+    // Rate used to sample tentative collisions in a segment
+    static float _GetMajorant(const Volume* volume, const Volume::Segment& segment);
+    
+    Spectrum _scatteredLight(const Scene& scene, const Renderer& renderer, const Volume* volume,
+                             const Ray& ray, const vec3& p) const;
+};
+
+#endif /* defined(__CSE168_Rendering__DeltaTrackingIntegrator__) */
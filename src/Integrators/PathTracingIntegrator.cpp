@@ -18,10 +18,20 @@
 std::shared_ptr<PathTracingIntegrator> PathTracingIntegrator::Load(const rapidjson::Value& value) {
     std::shared_ptr<PathTracingIntegrator> integrator = std::make_shared<PathTracingIntegrator>();
     
+    if (value.IsObject()) {
+        if (value.HasMember("russianRouletteDepth")) {
+            integrator->setRussianRouletteDepth(value["russianRouletteDepth"].GetInt());
+        }
+        if (value.HasMember("mis")) {
+            integrator->setUseMIS(value["mis"].GetBool());
+        }
+    }
+    
     return integrator;
 }
 
-PathTracingIntegrator::PathTracingIntegrator() : SurfaceIntegrator() {
+PathTracingIntegrator::PathTracingIntegrator() : SurfaceIntegrator(),
+_russianRouletteDepth(3), _useMIS(true) {
     
 }
 
@@ -29,44 +39,114 @@ PathTracingIntegrator::~PathTracingIntegrator() {
     
 }
 
+void PathTracingIntegrator::setRussianRouletteDepth(uint_t depth) {
+    _russianRouletteDepth = depth;
+}
+
+void PathTracingIntegrator::setUseMIS(bool useMIS) {
+    _useMIS = useMIS;
+}
+
 Spectrum PathTracingIntegrator::li(const Scene& scene, const Renderer& renderer, const Ray& ray,
                                    const Intersection& intersection) const {
     Spectrum l(0.f);
+    Spectrum throughput(1.f);
+    Ray pathRay(ray);
+    Intersection isec(intersection);
     
-    // If primitive is an area light, simply return its emited light
-    AreaLight* areaLight = intersection.primitive->getAreaLight();
-    if (areaLight) {
-        if (ray.type == Ray::DiffuseReflected) {
-            return l;
-        }
-        return areaLight->le(ray, &intersection);
-    }
-    
-    l += GetDirectLighting(scene, renderer, ray, intersection);
+    // Density of the BSDF sample that led to the current vertex, 0 after a specular bounce
+    float bsdfPdf = 0.f;
+    vec3 previousPoint, previousNormal;
     
-    // Sample BSDF to integrate indirect illumination
-    if (ray.depth < _maxRayDepth) {
+    for (uint_t bounces = 0; ; ++bounces) {
+        // Add light emitted by area lights: fully if it can't be sampled by the direct
+        // lighting, with the MIS weight otherwise
+        AreaLight* areaLight = isec.primitive->getAreaLight();
+        if (areaLight) {
+            Spectrum le = areaLight->le(pathRay, &isec);
+            if (bounces == 0 || bsdfPdf == 0.f) {
+                l += throughput * le;
+            } else if (_useMIS) {
+                int lightSamplesCount = areaLight->getSamplingConfig().count;
+                float lightPdf = areaLight->pdfL(previousPoint, pathRay.direction)
+                * getLightSelectionPdf(previousPoint, previousNormal, areaLight);
+                l += throughput * le * PowerHeuristic(1, bsdfPdf,
+                                                      lightSamplesCount*lightSamplesCount,
+                                                      lightPdf);
+            }
+            break;
+        }
         
+        l += throughput * getDirectLighting(scene, renderer, pathRay, isec, _useMIS);
+        
+        if (pathRay.depth >= (int)_maxRayDepth) {
+            break;
+        }
+        
+        // Sample BSDF to find the next path vertex
+        vec3 wo = -pathRay.direction;
         vec3 wi;
         Material::BxDFType type;
-        Spectrum f = intersection.material->sampleBSDF(-ray.direction, &wi, intersection,
-                                                       Material::BSDFAll, &type);
-        if (!f.isBlack()) {
-            Ray reflectedRay(ray);
-            
-            reflectedRay.origin = intersection.point;
-            reflectedRay.direction = wi;
-            reflectedRay.tmin = intersection.rayEpsilon;
-            reflectedRay.tmax = INFINITY;
-            reflectedRay.depth = ray.depth + 1;
-            reflectedRay.type = ((type & Material::BSDFDiffuse) ?
-                                 Ray::DiffuseReflected : Ray::SpecularReflected);
-            Spectrum li = renderer.li(scene, reflectedRay);
-            
-            l += f * li;
+        Spectrum f = isec.material->sampleBSDF(wo, &wi, isec, Material::BSDFAll, &type);
+        if (f.isBlack()) {
+            break;
         }
+        bsdfPdf = ((type & (Material::BSDFDiffuse | Material::BSDFGlossy)) ?
+                   isec.material->pdfBSDF(wo, wi, isec) : 0.f);
+        throughput *= f;
+        
+        // Randomly terminate paths that won't contribute much
+        if (bounces >= _russianRouletteDepth) {
+            float continueProbability = glm::min(1.f, throughput.luminance());
+            if ((float)rand()/RAND_MAX >= continueProbability) {
+                break;
+            }
+            throughput *= 1.f / continueProbability;
+        }
+        
+        previousPoint = isec.point;
+        previousNormal = dot(isec.normal, wo) < 0 ? -isec.normal : isec.normal;
+        pathRay.origin = isec.point;
+        pathRay.direction = wi;
+        pathRay.tmin = isec.rayEpsilon;
+        pathRay.tmax = INFINITY;
+        pathRay.depth += 1;
+        pathRay.hasDifferentials = false;
+        pathRay.type = ((type & Material::BSDFDiffuse) ?
+                        Ray::DiffuseReflected : Ray::SpecularReflected);
+        pathRay.nonDeltaBounce = (bsdfPdf > 0.f);
         
+        isec = Intersection();
+        bool hit = scene.intersect(pathRay, &isec);
+        
+        // Compute light coming from participating media along the new segment
+        Spectrum t;
+        Spectrum lv = renderer.volumeLi(scene, pathRay, &t);
+        l += throughput * lv;
+        throughput *= t;
+        
+        // Handle ray that doesn't intersect any geometry
+        if (!hit) {
+            for (Light* light : scene.getLights()) {
+                Spectrum le = light->le(pathRay);
+                float lightPdf = light->pdfL(previousPoint, pathRay.direction)
+                * getLightSelectionPdf(previousPoint, previousNormal, light);
+                if (bsdfPdf > 0.f && lightPdf > 0.f) {
+                    // Without MIS, direct lighting already accounts for this light
+                    if (!_useMIS) {
+                        continue;
+                    }
+                    int lightSamplesCount = light->getSamplingConfig().count;
+                    le *= PowerHeuristic(1, bsdfPdf, lightSamplesCount*lightSamplesCount,
+                                         lightPdf);
+                }
+                l += throughput * le;
+            }
+            break;
+        }
+        
+        isec.applyNormalMapping();
     }
     
     return l;
-}
\ No newline at end of file
+}
@@ -20,8 +20,15 @@ public:
     PathTracingIntegrator();
     virtual ~PathTracingIntegrator();
     
+    void setRussianRouletteDepth(uint_t depth);
+    void setUseMIS(bool useMIS);
+    
     virtual Spectrum li(const Scene& scene, const Renderer& renderer, const Ray& ray,
                         const Intersection& Intersection) const;
+    
+private:
+    uint_t  _russianRouletteDepth;
+    bool    _useMIS;
 };
 
 #endif /* defined(__CSE168_Rendering__PathTracingIntegrator__) */
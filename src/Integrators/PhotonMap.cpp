@@ -0,0 +1,163 @@
+//
+//  PhotonMap.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/6/14.
+//
+//
+
+#include "PhotonMap.h"
+
+#include <algorithm>
+
+#include "Core/AABB.h"
+
+static const char       PhotonMapFileMagic[4] = {'P', 'M', 'A', 'P'};
+static const uint32_t   PhotonMapFileVersion = 1;
+
+PhotonMap::PhotonMap() : _storage(), _file(), _nodes(nullptr), _nodesCount(0) {
+}
+
+PhotonMap::~PhotonMap() {
+    _clear();
+}
+
+void PhotonMap::_clear() {
+    if (_file.isOpen()) {
+        _file.close();
+    }
+    _storage.clear();
+    _nodes = nullptr;
+    _nodesCount = 0;
+}
+
+void PhotonMap::build(std::vector<Node>& photons) {
+    _clear();
+    _storage.swap(photons);
+    _nodes = _storage.data();
+    _nodesCount = _storage.size();
+    if (_nodesCount > 0) {
+        _buildNode(0, _nodesCount);
+    }
+}
+
+void PhotonMap::_buildNode(uint_t start, uint_t end) {
+    // Compute photons bounding box
+    AABB bbox;
+    for (uint_t i = start; i < end; ++i) {
+        bbox = AABB::Union(bbox, _storage[i].position);
+    }
+    int splitDim = bbox.getMaxDimension();
+    // Split photons along the median, the median photon becomes the node
+    uint_t mid = (start + end)/2;
+    std::nth_element(_storage.begin() + start, _storage.begin() + mid, _storage.begin() + end,
+                     [&] (const Node& a, const Node& b) {
+        return a.position[splitDim] < b.position[splitDim];
+    });
+    _storage[mid].splitDim = splitDim;
+    // Recurse on sub-parts if necessary
+    if (mid - start > 0) {
+        _buildNode(start, mid);
+    }
+    if (end - (mid+1) > 0) {
+        _buildNode(mid+1, end);
+    }
+}
+
+bool PhotonMap::save(const std::string& filename, uint64_t key) const {
+    QFile file(filename.c_str());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "PhotonMap error: cannot write file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+    FileHeader header;
+    std::copy(PhotonMapFileMagic, PhotonMapFileMagic + 4, header.magic);
+    header.version = PhotonMapFileVersion;
+    header.key = key;
+    header.nodesCount = _nodesCount;
+    qint64 nodesSize = sizeof(Node) * _nodesCount;
+    if (file.write((const char*)&header, sizeof(header)) != sizeof(header)
+        || file.write((const char*)_nodes, nodesSize) != nodesSize) {
+        std::cerr << "PhotonMap error: cannot write file \"" << filename << "\"" << std::endl;
+        file.close();
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+bool PhotonMap::load(const std::string& filename, uint64_t key) {
+    _clear();
+
+    _file.setFileName(filename.c_str());
+    if (!_file.exists() || !_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    // Check the header before mapping the photons
+    FileHeader header;
+    if (_file.read((char*)&header, sizeof(header)) != sizeof(header)
+        || !std::equal(PhotonMapFileMagic, PhotonMapFileMagic + 4, header.magic)
+        || header.version != PhotonMapFileVersion || header.key != key
+        || (qint64)(sizeof(header) + sizeof(Node) * header.nodesCount) != _file.size()) {
+        _clear();
+        return false;
+    }
+    if (header.nodesCount == 0) {
+        return true;
+    }
+    uchar* data = _file.map(sizeof(header), sizeof(Node) * header.nodesCount);
+    if (!data) {
+        std::cerr << "PhotonMap error: cannot map file \"" << filename << "\"" << std::endl;
+        _clear();
+        return false;
+    }
+    _nodes = (const Node*)data;
+    _nodesCount = header.nodesCount;
+    return true;
+}
+
+uint_t PhotonMap::size() const {
+    return _nodesCount;
+}
+
+bool PhotonMap::SearchNodeComparator::operator()(const SearchNode &n1, const SearchNode &n2) {
+    return n1.first < n2.first;
+}
+
+void PhotonMap::findNearestPhotons(const vec3& p, uint_t maxCount,
+                                   SearchQueue& queue, float& maxDist) const {
+    if (_nodesCount > 0) {
+        _findNearestPhotons(p, maxCount, queue, 0, _nodesCount, maxDist);
+    }
+}
+
+void PhotonMap::_findNearestPhotons(const vec3& p, uint_t maxCount, SearchQueue& queue,
+                                    uint_t start, uint_t end, float& maxDist) const {
+    if (start >= end) {
+        return;
+    }
+    uint_t mid = (start + end)/2;
+    const Node* node = &_nodes[mid];
+    float planeDist = p[node->splitDim] - node->position[node->splitDim];
+    if (planeDist < 0) {
+        _findNearestPhotons(p, maxCount, queue, start, mid, maxDist);
+        if (planeDist*planeDist < maxDist) {
+            _findNearestPhotons(p, maxCount, queue, mid+1, end, maxDist);
+        }
+    } else {
+        _findNearestPhotons(p, maxCount, queue, mid+1, end, maxDist);
+        if (planeDist*planeDist < maxDist) {
+            _findNearestPhotons(p, maxCount, queue, start, mid, maxDist);
+        }
+    }
+    float d2 = dot(node->position - p, node->position - p);
+    if (d2 < maxDist) {
+        queue.push(std::make_pair(d2, node));
+        if (queue.size() > maxCount) {
+            queue.pop();
+        }
+        if (queue.size() == maxCount) {
+            maxDist = queue.top().first;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+//
+//  PhotonMap.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/6/14.
+//
+//
+
+#ifndef __CSE168_Rendering__PhotonMap__
+#define __CSE168_Rendering__PhotonMap__
+
+#include <vector>
+#include <queue>
+
+#include <QFile>
+
+#include "Core/Core.h"
+
+/*
+ * Photon kd-tree stored as a flat array: the node of the range [start, end)
+ * is stored at (start+end)/2 and its children are the ranges on each side,
+ * so the map can be written as is to a file and memory-mapped back.
+ */
+class PhotonMap {
+public:
+
+    struct Node {
+        vec3        position;
+        vec3        direction;
+        vec3        power;
+        uint32_t    splitDim;
+    };
+
+    typedef std::pair<float, const Node*> SearchNode;
+
+    class SearchNodeComparator {
+    public:
+        bool operator()(const SearchNode& n1, const SearchNode& n2);
+    };
+
+    typedef std::priority_queue
+    <SearchNode, std::vector<SearchNode>, SearchNodeComparator> SearchQueue;
+
+    PhotonMap();
+    ~PhotonMap();
+
+    // Build the kd-tree from the given photons (reordered in place)
+    void build(std::vector<Node>& photons);
+
+    bool save(const std::string& filename, uint64_t key) const;
+    bool load(const std::string& filename, uint64_t key);
+
+    uint_t  size() const;
+    void    findNearestPhotons(const vec3& p, uint_t maxCount,
+                               SearchQueue& queue, float& maxDist) const;
+
+private:
+    struct FileHeader {
+        char        magic[4];
+        uint32_t    version;
+        uint64_t    key;
+        uint64_t    nodesCount;
+    };
+
+    void _clear();
+    void _buildNode(uint_t start, uint_t end);
+    void _findNearestPhotons(const vec3& p, uint_t maxCount, SearchQueue& queue,
+                             uint_t start, uint_t end, float& maxDist) const;
+
+    std::vector<Node>   _storage;
+    QFile               _file;
+    const Node*         _nodes;
+    uint_t              _nodesCount;
+};
+
+#endif /* defined(__CSE168_Rendering__PhotonMap__) */
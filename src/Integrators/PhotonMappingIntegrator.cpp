@@ -7,12 +7,22 @@
 //
 
 #include <thread>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <QDir>
 
 #include "PhotonMappingIntegrator.h"
 
 #include "Core/Material.h"
 #include "Core/Scene.h"
 #include "Core/Renderer.h"
+#include "Core/AABB.h"
+#include "Core/TransformedPrimitive.h"
+
+// Number of photons emitted together, their rays are sorted before each bounce
+static const uint_t PhotonBatchSize = 1024;
 
 std::shared_ptr<PhotonMappingIntegrator> PhotonMappingIntegrator::Load(const rapidjson::Value& value) {
     std::shared_ptr<PhotonMappingIntegrator> integrator = std::make_shared<PhotonMappingIntegrator>();
@@ -43,25 +53,35 @@ std::shared_ptr<PhotonMappingIntegrator> PhotonMappingIntegrator::Load(const rap
         integrator->setSearchRadius(value["searchCount"].GetInt());
     }
     
-    return integrator;
-}
-
-PhotonMappingIntegrator::PhotonMapNode::PhotonMapNode() : photon(), left(nullptr), right(nullptr) {
-}
-
-PhotonMappingIntegrator::PhotonMapNode::~PhotonMapNode() {
-    if (left) {
-        delete left;
-    }
-    if (right) {
-        delete right;
+    if (value.HasMember("photonMapCache")) {
+        const rapidjson::Value& cache = value["photonMapCache"];
+        if (cache.HasMember("directory")) {
+            integrator->setCacheDirectory(cache["directory"].GetString());
+        }
+        if (cache.HasMember("reuse")) {
+            std::string reuse = cache["reuse"].GetString();
+            std::transform(reuse.begin(), reuse.end(), reuse.begin(), ::tolower);
+            if (reuse == "none") {
+                integrator->setReusePolicy(NoReuse);
+            } else if (reuse == "all") {
+                integrator->setReusePolicy(ReuseAll);
+            } else if (reuse == "global") {
+                integrator->setReusePolicy(ReuseGlobal);
+            } else {
+                std::cerr << "PhotonMappingIntegrator warning: unknown reuse policy \""
+                << reuse << "\"" << std::endl;
+            }
+        }
     }
+    
+    return integrator;
 }
 
 PhotonMappingIntegrator::PhotonMappingIntegrator() :
-_globalMap(nullptr), _causticsMap(nullptr),
+_globalMap(), _causticsMap(), _globalMapKey(0), _causticsMapKey(0),
 _globalPhotonsCount(1e6), _causticsPhotonsCount(1e6),
-_searchRadius(sqrt(0.0001f)), _searchCount(500) {
+_searchRadius(sqrt(0.0001f)), _searchCount(500),
+_reusePolicy(NoReuse), _cacheDirectory() {
 }
 
 void PhotonMappingIntegrator::setGlobalPhotonsCount(uint_t count) {
@@ -80,32 +100,149 @@ void PhotonMappingIntegrator::setSearchCount(uint_t count) {
     _searchCount = count;
 }
 
+void PhotonMappingIntegrator::setReusePolicy(ReusePolicy policy) {
+    _reusePolicy = policy;
+}
+
+void PhotonMappingIntegrator::setCacheDirectory(const std::string& directory) {
+    _cacheDirectory = directory;
+    if (!_cacheDirectory.empty() && _cacheDirectory[_cacheDirectory.size()-1] != '/') {
+        _cacheDirectory += '/';
+    }
+}
+
 PhotonMappingIntegrator::~PhotonMappingIntegrator() {
-    if (_globalMap) {
-        delete _globalMap;
+}
+
+void PhotonMappingIntegrator::preprocess(const Scene& scene, const Camera* camera, const Renderer& renderer) {
+    SurfaceIntegrator::preprocess(scene, camera, renderer);
+    
+    _updatePhotonMap(scene, camera, renderer, &_globalMap, &_globalMapKey,
+                     _globalPhotonsCount, false, _reusePolicy != NoReuse);
+    _updatePhotonMap(scene, camera, renderer, &_causticsMap, &_causticsMapKey,
+                     _causticsPhotonsCount, true, _reusePolicy == ReuseAll);
+}
+
+void PhotonMappingIntegrator::_updatePhotonMap(const Scene& scene, const Camera* camera,
+                                               const Renderer& renderer,
+                                               PhotonMap* map, uint64_t* mapKey,
+                                               uint_t photonsCount, bool isCausticMap,
+                                               bool reuse) {
+    uint64_t key = _getPhotonMapKey(scene, photonsCount, isCausticMap);
+    std::string filename = _getCacheFilename(key);
+    
+    if (reuse) {
+        // Keep the map built by a previous frame
+        if (*mapKey == key) {
+            return;
+        }
+        // Or map the one saved by a previous run
+        if (!filename.empty() && map->load(filename, key)) {
+            qDebug() << "Loaded" << map->size() << (isCausticMap ? "caustics" : "global")
+            << "photons from" << filename.c_str();
+            *mapKey = key;
+            return;
+        }
     }
-    if (_causticsMap) {
-        delete _causticsMap;
+    
+    _generatePhotonMap(scene, camera, renderer, map, photonsCount, isCausticMap);
+    *mapKey = key;
+    
+    if (reuse && !filename.empty()) {
+        map->save(filename, key);
     }
 }
 
-void PhotonMappingIntegrator::preprocess(const Scene& scene, const Camera* camera, const Renderer& renderer) {
-    // Cleanup any previous state
-    if (_globalMap) {
-        delete _globalMap;
+uint64_t PhotonMappingIntegrator::_getPhotonMapKey(const Scene& scene, uint_t photonsCount,
+                                                   bool isCausticMap) const {
+    uint64_t key = Core::hash(&photonsCount, sizeof(photonsCount));
+    key = Core::hash(&isCausticMap, sizeof(isCausticMap), key);
+    
+    AABB bounds = scene.getAggregate()->getBoundingBox();
+    key = Core::hash(&bounds.min, sizeof(bounds.min), key);
+    key = Core::hash(&bounds.max, sizeof(bounds.max), key);
+    
+    // Fingerprint the geometry by the bounds of each primitive, in world and
+    // object space
+    std::vector<std::shared_ptr<Primitive>> primitives = scene.getAggregate()->getPrimitives();
+    uint64_t primitivesCount = primitives.size();
+    key = Core::hash(&primitivesCount, sizeof(primitivesCount), key);
+    for (const std::shared_ptr<Primitive>& primitive : primitives) {
+        AABB box = primitive->getBoundingBox();
+        key = Core::hash(primitive->getName().data(), primitive->getName().size(), key);
+        key = Core::hash(&box.min, sizeof(box.min), key);
+        key = Core::hash(&box.max, sizeof(box.max), key);
+        const TransformedPrimitive* tp = dynamic_cast<const TransformedPrimitive*>(primitive.get());
+        if (tp && tp->getPrimitive()) {
+            box = tp->getPrimitive()->getBoundingBox();
+            key = Core::hash(&box.min, sizeof(box.min), key);
+            key = Core::hash(&box.max, sizeof(box.max), key);
+        }
     }
-    if (_causticsMap) {
-        delete _causticsMap;
+    
+    // Fingerprint the materials by evaluating them at fixed directions
+    Intersection isec;
+    isec.normal = vec3(0.f, 0.f, 1.f);
+    isec.tangentU = vec3(1.f, 0.f, 0.f);
+    isec.tangentV = vec3(0.f, 1.f, 0.f);
+    isec.uv = vec2(0.5f);
+    const vec3 directions[3] = {
+        vec3(0.f, 0.f, 1.f), normalize(vec3(1.f, 0.f, 1.f)), normalize(vec3(-1.f, 1.f, -1.f))
+    };
+    for (const auto& entry : scene.getMaterials()) {
+        const Material* material = entry.second.get();
+        key = Core::hash(entry.first.data(), entry.first.size(), key);
+        Material::BxDFType bsdfType = material->getBSDFType();
+        key = Core::hash(&bsdfType, sizeof(bsdfType), key);
+        for (const vec3& wo : directions) {
+            for (const vec3& wi : directions) {
+                vec3 f = material->evaluateBSDF(wo, wi, isec).getColor();
+                key = Core::hash(&f, sizeof(f), key);
+            }
+        }
+        vec3 transmitted = material->transmittedLight(1.f).getColor();
+        key = Core::hash(&transmitted, sizeof(transmitted), key);
     }
     
-    // Generate maps
-    _globalMap = _generatePhotonMap(scene, camera, renderer, _globalPhotonsCount, false);
-    _causticsMap = _generatePhotonMap(scene, camera, renderer, _causticsPhotonsCount, true);
+    // Lights have no common description, so fingerprint them by sampling them
+    // from fixed points of the scene bounds
+    vec3 center = (bounds.min + bounds.max) * 0.5f;
+    vec3 probes[9] = {center};
+    for (int i = 0; i < 8; ++i) {
+        probes[i+1] = vec3((i & 1) ? bounds.max.x : bounds.min.x,
+                           (i & 2) ? bounds.max.y : bounds.min.y,
+                           (i & 4) ? bounds.max.z : bounds.min.z);
+    }
+    for (const Light* light : scene.getLights()) {
+        for (const vec3& probe : probes) {
+            vec3 wi;
+            VisibilityTester vt((Ray()));
+            vec3 li = light->sampleL(probe, 0.f, LightSample(0.5f, 0.5f), &wi, &vt).getColor();
+            key = Core::hash(&li, sizeof(li), key);
+            key = Core::hash(&wi, sizeof(wi), key);
+        }
+    }
+    return key;
 }
 
-PhotonMappingIntegrator::PhotonMapNode*
-PhotonMappingIntegrator::_generatePhotonMap(const Scene& scene, const Camera*, const Renderer& renderer,
-                                            uint_t photonsCount, bool isCausticMap) {
+std::string PhotonMappingIntegrator::_getCacheFilename(uint64_t key) const {
+    if (_cacheDirectory.empty()) {
+        return std::string();
+    }
+    std::string directory = _cacheDirectory;
+    if (directory[0] != '/') {
+        directory = Core::baseDirectory + directory;
+    }
+    QDir().mkpath(directory.c_str());
+    
+    std::ostringstream filename;
+    filename << directory << std::hex << std::setw(16) << std::setfill('0') << key << ".photons";
+    return filename.str();
+}
+
+void PhotonMappingIntegrator::_generatePhotonMap(const Scene& scene, const Camera*,
+                                                 const Renderer& renderer, PhotonMap* map,
+                                                 uint_t photonsCount, bool isCausticMap) {
     std::vector<Photon> photons;
     photons.reserve(photonsCount);
     
@@ -117,12 +254,8 @@ PhotonMappingIntegrator::_generatePhotonMap(const Scene& scene, const Camera*, c
         photons.insert(photons.end(), lightPhotons.begin(), lightPhotons.end());
     }
     
-    if (photons.size() == 0) {
-        return nullptr;
-    }
-    
     // Build photon map
-    return _buildPhotonMapNode(photons, 0, photons.size());
+    map->build(photons);
 }
 
 void PhotonMappingIntegrator::_traceLightPhotons(const Scene& scene, const Renderer& renderer,
@@ -163,11 +296,26 @@ void PhotonMappingIntegrator::_traceLightPhotons(const Scene& scene, const Rende
 }
 
 void PhotonMappingIntegrator::TraceLightPhotonsTask::run() {
+    AABB sceneBounds = scene->getAggregate()->getBoundingBox();
+    RayQueue rays;
+    std::vector<Spectrum> powers;
+    
     while (photons.size() < photonsCount) {
-        Ray photonRay;
-        Spectrum power = light->samplePhoton(&photonRay.origin, &photonRay.direction);
-        ++nbPhotonsTraced;
-        integrator->_tracePhoton(*scene, photonRay, power, &photons, photonsCount, isCausticMap);
+        // Emit a batch of photons from the light
+        uint_t batchSize = std::min(PhotonBatchSize, photonsCount - (uint_t)photons.size());
+        rays.clear();
+        powers.clear();
+        for (uint_t i = 0; i < batchSize; ++i) {
+            Ray photonRay;
+            photonRay.depth = 0;
+            powers.push_back(light->samplePhoton(&photonRay.origin, &photonRay.direction));
+            rays.push(photonRay);
+        }
+        nbPhotonsTraced += batchSize;
+        
+        // The whole batch is traced, even if it overfills the map, so that no
+        // paths are cut off depending on their position in the sort order
+        integrator->_tracePhotons(*scene, sceneBounds, rays, powers, &photons, isCausticMap);
         
         // If no photons are stored after a lot has been thrown, break to prevent infinite loop
         if (photons.size() == 0 && nbPhotonsTraced > photonsCount) {
@@ -176,93 +324,85 @@ void PhotonMappingIntegrator::TraceLightPhotonsTask::run() {
     }
 }
 
-void PhotonMappingIntegrator::_tracePhoton(const Scene& scene, const Ray &ray, const Spectrum &power,
-                                           std::vector<Photon>* photons, uint_t photonsCount,
-                                           bool isCausticMap) const {
-    Spectrum photonPower = power;
-    Ray photonRay = ray;
-    photonRay.depth = 0;
-    Intersection isec;
+void PhotonMappingIntegrator::_tracePhotons(const Scene& scene, const AABB& sceneBounds,
+                                            RayQueue& rays, std::vector<Spectrum>& powers,
+                                            std::vector<Photon>* photons,
+                                            bool isCausticMap) const {
+    std::vector<uint_t> order;
+    std::vector<uint_t> bounced;
     
-    while (scene.intersect(photonRay, &isec)) {
-        // Update intersection normal
-        isec.applyNormalMapping();
-        
-        // Sample bsdf
-        vec3 wi;
-        Material::BxDFType type;
-        Spectrum f = isec.material->sampleBSDF(-photonRay.direction, &wi, isec, Material::BSDFAll,
-                                               &type);
+    while (rays.size() > 0) {
+        // Sort photon rays so that consecutive rays traverse the same BVH nodes
+        rays.getSortOrder(sceneBounds, &order);
+        rays.gather(order);
+        RayQueue::Gather(powers, order);
         
-        // If we are generating caustics map, break if we hit a diffuse surface
-        if (isCausticMap) {
-            if (type & Material::BSDFDiffuse) {
-                if (photonRay.depth > 0) {
-                    Photon p;
-                    p.position = isec.point;
-                    p.direction = normalize(-photonRay.direction);
-                    p.power = photonPower;
-                    photons->push_back(p);
-                }
-                break;
-            }
-        } else {
-            // Add a photon if we hit a diffuse surface
-            if (type & Material::BSDFDiffuse) {
-                Photon p;
-                p.position = isec.point;
-                p.direction = normalize(-photonRay.direction);
-                p.power = photonPower;
-                photons->push_back(p);
+        bounced.clear();
+        for (uint_t i = 0; i < rays.size(); ++i) {
+            Ray photonRay = rays.getRay(i);
+            if (_scatterPhoton(scene, &photonRay, &powers[i], photons, isCausticMap)) {
+                rays.setRay(i, photonRay);
+                bounced.push_back(i);
             }
         }
-
-        // Stop tracing if we filled photon map
-        if (photons->size() >= photonsCount) {
-            break;
-        }
         
-        // Bounce
-        if (!f.isBlack() && photonRay.depth < 5) {
-            photonRay.origin = isec.point;
-            photonRay.direction = wi;
-            photonRay.tmin = isec.rayEpsilon;
-            photonRay.tmax = INFINITY;
-            photonRay.depth += 1;
-            photonPower *= f;
-            isec = Intersection();
-        } else {
-            break;
-        }
+        // Keep photons that bounced
+        rays.gather(bounced);
+        RayQueue::Gather(powers, bounced);
     }
 }
 
-PhotonMappingIntegrator::PhotonMapNode*
-PhotonMappingIntegrator::_buildPhotonMapNode(std::vector<Photon> &photons, uint_t start, uint_t end) const {
-    PhotonMapNode* node = new PhotonMapNode();
-    
-    // Compute photons bounding box
-    AABB bbox;
-    for (uint_t i = start; i < end; ++i) {
-        bbox = AABB::Union(bbox, photons[i].position);
+bool PhotonMappingIntegrator::_scatterPhoton(const Scene& scene, Ray* photonRay, Spectrum* power,
+                                             std::vector<Photon>* photons,
+                                             bool isCausticMap) const {
+    Intersection isec;
+    if (!scene.intersect(*photonRay, &isec)) {
+        return false;
     }
-    int splitDim = bbox.getMaxDimension();
-    // Split photons along the median
-    int mid = (start + end)/2;
-    std::nth_element(&photons[start], &photons[mid], &photons[end], [&] (const Photon& a, const Photon& b) {
-        return a.position[splitDim] < b.position[splitDim];
-    });
-    // Store photon in current node
-    node->photon = photons[mid];
-    node->splitDim = splitDim;
-    // Recurse on sub-parts if necessary
-    if (mid - start > 0) {
-        node->left = _buildPhotonMapNode(photons, start, mid);
+    
+    // Update intersection normal
+    isec.applyNormalMapping();
+    
+    // Sample bsdf
+    vec3 wi;
+    Material::BxDFType type;
+    Spectrum f = isec.material->sampleBSDF(-photonRay->direction, &wi, isec, Material::BSDFAll,
+                                           &type);
+    
+    // If we are generating caustics map, stop if we hit a diffuse surface
+    if (isCausticMap) {
+        if (type & Material::BSDFDiffuse) {
+            if (photonRay->depth > 0) {
+                Photon p;
+                p.position = isec.point;
+                p.direction = normalize(-photonRay->direction);
+                p.power = power->getColor();
+                photons->push_back(p);
+            }
+            return false;
+        }
+    } else {
+        // Add a photon if we hit a diffuse surface
+        if (type & Material::BSDFDiffuse) {
+            Photon p;
+            p.position = isec.point;
+            p.direction = normalize(-photonRay->direction);
+            p.power = power->getColor();
+            photons->push_back(p);
+        }
     }
-    if (end - (mid+1) > 0) {
-        node->right = _buildPhotonMapNode(photons, mid+1, end);
+    
+    // Bounce
+    if (!f.isBlack() && photonRay->depth < 5) {
+        photonRay->origin = isec.point;
+        photonRay->direction = wi;
+        photonRay->tmin = isec.rayEpsilon;
+        photonRay->tmax = INFINITY;
+        photonRay->depth += 1;
+        *power *= f;
+        return true;
     }
-    return node;
+    return false;
 }
 
 Spectrum PhotonMappingIntegrator::li(const Scene& scene, const Renderer& renderer, const Ray& ray,
@@ -297,8 +437,10 @@ Spectrum PhotonMappingIntegrator::li(const Scene& scene, const Renderer& rendere
     reflectedRay.tmin = intersection.rayEpsilon;
     reflectedRay.tmax = INFINITY;
     reflectedRay.depth = ray.depth + 1;
+    reflectedRay.hasDifferentials = false;
     reflectedRay.type = (Ray::Type)(ray.type | ((type & Material::BSDFDiffuse) ?
                                                 Ray::DiffuseReflected : Ray::SpecularReflected));
+    reflectedRay.nonDeltaBounce = ((type & (Material::BSDFDiffuse | Material::BSDFGlossy)) != 0);
     
     // Diffuse light from diffuse reflection: read in global photon map
     if ((ray.type & Ray::DiffuseReflected) && type == Material::BSDFDiffuse) {
@@ -306,7 +448,7 @@ Spectrum PhotonMappingIntegrator::li(const Scene& scene, const Renderer& rendere
     }
     
     // Compute direct illumination
-    l += GetDirectLighting(scene, renderer, ray, intersection);
+    l += getDirectLighting(scene, renderer, ray, intersection);
     
     // Get caustic light in photon map
     l += _getPhotonMapRadiance(intersection, ray, _causticsMap);
@@ -319,23 +461,23 @@ Spectrum PhotonMappingIntegrator::li(const Scene& scene, const Renderer& rendere
 
 Spectrum PhotonMappingIntegrator::_getPhotonMapRadiance(const Intersection& intersection,
                                                         const Ray& ray,
-                                                        const PhotonMapNode* photonMap) const {
+                                                        const PhotonMap& photonMap) const {
     Spectrum l(0.f);
     
     // Find nearest photons at intersection
-    PhotonMapSearchQueue queue;
+    PhotonMap::SearchQueue queue;
     float maxDist = _searchRadius*_searchRadius;
-    _findNearestPhotons(intersection.point, queue, photonMap, maxDist);
+    photonMap.findNearestPhotons(intersection.point, _searchCount, queue, maxDist);
 
     if (queue.size() == 0) {
         return Spectrum(0.f);
     }
 
     while (queue.size() > 0) {
-        const Photon& photon = queue.top().second->photon;
+        const Photon& photon = *queue.top().second;
         if (dot(photon.direction, intersection.normal) > 0) {
             Spectrum fr = intersection.material->evaluateBSDF(-ray.direction, photon.direction, intersection);
-            l += fr * photon.power;
+            l += fr * Spectrum(photon.power);
         }
         queue.pop();
     }
@@ -344,37 +486,3 @@ Spectrum PhotonMappingIntegrator::_getPhotonMapRadiance(const Intersection& inte
     
     return l;
 }
-
-bool PhotonMappingIntegrator::PhotonMapNodeComparator::operator()(const PhotonMapSearchNode &n1,
-                                                                  const PhotonMapSearchNode &n2) {
-    return n1.first < n2.first;
-}
-
-void PhotonMappingIntegrator::_findNearestPhotons(const vec3& p, PhotonMapSearchQueue& queue,
-                                                  const PhotonMapNode* node, float& maxDist) const {
-    if (node == nullptr) {
-        return;
-    }
-    float planeDist = p[node->splitDim] - node->photon.position[node->splitDim];
-    if (planeDist < 0) {
-        _findNearestPhotons(p, queue, node->left, maxDist);
-        if (planeDist*planeDist < maxDist) {
-            _findNearestPhotons(p, queue, node->right, maxDist);
-        }
-    } else {
-        _findNearestPhotons(p, queue, node->right, maxDist);
-        if (planeDist*planeDist < maxDist) {
-            _findNearestPhotons(p, queue, node->left, maxDist);
-        }
-    }
-    float d2 = dot(node->photon.position - p, node->photon.position - p);
-    if (d2 < maxDist) {
-        queue.push(std::make_pair(d2, node));
-        if (queue.size() > _searchCount) {
-            queue.pop();
-        }
-        if (queue.size() == _searchCount) {
-            maxDist = queue.top().first;
-        }
-    }
-}
\ No newline at end of file
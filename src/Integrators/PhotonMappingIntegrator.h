@@ -12,13 +12,19 @@
 #include "Core/Core.h"
 #include "Core/SurfaceIntegrator.h"
 #include "Core/Light.h"
-
-#include <queue>
-#include <mutex>
+#include "Core/RayQueue.h"
+#include "PhotonMap.h"
 
 class PhotonMappingIntegrator : public SurfaceIntegrator {
 public:
     
+    // Which photon maps may be reused across preprocess calls and runs
+    enum ReusePolicy {
+        NoReuse,        // Regenerate both maps on every preprocess
+        ReuseAll,       // Static lighting and geometry: reuse both maps
+        ReuseGlobal     // Reuse the global map, regenerate the caustics map
+    };
+    
     static std::shared_ptr<PhotonMappingIntegrator> Load(const rapidjson::Value& value);
     
     PhotonMappingIntegrator();
@@ -28,6 +34,11 @@ public:
     void setCausticsPhotonsCount(uint_t count);
     void setSearchRadius(float radius);
     void setSearchCount(uint_t count);
+    void setReusePolicy(ReusePolicy policy);
+    // Saved maps are keyed on the lights, the bounds of the scene primitives and
+    // the materials sampled at fixed directions. Edits these miss, like moving
+    // vertices inside the bounds of a mesh, need the cache directory cleared
+    void setCacheDirectory(const std::string& directory);
     
     virtual void preprocess(const Scene& scene, const Camera* camera,
                             const Renderer& renderer);
@@ -36,32 +47,7 @@ public:
                         const Intersection& Intersection) const;
     
 private:
-    struct Photon {
-        vec3        position;
-        vec3        direction;
-        Spectrum    power;
-    };
-    
-    struct PhotonMapNode {
-        PhotonMapNode();
-        ~PhotonMapNode();
-        
-        Photon          photon;
-        uint_t          splitDim;
-        PhotonMapNode*  left;
-        PhotonMapNode*  right;
-    };
-    
-    typedef std::pair<float, const PhotonMapNode*> PhotonMapSearchNode;
-    
-    class PhotonMapNodeComparator {
-    public:
-        bool operator()(const PhotonMapSearchNode& n1, const PhotonMapSearchNode& n2);
-    };
-    
-    typedef std::priority_queue
-    <PhotonMapSearchNode, std::vector<PhotonMapSearchNode>,
-    PhotonMapNodeComparator> PhotonMapSearchQueue;
+    typedef PhotonMap::Node Photon;
     
     class TraceLightPhotonsTask {
     public:
@@ -76,32 +62,40 @@ private:
         const PhotonMappingIntegrator*  integrator;
     };
     
-    PhotonMapNode* _generatePhotonMap(const Scene& scene, const Camera*,
-                                      const Renderer& renderer,
-                                      uint_t photonsCount, bool isCausticMap);
+    void _updatePhotonMap(const Scene& scene, const Camera* camera, const Renderer& renderer,
+                          PhotonMap* map, uint64_t* mapKey, uint_t photonsCount,
+                          bool isCausticMap, bool reuse);
+    void _generatePhotonMap(const Scene& scene, const Camera*,
+                            const Renderer& renderer, PhotonMap* map,
+                            uint_t photonsCount, bool isCausticMap);
+    
+    uint64_t    _getPhotonMapKey(const Scene& scene, uint_t photonsCount,
+                                 bool isCausticMap) const;
+    std::string _getCacheFilename(uint64_t key) const;
     
     void _traceLightPhotons(const Scene& scene, const Renderer& renderer,
                             const Light* light, std::vector<Photon>* photons,
                             int photonsCount, bool isCausticMap) const;
-    void _tracePhoton(const Scene& scene, const Ray& ray, const Spectrum& power,
-                      std::vector<Photon>* photons, uint_t photonsCount,
-                      bool isCausticMap) const;
-    
-    PhotonMapNode* _buildPhotonMapNode(std::vector<Photon>& photons,
-                                       uint_t start, uint_t end) const;
+    void _tracePhotons(const Scene& scene, const AABB& sceneBounds, RayQueue& rays,
+                       std::vector<Spectrum>& powers, std::vector<Photon>* photons,
+                       bool isCausticMap) const;
+    bool _scatterPhoton(const Scene& scene, Ray* photonRay, Spectrum* power,
+                        std::vector<Photon>* photons, bool isCausticMap) const;
     
     Spectrum    _getPhotonMapRadiance(const Intersection& intersection,
                                       const Ray& ray,
-                                      const PhotonMapNode* photonMap) const;
-    void        _findNearestPhotons(const vec3& p, PhotonMapSearchQueue& queue,
-                                    const PhotonMapNode* node, float& maxDist) const;
+                                      const PhotonMap& photonMap) const;
     
-    PhotonMapNode*      _globalMap;
-    PhotonMapNode*      _causticsMap;
+    PhotonMap           _globalMap;
+    PhotonMap           _causticsMap;
+    uint64_t            _globalMapKey;
+    uint64_t            _causticsMapKey;
     uint_t              _globalPhotonsCount;
     uint_t              _causticsPhotonsCount;
     float               _searchRadius;
     uint_t              _searchCount;
+    ReusePolicy         _reusePolicy;
+    std::string         _cacheDirectory;
 };
 
 #endif /* defined(__CSE168_Rendering__PhotonMappingIntegrator__) */
@@ -8,6 +8,9 @@
 
 #include "SingleScatteringIntegrator.h"
 
+#include <vector>
+#include <algorithm>
+
 #include "Core/Renderer.h"
 
 std::shared_ptr<SingleScatteringIntegrator> SingleScatteringIntegrator::Load(const rapidjson::Value& value) {
@@ -40,48 +43,66 @@ Spectrum SingleScatteringIntegrator::li(const Scene& scene, const Renderer& rend
     
     float tstart, tend;
     if (volume->intersectP(ray, &tstart, &tend)) {
-        float t0 = tstart + ((float)rand()/RAND_MAX)*stepSize;
-        float t1 = tstart;
-        while (t1 < tend) {
-            t1 = t0 + stepSize;
-            if (t1 > tend) {
-                break;
+        float tfirst = tstart + ((float)rand()/RAND_MAX)*stepSize;
+        
+        uint_t stepsCount = tend > tfirst ? (uint_t)((tend - tfirst) / stepSize) : 0;
+        
+        // Only march the steps falling in non-empty segments of the medium,
+        // empty steps would neither attenuate nor add any light
+        std::vector<Volume::Segment> segments;
+        volume->getSegments(ray, tstart, tend, segments);
+        std::vector<Volume::Sample> samples;
+        
+        for (const Volume::Segment& segment : segments) {
+            uint_t firstStep = (uint_t)std::max(0.f, ceilf((segment.t0 - tfirst) / stepSize));
+            uint_t endStep = (uint_t)std::max(0.f, ceilf((segment.t1 - tfirst) / stepSize));
+            endStep = std::min(endStep, stepsCount);
+            if (firstStep >= endStep) {
+                continue;
             }
-            vec3 p = ray(t0);
-            Ray stepRay = Ray(ray);
-            stepRay.tmin = t0;
-            stepRay.tmax = t1;
-            
-            // Compute transmission
-            Spectrum tau = volume->tau(stepRay);
-            tr *= Spectrum::exp(-tau);
             
-            // Add emitted light
-            lv += tr * stepSize * volume->le(p);
+            // Sample the medium for all the steps of the segment at once
+            samples.resize(endStep - firstStep);
+            volume->sampleSegment(ray, tfirst + firstStep*stepSize, stepSize, endStep - firstStep, samples.data());
             
-            // Compute radiance contribution from lights
-            Spectrum scattering = volume->sigmaS(p) * stepSize;
-            if (!scattering.isBlack()) {
-                for (Light* light : scene.getLights()) {
-                    VisibilityTester vt(stepRay);
-                    LightSample sample;
-                    sample.u = (float)rand()/RAND_MAX;
-                    sample.v = (float)rand()/RAND_MAX;
-                    
-                    vec3 wi;
-                    Spectrum li = light->sampleL(p, 0.f, sample, &wi, &vt);
-                    
-                    if (li.isBlack()) {
-                        continue;
+            for (uint_t step = firstStep; step < endStep; ++step) {
+                float t0 = tfirst + step*stepSize;
+                float t1 = t0 + stepSize;
+                const Volume::Sample& sample = samples[step - firstStep];
+                vec3 p = ray(t0);
+                Ray stepRay = Ray(ray);
+                stepRay.tmin = t0;
+                stepRay.tmax = t1;
+                
+                // Compute transmission
+                tr *= Spectrum::exp(-sample.sigmaT * stepSize);
+                
+                // Add emitted light
+                lv += tr * stepSize * sample.le;
+                
+                // Compute radiance contribution from lights
+                Spectrum scattering = sample.sigmaS * stepSize;
+                if (!scattering.isBlack()) {
+                    for (Light* light : scene.getLights()) {
+                        VisibilityTester vt(stepRay);
+                        LightSample lightSample;
+                        lightSample.u = (float)rand()/RAND_MAX;
+                        lightSample.v = (float)rand()/RAND_MAX;
+                        
+                        vec3 wi;
+                        Spectrum li = light->sampleL(p, 0.f, lightSample, &wi, &vt);
+                        
+                        if (li.isBlack()) {
+                            continue;
+                        }
+                        
+                        if (vt.unoccluded(scene, light)) {
+                            li *= scattering * vt.transmittance(scene, renderer);
+                            lv += tr * volume->phase(p, -wi, wo) * li;
+                        }
                     }
                     
-                    if (vt.unoccluded(scene)) {
-                        li *= scattering * vt.transmittance(scene, renderer);
-                        lv += tr * volume->phase(p, -wi, wo) * li;
-                    }
-                }
-                
-                // Multiple scattering
+                    // Multiple scattering
 //                if (ray.depth == 0) {
 //                    Ray scatteredRay(ray);
 //                    
@@ -101,9 +122,8 @@ Spectrum SingleScatteringIntegrator::li(const Scene& scene, const Renderer& rend
 //                    Spectrum scatteredL = renderer.li(scene, scatteredRay);
 //                    lv += tr * stepSize * volume->phase(p, -scatteredRay.direction, wo) * scatteredL;
 //                }
+                }
             }
-            
-            t0 = t1;
         }
     }
     
@@ -43,7 +43,7 @@ Spectrum WhittedIntegrator::li(const Scene& scene, const Renderer& renderer, con
     const vec3& n = intersection.normal;
     vec3 wo = -ray.direction;
     
-    l += GetDirectLighting(scene, renderer, ray, intersection);
+    l += getDirectLighting(scene, renderer, ray, intersection);
     
     // Trace rays for specular reflection and refraction
     if (ray.depth < _maxRayDepth) {
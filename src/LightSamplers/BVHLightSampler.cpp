@@ -0,0 +1,248 @@
+//
+//  BVHLightSampler.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/8/14.
+//
+//
+
+#include "BVHLightSampler.h"
+
+#include <algorithm>
+
+#include "Core/Scene.h"
+#include "Core/Light.h"
+
+static const float OneMinusEpsilon = 0.99999994f;
+
+BVHLightSampler::BVHLightSampler()
+: LightSampler(), _nodes(), _lights(), _infiniteLights(), _lightsLeaves() {
+    
+}
+
+BVHLightSampler::~BVHLightSampler() {
+    
+}
+
+void BVHLightSampler::preprocess(const Scene& scene) {
+    _nodes.clear();
+    _lights.clear();
+    _infiniteLights.clear();
+    _lightsLeaves.clear();
+    
+    std::vector<BuildLight> buildLights;
+    for (const Light* light : scene.getLights()) {
+        float power = light->power(scene).luminance();
+        if (power <= 0.f) {
+            continue;
+        }
+        LightBounds bounds;
+        if (light->getBounds(&bounds)) {
+            bounds.power = power;
+            buildLights.push_back(std::make_pair((int)_lights.size(), bounds));
+            _lights.push_back(light);
+        } else {
+            _infiniteLights.push_back(light);
+        }
+    }
+    
+    if (buildLights.size() > 0) {
+        _buildNode(buildLights, 0, buildLights.size(), -1);
+    }
+}
+
+float BVHLightSampler::_EvaluateCost(const LightBounds& b, const AABB& bounds, int dim) {
+    // Solid angle measure of the emission cone, widened by the spread angle
+    float thetaO = acos(glm::clamp(b.cosThetaO, -1.f, 1.f));
+    float thetaE = acos(glm::clamp(b.cosThetaE, -1.f, 1.f));
+    float thetaW = glm::min(thetaO + thetaE, (float)M_PI);
+    float sinThetaO = sin(thetaO);
+    float mOmega = 2.f*M_PI * (1.f - b.cosThetaO)
+    + M_PI/2.f * (2.f*thetaW*sinThetaO - cos(thetaO - 2.f*thetaW)
+                  - 2.f*thetaO*sinThetaO + b.cosThetaO);
+    
+    // Penalize thin splits
+    vec3 d = bounds.max - bounds.min;
+    float kr = glm::max(d.x, glm::max(d.y, d.z)) / d[dim];
+    
+    return b.power * mOmega * kr * b.bounds.surfaceArea();
+}
+
+int BVHLightSampler::_buildNode(std::vector<BuildLight>& buildLights, uint_t start, uint_t end,
+                                int parent) {
+    int nodeIndex = _nodes.size();
+    _nodes.push_back(Node());
+    _nodes[nodeIndex].parent = parent;
+    _nodes[nodeIndex].children[0] = -1;
+    _nodes[nodeIndex].children[1] = -1;
+    _nodes[nodeIndex].lightIndex = -1;
+    
+    // Create leaf
+    if (end - start == 1) {
+        _nodes[nodeIndex].bounds = buildLights[start].second;
+        _nodes[nodeIndex].lightIndex = buildLights[start].first;
+        _lightsLeaves[_lights[buildLights[start].first]] = nodeIndex;
+        return nodeIndex;
+    }
+    
+    // Compute bounds of the lights and of their centroids
+    AABB bounds, centroidBounds;
+    for (uint_t i = start; i < end; ++i) {
+        bounds = AABB::Union(bounds, buildLights[i].second.bounds);
+        centroidBounds = AABB::Union(centroidBounds, buildLights[i].second.getCentroid());
+    }
+    
+    // Find the cheapest split among buckets along every dimension
+    const int bucketsCount = 12;
+    float minCost = INFINITY;
+    int minCostDim = -1, minCostBucket = -1;
+    for (int dim = 0; dim < 3; ++dim) {
+        float extent = centroidBounds.max[dim] - centroidBounds.min[dim];
+        if (extent <= 0.f) {
+            continue;
+        }
+        LightBounds buckets[bucketsCount];
+        for (uint_t i = start; i < end; ++i) {
+            const LightBounds& b = buildLights[i].second;
+            int bucket = bucketsCount * ((b.getCentroid()[dim] - centroidBounds.min[dim]) / extent);
+            bucket = glm::clamp(bucket, 0, bucketsCount-1);
+            buckets[bucket] = LightBounds::Union(buckets[bucket], b);
+        }
+        for (int split = 0; split < bucketsCount-1; ++split) {
+            LightBounds below, above;
+            for (int i = 0; i <= split; ++i) {
+                below = LightBounds::Union(below, buckets[i]);
+            }
+            for (int i = split+1; i < bucketsCount; ++i) {
+                above = LightBounds::Union(above, buckets[i]);
+            }
+            float cost = 0.f;
+            if (!below.isEmpty()) {
+                cost += _EvaluateCost(below, bounds, dim);
+            }
+            if (!above.isEmpty()) {
+                cost += _EvaluateCost(above, bounds, dim);
+            }
+            if (cost > 0.f && cost < minCost) {
+                minCost = cost;
+                minCostDim = dim;
+                minCostBucket = split;
+            }
+        }
+    }
+    
+    // Partition lights, falling back to a median split
+    uint_t mid = (start + end) / 2;
+    if (minCostDim != -1) {
+        int dim = minCostDim;
+        float extent = centroidBounds.max[dim] - centroidBounds.min[dim];
+        BuildLight* midLight = std::partition(&buildLights[start], &buildLights[end-1]+1,
+                                              [&] (const BuildLight& l) {
+            int bucket = bucketsCount * ((l.second.getCentroid()[dim] - centroidBounds.min[dim])
+                                         / extent);
+            return glm::clamp(bucket, 0, bucketsCount-1) <= minCostBucket;
+        });
+        mid = midLight - &buildLights[0];
+    }
+    if (mid == start || mid == end) {
+        mid = (start + end) / 2;
+        int dim = centroidBounds.getMaxDimension();
+        std::nth_element(&buildLights[start], &buildLights[mid], &buildLights[end-1]+1,
+                         [&] (const BuildLight& a, const BuildLight& b) {
+            return a.second.getCentroid()[dim] < b.second.getCentroid()[dim];
+        });
+    }
+    
+    int left = _buildNode(buildLights, start, mid, nodeIndex);
+    int right = _buildNode(buildLights, mid, end, nodeIndex);
+    _nodes[nodeIndex].children[0] = left;
+    _nodes[nodeIndex].children[1] = right;
+    _nodes[nodeIndex].bounds = LightBounds::Union(_nodes[left].bounds, _nodes[right].bounds);
+    return nodeIndex;
+}
+
+float BVHLightSampler::_getInfiniteLightsProbability() const {
+    float candidates = _infiniteLights.size() + (_nodes.empty() ? 0 : 1);
+    if (candidates == 0) {
+        return 0.f;
+    }
+    return _infiniteLights.size() / candidates;
+}
+
+const Light* BVHLightSampler::sample(const vec3& point, const vec3& normal, float u,
+                                     float* pdf) const {
+    *pdf = 0.f;
+    
+    // Choose between lights at infinity and the hierarchy
+    float pInfinite = _getInfiniteLightsProbability();
+    if (u < pInfinite) {
+        int count = _infiniteLights.size();
+        int index = glm::min((int)((u / pInfinite) * count), count-1);
+        *pdf = pInfinite / count;
+        return _infiniteLights[index];
+    }
+    if (_nodes.empty()) {
+        return nullptr;
+    }
+    u = glm::min((u - pInfinite) / (1.f - pInfinite), OneMinusEpsilon);
+    
+    // Traverse the tree, reusing the sample to choose between children
+    float nodePdf = 1.f - pInfinite;
+    int nodeIndex = 0;
+    while (true) {
+        const Node& node = _nodes[nodeIndex];
+        if (node.lightIndex != -1) {
+            if (node.bounds.importance(point, normal) <= 0.f) {
+                return nullptr;
+            }
+            *pdf = nodePdf;
+            return _lights[node.lightIndex];
+        }
+        float c0 = _nodes[node.children[0]].bounds.importance(point, normal);
+        float c1 = _nodes[node.children[1]].bounds.importance(point, normal);
+        if (c0 == 0.f && c1 == 0.f) {
+            return nullptr;
+        }
+        float p0 = c0 / (c0 + c1);
+        if (u < p0) {
+            nodeIndex = node.children[0];
+            u = glm::min(u / p0, OneMinusEpsilon);
+            nodePdf *= p0;
+        } else {
+            nodeIndex = node.children[1];
+            u = glm::min((u - p0) / (1.f - p0), OneMinusEpsilon);
+            nodePdf *= 1.f - p0;
+        }
+    }
+}
+
+float BVHLightSampler::pdf(const vec3& point, const vec3& normal, const Light* light) const {
+    float pInfinite = _getInfiniteLightsProbability();
+    if (std::find(_infiniteLights.begin(), _infiniteLights.end(), light) != _infiniteLights.end()) {
+        return pInfinite / _infiniteLights.size();
+    }
+    
+    auto it = _lightsLeaves.find(light);
+    if (it == _lightsLeaves.end()) {
+        return 0.f;
+    }
+    
+    // Go up to the root, accumulating the probability of choosing each node
+    int nodeIndex = it->second;
+    if (_nodes[nodeIndex].bounds.importance(point, normal) <= 0.f) {
+        return 0.f;
+    }
+    float pdf = 1.f - pInfinite;
+    while (_nodes[nodeIndex].parent != -1) {
+        const Node& parent = _nodes[_nodes[nodeIndex].parent];
+        float c0 = _nodes[parent.children[0]].bounds.importance(point, normal);
+        float c1 = _nodes[parent.children[1]].bounds.importance(point, normal);
+        float c = (parent.children[0] == nodeIndex) ? c0 : c1;
+        if (c0 + c1 == 0.f) {
+            return 0.f;
+        }
+        pdf *= c / (c0 + c1);
+        nodeIndex = _nodes[nodeIndex].parent;
+    }
+    return pdf;
+}
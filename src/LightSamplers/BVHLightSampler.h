@@ -0,0 +1,58 @@
+//
+//  BVHLightSampler.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/8/14.
+//
+//
+
+#ifndef __CSE168_Rendering__BVHLightSampler__
+#define __CSE168_Rendering__BVHLightSampler__
+
+#include <map>
+#include <vector>
+
+#include "Core/Core.h"
+#include "Core/LightSampler.h"
+#include "Core/LightBounds.h"
+
+/*
+ * Chooses lights by traversing a hierarchy of light bounds, picking at each node
+ * a child proportionally to its estimated importance for the shading point.
+ * Lights at infinity are chosen uniformly, as a single extra candidate.
+ */
+class BVHLightSampler : public LightSampler {
+public:
+    
+    BVHLightSampler();
+    virtual ~BVHLightSampler();
+    
+    virtual void preprocess(const Scene& scene);
+    
+    virtual const Light* sample(const vec3& point, const vec3& normal, float u,
+                                float* pdf) const;
+    virtual float pdf(const vec3& point, const vec3& normal, const Light* light) const;
+    
+private:
+    struct Node {
+        LightBounds bounds;
+        int         children[2];
+        int         parent;
+        int         lightIndex;
+    };
+    
+    typedef std::pair<int, LightBounds> BuildLight;
+    
+    static float _EvaluateCost(const LightBounds& b, const AABB& bounds, int dim);
+    
+    int     _buildNode(std::vector<BuildLight>& buildLights, uint_t start, uint_t end,
+                       int parent);
+    float   _getInfiniteLightsProbability() const;
+    
+    std::vector<Node>           _nodes;
+    std::vector<const Light*>   _lights;
+    std::vector<const Light*>   _infiniteLights;
+    std::map<const Light*, int> _lightsLeaves;
+};
+
+#endif /* defined(__CSE168_Rendering__BVHLightSampler__) */
@@ -0,0 +1,49 @@
+//
+//  PowerLightSampler.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/7/14.
+//
+//
+
+#include "PowerLightSampler.h"
+
+#include "Core/Scene.h"
+#include "Core/Light.h"
+
+PowerLightSampler::PowerLightSampler() : LightSampler(), _distribution(), _lights(), _lightsIndices() {
+    
+}
+
+PowerLightSampler::~PowerLightSampler() {
+    
+}
+
+void PowerLightSampler::preprocess(const Scene& scene) {
+    _lights.clear();
+    _lightsIndices.clear();
+    
+    std::vector<float> powers;
+    for (const Light* light : scene.getLights()) {
+        _lightsIndices[light] = _lights.size();
+        _lights.push_back(light);
+        powers.push_back(light->power(scene).luminance());
+    }
+    _distribution.build(powers);
+}
+
+const Light* PowerLightSampler::sample(const vec3&, const vec3&, float u, float* pdf) const {
+    int index = _distribution.sample(u, pdf);
+    if (index < 0) {
+        return nullptr;
+    }
+    return _lights[index];
+}
+
+float PowerLightSampler::pdf(const vec3&, const vec3&, const Light* light) const {
+    auto it = _lightsIndices.find(light);
+    if (it == _lightsIndices.end() || _distribution.size() == 0) {
+        return 0.f;
+    }
+    return _distribution.pdf(it->second);
+}
@@ -0,0 +1,39 @@
+//
+//  PowerLightSampler.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/7/14.
+//
+//
+
+#ifndef __CSE168_Rendering__PowerLightSampler__
+#define __CSE168_Rendering__PowerLightSampler__
+
+#include <map>
+
+#include "Core/Core.h"
+#include "Core/LightSampler.h"
+#include "Core/Sampling.h"
+
+/*
+ * Chooses lights proportionally to their power, regardless of the shading point
+ */
+class PowerLightSampler : public LightSampler {
+public:
+    
+    PowerLightSampler();
+    virtual ~PowerLightSampler();
+    
+    virtual void preprocess(const Scene& scene);
+    
+    virtual const Light* sample(const vec3& point, const vec3& normal, float u,
+                                float* pdf) const;
+    virtual float pdf(const vec3& point, const vec3& normal, const Light* light) const;
+    
+private:
+    AliasTable                  _distribution;
+    std::vector<const Light*>   _lights;
+    std::map<const Light*, int> _lightsIndices;
+};
+
+#endif /* defined(__CSE168_Rendering__PowerLightSampler__) */
@@ -24,12 +24,12 @@ AreaLight* AreaLight::CreateFromMesh(MeshBase* meshBase, const Transform& t, boo
     AreaLight* light = new AreaLight();
     std::shared_ptr<Triangle> triangle = mesh->getTriangle(0);
     vec3
-        p1 = t(triangle->getVertex((0+indexOffset)%3)->position),
-        p2 = t(triangle->getVertex((1+indexOffset)%3)->position),
-        p3 = t(triangle->getVertex((2+indexOffset)%3)->position)
+        p1 = t(triangle->getVertex((0+indexOffset)%3).position),
+        p2 = t(triangle->getVertex((1+indexOffset)%3).position),
+        p3 = t(triangle->getVertex((2+indexOffset)%3).position)
     ;
     light->setPoints(p1, p2, p3);
-    vec3 normal = normalize(t.applyToNormal(triangle->getVertex(0)->normal));
+    vec3 normal = normalize(t.applyToNormal(triangle->getVertex(0).normal));
     if (inverseNormal) {
         normal = -normal;
     }
@@ -116,13 +116,68 @@ Spectrum AreaLight::sampleL(const vec3 &point, float rayEpsilon,
     vt->setSegment(point, rayEpsilon, sampledPosition);
     
     float area = length(v1) * length(v2);
-
+    
+    // Same radiance as le(), divided by the solid angle density of the sample
     return Spectrum(
-            (color * (_intensity * area))
+            (color * ((_intensity / (float)M_PI) * area))
             * dot(-dist, _normal)
             * (1.0f / (distLength*distLength)));
 }
 
+float AreaLight::pdfL(const vec3& point, const vec3& wi) const {
+    if (_isDirectional) {
+        return 0.f;
+    }
+    
+    // Find where wi crosses the light plane
+    float cosine = dot(-wi, _normal);
+    if (cosine <= 0.f) {
+        return 0.f;
+    }
+    float t = dot(_points[0] - point, -_normal) / cosine;
+    if (t <= 0.f) {
+        return 0.f;
+    }
+    
+    // Check that the point is inside the light rectangle
+    vec3 v1 = _points[1] - _points[0], v2 = _points[2] - _points[0];
+    vec3 d = point + t * wi - _points[0];
+    float u = dot(d, v1) / dot(v1, v1);
+    float v = dot(d, v2) / dot(v2, v2);
+    if (u < 0.f || u > 1.f || v < 0.f || v > 1.f) {
+        return 0.f;
+    }
+    
+    // Convert the uniform area density to solid angle
+    float area = length(v1) * length(v2);
+    return (t * t) / (cosine * area);
+}
+
+Spectrum AreaLight::power(const Scene&) const {
+    vec3 v1 = _points[1] - _points[0], v2 = _points[2] - _points[0];
+    float area = length(v1) * length(v2);
+    vec3 color = _color->evaluateVec3(vec2(0.5f));
+    
+    // _intensity already includes the pi of the lambertian emission
+    return color * _intensity * area;
+}
+
+bool AreaLight::getBounds(LightBounds* bounds) const {
+    // Directional area lights light the whole scene like directional lights
+    if (_isDirectional) {
+        return false;
+    }
+    
+    AABB box(_points[0]);
+    box = AABB::Union(box, _points[1]);
+    box = AABB::Union(box, _points[2]);
+    box = AABB::Union(box, _points[1] + _points[2] - _points[0]);
+    
+    // Emits in the hemisphere around its normal
+    *bounds = LightBounds(box, _normal, 1.f, 0.f);
+    return true;
+}
+
 Spectrum AreaLight::samplePhoton(vec3 *p, vec3 *direction) const {
     float u = (float)rand()/RAND_MAX;
     float v = (float)rand()/RAND_MAX;
@@ -150,5 +205,6 @@ Spectrum AreaLight::samplePhoton(vec3 *p, vec3 *direction) const {
         *direction = normalize(normalize(v1)*dir.x + normalize(v2)*dir.z + _normal*dir.y);
     }
     
-    return color * _intensity * area * (float)M_PI;
+    // Power of a lambertian emitter of radiance _intensity/pi
+    return color * _intensity * area;
 }
\ No newline at end of file
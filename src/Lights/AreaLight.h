@@ -34,6 +34,9 @@ public:
     virtual Spectrum sampleL(const vec3& point, float rayEpsilon,
                              const LightSample& lightSample,
                              vec3* wi, VisibilityTester* vt) const;
+    virtual float pdfL(const vec3& point, const vec3& wi) const;
+    virtual Spectrum power(const Scene& scene) const;
+    virtual bool getBounds(LightBounds* bounds) const;
     virtual Spectrum samplePhoton(vec3* p, vec3* direction) const;
     
 private:
@@ -8,6 +8,9 @@
 
 #include "DirectionalLight.h"
 
+#include "Core/Scene.h"
+#include "Core/AABB.h"
+
 DirectionalLight::DirectionalLight(const vec3& direction, float intensity, const Spectrum& spectrum)
 : Light(), _direction(direction), _intensity(intensity), _spectrum(spectrum) {
     
@@ -39,4 +42,11 @@ Spectrum DirectionalLight::sampleL(const vec3& point, float rayEpsilon,
     *wi = -_direction;
     vt->setRay(point, rayEpsilon, *wi);
     return _intensity * _spectrum;
-}
\ No newline at end of file
+}
+
+Spectrum DirectionalLight::power(const Scene& scene) const {
+    // Light going through a disk covering the scene
+    AABB bounds = scene.getAggregate()->getBoundingBox();
+    float radius = 0.5f * length(bounds.max - bounds.min);
+    return _intensity * _spectrum * (float)M_PI * radius * radius;
+}
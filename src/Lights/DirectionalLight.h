@@ -25,6 +25,7 @@ public:
     virtual Spectrum sampleL(const vec3& point, float rayEpsilon,
                              const LightSample& lightSample,
                              vec3* wi, VisibilityTester* vt) const;
+    virtual Spectrum power(const Scene& scene) const;
     
 private:
     vec3        _direction;
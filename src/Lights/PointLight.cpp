@@ -8,6 +8,8 @@
 
 #include "PointLight.h"
 
+#include "Core/Scene.h"
+
 PointLight::PointLight(const vec3& position, float intensity, const Spectrum& spectrum)
 : Light(), _position(position), _intensity(intensity), _spectrum(spectrum), _noDecay(false) {
     
@@ -50,6 +52,16 @@ Spectrum PointLight::sampleL(const vec3& point, float rayEpsilon,
     return (_spectrum * _intensity * decay);
 }
 
+Spectrum PointLight::power(const Scene&) const {
+    return _spectrum * _intensity * 4.f*M_PI;
+}
+
+bool PointLight::getBounds(LightBounds* bounds) const {
+    // Emits in every direction
+    *bounds = LightBounds(AABB(_position), vec3(0.f, 1.f, 0.f), -1.f, 0.f);
+    return true;
+}
+
 Spectrum PointLight::samplePhoton(vec3 *p, vec3 *direction) const {
     *p = _position;
     
@@ -27,6 +27,8 @@ public:
     virtual Spectrum sampleL(const vec3& point, float rayEpsilon,
                              const LightSample& lightSample,
                              vec3* wi, VisibilityTester* vt) const;
+    virtual Spectrum power(const Scene& scene) const;
+    virtual bool getBounds(LightBounds* bounds) const;
     virtual Spectrum samplePhoton(vec3* p, vec3* direction) const;
     
 private:    
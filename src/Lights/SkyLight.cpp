@@ -8,12 +8,22 @@
 
 #include "SkyLight.h"
 
+#include <thread>
+
+#include "Core/Scene.h"
+#include "Core/AABB.h"
+
+// Maximum resolution of the importance sampling distribution
+static const int SkyLightMaxDistributionWidth = 1024;
+
 SkyLight::SkyLight(const vec3& color) :
-Light(), _color(std::make_shared<UniformVec3Texture>(color)), _intensity(1.f), _transform() {
+Light(), _color(std::make_shared<UniformVec3Texture>(color)), _intensity(1.f),
+_transform(), _inverseTransform(), _distribution(), _averageColor(0.f), _distributionTexture(nullptr) {
     
 }
 
-SkyLight::SkyLight(const std::shared_ptr<Texture>& color) : Light(), _color(), _intensity(1.f), _transform() {
+SkyLight::SkyLight(const std::shared_ptr<Texture>& color) : Light(), _color(), _intensity(1.f),
+_transform(), _inverseTransform(), _distribution(), _averageColor(0.f), _distributionTexture(nullptr) {
     if (color) {
         _color = color;
     } else {
@@ -27,10 +37,12 @@ SkyLight::~SkyLight() {
 
 void SkyLight::setColor(const vec3& color) {
     _color = std::make_shared<UniformVec3Texture>(color);
+    _distributionTexture = nullptr;
 }
 
 void SkyLight::setColor(const std::shared_ptr<Texture> &color) {
     _color = color;
+    _distributionTexture = nullptr;
 }
 
 void SkyLight::setIntensity(float intensity) {
@@ -39,18 +51,115 @@ void SkyLight::setIntensity(float intensity) {
 
 void SkyLight::setTransform(const Transform &t) {
     _transform = t;
+    _inverseTransform = Transform::Inverse(t);
 }
 
-Spectrum SkyLight::le(const Ray & ray, const Intersection*) const {
-    vec3 d = normalize(ray.direction);
-    d = _transform.applyToVector(d);
+vec2 SkyLight::_directionToUV(const vec3& direction) const {
+    vec3 d = _transform.applyToVector(normalize(direction));
     vec2 uv;
     uv.s = ((atan2f(d.x, d.z) + M_PI)
             / (2.f * M_PI));
-    uv.t = ((asin(d.y) + 0.5f*M_PI) / M_PI);
+    uv.t = ((asin(glm::clamp(d.y, -1.f, 1.f)) + 0.5f*M_PI) / M_PI);
+    return uv;
+}
+
+vec3 SkyLight::_uvToDirection(const vec2& uv) const {
+    float phi = uv.s * 2.f*M_PI - M_PI;
+    float latitude = uv.t * M_PI - 0.5f*M_PI;
+    vec3 d(cos(latitude) * sin(phi), sin(latitude), cos(latitude) * cos(phi));
+    return normalize(_inverseTransform.applyToVector(d));
+}
+
+Spectrum SkyLight::le(const Ray & ray, const Intersection*) const {
+    vec2 uv = _directionToUV(ray.direction);
     return Spectrum(_color->evaluateVec3(uv)) * _intensity;
 }
 
-Spectrum SkyLight::sampleL(const vec3&, float, const LightSample&, vec3*, VisibilityTester*) const {
-    return Spectrum(0);
-}
\ No newline at end of file
+Spectrum SkyLight::sampleL(const vec3& point, float rayEpsilon, const LightSample& lightSample,
+                           vec3* wi, VisibilityTester* vt) const {
+    if (_distribution.isEmpty()) {
+        return Spectrum(0.f);
+    }
+    
+    // Sample a texel proportionally to its contribution
+    float uvPdf;
+    vec2 uv = _distribution.sampleContinuous(lightSample.u, lightSample.v, &uvPdf);
+    float cosLatitude = cos(uv.t * M_PI - 0.5f*M_PI);
+    if (uvPdf == 0.f || cosLatitude <= 0.f) {
+        return Spectrum(0.f);
+    }
+    
+    *wi = _uvToDirection(uv);
+    vt->setRay(point, rayEpsilon, *wi);
+    
+    // Convert the density from texture space to solid angle
+    float pdf = uvPdf / (2.f*M_PI*M_PI * cosLatitude);
+    return Spectrum(_color->evaluateVec3(uv) * (_intensity / pdf));
+}
+
+float SkyLight::pdfL(const vec3&, const vec3& wi) const {
+    if (_distribution.isEmpty()) {
+        return 0.f;
+    }
+    vec2 uv = _directionToUV(wi);
+    float cosLatitude = cos(uv.t * M_PI - 0.5f*M_PI);
+    if (cosLatitude <= 0.f) {
+        return 0.f;
+    }
+    return _distribution.pdf(uv) / (2.f*M_PI*M_PI * cosLatitude);
+}
+
+void SkyLight::preprocess(const Scene&) {
+    // The distribution only depends on the texture
+    if (_distributionTexture == _color.get()) {
+        return;
+    }
+    _distributionTexture = _color.get();
+    
+    ivec2 resolution = _color->getResolution();
+    int width = glm::clamp(resolution.x, 1, SkyLightMaxDistributionWidth);
+    int height = glm::clamp(resolution.y, 1, SkyLightMaxDistributionWidth/2);
+    
+    // Give constant textures enough rows for the latitude weighting
+    height = glm::max(height, 64);
+    
+    _distribution.resize(width, height);
+    std::vector<vec3> rowColors(height, vec3(0.f));
+    
+    // Build rows in parallel, weighting texels by the solid angle they cover
+    int threadsCount = glm::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadsCount; ++t) {
+        threads.push_back(std::thread([&, t] {
+            std::vector<float> values(width);
+            for (int v = t; v < height; v += threadsCount) {
+                float latitude = ((v + 0.5f) / height) * M_PI - 0.5f*M_PI;
+                float cosLatitude = cos(latitude);
+                for (int u = 0; u < width; ++u) {
+                    vec3 color = _color->evaluateVec3(vec2((u + 0.5f) / width, (v + 0.5f) / height));
+                    values[u] = Spectrum(color).luminance() * cosLatitude;
+                    rowColors[v] += color * cosLatitude;
+                }
+                _distribution.buildRow(v, values.data());
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    _distribution.buildMarginal();
+    
+    // Average radiance over the sphere
+    _averageColor = vec3(0.f);
+    for (const vec3& c : rowColors) {
+        _averageColor += c;
+    }
+    _averageColor *= ((float)M_PI / height) * (2.f*(float)M_PI / width) / (4.f*(float)M_PI);
+}
+
+Spectrum SkyLight::power(const Scene& scene) const {
+    // Light going through a disk covering the scene, from every direction
+    AABB bounds = scene.getAggregate()->getBoundingBox();
+    float radius = 0.5f * length(bounds.max - bounds.min);
+    return Spectrum(_averageColor * _intensity * 4.f*(float)M_PI * (float)M_PI * radius * radius);
+}
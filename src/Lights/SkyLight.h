@@ -14,6 +14,7 @@
 #include "Core/Spectrum.h"
 #include "Core/Texture.h"
 #include "Core/Transform.h"
+#include "Core/Sampling.h"
 
 class SkyLight : public Light {
 public:
@@ -31,11 +32,24 @@ public:
     virtual Spectrum sampleL(const vec3& point, float rayEpsilon,
                              const LightSample& lightSample,
                              vec3* wi, VisibilityTester* vt) const;
+    virtual float pdfL(const vec3& point, const vec3& wi) const;
+    virtual Spectrum power(const Scene& scene) const;
+    
+    virtual void preprocess(const Scene& scene);
     
 private:
+    vec2 _directionToUV(const vec3& direction) const;
+    vec3 _uvToDirection(const vec2& uv) const;
+    
     std::shared_ptr<Texture>    _color;
     float                       _intensity;
     Transform                   _transform;
+    Transform                   _inverseTransform;
+    
+    // Importance sampling data, built for _distributionTexture
+    Distribution2D              _distribution;
+    vec3                        _averageColor;
+    const Texture*              _distributionTexture;
 };
 
 #endif /* defined(__CSE168_Rendering__SkyLight__) */
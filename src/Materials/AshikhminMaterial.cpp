@@ -168,12 +168,12 @@ Spectrum AshikhminMaterial::evaluateBSDF(const vec3& wo, const vec3& wi,
         n = -n;
     }
     
-    float nu = _roughnessU->evaluateFloat(intersection.uv);
-    float nv = _roughnessV->evaluateFloat(intersection.uv);
-    float diffuseIntensity = _diffuseIntensity->evaluateFloat(intersection.uv);
-    float specularIntensity = _specularIntensity->evaluateFloat(intersection.uv);
-    vec3 diffuseColor = _diffuseColor->evaluateVec3(intersection.uv);
-    vec3 specularColor = _specularColor->evaluateVec3(intersection.uv);
+    float nu = _roughnessU->evaluateFloat(intersection);
+    float nv = _roughnessV->evaluateFloat(intersection);
+    float diffuseIntensity = _diffuseIntensity->evaluateFloat(intersection);
+    float specularIntensity = _specularIntensity->evaluateFloat(intersection);
+    vec3 diffuseColor = _diffuseColor->evaluateVec3(intersection);
+    vec3 specularColor = _specularColor->evaluateVec3(intersection);
     
     vec3 h = normalize(wo + wi);
     
@@ -223,14 +223,14 @@ Spectrum AshikhminMaterial::evaluateBSDF(const vec3& wo, const vec3& wi,
 
 Spectrum AshikhminMaterial::sampleBSDF(const vec3& wo, vec3* wi, const Intersection& intersection,
                                        BxDFType, BxDFType* sampledType) const {
-    float nu = _roughnessU->evaluateFloat(intersection.uv);
-    float nv = _roughnessV->evaluateFloat(intersection.uv);
-    float specularIntensity = _specularIntensity->evaluateFloat(intersection.uv);
-    vec3 diffuseColor = _diffuseColor->evaluateVec3(intersection.uv);
-    vec3 specularColor = _specularColor->evaluateVec3(intersection.uv);
+    float nu = _roughnessU->evaluateFloat(intersection);
+    float nv = _roughnessV->evaluateFloat(intersection);
+    float specularIntensity = _specularIntensity->evaluateFloat(intersection);
+    vec3 diffuseColor = _diffuseColor->evaluateVec3(intersection);
+    vec3 specularColor = _specularColor->evaluateVec3(intersection);
     
     if ((float)rand()/RAND_MAX < specularIntensity) {
-        *sampledType = BSDFReflection;
+        *sampledType = (BxDFType)(BSDFReflection | BSDFGlossy);
         float s1 = (float)rand()/RAND_MAX;
         float s2 = (float)rand()/RAND_MAX;
         
@@ -267,4 +267,34 @@ Spectrum AshikhminMaterial::sampleBSDF(const vec3& wo, vec3* wi, const Intersect
         *wi = normalize(surfaceToWorld(cosineSampleHemisphere(), intersection));
         return diffuseColor;
     }
+}
+
+float AshikhminMaterial::pdfBSDF(const vec3& wo, const vec3& wi,
+                                 const Intersection& intersection) const {
+    float specularIntensity = glm::clamp(_specularIntensity->evaluateFloat(intersection), 0.f, 1.f);
+    const vec3& n = intersection.normal;
+    if (dot(n, wi) <= 0.f) {
+        return 0.f;
+    }
+    float diffusePdf = Material::pdfBSDF(wo, wi, intersection);
+    
+    // Density of the half vector sampled by sampleBSDF, in the same frame
+    float specularPdf = 0.f;
+    vec3 h = normalize(wo + wi);
+    float nh = dot(n, h);
+    float hk = dot(h, wo);
+    if (specularIntensity > 0.f && nh > 0.f && hk > 0.f) {
+        float nu = _roughnessU->evaluateFloat(intersection);
+        float nv = _roughnessV->evaluateFloat(intersection);
+        float hu = dot(h, intersection.tangentU);
+        float hv = dot(h, intersection.tangentV);
+        float exponent = nh < 1.f ? (nu*hu*hu + nv*hv*hv) / (1.f - nh*nh) : 0.f;
+        float halfPdf = sqrt((nu + 1.f)*(nv + 1.f)) / (2.f*M_PI) * pow(nh, exponent);
+        specularPdf = halfPdf / (4.f*hk);
+        if (glm::isnan(specularPdf)) {
+            specularPdf = 0.f;
+        }
+    }
+    
+    return specularIntensity*specularPdf + (1.f - specularIntensity)*diffusePdf;
 }
\ No newline at end of file
@@ -46,6 +46,8 @@ public:
     virtual Spectrum sampleBSDF(const vec3& wo, vec3* wi,
                                 const Intersection& intersection,
                                 BxDFType type, BxDFType* sampledType) const;
+    virtual float pdfBSDF(const vec3& wo, const vec3& wi,
+                          const Intersection& intersection) const;
     
 private:
     std::shared_ptr<Texture>    _diffuseColor;
@@ -73,7 +73,7 @@ Spectrum Glossy::evaluateBSDF(const vec3 &wo, const vec3 &wi,
     float fr = refracted(cosi, wo, intersection.normal, _indexOut, _indexIn, &t);
     vec3 h = normalize(wo + wi);
     float blinn = pow(dot(intersection.normal, h), _roughness);
-    return (1.f - fr) * Spectrum(_color->evaluateVec3(intersection.uv)) + blinn * Spectrum(1.f);
+    return (1.f - fr) * Spectrum(_color->evaluateVec3(intersection)) + blinn * Spectrum(1.f);
 }
 
 Spectrum Glossy::sampleBSDF(const vec3 &wo, vec3 *wi, const Intersection &intersection,
@@ -90,10 +90,19 @@ Spectrum Glossy::sampleBSDF(const vec3 &wo, vec3 *wi, const Intersection &inters
     if ((float)rand()/RAND_MAX > fr) {
         *sampledType = BSDFDiffuse;
         *wi = normalize(surfaceToWorld(cosineSampleHemisphere(), intersection));
-        return Spectrum(_color->evaluateVec3(intersection.uv));
+        return Spectrum(_color->evaluateVec3(intersection));
     } else {
         *sampledType = BSDFReflection;
         *wi = reflect(-wo, intersection.normal);
         return Spectrum(1.0f);
     }
+}
+
+float Glossy::pdfBSDF(const vec3& wo, const vec3& wi, const Intersection& intersection) const {
+    // The diffuse lobe is chosen when the sample isn't reflected, the mirror
+    // reflection has no density
+    float cosi = glm::abs(glm::dot(wo, intersection.normal));
+    vec3 t;
+    float fr = refracted(cosi, wo, intersection.normal, _indexOut, _indexIn, &t);
+    return (1.f - fr) * Material::pdfBSDF(wo, wi, intersection);
 }
\ No newline at end of file
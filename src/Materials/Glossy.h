@@ -28,6 +28,8 @@ public:
     virtual Spectrum sampleBSDF(const vec3& wo, vec3* wi,
                                 const Intersection& intersection,
                                 BxDFType type, BxDFType* sampledType) const;
+    virtual float pdfBSDF(const vec3& wo, const vec3& wi,
+                          const Intersection& intersection) const;
     
     virtual void setDiffuseColor(const vec3& color);
     virtual void setDiffuseColor(const std::shared_ptr<Texture>& color);
@@ -57,7 +57,7 @@ std::shared_ptr<Texture> Matte::getColor() const {
 
 Spectrum Matte::evaluateBSDF(const vec3&, const vec3&,
                              const Intersection& intersection) const {
-    return Spectrum(_color->evaluateVec3(intersection.uv) / (float)M_PI);
+    return Spectrum(_color->evaluateVec3(intersection) / (float)M_PI);
 }
 
 Spectrum Matte::sampleBSDF(const vec3&, vec3* wi, const Intersection& intersection,
@@ -69,7 +69,7 @@ Spectrum Matte::sampleBSDF(const vec3&, vec3* wi, const Intersection& intersecti
     
     *sampledType = BSDFDiffuse;
     *wi = normalize(surfaceToWorld(cosineSampleHemisphere(), intersection));
-    return _color->evaluateVec3(intersection.uv);
+    return _color->evaluateVec3(intersection);
 }
 
 Material::BxDFType Matte::getBSDFType() const {
@@ -82,7 +82,7 @@ Spectrum Metal::evaluateBSDF(const vec3& wo, const vec3& wi,
     if (glm::isnan(blinn)) {
         blinn = 0.f;
     }
-    return Spectrum(_color->evaluateVec3(intersection.uv)) * blinn * 0.f;
+    return Spectrum(_color->evaluateVec3(intersection)) * blinn * 0.f;
 }
 
 Spectrum Metal::sampleBSDF(const vec3& wo, vec3* wi, const Intersection& intersection,
@@ -94,7 +94,7 @@ Spectrum Metal::sampleBSDF(const vec3& wo, vec3* wi, const Intersection& interse
     *sampledType = BSDFReflection;
     *wi = glm::reflect(-wo, intersection.normal);
     float cosi = glm::abs(glm::dot(wo, intersection.normal));
-    return Spectrum(_color->evaluateVec3(intersection.uv)) * fresnelConductor(cosi, _eta, _k);
+    return Spectrum(_color->evaluateVec3(intersection)) * fresnelConductor(cosi, _eta, _k);
 }
 
 Material::BxDFType Metal::getBSDFType() const {
@@ -0,0 +1,441 @@
+//
+//  WavefrontRenderer.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/9/14.
+//
+//
+
+#include "WavefrontRenderer.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "Core/Scene.h"
+#include "Core/Material.h"
+#include "Core/Primitive.h"
+#include "Core/Integrator.h"
+#include "Core/VisibilityTester.h"
+
+std::shared_ptr<WavefrontRenderer> WavefrontRenderer::Load(const rapidjson::Value& value) {
+    std::shared_ptr<WavefrontRenderer> renderer = std::make_shared<WavefrontRenderer>();
+    
+    if (value.HasMember("maxRayDepth")) {
+        renderer->setMaxRayDepth(value["maxRayDepth"].GetInt());
+    }
+    if (value.HasMember("russianRouletteDepth")) {
+        renderer->setRussianRouletteDepth(value["russianRouletteDepth"].GetInt());
+    }
+    if (value.HasMember("queueSize")) {
+        renderer->setQueueSize(value["queueSize"].GetInt());
+    }
+    if (value.HasMember("raySorting")) {
+        renderer->setRaySorting(value["raySorting"].GetBool());
+    }
+    if (value.HasMember("lightSampling")) {
+        renderer->setLightSampler(LightSampler::Load(value["lightSampling"]));
+    }
+    
+    return renderer;
+}
+
+WavefrontRenderer::WavefrontRenderer() : Renderer(),
+_maxRayDepth(5), _russianRouletteDepth(3), _queueSize(1 << 16), _raySorting(true), _lightSampler() {
+    
+}
+
+WavefrontRenderer::~WavefrontRenderer() {
+    
+}
+
+void WavefrontRenderer::setMaxRayDepth(uint_t depth) {
+    _maxRayDepth = depth;
+}
+
+void WavefrontRenderer::setRussianRouletteDepth(uint_t depth) {
+    _russianRouletteDepth = depth;
+}
+
+void WavefrontRenderer::setQueueSize(uint_t size) {
+    _queueSize = std::max((uint_t)1, size);
+}
+
+void WavefrontRenderer::setRaySorting(bool sortRays) {
+    _raySorting = sortRays;
+}
+
+void WavefrontRenderer::setLightSampler(const std::shared_ptr<LightSampler>& sampler) {
+    _lightSampler = sampler;
+}
+
+void WavefrontRenderer::preprocess(const Scene& scene, Camera* camera) {
+    Renderer::preprocess(scene, camera);
+    if (_lightSampler) {
+        _lightSampler->preprocess(scene);
+    }
+}
+
+int WavefrontRenderer::_getTasksCount(int) const {
+    // Few large tasks, so that each stage works on long queues
+    return 4 * Task::NumSystemCores();
+}
+
+void WavefrontRenderer::renderSamples(const Scene& scene, Camera* camera,
+                                      const CameraSample* samples, int samplesCount) const {
+    std::vector<Spectrum> radiance(samplesCount, Spectrum(0.f));
+    
+    RayQueue                    rays;
+    PathQueue                   paths;
+    ShadowQueue                 shadowRays;
+    std::vector<Intersection>   intersections;
+    std::vector<bool>           alive;
+    
+    AABB sceneBounds = scene.getAggregate()->getBoundingBox();
+    
+    // Process samples by batches to bound the size of the queues
+    int raysPerSample = _antialiasingSampling.count * _antialiasingSampling.count;
+    int batchSize = glm::max(1, (int)_queueSize / glm::max(1, raysPerSample));
+    for (int start = 0; start < samplesCount; start += batchSize) {
+        int end = glm::min(samplesCount, start + batchSize);
+        
+        rays.clear();
+        paths.clear();
+        _generateCameraRays(camera, samples, start, end, rays, paths);
+        
+        for (bool cameraRays = true; rays.size() > 0; cameraRays = false) {
+            // Camera rays are generated in a coherent order, bounce rays are scattered
+            if (_raySorting && !cameraRays) {
+                _sortRays(sceneBounds, rays, paths);
+            }
+            _intersect(scene, rays, paths, intersections, alive, radiance.data());
+            _shadeMissed(scene, rays, paths, alive, radiance.data());
+            
+            shadowRays.clear();
+            _shade(scene, rays, paths, intersections, alive, shadowRays, radiance.data());
+            _traceShadowRays(scene, shadowRays, radiance.data());
+            
+            _compact(rays, paths, alive);
+        }
+    }
+    
+    // Add samples contribution to camera film
+    for (int i = 0; i < samplesCount; ++i) {
+        if (radiance[i].hasNaNs()) {
+            qDebug() << "NAN";
+        }
+        camera->getFilm()->addSample(samples[i], radiance[i], 1.0f/(float)_samplesCount);
+    }
+}
+
+void WavefrontRenderer::_generateCameraRays(Camera* camera, const CameraSample* samples,
+                                            int start, int end,
+                                            RayQueue& rays, PathQueue& paths) const {
+    int subSamplesCount = _antialiasingSampling.count;
+    float subSampleWeight = 1.0f / ((float)(subSamplesCount*subSamplesCount));
+    
+    rays.reserve((end - start) * subSamplesCount * subSamplesCount);
+    for (int i = start; i < end; ++i) {
+        for (int subSampleX = 0; subSampleX < subSamplesCount; ++subSampleX) {
+            for (int subSampleY = 0; subSampleY < subSamplesCount; ++subSampleY) {
+                CameraSample subSample = _getSubSample(samples[i], subSampleX, subSampleY);
+                
+                Ray ray;
+                float rayWeight = camera->generateRay(subSample, &ray) * subSampleWeight;
+                if (rayWeight > 0.f) {
+                    rays.push(ray);
+                    paths.push(i, Spectrum(rayWeight));
+                }
+            }
+        }
+    }
+}
+
+void WavefrontRenderer::_intersect(const Scene& scene, RayQueue& rays, PathQueue& paths,
+                                   std::vector<Intersection>& intersections,
+                                   std::vector<bool>& hits, Spectrum* radiance) const {
+    intersections.assign(rays.size(), Intersection());
+    hits.assign(rays.size(), false);
+    
+    for (uint_t i = 0; i < rays.size(); ++i) {
+        Ray ray = rays.getRay(i);
+        hits[i] = scene.intersect(ray, &intersections[i]);
+        rays.tmax[i] = ray.tmax;
+        
+        // Compute light coming from participating media along the segment
+        Spectrum t;
+        Spectrum lv = volumeLi(scene, ray, &t);
+        radiance[paths.samples[i]] += paths.throughputs[i] * lv;
+        paths.throughputs[i] *= t;
+    }
+}
+
+void WavefrontRenderer::_shadeMissed(const Scene& scene, const RayQueue& rays,
+                                     const PathQueue& paths, const std::vector<bool>& hits,
+                                     Spectrum* radiance) const {
+    for (uint_t i = 0; i < rays.size(); ++i) {
+        if (hits[i]) {
+            continue;
+        }
+        Ray ray = rays.getRay(i);
+        float bsdfPdf = paths.bsdfPdfs[i];
+        for (Light* light : scene.getLights()) {
+            Spectrum le = light->le(ray);
+            // Lights that can be sampled share their contribution with direct lighting
+            if (bsdfPdf > 0.f) {
+                float lightPdf = light->pdfL(paths.previousPoints[i], ray.direction)
+                * _getLightSelectionPdf(paths.previousPoints[i], paths.previousNormals[i], light);
+                if (lightPdf > 0.f) {
+                    int lightSamplesCount = light->getSamplingConfig().count;
+                    le *= Integrator::PowerHeuristic(1, bsdfPdf,
+                                                     lightSamplesCount*lightSamplesCount,
+                                                     lightPdf);
+                }
+            }
+            radiance[paths.samples[i]] += paths.throughputs[i] * le;
+        }
+    }
+}
+
+void WavefrontRenderer::_shade(const Scene& scene, RayQueue& rays, PathQueue& paths,
+                               std::vector<Intersection>& intersections,
+                               std::vector<bool>& alive, ShadowQueue& shadowRays,
+                               Spectrum* radiance) const {
+    // Sort hit points by material, so each material is evaluated for a whole batch
+    std::vector<uint_t> order;
+    order.reserve(rays.size());
+    for (uint_t i = 0; i < rays.size(); ++i) {
+        if (alive[i]) {
+            order.push_back(i);
+        }
+    }
+    std::less<const Material*> materialLess;
+    std::stable_sort(order.begin(), order.end(), [&] (uint_t a, uint_t b) {
+        return materialLess(intersections[a].material, intersections[b].material);
+    });
+    
+    for (uint_t i : order) {
+        Intersection& isec = intersections[i];
+        isec.applyNormalMapping();
+        
+        Ray ray = rays.getRay(i);
+        uint_t sample = paths.samples[i];
+        Spectrum& throughput = paths.throughputs[i];
+        
+        // Add light emitted by area lights, weighted against direct lighting
+        AreaLight* areaLight = isec.primitive->getAreaLight();
+        if (areaLight) {
+            Spectrum le = areaLight->le(ray, &isec);
+            float bsdfPdf = paths.bsdfPdfs[i];
+            if (bsdfPdf == 0.f) {
+                radiance[sample] += throughput * le;
+            } else {
+                int lightSamplesCount = areaLight->getSamplingConfig().count;
+                float lightPdf = areaLight->pdfL(paths.previousPoints[i], ray.direction)
+                * _getLightSelectionPdf(paths.previousPoints[i], paths.previousNormals[i],
+                                        areaLight);
+                radiance[sample] += throughput * le
+                * Integrator::PowerHeuristic(1, bsdfPdf, lightSamplesCount*lightSamplesCount,
+                                             lightPdf);
+            }
+            alive[i] = false;
+            continue;
+        }
+        
+        vec3 wo = -ray.direction;
+        vec3 n = dot(isec.normal, wo) < 0 ? -isec.normal : isec.normal;
+        
+        // Queue shadow rays for direct lighting
+        if (_lightSampler) {
+            float selectionPdf;
+            const Light* light = _lightSampler->sample(isec.point, n, (float)rand()/RAND_MAX,
+                                                       &selectionPdf);
+            if (light && selectionPdf > 0.f) {
+                _sampleLight(ray, isec, n, light, selectionPdf, sample, throughput, shadowRays);
+            }
+        } else {
+            for (const Light* light : scene.getLights()) {
+                _sampleLight(ray, isec, n, light, 1.f, sample, throughput, shadowRays);
+            }
+        }
+        
+        if (ray.depth >= (int)_maxRayDepth) {
+            alive[i] = false;
+            continue;
+        }
+        
+        // Sample BSDF to find the next path vertex
+        vec3 wi;
+        Material::BxDFType type;
+        Spectrum f = isec.material->sampleBSDF(wo, &wi, isec, Material::BSDFAll, &type);
+        if (f.isBlack()) {
+            alive[i] = false;
+            continue;
+        }
+        paths.bsdfPdfs[i] = ((type & (Material::BSDFDiffuse | Material::BSDFGlossy)) ?
+                             isec.material->pdfBSDF(wo, wi, isec) : 0.f);
+        throughput *= f;
+        
+        // Randomly terminate paths that won't contribute much
+        if (paths.bounces[i] >= _russianRouletteDepth) {
+            float continueProbability = glm::min(1.f, throughput.luminance());
+            if ((float)rand()/RAND_MAX >= continueProbability) {
+                alive[i] = false;
+                continue;
+            }
+            throughput *= 1.f / continueProbability;
+        }
+        paths.bounces[i] += 1;
+        paths.previousPoints[i] = isec.point;
+        paths.previousNormals[i] = n;
+        
+        ray.origin = isec.point;
+        ray.direction = wi;
+        ray.tmin = isec.rayEpsilon;
+        ray.tmax = INFINITY;
+        ray.depth += 1;
+        ray.type = ((type & Material::BSDFDiffuse) ?
+                    Ray::DiffuseReflected : Ray::SpecularReflected);
+        rays.setRay(i, ray);
+    }
+}
+
+void WavefrontRenderer::_sampleLight(const Ray& ray, const Intersection& intersection,
+                                     const vec3& n, const Light* light, float selectionPdf,
+                                     uint_t sample, const Spectrum& throughput,
+                                     ShadowQueue& shadowRays) const {
+    const vec3& point = intersection.point;
+    vec3 wo = -ray.direction;
+    
+    const SamplingConfig& sampling = light->getSamplingConfig();
+    int samplesCount = sampling.count;
+    for (int i = 0; i < samplesCount; ++i) {
+        for (int j = 0; j < samplesCount; ++j) {
+            LightSample lightSample;
+            vec3 wi;
+            VisibilityTester vt(ray);
+            
+            lightSample.u = (float)i/samplesCount;
+            lightSample.v = (float)j/samplesCount;
+            
+            if (sampling.jittered) {
+                lightSample.u += ((float)rand()/RAND_MAX) / samplesCount;
+                lightSample.v += ((float)rand()/RAND_MAX) / samplesCount;
+            } else {
+                lightSample.u += 0.5f / samplesCount;
+                lightSample.v += 0.5f / samplesCount;
+            }
+            
+            Spectrum li = light->sampleL(point, intersection.rayEpsilon, lightSample, &wi, &vt);
+            float cosine = dot(wi, n);
+            if (li.isBlack() || cosine <= 0) {
+                continue;
+            }
+            
+            Spectrum f = intersection.material->evaluateBSDF(wo, wi, intersection);
+            if (f.isBlack()) {
+                continue;
+            }
+            
+            // Share the contribution with BSDF sampling for non-delta lights
+            float weight = 1.f;
+            float lightPdf = light->pdfL(point, wi);
+            if (lightPdf > 0.f) {
+                float bsdfPdf = intersection.material->pdfBSDF(wo, wi, intersection);
+                weight = Integrator::PowerHeuristic(samplesCount*samplesCount,
+                                                    selectionPdf*lightPdf, 1, bsdfPdf);
+            }
+            
+            // Visibility and attenuation are resolved by the shadow rays stage
+            shadowRays.push(vt.getRay(), sample,
+                            throughput * li * f * cosine
+                            * (weight / (samplesCount*samplesCount*selectionPdf)),
+                            light);
+        }
+    }
+}
+
+void WavefrontRenderer::_traceShadowRays(const Scene& scene, const ShadowQueue& shadowRays,
+                                         Spectrum* radiance) const {
+    for (uint_t i = 0; i < shadowRays.rays.size(); ++i) {
+        Ray ray = shadowRays.rays.getRay(i);
+        if (scene.intersectP(ray, shadowRays.lights[i])) {
+            continue;
+        }
+        radiance[shadowRays.samples[i]] += (shadowRays.contributions[i]
+                                            * transmittance(scene, ray));
+    }
+}
+
+void WavefrontRenderer::_compact(RayQueue& rays, PathQueue& paths,
+                                 const std::vector<bool>& alive) const {
+    std::vector<uint_t> indices;
+    indices.reserve(rays.size());
+    for (uint_t i = 0; i < rays.size(); ++i) {
+        if (alive[i]) {
+            indices.push_back(i);
+        }
+    }
+    if (indices.size() == rays.size()) {
+        return;
+    }
+    rays.gather(indices);
+    paths.gather(indices);
+}
+
+void WavefrontRenderer::_sortRays(const AABB& sceneBounds, RayQueue& rays,
+                                  PathQueue& paths) const {
+    std::vector<uint_t> order;
+    rays.getSortOrder(sceneBounds, &order);
+    rays.gather(order);
+    paths.gather(order);
+}
+
+float WavefrontRenderer::_getLightSelectionPdf(const vec3& point, const vec3& normal,
+                                               const Light* light) const {
+    if (_lightSampler) {
+        return _lightSampler->pdf(point, normal, light);
+    }
+    return 1.f;
+}
+
+void WavefrontRenderer::PathQueue::clear() {
+    samples.clear();
+    throughputs.clear();
+    bsdfPdfs.clear();
+    previousPoints.clear();
+    previousNormals.clear();
+    bounces.clear();
+}
+
+void WavefrontRenderer::PathQueue::push(uint_t sample, const Spectrum& throughput) {
+    samples.push_back(sample);
+    throughputs.push_back(throughput);
+    bsdfPdfs.push_back(0.f);
+    previousPoints.push_back(vec3());
+    previousNormals.push_back(vec3());
+    bounces.push_back(0);
+}
+
+void WavefrontRenderer::PathQueue::gather(const std::vector<uint_t>& indices) {
+    RayQueue::Gather(samples, indices);
+    RayQueue::Gather(throughputs, indices);
+    RayQueue::Gather(bsdfPdfs, indices);
+    RayQueue::Gather(previousPoints, indices);
+    RayQueue::Gather(previousNormals, indices);
+    RayQueue::Gather(bounces, indices);
+}
+
+void WavefrontRenderer::ShadowQueue::clear() {
+    rays.clear();
+    samples.clear();
+    contributions.clear();
+    lights.clear();
+}
+
+void WavefrontRenderer::ShadowQueue::push(const Ray& ray, uint_t sample,
+                                          const Spectrum& contribution, const Light* light) {
+    rays.push(ray);
+    samples.push_back(sample);
+    contributions.push_back(contribution);
+    lights.push_back(light);
+}
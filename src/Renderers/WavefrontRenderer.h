@@ -0,0 +1,101 @@
+//
+//  WavefrontRenderer.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/9/14.
+//
+//
+
+#ifndef __CSE168_Rendering__WavefrontRenderer__
+#define __CSE168_Rendering__WavefrontRenderer__
+
+#include <vector>
+
+#include "Core/Core.h"
+#include "Core/Renderer.h"
+#include "Core/RayQueue.h"
+#include "Core/Intersection.h"
+#include "Core/LightSampler.h"
+
+/*
+ * Path tracer processing all the paths of a task together, stage by stage:
+ * camera rays generation, intersection, shading sorted by material,
+ * shadow rays tracing and compaction of the terminated paths
+ */
+class WavefrontRenderer : public Renderer {
+public:
+    
+    static std::shared_ptr<WavefrontRenderer> Load(const rapidjson::Value& value);
+    
+    WavefrontRenderer();
+    virtual ~WavefrontRenderer();
+    
+    void setMaxRayDepth(uint_t depth);
+    void setRussianRouletteDepth(uint_t depth);
+    void setQueueSize(uint_t size);
+    void setRaySorting(bool sortRays);
+    void setLightSampler(const std::shared_ptr<LightSampler>& sampler);
+    
+    virtual void preprocess(const Scene& scene, Camera* camera);
+    virtual void renderSamples(const Scene& scene, Camera* camera,
+                               const CameraSample* samples, int samplesCount) const;
+    
+protected:
+    virtual int _getTasksCount(int pixelsCount) const;
+    
+private:
+    
+    // State of the paths, parallel to the rays of the queue
+    struct PathQueue {
+        void clear();
+        void push(uint_t sample, const Spectrum& throughput);
+        void gather(const std::vector<uint_t>& indices);
+        
+        std::vector<uint_t>     samples;
+        std::vector<Spectrum>   throughputs;
+        std::vector<float>      bsdfPdfs;
+        std::vector<vec3>       previousPoints;
+        std::vector<vec3>       previousNormals;
+        std::vector<uint_t>     bounces;
+    };
+    
+    // Shadow rays with the contribution they add to their sample if unoccluded
+    struct ShadowQueue {
+        void clear();
+        void push(const Ray& ray, uint_t sample, const Spectrum& contribution,
+                  const Light* light);
+        
+        RayQueue                    rays;
+        std::vector<uint_t>         samples;
+        std::vector<Spectrum>       contributions;
+        std::vector<const Light*>   lights;
+    };
+    
+    void _generateCameraRays(Camera* camera, const CameraSample* samples,
+                             int start, int end, RayQueue& rays, PathQueue& paths) const;
+    void _intersect(const Scene& scene, RayQueue& rays, PathQueue& paths,
+                    std::vector<Intersection>& intersections, std::vector<bool>& hits,
+                    Spectrum* radiance) const;
+    void _shadeMissed(const Scene& scene, const RayQueue& rays, const PathQueue& paths,
+                      const std::vector<bool>& hits, Spectrum* radiance) const;
+    void _shade(const Scene& scene, RayQueue& rays, PathQueue& paths,
+                std::vector<Intersection>& intersections, std::vector<bool>& alive,
+                ShadowQueue& shadowRays, Spectrum* radiance) const;
+    void _sampleLight(const Ray& ray, const Intersection& intersection, const vec3& n,
+                      const Light* light, float selectionPdf, uint_t sample,
+                      const Spectrum& throughput, ShadowQueue& shadowRays) const;
+    void _traceShadowRays(const Scene& scene, const ShadowQueue& shadowRays,
+                          Spectrum* radiance) const;
+    void _compact(RayQueue& rays, PathQueue& paths, const std::vector<bool>& alive) const;
+    void _sortRays(const AABB& sceneBounds, RayQueue& rays, PathQueue& paths) const;
+    
+    float _getLightSelectionPdf(const vec3& point, const vec3& normal, const Light* light) const;
+    
+    uint_t                          _maxRayDepth;
+    uint_t                          _russianRouletteDepth;
+    uint_t                          _queueSize;
+    bool                            _raySorting;
+    std::shared_ptr<LightSampler>   _lightSampler;
+};
+
+#endif /* defined(__CSE168_Rendering__WavefrontRenderer__) */
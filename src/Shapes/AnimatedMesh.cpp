@@ -10,45 +10,67 @@
 
 #include "Shapes/Mesh.h"
 
-AnimatedMesh::AnimatedMesh() : _endVertices(nullptr) {
+AnimatedMesh::AnimatedMesh() : _endPositions(nullptr), _endAttributes(nullptr) {
     
 }
 
 AnimatedMesh::~AnimatedMesh() {
-    if (_endVertices) {
-        delete[] _endVertices;
+    _releaseEndData();
+}
+
+void AnimatedMesh::_releaseEndData() {
+    if (_endPositions) {
+        delete[] _endPositions;
+    }
+    if (_endAttributes) {
+        delete[] _endAttributes;
     }
+    _endPositions = nullptr;
+    _endAttributes = nullptr;
 }
 
 void AnimatedMesh::setEndVertices(Vertex* vertices) {
-    if (_endVertices) {
-        delete[] _endVertices;
+    _releaseEndData();
+    if (!vertices) {
+        return;
     }
-    _endVertices = vertices;
+    _endPositions = new vec3[_verticesCount];
+    _endAttributes = new VertexAttributes[_verticesCount];
+    SplitVertices(_verticesCount, vertices, _endPositions, _endAttributes);
+    delete[] vertices;
+}
+
+const vec3& AnimatedMesh::getEndPosition(uint_t index) const {
+    return _endPositions[index];
 }
 
-const Vertex* AnimatedMesh::getEndVertex(uint_t index) const {
-    return &_endVertices[index];
+vec3 AnimatedMesh::getInterpolatedPosition(uint_t index, float time) const {
+    return glm::mix(_positions[index], _endPositions[index], time);
 }
 
-Vertex AnimatedMesh::getInterpolatedVertex(uint_t index, float time) const {
-    Vertex vertex;
+VertexAttributes AnimatedMesh::getInterpolatedAttributes(uint_t index, float time) const {
+    VertexAttributes attributes;
     
-    const Vertex* v0 = &_vertices[index];
-    const Vertex* v1 = &_endVertices[index];
+    VertexAttributes a0 = getAttributes(index);
+    const VertexAttributes* a1 = &_endAttributes[index];
     
-    vertex.position = glm::mix(v0->position, v1->position, time);
-    vertex.normal = normalize(glm::mix(v0->normal, v1->normal, time));
-    vertex.tangentU = normalize(glm::mix(v0->tangentU, v1->tangentU, time));
-    vertex.tangentV = normalize(glm::mix(v0->tangentV, v1->tangentV, time));
-    vertex.texCoord = v0->texCoord;
+    attributes.normal = normalize(glm::mix(a0.normal, a1->normal, time));
+    attributes.tangentU = normalize(glm::mix(a0.tangentU, a1->tangentU, time));
+    attributes.tangentV = normalize(glm::mix(a0.tangentV, a1->tangentV, time));
+    attributes.texCoord = a0.texCoord;
     
-    return vertex;
+    return attributes;
 }
 
 void AnimatedMesh::generateTangents(bool useUVs) {
-    Mesh::GenerateTangents(useUVs, _vertices, _verticesCount, _indices, _indicesCount);
-    Mesh::GenerateTangents(useUVs, _endVertices, _verticesCount, _indices, _indicesCount);
+    _unpackAttributes();
+    // Skinned meshes regenerate their tangents on each evaluation, the adjacency
+    // is kept and shared by the start and end vertices
+    const VertexAdjacency& adjacency = _getAdjacency();
+    GenerateTangents(useUVs, _positions, _attributes, _verticesCount, _indices, _indicesCount,
+                     adjacency);
+    GenerateTangents(useUVs, _endPositions, _endAttributes, _verticesCount, _indices, _indicesCount,
+                     adjacency);
 }
 
 std::shared_ptr<AnimatedTriangle> AnimatedMesh::getAnimatedTriangle(int index) const {
@@ -66,8 +88,8 @@ AABB AnimatedMesh::getBoundingBox() const {
     AABB bound;
     
     for (int i = 0; i < _verticesCount; ++i) {
-        bound = AABB::Union(bound, _vertices[i].position);
-        bound = AABB::Union(bound, _endVertices[i].position);
+        bound = AABB::Union(bound, _positions[i]);
+        bound = AABB::Union(bound, _endPositions[i]);
     }
     return bound;
 }
@@ -21,10 +21,12 @@ public:
     AnimatedMesh();
     virtual ~AnimatedMesh();
     
+    // Split the end vertices into streams, the array is deleted
     void setEndVertices(Vertex* vertices);
-    const Vertex* getEndVertex(uint_t index) const;
+    const vec3& getEndPosition(uint_t index) const;
     
-    Vertex getInterpolatedVertex(uint_t index, float time) const;
+    vec3 getInterpolatedPosition(uint_t index, float time) const;
+    VertexAttributes getInterpolatedAttributes(uint_t index, float time) const;
     
     virtual void generateTangents(bool useUVs=true);
     
@@ -34,7 +36,10 @@ public:
     virtual void refine(std::vector<std::shared_ptr<Shape>> &refined) const;
     
 private:
-    Vertex* _endVertices;
+    void _releaseEndData();
+    
+    vec3*               _endPositions;
+    VertexAttributes*   _endAttributes;
 };
 
 #endif /* defined(__CSE168_Rendering__AnimatedMesh__) */
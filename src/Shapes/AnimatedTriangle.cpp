@@ -34,11 +34,10 @@ void AnimatedTriangle::setMaterial(const std::shared_ptr<Material>& material) {
 }
 
 bool AnimatedTriangle::intersect(const Ray& ray, Intersection* intersection) const {
-    Vertex v0 = _mesh->getInterpolatedVertex(_vertices[0], ray.time);
-    Vertex v1 = _mesh->getInterpolatedVertex(_vertices[1], ray.time);
-    Vertex v2 = _mesh->getInterpolatedVertex(_vertices[2], ray.time);
+    vec3 a = _mesh->getInterpolatedPosition(_vertices[0], ray.time);
+    vec3 b = _mesh->getInterpolatedPosition(_vertices[1], ray.time);
+    vec3 c = _mesh->getInterpolatedPosition(_vertices[2], ray.time);
     
-    const vec3 &a = v0.position, &b = v1.position, &c = v2.position;
     vec3 oa = ray.origin - a, ca = c - a, ba = b - a;
     vec3 normal = cross(ba, ca);
     float det = dot(-ray.direction, normal);
@@ -67,6 +66,11 @@ bool AnimatedTriangle::intersect(const Ray& ray, Intersection* intersection) con
         return false;
     }
     
+    // Shading attributes are only interpolated for hits
+    VertexAttributes v0 = _mesh->getInterpolatedAttributes(_vertices[0], ray.time);
+    VertexAttributes v1 = _mesh->getInterpolatedAttributes(_vertices[1], ray.time);
+    VertexAttributes v2 = _mesh->getInterpolatedAttributes(_vertices[2], ray.time);
+    
     // Compute uv coords
     vec2 uvs = ((1-alpha-beta)*v0.texCoord
                 + alpha*v1.texCoord
@@ -104,6 +108,7 @@ bool AnimatedTriangle::intersect(const Ray& ray, Intersection* intersection) con
     intersection->tangentV = ((1-alpha-beta)*v0.tangentV
                               + alpha*v1.tangentV
                               + beta*v2.tangentV);
+    intersection->computePositionDerivatives(a, b, c, v0.texCoord, v1.texCoord, v2.texCoord);
     
     if (_material) {
         intersection->material = _material.get();
@@ -114,11 +119,10 @@ bool AnimatedTriangle::intersect(const Ray& ray, Intersection* intersection) con
 }
 
 bool AnimatedTriangle::intersectP(const Ray& ray) const {
-    Vertex v0 = _mesh->getInterpolatedVertex(_vertices[0], ray.time);
-    Vertex v1 = _mesh->getInterpolatedVertex(_vertices[1], ray.time);
-    Vertex v2 = _mesh->getInterpolatedVertex(_vertices[2], ray.time);
+    vec3 a = _mesh->getInterpolatedPosition(_vertices[0], ray.time);
+    vec3 b = _mesh->getInterpolatedPosition(_vertices[1], ray.time);
+    vec3 c = _mesh->getInterpolatedPosition(_vertices[2], ray.time);
     
-    const vec3 &a = v0.position, &b = v1.position, &c = v2.position;
     vec3 oa = ray.origin - a, ca = c - a, ba = b - a;
     vec3 normal = cross(ba, ca);
     float det = dot(-ray.direction, normal);
@@ -143,13 +147,12 @@ bool AnimatedTriangle::intersectP(const Ray& ray) const {
         return false;
     }
     
-    // Compute uv coords
-    vec2 uvs = ((1-alpha-beta)*v0.texCoord
-                + alpha*v1.texCoord
-                + beta*v2.texCoord);
-    
     // Reject if we have an alpha texture
     if (_mesh && _mesh->_alphaTexture) {
+        // Compute uv coords
+        vec2 uvs = ((1-alpha-beta)*_mesh->getTexCoord(_vertices[0])
+                    + alpha*_mesh->getTexCoord(_vertices[1])
+                    + beta*_mesh->getTexCoord(_vertices[2]));
         if (_mesh->_alphaTexture->evaluateFloat(uvs) == 0.0f) {
             return false;
         }
@@ -158,13 +161,17 @@ bool AnimatedTriangle::intersectP(const Ray& ray) const {
     return true;
 }
 
+bool AnimatedTriangle::isOpaque() const {
+    return !(_mesh && _mesh->_alphaTexture);
+}
+
 AABB AnimatedTriangle::getBoundingBox() const {
-    AABB b1 = AABB::Union(AABB(_mesh->getVertex(_vertices[0])->position,
-                               _mesh->getVertex(_vertices[1])->position),
-                          _mesh->getVertex(_vertices[2])->position);
-    AABB b2 = AABB::Union(AABB(_mesh->getEndVertex(_vertices[0])->position,
-                               _mesh->getEndVertex(_vertices[1])->position),
-                          _mesh->getEndVertex(_vertices[2])->position);
+    AABB b1 = AABB::Union(AABB(_mesh->getPosition(_vertices[0]),
+                               _mesh->getPosition(_vertices[1])),
+                          _mesh->getPosition(_vertices[2]));
+    AABB b2 = AABB::Union(AABB(_mesh->getEndPosition(_vertices[0]),
+                               _mesh->getEndPosition(_vertices[1])),
+                          _mesh->getEndPosition(_vertices[2]));
     return AABB::Union(b1, b2);
 }
 
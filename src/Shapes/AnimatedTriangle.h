@@ -27,6 +27,7 @@ public:
     
     virtual bool intersect(const Ray& ray, Intersection* intersection) const;
     virtual bool intersectP(const Ray& ray) const;
+    virtual bool isOpaque() const;
     virtual AABB getBoundingBox() const;
     
     bool hasMaterial() const;
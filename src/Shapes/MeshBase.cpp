@@ -8,24 +8,109 @@
 
 #include "MeshBase.h"
 
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Octahedral encoding of a unit vector as two snorm16 values
+static void EncodeOctahedral(const vec3& v, int16_t* encoded) {
+    float l1 = abs(v.x) + abs(v.y) + abs(v.z);
+    vec2 p = l1 > 0.f ? vec2(v.x, v.y) / l1 : vec2(0.f);
+    if (v.z < 0.f) {
+        p = vec2((1.f - abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f),
+                 (1.f - abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f));
+    }
+    encoded[0] = (int16_t)roundf(clamp(p.x, -1.f, 1.f) * 32767.f);
+    encoded[1] = (int16_t)roundf(clamp(p.y, -1.f, 1.f) * 32767.f);
+}
+
+static vec3 DecodeOctahedral(const int16_t* encoded) {
+    vec3 v(encoded[0] / 32767.f, encoded[1] / 32767.f, 0.f);
+    v.z = 1.f - abs(v.x) - abs(v.y);
+    if (v.z < 0.f) {
+        v = vec3((1.f - abs(v.y)) * (v.x >= 0.f ? 1.f : -1.f),
+                 (1.f - abs(v.x)) * (v.y >= 0.f ? 1.f : -1.f),
+                 v.z);
+    }
+    return normalize(v);
+}
+
 MeshBase::MeshBase() :
-_verticesCount(0), _vertices(nullptr),
+_verticesCount(0), _positions(nullptr), _attributes(nullptr), _packedAttributes(nullptr),
 _indicesCount(0), _indices(nullptr),
 _materialIndices(nullptr), _materials(),
-_alphaTexture() {
+_alphaTexture(), _sharedDataOwner(), _adjacency() {
     
 }
 
 MeshBase::~MeshBase() {
-    if (_vertices) {
-        delete[] _vertices;
+    _releaseData();
+}
+
+void MeshBase::_releaseData() {
+    if (!_sharedDataOwner) {
+        if (_positions) {
+            delete[] _positions;
+        }
+        if (_attributes) {
+            delete[] _attributes;
+        }
+        if (_packedAttributes) {
+            delete[] _packedAttributes;
+        }
+        if (_indices) {
+            delete[] _indices;
+        }
+        if (_materialIndices) {
+            delete[] _materialIndices;
+        }
     }
-    if (_indices) {
-        delete[] _indices;
+    _sharedDataOwner.reset();
+    _positions = nullptr;
+    _attributes = nullptr;
+    _packedAttributes = nullptr;
+    _indices = nullptr;
+    _materialIndices = nullptr;
+    _verticesCount = 0;
+    _indicesCount = 0;
+    _releaseAdjacency();
+}
+
+template<class T> static T* CopyArray(const T* array, uint_t count) {
+    if (!array) {
+        return nullptr;
     }
-    if (_materialIndices) {
-        delete[] _materialIndices;
+    T* copy = new T[count];
+    std::copy(array, array + count, copy);
+    return copy;
+}
+
+void MeshBase::_copySharedData() {
+    if (!_sharedDataOwner) {
+        return;
     }
+    // Take ownership of copies so the arrays can be replaced or modified
+    _positions = CopyArray(_positions, _verticesCount);
+    _attributes = CopyArray(_attributes, _verticesCount);
+    _packedAttributes = CopyArray(_packedAttributes, _verticesCount);
+    _indices = CopyArray(_indices, _indicesCount);
+    _materialIndices = CopyArray(_materialIndices, _indicesCount/3);
+    _sharedDataOwner.reset();
+}
+
+void MeshBase::_unpackAttributes() {
+    _copySharedData();
+    if (!_packedAttributes) {
+        return;
+    }
+    _attributes = new VertexAttributes[_verticesCount];
+    for (int i = 0; i < _verticesCount; ++i) {
+        UnpackAttributes(_packedAttributes[i], &_attributes[i]);
+    }
+    delete[] _packedAttributes;
+    _packedAttributes = nullptr;
 }
 
 void MeshBase::setMaterials(const std::vector<std::shared_ptr<Material>>& materials) {
@@ -33,14 +118,33 @@ void MeshBase::setMaterials(const std::vector<std::shared_ptr<Material>>& materi
 }
 
 void MeshBase::setVertices(int count, Vertex* vertices) {
-    if (_vertices) {
-        delete[] _vertices;
+    _copySharedData();
+    if (_positions) {
+        delete[] _positions;
+    }
+    if (_attributes) {
+        delete[] _attributes;
+    }
+    if (_packedAttributes) {
+        delete[] _packedAttributes;
+        _packedAttributes = nullptr;
     }
     _verticesCount = count;
-    _vertices = vertices;
+    _positions = vertices ? new vec3[count] : nullptr;
+    _attributes = vertices ? new VertexAttributes[count] : nullptr;
+    if (vertices) {
+        SplitVertices(count, vertices, _positions, _attributes);
+        delete[] vertices;
+    }
 }
 
 void MeshBase::setIndices(int count, uint_t* indices) {
+    _copySharedData();
+    // Skinned meshes set the same indices on each evaluation, keep their adjacency
+    if (count != _indicesCount || !_indices || !indices
+        || !std::equal(indices, indices + count, _indices)) {
+        _adjacency.offsets.clear();
+    }
     if (_indices) {
         delete [] _indices;
     }
@@ -49,6 +153,7 @@ void MeshBase::setIndices(int count, uint_t* indices) {
 }
 
 void MeshBase::setMaterialIndices(uint_t* indices) {
+    _copySharedData();
     if (_materialIndices) {
         delete[] _materialIndices;
     }
@@ -59,23 +164,126 @@ void MeshBase::setAlphaTexture(const std::shared_ptr<Texture>& texture) {
     _alphaTexture = texture;
 }
 
+void MeshBase::setSharedData(const std::shared_ptr<const void>& owner,
+                             const VertexStreams& streams,
+                             int indicesCount, const uint_t* indices,
+                             const uint_t* materialIndices) {
+    _releaseData();
+    _sharedDataOwner = owner;
+    // Shared arrays are never written, meshes only modify the data they own
+    _verticesCount = streams.verticesCount;
+    _positions = const_cast<vec3*>(streams.positions);
+    _attributes = const_cast<VertexAttributes*>(streams.attributes);
+    _packedAttributes = const_cast<PackedVertexAttributes*>(streams.packedAttributes);
+    _indicesCount = indicesCount;
+    _indices = const_cast<uint_t*>(indices);
+    _materialIndices = const_cast<uint_t*>(materialIndices);
+}
+
+void MeshBase::quantizeAttributes() {
+    if (!_attributes) {
+        return;
+    }
+    _copySharedData();
+    _packedAttributes = new PackedVertexAttributes[_verticesCount];
+    for (int i = 0; i < _verticesCount; ++i) {
+        PackAttributes(_attributes[i], &_packedAttributes[i]);
+    }
+    delete[] _attributes;
+    _attributes = nullptr;
+}
+
+bool MeshBase::isQuantized() const {
+    return _packedAttributes != nullptr;
+}
+
 void MeshBase::generateTangents(bool useUVs) {
-    GenerateTangents(useUVs, _vertices, _verticesCount, _indices, _indicesCount);
+    _unpackAttributes();
+    GenerateTangents(useUVs, _positions, _attributes, _verticesCount, _indices, _indicesCount,
+                     _getAdjacency());
+    // Static meshes generate their tangents once, don't keep the adjacency while rendering
+    _releaseAdjacency();
+}
+
+const MeshBase::VertexAdjacency& MeshBase::_getAdjacency() {
+    if (_adjacency.offsets.size() != (size_t)_verticesCount+1) {
+        BuildAdjacency(_verticesCount, _indices, _indicesCount, &_adjacency);
+    }
+    return _adjacency;
+}
+
+void MeshBase::_releaseAdjacency() {
+    std::vector<uint_t>().swap(_adjacency.offsets);
+    std::vector<uint_t>().swap(_adjacency.triangles);
 }
 
 int MeshBase::getTrianglesCount() const {
     return _indicesCount/3;
 }
 
-const Vertex* MeshBase::getVertex(uint_t index) const {
-    return &_vertices[index];
+int MeshBase::getVerticesCount() const {
+    return _verticesCount;
+}
+
+int MeshBase::getIndicesCount() const {
+    return _indicesCount;
+}
+
+const uint_t* MeshBase::getIndices() const {
+    return _indices;
+}
+
+const uint_t* MeshBase::getMaterialIndices() const {
+    return _materialIndices;
+}
+
+VertexStreams MeshBase::getVertexStreams() const {
+    VertexStreams streams = {(uint_t)_verticesCount, _positions, _attributes, _packedAttributes};
+    return streams;
+}
+
+const vec3& MeshBase::getPosition(uint_t index) const {
+    return _positions[index];
+}
+
+vec2 MeshBase::getTexCoord(uint_t index) const {
+    if (_packedAttributes) {
+        const uint16_t* texCoord = _packedAttributes[index].texCoord;
+        return vec2(Core::halfToFloat(texCoord[0]), Core::halfToFloat(texCoord[1]));
+    }
+    return _attributes[index].texCoord;
+}
+
+VertexAttributes MeshBase::getAttributes(uint_t index) const {
+    if (_packedAttributes) {
+        VertexAttributes attributes;
+        UnpackAttributes(_packedAttributes[index], &attributes);
+        return attributes;
+    }
+    return _attributes[index];
+}
+
+Vertex MeshBase::getVertex(uint_t index) const {
+    VertexAttributes attributes = getAttributes(index);
+    Vertex vertex(_positions[index], attributes.normal, attributes.texCoord);
+    vertex.tangentU = attributes.tangentU;
+    vertex.tangentV = attributes.tangentV;
+    return vertex;
+}
+
+size_t MeshBase::getPositionsSize() const {
+    return sizeof(vec3) * _verticesCount;
+}
+
+size_t MeshBase::getAttributesSize() const {
+    return (_packedAttributes ? sizeof(PackedVertexAttributes) : sizeof(VertexAttributes)) * _verticesCount;
 }
 
 AABB MeshBase::getBoundingBox() const {
     AABB bound;
     
     for (int i = 0; i < _verticesCount; ++i) {
-        bound = AABB::Union(bound, _vertices[i].position);
+        bound = AABB::Union(bound, _positions[i]);
     }
     return bound;
 }
@@ -84,69 +292,211 @@ bool MeshBase::canIntersect() const {
     return false;
 }
 
-void MeshBase::GenerateTangents(bool useUVs, Vertex* vertices,
-                            uint_t verticesCount, uint_t* indices, uint_t indicesCount) {
-    // Init tangents to zero vectors
+void MeshBase::SplitVertices(uint_t verticesCount, const Vertex* vertices,
+                             vec3* positions, VertexAttributes* attributes) {
+    for (uint_t i = 0; i < verticesCount; ++i) {
+        positions[i] = vertices[i].position;
+        attributes[i].normal = vertices[i].normal;
+        attributes[i].texCoord = vertices[i].texCoord;
+        attributes[i].tangentU = vertices[i].tangentU;
+        attributes[i].tangentV = vertices[i].tangentV;
+    }
+}
+
+void MeshBase::PackAttributes(const VertexAttributes& attributes, PackedVertexAttributes* packed) {
+    EncodeOctahedral(attributes.normal, packed->normal);
+    EncodeOctahedral(attributes.tangentU, packed->tangentU);
+    EncodeOctahedral(attributes.tangentV, packed->tangentV);
+    // Half floats keep the uvs of tiled textures outside of [0, 1]
+    packed->texCoord[0] = Core::floatToHalf(attributes.texCoord.s);
+    packed->texCoord[1] = Core::floatToHalf(attributes.texCoord.t);
+}
+
+void MeshBase::UnpackAttributes(const PackedVertexAttributes& packed, VertexAttributes* attributes) {
+    attributes->normal = DecodeOctahedral(packed.normal);
+    attributes->tangentU = DecodeOctahedral(packed.tangentU);
+    attributes->tangentV = DecodeOctahedral(packed.tangentV);
+    attributes->texCoord = vec2(Core::halfToFloat(packed.texCoord[0]),
+                                Core::halfToFloat(packed.texCoord[1]));
+}
+
+void MeshBase::BuildAdjacency(uint_t verticesCount, const uint_t* indices, uint_t indicesCount,
+                              VertexAdjacency* adjacency) {
+    std::vector<uint_t>& offsets = adjacency->offsets;
+    offsets.assign(verticesCount+1, 0);
+    for (uint_t i = 0; i < indicesCount; ++i) {
+        offsets[indices[i]+1] += 1;
+    }
     for (uint_t i = 0; i < verticesCount; ++i) {
-        vertices[i].tangentU = vec3(0.f);
-        vertices[i].tangentV = vec3(0.f);
+        offsets[i+1] += offsets[i];
     }
+    // Triangles are listed in increasing order for each vertex
+    std::vector<uint_t> fill(offsets.begin(), offsets.end()-1);
+    adjacency->triangles.resize(indicesCount);
+    for (uint_t i = 0; i < indicesCount; ++i) {
+        adjacency->triangles[fill[indices[i]]++] = i/3;
+    }
+}
+
+static void TriangleTangents(bool useUVs, const vec3& p0, const vec3& p1, const vec3& p2,
+                             const vec2& uv0, const vec2& uv1, const vec2& uv2,
+                             vec3* triangleTangentU, vec3* triangleTangentV) {
+    vec3 tangentU, tangentV;
     
-    uint_t trianglesCount = indicesCount / 3;
-    for (uint_t i = 0; i < trianglesCount; ++i) {
-        Vertex
-        *p0 = &vertices[indices[i*3+0]],
-        *p1 = &vertices[indices[i*3+1]],
-        *p2 = &vertices[indices[i*3+2]];
+    bool invalidUVs = false;
+    if (useUVs) {
+        // Generate tangents based on uv coords
+        vec3 q1 = p1 - p0;
+        vec3 q2 = p2 - p0;
+        float s1 = uv1.s - uv0.s;
+        float t1 = uv1.t - uv0.t;
+        float s2 = uv2.s - uv0.s;
+        float t2 = uv2.t - uv0.t;
         
-        vec3 tangentU, tangentV;
+        float r = 1.0f / (s1 * t2 - s2 * t1);
+        vec3 sdir((t2 * q1.x - t1 * q2.x) * r, (t2 * q1.y - t1 * q2.y) * r,
+                  (t2 * q1.z - t1 * q2.z) * r);
+        vec3 tdir((s1 * q2.x - s2 * q1.x) * r, (s1 * q2.y - s2 * q1.y) * r,
+                  (s1 * q2.z - s2 * q1.z) * r);
         
-        bool invalidUVs = false;
-        if (useUVs) {
-            // Generate tangents based on uv coords
-            vec3 q1 = p1->position - p0->position;
-            vec3 q2 = p2->position - p0->position;
-            float s1 = p1->texCoord.s - p0->texCoord.s;
-            float t1 = p1->texCoord.t - p0->texCoord.t;
-            float s2 = p2->texCoord.s - p0->texCoord.s;
-            float t2 = p2->texCoord.t - p0->texCoord.t;
-            
-            float r = 1.0f / (s1 * t2 - s2 * t1);
-            vec3 sdir((t2 * q1.x - t1 * q2.x) * r, (t2 * q1.y - t1 * q2.y) * r,
-                      (t2 * q1.z - t1 * q2.z) * r);
-            vec3 tdir((s1 * q2.x - s2 * q1.x) * r, (s1 * q2.y - s2 * q1.y) * r,
-                      (s1 * q2.z - s2 * q1.z) * r);
-            
-            tangentU = normalize(sdir);
-            tangentV = normalize(tdir);
-        }
+        tangentU = normalize(sdir);
+        tangentV = normalize(tdir);
+    }
+    
+    if (glm::isnan(tangentU.x) || glm::isnan(tangentU.y) || glm::isnan(tangentU.z)
+        || glm::isnan(tangentV.x) || glm::isnan(tangentV.y) || glm::isnan(tangentV.z)) {
+        invalidUVs = true;
+    }
+    
+    if (!useUVs || invalidUVs) {
+        // Generate dummy tangents based on simple axis
+        vec3 normal = normalize(cross(p1 - p0, p2 - p0));
         
-        if (glm::isnan(tangentU.x) || glm::isnan(tangentU.y) || glm::isnan(tangentU.z)
-            || glm::isnan(tangentV.x) || glm::isnan(tangentV.y) || glm::isnan(tangentV.z)) {
-            invalidUVs = true;
+        if (abs(normal.y) > 1.0f-0.00001f) {
+            tangentU = vec3(1.0f, 0.0f, 0.0f);
+            tangentV = vec3(0.0f, 0.0f, 1.0f);
+        } else {
+            tangentU = normalize(cross(vec3(0.0f, 1.0f, 0.0f), normal));
+            tangentV = cross(normal, tangentU);
         }
-        
-        if (!useUVs || invalidUVs) {
-            // Generate dummy tangents based on simple axis
-            vec3 normal = normalize(cross(p1->position - p0->position, p2->position - p0->position));
-            
-            if (abs(normal.y) > 1.0f-0.00001f) {
-                tangentU = vec3(1.0f, 0.0f, 0.0f);
-                tangentV = vec3(0.0f, 0.0f, 1.0f);
-            } else {
-                tangentU = normalize(cross(vec3(0.0f, 1.0f, 0.0f), normal));
-                tangentV = cross(normal, tangentU);
-            }
+    }
+    
+    *triangleTangentU = tangentU;
+    *triangleTangentV = tangentV;
+}
+
+#ifdef __SSE2__
+static inline void Normalize4(__m128* x, __m128* y, __m128* z) {
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(*x, *x), _mm_mul_ps(*y, *y)),
+                                           _mm_mul_ps(*z, *z)));
+    __m128 inverse = _mm_div_ps(_mm_set1_ps(1.f), length);
+    *x = _mm_mul_ps(*x, inverse);
+    *y = _mm_mul_ps(*y, inverse);
+    *z = _mm_mul_ps(*z, inverse);
+}
+
+// Uv based tangents of 4 triangles, with the same operations as the scalar
+// code. Returns a bit mask of the triangles with NaN tangents
+static inline int TriangleTangents4(const vec3* positions, const VertexAttributes* attributes,
+                                    const uint_t* indices, vec3* tangentsU, vec3* tangentsV) {
+    float p[3][3][4], uv[3][2][4];
+    for (int k = 0; k < 4; ++k) {
+        for (int j = 0; j < 3; ++j) {
+            const vec3& position = positions[indices[k*3+j]];
+            const vec2& texCoord = attributes[indices[k*3+j]].texCoord;
+            p[j][0][k] = position.x;
+            p[j][1][k] = position.y;
+            p[j][2][k] = position.z;
+            uv[j][0][k] = texCoord.s;
+            uv[j][1][k] = texCoord.t;
         }
-        
-        p0->tangentU += tangentU; p0->tangentV += tangentV;
-        p1->tangentU += tangentU; p1->tangentV += tangentV;
-        p2->tangentU += tangentU; p2->tangentV += tangentV;
     }
+    __m128 q1[3], q2[3];
+    for (int c = 0; c < 3; ++c) {
+        __m128 p0 = _mm_loadu_ps(p[0][c]);
+        q1[c] = _mm_sub_ps(_mm_loadu_ps(p[1][c]), p0);
+        q2[c] = _mm_sub_ps(_mm_loadu_ps(p[2][c]), p0);
+    }
+    __m128 s0 = _mm_loadu_ps(uv[0][0]), t0 = _mm_loadu_ps(uv[0][1]);
+    __m128 s1 = _mm_sub_ps(_mm_loadu_ps(uv[1][0]), s0);
+    __m128 t1 = _mm_sub_ps(_mm_loadu_ps(uv[1][1]), t0);
+    __m128 s2 = _mm_sub_ps(_mm_loadu_ps(uv[2][0]), s0);
+    __m128 t2 = _mm_sub_ps(_mm_loadu_ps(uv[2][1]), t0);
+    __m128 r = _mm_div_ps(_mm_set1_ps(1.f), _mm_sub_ps(_mm_mul_ps(s1, t2), _mm_mul_ps(s2, t1)));
     
-    // Normalize tangents
-    for (uint_t i = 0; i < verticesCount; ++i) {
-        vertices[i].tangentU = normalize(vertices[i].tangentU);
-        vertices[i].tangentV = normalize(vertices[i].tangentV);
+    __m128 sdir[3], tdir[3];
+    for (int c = 0; c < 3; ++c) {
+        sdir[c] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(t2, q1[c]), _mm_mul_ps(t1, q2[c])), r);
+        tdir[c] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(s1, q2[c]), _mm_mul_ps(s2, q1[c])), r);
     }
-}
\ No newline at end of file
+    Normalize4(&sdir[0], &sdir[1], &sdir[2]);
+    Normalize4(&tdir[0], &tdir[1], &tdir[2]);
+    
+    __m128 nan = _mm_setzero_ps();
+    float u[3][4], v[3][4];
+    for (int c = 0; c < 3; ++c) {
+        nan = _mm_or_ps(nan, _mm_or_ps(_mm_cmpunord_ps(sdir[c], sdir[c]), _mm_cmpunord_ps(tdir[c], tdir[c])));
+        _mm_storeu_ps(u[c], sdir[c]);
+        _mm_storeu_ps(v[c], tdir[c]);
+    }
+    for (int k = 0; k < 4; ++k) {
+        tangentsU[k] = vec3(u[0][k], u[1][k], u[2][k]);
+        tangentsV[k] = vec3(v[0][k], v[1][k], v[2][k]);
+    }
+    return _mm_movemask_ps(nan);
+}
+#endif
+
+void MeshBase::GenerateTangents(bool useUVs,
+                                const vec3* positions, VertexAttributes* attributes,
+                                uint_t verticesCount,
+                                const uint_t* indices, uint_t indicesCount,
+                                const VertexAdjacency& adjacency) {
+    static const uint_t ChunkSize = 4096;
+    
+    // Compute the tangents of each triangle
+    uint_t trianglesCount = indicesCount / 3;
+    std::vector<vec3> trianglesTangentU(trianglesCount), trianglesTangentV(trianglesCount);
+    Core::parallelFor((trianglesCount + ChunkSize-1) / ChunkSize, [&] (uint_t chunk) {
+        uint_t start = chunk*ChunkSize, end = std::min(start + ChunkSize, trianglesCount);
+        uint_t i = start;
+#ifdef __SSE2__
+        // Triangles with invalid uvs fall back to the scalar code
+        for (; useUVs && i + 4 <= end; i += 4) {
+            int invalid = TriangleTangents4(positions, attributes, &indices[i*3],
+                                            &trianglesTangentU[i], &trianglesTangentV[i]);
+            for (int k = 0; invalid && k < 4; ++k) {
+                if (invalid & (1 << k)) {
+                    const uint_t* t = &indices[(i+k)*3];
+                    TriangleTangents(useUVs, positions[t[0]], positions[t[1]], positions[t[2]],
+                                     attributes[t[0]].texCoord, attributes[t[1]].texCoord,
+                                     attributes[t[2]].texCoord,
+                                     &trianglesTangentU[i+k], &trianglesTangentV[i+k]);
+                }
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            const uint_t* t = &indices[i*3];
+            TriangleTangents(useUVs, positions[t[0]], positions[t[1]], positions[t[2]],
+                             attributes[t[0]].texCoord, attributes[t[1]].texCoord,
+                             attributes[t[2]].texCoord,
+                             &trianglesTangentU[i], &trianglesTangentV[i]);
+        }
+    });
+    
+    // Gather the tangents of the triangles around each vertex, in triangles
+    // order so the sums don't depend on the threads
+    Core::parallelFor((verticesCount + ChunkSize-1) / ChunkSize, [&] (uint_t chunk) {
+        uint_t start = chunk*ChunkSize, end = std::min(start + ChunkSize, verticesCount);
+        for (uint_t i = start; i < end; ++i) {
+            vec3 tangentU(0.f), tangentV(0.f);
+            for (uint_t j = adjacency.offsets[i]; j < adjacency.offsets[i+1]; ++j) {
+                tangentU += trianglesTangentU[adjacency.triangles[j]];
+                tangentV += trianglesTangentV[adjacency.triangles[j]];
+            }
+            attributes[i].tangentU = normalize(tangentU);
+            attributes[i].tangentV = normalize(tangentV);
+        }
+    });
+}
@@ -17,6 +17,11 @@
 
 #include <vector>
 
+/*
+ * Triangle mesh data. Vertices are stored as separate streams: positions,
+ * which are all intersection tests need, and shading attributes, which are
+ * only read for hits. Attributes can be quantized to save memory.
+ */
 class MeshBase : public Shape {
 public:
     
@@ -27,32 +32,85 @@ public:
     
     void setMaterials(const std::vector<std::shared_ptr<Material>>& materials);
     
+    // Split the vertices into streams, the array is deleted
     void setVertices(int count, Vertex* vertices);
     void setIndices(int count, uint_t* indices);
     void setMaterialIndices(uint_t* indices);
     void setAlphaTexture(const std::shared_ptr<Texture>& texture);
     
+    // Use read-only arrays owned by another object, which the mesh keeps alive
+    void setSharedData(const std::shared_ptr<const void>& owner,
+                       const VertexStreams& streams,
+                       int indicesCount, const uint_t* indices,
+                       const uint_t* materialIndices);
+    
+    // Pack the shading attributes, normals and tangents keep about 1e-4 precision
+    // and uvs 11 bits of mantissa
+    void quantizeAttributes();
+    bool isQuantized() const;
+    
     virtual void generateTangents(bool useUVs=true);
     
     int getTrianglesCount() const;
+    int getVerticesCount() const;
+    int getIndicesCount() const;
+    const uint_t* getIndices() const;
+    const uint_t* getMaterialIndices() const;
+    VertexStreams getVertexStreams() const;
+    
+    const vec3& getPosition(uint_t index) const;
+    vec2 getTexCoord(uint_t index) const;
+    VertexAttributes getAttributes(uint_t index) const;
+    Vertex getVertex(uint_t index) const;
+    
+    // Memory used by the positions and attributes streams
+    size_t getPositionsSize() const;
+    size_t getAttributesSize() const;
     
-    const Vertex* getVertex(uint_t index) const;
     virtual AABB getBoundingBox() const;
     virtual bool canIntersect() const;
     
+    static void SplitVertices(uint_t verticesCount, const Vertex* vertices,
+                              vec3* positions, VertexAttributes* attributes);
+    static void PackAttributes(const VertexAttributes& attributes, PackedVertexAttributes* packed);
+    static void UnpackAttributes(const PackedVertexAttributes& packed, VertexAttributes* attributes);
+    
+    // Triangles using each vertex, as compressed rows
+    struct VertexAdjacency {
+        std::vector<uint_t> offsets;
+        std::vector<uint_t> triangles;
+    };
+    
+    static void BuildAdjacency(uint_t verticesCount, const uint_t* indices, uint_t indicesCount,
+                               VertexAdjacency* adjacency);
+    
+    // Triangle tangents are computed in parallel, 4 at a time with SSE2, then
+    // gathered by each vertex from its adjacent triangles
     static void GenerateTangents(bool useUVs,
-                                 Vertex* vertices,
+                                 const vec3* positions, VertexAttributes* attributes,
                                  uint_t verticesCount,
-                                 uint_t* indices, uint_t indicesCount);
+                                 const uint_t* indices, uint_t indicesCount,
+                                 const VertexAdjacency& adjacency);
     
 protected:
+    void _releaseData();
+    void _copySharedData();
+    void _unpackAttributes();
+    // Adjacency of the current indices, built on demand
+    const VertexAdjacency& _getAdjacency();
+    void _releaseAdjacency();
+    
     int                                     _verticesCount;
-    Vertex*                                 _vertices;
+    vec3*                                   _positions;
+    VertexAttributes*                       _attributes;
+    PackedVertexAttributes*                 _packedAttributes;
     int                                     _indicesCount;
     uint_t*                                 _indices;
     uint_t*                                 _materialIndices;
     std::vector<std::shared_ptr<Material>>  _materials;
     std::shared_ptr<Texture>                _alphaTexture;
+    std::shared_ptr<const void>             _sharedDataOwner;
+    VertexAdjacency                         _adjacency;
 };
 
 #endif /* defined(__CSE168_Rendering__MeshBase__) */
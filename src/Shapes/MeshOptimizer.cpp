@@ -0,0 +1,245 @@
+//
+//  MeshOptimizer.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <vector>
+#include <cstring>
+
+#include "Core/AABB.h"
+
+static const uint_t InvalidIndex = (uint_t)-1;
+
+// Triangles are reordered for the vertex cache inside blocks of this many
+// Morton-ordered triangles, so the spatial order is kept at a larger scale
+static const uint_t VertexCacheBlockSize = 1024;
+static const uint_t VertexCacheSize = 16;
+
+static uint64_t HashVertex(const Vertex& v) {
+    uint64_t hash = Core::hash(&v.position, sizeof(v.position));
+    hash = Core::hash(&v.normal, sizeof(v.normal), hash);
+    return Core::hash(&v.texCoord, sizeof(v.texCoord), hash);
+}
+
+static bool SameVertex(const Vertex& a, const Vertex& b) {
+    return (memcmp(&a.position, &b.position, sizeof(a.position)) == 0
+            && memcmp(&a.normal, &b.normal, sizeof(a.normal)) == 0
+            && memcmp(&a.texCoord, &b.texCoord, sizeof(a.texCoord)) == 0);
+}
+
+// Spread the 10 low bits of x so there are two zero bits between each bit
+static uint32_t SpreadBits(uint32_t x) {
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x <<  8)) & 0x0300F00F;
+    x = (x | (x <<  4)) & 0x030C30C3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+static uint32_t MortonCode(const vec3& p) {
+    uint32_t x = (uint32_t)clamp(p.x * 1024.f, 0.f, 1023.f);
+    uint32_t y = (uint32_t)clamp(p.y * 1024.f, 0.f, 1023.f);
+    uint32_t z = (uint32_t)clamp(p.z * 1024.f, 0.f, 1023.f);
+    return (SpreadBits(x) << 2) | (SpreadBits(y) << 1) | SpreadBits(z);
+}
+
+uint_t MeshOptimizer::WeldVertices(uint_t verticesCount, Vertex* vertices,
+                                   uint_t indicesCount, uint_t* indices) {
+    // Open addressing table of the kept vertices
+    uint_t tableSize = Core::roundUpPow2(std::max(verticesCount*2, (uint_t)16));
+    std::vector<uint_t> table(tableSize, InvalidIndex);
+    std::vector<uint_t> remap(verticesCount);
+    
+    // Kept vertices are moved to the front, in order of first occurence
+    uint_t weldedCount = 0;
+    for (uint_t i = 0; i < verticesCount; ++i) {
+        uint_t slot = HashVertex(vertices[i]) & (tableSize-1);
+        while (table[slot] != InvalidIndex && !SameVertex(vertices[table[slot]], vertices[i])) {
+            slot = (slot + 1) & (tableSize-1);
+        }
+        if (table[slot] == InvalidIndex) {
+            vertices[weldedCount] = vertices[i];
+            table[slot] = weldedCount++;
+        }
+        remap[i] = table[slot];
+    }
+    
+    for (uint_t i = 0; i < indicesCount; ++i) {
+        indices[i] = remap[indices[i]];
+    }
+    return weldedCount;
+}
+
+void MeshOptimizer::ReorderTriangles(uint_t verticesCount, const Vertex* vertices,
+                                     uint_t indicesCount, uint_t* indices, uint_t* materialIndices) {
+    uint_t trianglesCount = indicesCount/3;
+    if (trianglesCount < 2) {
+        return;
+    }
+    
+    // Sort triangles by the Morton code of their centroid
+    AABB bounds;
+    std::vector<vec3> centroids(trianglesCount);
+    for (uint_t i = 0; i < trianglesCount; ++i) {
+        centroids[i] = (vertices[indices[i*3+0]].position
+                        + vertices[indices[i*3+1]].position
+                        + vertices[indices[i*3+2]].position) / 3.f;
+        bounds = AABB::Union(bounds, centroids[i]);
+    }
+    vec3 extent = bounds.max - bounds.min;
+    vec3 scale(extent.x > 0.f ? 1.f/extent.x : 0.f,
+               extent.y > 0.f ? 1.f/extent.y : 0.f,
+               extent.z > 0.f ? 1.f/extent.z : 0.f);
+    std::vector<std::pair<uint32_t, uint_t>> codes(trianglesCount);
+    for (uint_t i = 0; i < trianglesCount; ++i) {
+        codes[i] = std::make_pair(MortonCode((centroids[i] - bounds.min) * scale), i);
+    }
+    std::sort(codes.begin(), codes.end());
+    
+    std::vector<uint_t> sortedIndices(indicesCount);
+    for (uint_t i = 0; i < trianglesCount; ++i) {
+        std::copy(indices + codes[i].second*3, indices + codes[i].second*3 + 3, &sortedIndices[i*3]);
+    }
+    
+    // Vertex to triangles adjacency, and count of triangles left to emit per vertex
+    std::vector<uint_t> adjacencyOffsets(verticesCount+1, 0);
+    for (uint_t i = 0; i < indicesCount; ++i) {
+        adjacencyOffsets[sortedIndices[i]+1] += 1;
+    }
+    for (uint_t i = 0; i < verticesCount; ++i) {
+        adjacencyOffsets[i+1] += adjacencyOffsets[i];
+    }
+    std::vector<uint_t> liveTriangles(verticesCount);
+    for (uint_t i = 0; i < verticesCount; ++i) {
+        liveTriangles[i] = adjacencyOffsets[i+1] - adjacencyOffsets[i];
+    }
+    std::vector<uint_t> adjacency(indicesCount);
+    std::vector<uint_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end()-1);
+    for (uint_t i = 0; i < indicesCount; ++i) {
+        adjacency[fill[sortedIndices[i]]++] = i/3;
+    }
+    
+    // Vertex score from Forsyth's algorithm: recently used vertices score
+    // higher, except the ones of the last triangle so strips don't turn
+    // back, and so do vertices with few triangles left
+    std::vector<int> cachePositions(verticesCount, -1);
+    auto vertexScore = [&] (uint_t v) {
+        if (liveTriangles[v] == 0) {
+            return -1.f;
+        }
+        float score = 0.f;
+        int position = cachePositions[v];
+        if (position >= 0 && position < 3) {
+            score = 0.75f;
+        } else if (position >= 3) {
+            score = powf(1.f - (float)(position - 3) / (VertexCacheSize - 3), 1.5f);
+        }
+        return score + 2.f / sqrtf((float)liveTriangles[v]);
+    };
+    
+    // Greedily emit the best scored triangle using cached vertices, inside each block
+    std::vector<bool> emitted(trianglesCount, false);
+    std::vector<uint_t> order;
+    order.reserve(trianglesCount);
+    std::vector<uint_t> cache;
+    for (uint_t blockStart = 0; blockStart < trianglesCount; blockStart += VertexCacheBlockSize) {
+        uint_t blockEnd = std::min(blockStart + VertexCacheBlockSize, trianglesCount);
+        uint_t next = blockStart;
+        for (uint_t emittedCount = blockStart; emittedCount < blockEnd; ++emittedCount) {
+            uint_t best = InvalidIndex;
+            float bestScore = -1.f;
+            for (uint_t v : cache) {
+                for (uint_t j = adjacencyOffsets[v]; j < adjacencyOffsets[v+1]; ++j) {
+                    uint_t t = adjacency[j];
+                    if (t < blockStart || t >= blockEnd || emitted[t]) {
+                        continue;
+                    }
+                    float score = (vertexScore(sortedIndices[t*3+0]) + vertexScore(sortedIndices[t*3+1])
+                                   + vertexScore(sortedIndices[t*3+2]));
+                    if (score > bestScore) {
+                        best = t;
+                        bestScore = score;
+                    }
+                }
+            }
+            // Restart from the next triangle in Morton order
+            if (best == InvalidIndex) {
+                while (emitted[next]) {
+                    ++next;
+                }
+                best = next;
+            }
+            
+            emitted[best] = true;
+            order.push_back(best);
+            
+            // Move the triangle vertices to the front of the cache
+            for (int k = 2; k >= 0; --k) {
+                uint_t v = sortedIndices[best*3+k];
+                liveTriangles[v] -= 1;
+                cache.erase(std::remove(cache.begin(), cache.end(), v), cache.end());
+                cache.insert(cache.begin(), v);
+            }
+            for (uint_t v : cache) {
+                cachePositions[v] = -1;
+            }
+            if (cache.size() > VertexCacheSize) {
+                cache.resize(VertexCacheSize);
+            }
+            for (uint_t k = 0; k < cache.size(); ++k) {
+                cachePositions[cache[k]] = k;
+            }
+        }
+    }
+    
+    // Write back triangles and their materials in the final order
+    std::vector<uint_t> sortedMaterials;
+    if (materialIndices) {
+        sortedMaterials.assign(materialIndices, materialIndices + trianglesCount);
+    }
+    for (uint_t i = 0; i < trianglesCount; ++i) {
+        uint_t t = order[i];
+        std::copy(&sortedIndices[t*3], &sortedIndices[t*3] + 3, indices + i*3);
+        if (materialIndices) {
+            materialIndices[i] = sortedMaterials[codes[t].second];
+        }
+    }
+}
+
+void MeshOptimizer::ReorderVertices(uint_t verticesCount, Vertex* vertices,
+                                    uint_t indicesCount, uint_t* indices) {
+    std::vector<uint_t> remap(verticesCount, InvalidIndex);
+    uint_t nextIndex = 0;
+    for (uint_t i = 0; i < indicesCount; ++i) {
+        if (remap[indices[i]] == InvalidIndex) {
+            remap[indices[i]] = nextIndex++;
+        }
+        indices[i] = remap[indices[i]];
+    }
+    
+    // Unused vertices go last
+    for (uint_t i = 0; i < verticesCount; ++i) {
+        if (remap[i] == InvalidIndex) {
+            remap[i] = nextIndex++;
+        }
+    }
+    std::vector<Vertex> reordered(verticesCount);
+    for (uint_t i = 0; i < verticesCount; ++i) {
+        reordered[remap[i]] = vertices[i];
+    }
+    std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+uint_t MeshOptimizer::Optimize(uint_t verticesCount, Vertex* vertices,
+                               uint_t indicesCount, uint_t* indices, uint_t* materialIndices) {
+    verticesCount = WeldVertices(verticesCount, vertices, indicesCount, indices);
+    ReorderTriangles(verticesCount, vertices, indicesCount, indices, materialIndices);
+    ReorderVertices(verticesCount, vertices, indicesCount, indices);
+    return verticesCount;
+}
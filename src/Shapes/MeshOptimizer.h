@@ -0,0 +1,42 @@
+//
+//  MeshOptimizer.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#ifndef __CSE168_Rendering__MeshOptimizer__
+#define __CSE168_Rendering__MeshOptimizer__
+
+#include "Core/Core.h"
+#include "Shapes/Vertex.h"
+
+/*
+ * Import-time passes compacting meshes and improving their memory locality.
+ * They work in place on the vertices and indices arrays, and keep the
+ * material indices along with their triangles.
+ */
+namespace MeshOptimizer {
+    
+    // Merge the vertices with the same position, normal and uvs, tangents are
+    // ignored since they are generated afterwards. Returns the vertices count
+    uint_t WeldVertices(uint_t verticesCount, Vertex* vertices,
+                        uint_t indicesCount, uint_t* indices);
+    
+    // Sort triangles along a Morton curve of their centroids, then for the
+    // vertex cache inside blocks of neighbour triangles
+    void ReorderTriangles(uint_t verticesCount, const Vertex* vertices,
+                          uint_t indicesCount, uint_t* indices, uint_t* materialIndices);
+    
+    // Store vertices in the order triangles first use them
+    void ReorderVertices(uint_t verticesCount, Vertex* vertices,
+                         uint_t indicesCount, uint_t* indices);
+    
+    // Run all passes, returns the vertices count
+    uint_t Optimize(uint_t verticesCount, Vertex* vertices,
+                    uint_t indicesCount, uint_t* indices, uint_t* materialIndices);
+    
+}
+
+#endif /* defined(__CSE168_Rendering__MeshOptimizer__) */
@@ -39,16 +39,15 @@ void Triangle::setVertices(uint_t a, uint_t b, uint_t c) {
     _vertices[2] = c;
 }
 
-const Vertex* Triangle::getVertex(int num) const {
+Vertex Triangle::getVertex(int num) const {
     return _mesh->getVertex(num);
 }
 
 bool Triangle::intersect(const Ray& ray, Intersection* intersection) const {
-    const Vertex* v0 = _mesh->getVertex(_vertices[0]);
-    const Vertex* v1 = _mesh->getVertex(_vertices[1]);
-    const Vertex* v2 = _mesh->getVertex(_vertices[2]);
+    const vec3& a = _mesh->getPosition(_vertices[0]);
+    const vec3& b = _mesh->getPosition(_vertices[1]);
+    const vec3& c = _mesh->getPosition(_vertices[2]);
     
-    const vec3 &a = v0->position, &b = v1->position, &c = v2->position;
     vec3 oa = ray.origin - a, ca = c - a, ba = b - a;
     vec3 normal = cross(ba, ca);
     float det = dot(-ray.direction, normal);
@@ -77,10 +76,15 @@ bool Triangle::intersect(const Ray& ray, Intersection* intersection) const {
         return false;
     }
     
+    // Shading attributes are only fetched for hits
+    VertexAttributes v0 = _mesh->getAttributes(_vertices[0]);
+    VertexAttributes v1 = _mesh->getAttributes(_vertices[1]);
+    VertexAttributes v2 = _mesh->getAttributes(_vertices[2]);
+    
     // Compute uv coords
-    vec2 uvs = ((1-alpha-beta)*v0->texCoord
-                + alpha*v1->texCoord
-                + beta*v2->texCoord);
+    vec2 uvs = ((1-alpha-beta)*v0.texCoord
+                + alpha*v1.texCoord
+                + beta*v2.texCoord);
     
     // Reject if we have an alpha texture
     const Texture* alphaTexture = nullptr;
@@ -94,9 +98,9 @@ bool Triangle::intersect(const Ray& ray, Intersection* intersection) const {
     }
     
     // Compute smoothed normal
-    normal = ((1-alpha-beta)*v0->normal
-              + alpha*v1->normal
-              + beta*v2->normal);
+    normal = ((1-alpha-beta)*v0.normal
+              + alpha*v1.normal
+              + beta*v2.normal);
     
     // Update the ray
     ray.tmax = t;
@@ -108,12 +112,13 @@ bool Triangle::intersect(const Ray& ray, Intersection* intersection) const {
     intersection->uv = uvs;
     
     // Interpolate tangents
-    intersection->tangentU = ((1-alpha-beta)*v0->tangentU
-                              + alpha*v1->tangentU
-                              + beta*v2->tangentU);
-    intersection->tangentV = ((1-alpha-beta)*v0->tangentV
-                              + alpha*v1->tangentV
-                              + beta*v2->tangentV);
+    intersection->tangentU = ((1-alpha-beta)*v0.tangentU
+                              + alpha*v1.tangentU
+                              + beta*v2.tangentU);
+    intersection->tangentV = ((1-alpha-beta)*v0.tangentV
+                              + alpha*v1.tangentV
+                              + beta*v2.tangentV);
+    intersection->computePositionDerivatives(a, b, c, v0.texCoord, v1.texCoord, v2.texCoord);
     
     if (_material) {
         intersection->material = _material.get();
@@ -124,11 +129,10 @@ bool Triangle::intersect(const Ray& ray, Intersection* intersection) const {
 }
 
 bool Triangle::intersectP(const Ray& ray) const {
-    const Vertex* v0 = _mesh->getVertex(_vertices[0]);
-    const Vertex* v1 = _mesh->getVertex(_vertices[1]);
-    const Vertex* v2 = _mesh->getVertex(_vertices[2]);
+    const vec3& a = _mesh->getPosition(_vertices[0]);
+    const vec3& b = _mesh->getPosition(_vertices[1]);
+    const vec3& c = _mesh->getPosition(_vertices[2]);
     
-    const vec3 &a = v0->position, &b = v1->position, &c = v2->position;
     vec3 oa = ray.origin - a, ca = c - a, ba = b - a;
     vec3 normal = cross(ba, ca);
     float det = dot(-ray.direction, normal);
@@ -153,13 +157,12 @@ bool Triangle::intersectP(const Ray& ray) const {
         return false;
     }
     
-    // Compute uv coords
-    vec2 uvs = ((1-alpha-beta)*v0->texCoord
-                + alpha*v1->texCoord
-                + beta*v2->texCoord);
-    
     // Reject if we have an alpha texture
     if (_mesh && _mesh->_alphaTexture) {
+        // Compute uv coords
+        vec2 uvs = ((1-alpha-beta)*_mesh->getTexCoord(_vertices[0])
+                    + alpha*_mesh->getTexCoord(_vertices[1])
+                    + beta*_mesh->getTexCoord(_vertices[2]));
         if (_mesh->_alphaTexture->evaluateFloat(uvs) == 0.0f) {
             return false;
         }
@@ -168,9 +171,13 @@ bool Triangle::intersectP(const Ray& ray) const {
     return true;
 }
 
+bool Triangle::isOpaque() const {
+    return !(_mesh && _mesh->_alphaTexture);
+}
+
 AABB Triangle::getBoundingBox() const {
-    return AABB::Union(AABB(getVertex(_vertices[0])->position, getVertex(_vertices[1])->position),
-                       getVertex(_vertices[2])->position);
+    return AABB::Union(AABB(_mesh->getPosition(_vertices[0]), _mesh->getPosition(_vertices[1])),
+                       _mesh->getPosition(_vertices[2]));
 }
 
 bool Triangle::hasMaterial() const {
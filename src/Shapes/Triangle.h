@@ -26,10 +26,11 @@ public:
     void setMaterial(const std::shared_ptr<Material>& material);
     void setVertices(uint_t a, uint_t b, uint_t c);
     
-    const Vertex* getVertex(int num) const;
+    Vertex getVertex(int num) const;
     
     virtual bool intersect(const Ray& ray, Intersection* intersection) const;
     virtual bool intersectP(const Ray& ray) const;
+    virtual bool isOpaque() const;
     virtual AABB getBoundingBox() const;
     
     bool hasMaterial() const;
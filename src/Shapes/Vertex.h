@@ -24,4 +24,27 @@ struct Vertex {
     vec3    tangentU, tangentV;
 };
 
+// Shading attributes of a vertex, meshes store them apart from the positions
+struct VertexAttributes {
+    vec3    normal;
+    vec2    texCoord;
+    vec3    tangentU, tangentV;
+};
+
+// Quantized shading attributes: octahedral normal and tangents, half float uvs
+struct PackedVertexAttributes {
+    int16_t     normal[2];
+    int16_t     tangentU[2];
+    int16_t     tangentV[2];
+    uint16_t    texCoord[2];
+};
+
+// Vertex arrays of a mesh, only one of the attributes arrays is set
+struct VertexStreams {
+    uint_t                          verticesCount;
+    const vec3*                     positions;
+    const VertexAttributes*         attributes;
+    const PackedVertexAttributes*   packedAttributes;
+};
+
 #endif /* defined(__CSE168_Rendering__Vertex__) */
@@ -0,0 +1,149 @@
+//
+//  Benchmarks.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#include "Benchmarks.h"
+
+#include <vector>
+#include <algorithm>
+
+#include <QElapsedTimer>
+
+#include "Core/Texture.h"
+#include "Utilities/ImageLoading.h"
+
+static const uint_t TextureLookupsCount = 1 << 22;
+static const uint_t TextureBatchSize = 64;
+
+bool Benchmarks::Run(const std::string& name, int argc, char* argv[]) {
+    if (name == "textures") {
+        return Textures(argc > 0 ? argv[0] : "");
+    }
+    std::cerr << "Benchmarks error: unknown benchmark \"" << name << "\"" << std::endl;
+    return false;
+}
+
+// Print the lookups rate of a run, the checksum keeps the lookups from being optimized away
+static void PrintTextureResult(const std::string& name, qint64 nanoseconds, float checksum) {
+    double rate = TextureLookupsCount / (nanoseconds * 1e-9) / 1e6;
+    std::cout << "  " << name << ": " << nanoseconds / 1e6 << "ms, "
+    << rate << "M lookups/s (checksum " << checksum << ")" << std::endl;
+}
+
+// Batched lookups must match the scalar ones up to the rounding of the SSE2 kernel
+static bool CheckTextureBatches(const std::string& name, const Texture& texture,
+                                const std::vector<vec2>& positions) {
+    std::vector<vec3> colors(TextureBatchSize);
+    std::vector<float> values(TextureBatchSize);
+    for (uint_t i = 0; i < TextureLookupsCount; i += TextureBatchSize) {
+        texture.evaluateVec3Batch(TextureBatchSize, &positions[i], colors.data());
+        texture.evaluateFloatBatch(TextureBatchSize, &positions[i], values.data());
+        for (uint_t j = 0; j < TextureBatchSize; ++j) {
+            vec3 color;
+            float value;
+            texture.evaluateVec3Batch(1, &positions[i+j], &color);
+            texture.evaluateFloatBatch(1, &positions[i+j], &value);
+            vec3 colorError = glm::abs(colors[j] - color);
+            float error = std::max(fabsf(values[j] - value),
+                                   std::max(colorError.x, std::max(colorError.y, colorError.z)));
+            if (error > 1e-5f * std::max(1.f, fabsf(value))) {
+                std::cerr << "Benchmarks error: " << name << " batched lookup " << i+j
+                << " differs from the scalar lookup" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool BenchmarkTexture(const std::string& name, const Texture& texture,
+                             const std::vector<vec2>& positions) {
+    std::cout << name << " texture" << std::endl;
+    if (!CheckTextureBatches(name, texture, positions)) {
+        return false;
+    }
+    QElapsedTimer timer;
+    
+    // Scalar bilinear lookups, one virtual call each
+    timer.start();
+    float checksum = 0.f;
+    for (uint_t i = 0; i < TextureLookupsCount; ++i) {
+        vec3 color;
+        texture.evaluateVec3Batch(1, &positions[i], &color);
+        checksum += color.x;
+    }
+    PrintTextureResult("evaluateVec3Batch x1", timer.nsecsElapsed(), checksum);
+    
+    timer.start();
+    checksum = 0.f;
+    for (uint_t i = 0; i < TextureLookupsCount; ++i) {
+        float value;
+        texture.evaluateFloatBatch(1, &positions[i], &value);
+        checksum += value;
+    }
+    PrintTextureResult("evaluateFloatBatch x1", timer.nsecsElapsed(), checksum);
+    
+    // The same lookups by batches, as packet shading would issue them
+    std::vector<vec3> colors(TextureBatchSize);
+    timer.start();
+    checksum = 0.f;
+    for (uint_t i = 0; i < TextureLookupsCount; i += TextureBatchSize) {
+        texture.evaluateVec3Batch(TextureBatchSize, &positions[i], colors.data());
+        checksum += colors[0].x;
+    }
+    PrintTextureResult("evaluateVec3Batch", timer.nsecsElapsed(), checksum);
+    
+    std::vector<float> values(TextureBatchSize);
+    timer.start();
+    checksum = 0.f;
+    for (uint_t i = 0; i < TextureLookupsCount; i += TextureBatchSize) {
+        texture.evaluateFloatBatch(TextureBatchSize, &positions[i], values.data());
+        checksum += values[0];
+    }
+    PrintTextureResult("evaluateFloatBatch", timer.nsecsElapsed(), checksum);
+    return true;
+}
+
+bool Benchmarks::Textures(const std::string& filename) {
+    std::shared_ptr<Texture> color, gray;
+    if (!filename.empty()) {
+        color = ImageLoading::LoadImage(filename);
+        gray = ImageLoading::LoadFloatImage(filename);
+        if (!color || !gray) {
+            std::cerr << "Benchmarks error: couldn't load texture \"" << filename << "\"" << std::endl;
+            return false;
+        }
+    } else {
+        // Noise texture large enough to miss the caches
+        const int size = 2048;
+        uint32_t* colorData = new uint32_t[size*size];
+        float* grayData = new float[size*size];
+        for (int i = 0; i < size*size; ++i) {
+            colorData[i] = (uint32_t)rand();
+            grayData[i] = (float)rand()/RAND_MAX;
+        }
+        std::shared_ptr<IntTexture> intTexture = std::make_shared<IntTexture>();
+        intTexture->setData(size, size, colorData);
+        std::shared_ptr<FloatTexture> floatTexture = std::make_shared<FloatTexture>();
+        floatTexture->setData(size, size, grayData);
+        color = intTexture;
+        gray = floatTexture;
+    }
+    
+    std::vector<vec2> positions(TextureLookupsCount);
+    for (vec2& p : positions) {
+        p = vec2((float)rand()/RAND_MAX, (float)rand()/RAND_MAX) * 4.f - vec2(2.f);
+    }
+    
+#ifdef __SSE2__
+    std::cout << "Batched lookups use SSE2" << std::endl;
+#else
+    std::cout << "Batched lookups use scalar code" << std::endl;
+#endif
+    return (BenchmarkTexture("Color", *color, positions)
+            && BenchmarkTexture("Float", *gray, positions));
+}
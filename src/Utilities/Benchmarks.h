@@ -0,0 +1,23 @@
+//
+//  Benchmarks.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/12/14.
+//
+//
+
+#ifndef __CSE168_Rendering__Benchmarks__
+#define __CSE168_Rendering__Benchmarks__
+
+#include "Core/Core.h"
+
+namespace Benchmarks {
+    // Run the named benchmark, returns false if it doesn't exist
+    bool Run(const std::string& name, int argc, char* argv[]);
+    
+    // Compare scalar and batched bilinear lookups of an image texture, a
+    // generated one when filename is empty. Fails if their values differ
+    bool Textures(const std::string& filename);
+};
+
+#endif /* defined(__CSE168_Rendering__Benchmarks__) */
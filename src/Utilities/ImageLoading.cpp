@@ -8,29 +8,329 @@
 
 #include "ImageLoading.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include <QImage>
+#include <QFile>
+#include <QFileInfo>
 
-std::shared_ptr<Texture> ImageLoading::LoadImage(std::string filename) {
-    if (filename[0] != '/') {
-        filename = Core::baseDirectory + filename;
+#include "Utilities/TextureCache.h"
+
+// Fill the levels following the first one, each texel averaging 2x2 texels of the previous level
+template <typename T, typename Average>
+static void BuildPyramid(T* data, int width, int height, int levelsCount, const Average& average) {
+    const T* parent = data;
+    int parentWidth = width, parentHeight = height;
+    T* level = data + width*height;
+    for (int i = 1; i < levelsCount; ++i) {
+        int levelWidth = std::max(1, width >> i), levelHeight = std::max(1, height >> i);
+        for (int y = 0; y < levelHeight; ++y) {
+            int y0 = std::min(2*y, parentHeight-1), y1 = std::min(2*y+1, parentHeight-1);
+            for (int x = 0; x < levelWidth; ++x) {
+                int x0 = std::min(2*x, parentWidth-1), x1 = std::min(2*x+1, parentWidth-1);
+                level[y*levelWidth + x] = average(parent[y0*parentWidth + x0], parent[y0*parentWidth + x1],
+                                                  parent[y1*parentWidth + x0], parent[y1*parentWidth + x1]);
+            }
+        }
+        parent = level;
+        parentWidth = levelWidth;
+        parentHeight = levelHeight;
+        level += levelWidth*levelHeight;
+    }
+}
+
+static uint32_t AveragePixels(uint32_t p0, uint32_t p1, uint32_t p2, uint32_t p3) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t sum = (((p0 >> shift) & 0xff) + ((p1 >> shift) & 0xff)
+                        + ((p2 >> shift) & 0xff) + ((p3 >> shift) & 0xff) + 2);
+        result |= (sum >> 2) << shift;
+    }
+    return result;
+}
+
+static float AverageValues(float v0, float v1, float v2, float v3) {
+    return (v0 + v1 + v2 + v3) * 0.25f;
+}
+
+static uint8_t AverageBytes(uint8_t v0, uint8_t v1, uint8_t v2, uint8_t v3) {
+    return (v0 + v1 + v2 + v3 + 2) >> 2;
+}
+
+static vec3 AverageColors(const vec3& c0, const vec3& c1, const vec3& c2, const vec3& c3) {
+    return (c0 + c1 + c2 + c3) * 0.25f;
+}
+
+static std::string FileExtension(const std::string& filename) {
+    return QFileInfo(filename.c_str()).suffix().toLower().toStdString();
+}
+
+// Single channel pyramid of a gray image
+static uint8_t* DecodeGrayImage(const QImage& image, int* width, int* height, int* levelsCount) {
+    QImage converted = image.convertToFormat(QImage::Format_ARGB32);
+    
+    *width = converted.width();
+    *height = converted.height();
+    *levelsCount = ImageTexture::GetLevelsCount(*width, *height);
+    int size = (*width)*(*height);
+    uint8_t* data = new uint8_t[ImageTexture::GetTexelsCount(*width, *height, *levelsCount)];
+    const uint32_t* bits = (const uint32_t*)converted.bits();
+    for (int i = 0; i < size; ++i) {
+        data[i] = bits[i] & 0xff;
+    }
+    BuildPyramid(data, *width, *height, *levelsCount, AverageBytes);
+    
+    return data;
+}
+
+static float* DecodeFloatPixels(const QImage& image, int* width, int* height, int* levelsCount) {
+    QImage converted = image.convertToFormat(QImage::Format_ARGB32);
+    
+    // Copy image data to float array, followed by the MIP levels
+    *width = converted.width();
+    *height = converted.height();
+    *levelsCount = ImageTexture::GetLevelsCount(*width, *height);
+    int size = (*width)*(*height);
+    float* data = new float[ImageTexture::GetTexelsCount(*width, *height, *levelsCount)];
+    const uint32_t* bits = (const uint32_t*)converted.bits();
+    
+    for (int i = 0; i < size; ++i) {
+        int pixel = bits[i];
+        const uint8_t* components = (const uint8_t*)&pixel;
+        vec3 value = vec3((float)components[2]/255.f,
+                          (float)components[1]/255.f,
+                          (float)components[0]/255.f
+                          );
+        data[i] = (value.x + value.y + value.z) / 3.f;
     }
     
+    BuildPyramid(data, *width, *height, *levelsCount, AverageValues);
+    
+    return data;
+}
+
+// Read a run length encoded scanline of a Radiance file
+static bool ReadRGBEScanline(QFile& file, int width, uint8_t* scanline) {
+    uint8_t start[4];
+    if (file.read((char*)start, 4) != 4) {
+        return false;
+    }
+    if (start[0] != 2 || start[1] != 2 || (start[2] & 0x80) || width < 8 || width > 0x7fff) {
+        // Flat scanline, the first pixel is already read
+        std::copy(start, start + 4, scanline);
+        qint64 size = 4*(width-1);
+        return file.read((char*)scanline + 4, size) == size;
+    }
+    if (((start[2] << 8) | start[3]) != width) {
+        return false;
+    }
+    // Each component is stored separately as runs and dumps
+    for (int c = 0; c < 4; ++c) {
+        int x = 0;
+        while (x < width) {
+            uint8_t count;
+            if (!file.getChar((char*)&count)) {
+                return false;
+            }
+            if (count > 128) {
+                count -= 128;
+                uint8_t value;
+                if (x + count > width || !file.getChar((char*)&value)) {
+                    return false;
+                }
+                for (int i = 0; i < count; ++i) {
+                    scanline[4*(x++) + c] = value;
+                }
+            } else {
+                if (count == 0 || x + count > width) {
+                    return false;
+                }
+                for (int i = 0; i < count; ++i) {
+                    if (!file.getChar((char*)&scanline[4*(x++) + c])) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Decode a Radiance RGBE image to half RGB texels with their MIP levels
+static std::shared_ptr<Texture> LoadHDRImage(const std::string& filename) {
+    QFile file(filename.c_str());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    
+    // Header lines end with an empty line, followed by the resolution
+    QByteArray line = file.readLine().trimmed();
+    if (!line.startsWith("#?")) {
+        std::cerr << "ImageLoading error: invalid Radiance file \"" << filename << "\"" << std::endl;
+        return nullptr;
+    }
+    while (!file.atEnd()) {
+        line = file.readLine().trimmed();
+        if (line.isEmpty()) {
+            break;
+        }
+        if (line.startsWith("FORMAT=") && line != "FORMAT=32-bit_rle_rgbe") {
+            std::cerr << "ImageLoading error: unsupported Radiance format \"" << filename << "\"" << std::endl;
+            return nullptr;
+        }
+    }
+    QList<QByteArray> resolution = file.readLine().trimmed().split(' ');
+    if (resolution.size() != 4 || resolution[0] != "-Y" || resolution[2] != "+X") {
+        std::cerr << "ImageLoading error: unsupported Radiance orientation \"" << filename << "\"" << std::endl;
+        return nullptr;
+    }
+    int width = resolution[3].toInt(), height = resolution[1].toInt();
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+    
+    int levelsCount = ImageTexture::GetLevelsCount(width, height);
+    std::vector<vec3> colors(ImageTexture::GetTexelsCount(width, height, levelsCount));
+    std::vector<uint8_t> scanline(4*width);
+    for (int y = 0; y < height; ++y) {
+        if (!ReadRGBEScanline(file, width, scanline.data())) {
+            std::cerr << "ImageLoading error: corrupted Radiance file \"" << filename << "\"" << std::endl;
+            return nullptr;
+        }
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* rgbe = &scanline[4*x];
+            vec3& color = colors[y*width + x];
+            if (rgbe[3] == 0) {
+                color = vec3(0.f);
+            } else {
+                float f = ldexpf(1.f, (int)rgbe[3] - (128+8));
+                color = vec3(rgbe[0], rgbe[1], rgbe[2]) * f;
+            }
+        }
+    }
+    BuildPyramid(colors.data(), width, height, levelsCount, AverageColors);
+    
+    uint16_t* data = new uint16_t[3*colors.size()];
+    for (size_t i = 0; i < colors.size(); ++i) {
+        for (int c = 0; c < 3; ++c) {
+            data[3*i + c] = Core::floatToHalf(colors[i][c]);
+        }
+    }
+    std::shared_ptr<HalfRGBTexture> texture = std::make_shared<HalfRGBTexture>();
+    texture->setData(width, height, data, levelsCount);
+    return texture;
+}
+
+// Read a BC1, BC4 or BC5 compressed DDS file with its MIP levels
+static std::shared_ptr<Texture> LoadDDSImage(const std::string& filename) {
+    QFile file(filename.c_str());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    
+    // Magic followed by the 124 bytes header, as little endian 32 bits words
+    uint32_t header[32];
+    if (file.read((char*)header, sizeof(header)) != sizeof(header)
+        || memcmp(header, "DDS ", 4) != 0 || header[1] != 124) {
+        std::cerr << "ImageLoading error: invalid DDS file \"" << filename << "\"" << std::endl;
+        return nullptr;
+    }
+    int height = header[3], width = header[4];
+    int levelsCount = std::max(1, (int)header[7]);
+    const char* fourCC = (const char*)&header[21];
+    
+    BlockTexture::BlockFormat format;
+    if (memcmp(fourCC, "DXT1", 4) == 0) {
+        format = BlockTexture::BC1;
+    } else if (memcmp(fourCC, "ATI1", 4) == 0 || memcmp(fourCC, "BC4U", 4) == 0) {
+        format = BlockTexture::BC4;
+    } else if (memcmp(fourCC, "ATI2", 4) == 0 || memcmp(fourCC, "BC5U", 4) == 0) {
+        format = BlockTexture::BC5;
+    } else {
+        std::cerr << "ImageLoading error: unsupported DDS format \"" << filename << "\"" << std::endl;
+        return nullptr;
+    }
+    if (width <= 0 || height <= 0 || levelsCount > ImageTexture::GetLevelsCount(width, height)) {
+        std::cerr << "ImageLoading error: invalid DDS file \"" << filename << "\"" << std::endl;
+        return nullptr;
+    }
+    
+    qint64 size = 0;
+    for (int i = 0; i < levelsCount; ++i) {
+        size += BlockTexture::GetLevelSize(format, std::max(1, width >> i), std::max(1, height >> i));
+    }
+    uint8_t* data = new uint8_t[size];
+    if (file.read((char*)data, size) != size) {
+        std::cerr << "ImageLoading error: truncated DDS file \"" << filename << "\"" << std::endl;
+        delete[] data;
+        return nullptr;
+    }
+    std::shared_ptr<BlockTexture> texture = std::make_shared<BlockTexture>();
+    texture->setData(width, height, format, data, levelsCount);
+    return texture;
+}
+
+uint32_t* ImageLoading::DecodeImage(const std::string& filename, int* width, int* height,
+                                   int* levelsCount) {
     QImage image(filename.c_str());
     
     if (image.isNull()) {
         return nullptr;
     }
-
+    
     QImage converted = image.convertToFormat(QImage::Format_ARGB32);
     
-    // Copy image data to int array
-    int size = converted.byteCount();
-    uint32_t* data = new uint32_t[size];
+    // Copy image data to int array, followed by the MIP levels
+    *width = converted.width();
+    *height = converted.height();
+    *levelsCount = ImageTexture::GetLevelsCount(*width, *height);
+    uint32_t* data = new uint32_t[ImageTexture::GetTexelsCount(*width, *height, *levelsCount)];
     const uint32_t* bits = (const uint32_t*)converted.bits();
-    std::copy(bits, bits+(size/sizeof(uint32_t)), data);
+    std::copy(bits, bits+(*width)*(*height), data);
+    BuildPyramid(data, *width, *height, *levelsCount, AveragePixels);
+    
+    return data;
+}
+
+float* ImageLoading::DecodeFloatImage(const std::string& filename, int* width, int* height,
+                                      int* levelsCount) {
+    QImage image(filename.c_str());
+    
+    if (image.isNull()) {
+        return nullptr;
+    }
+    
+    return DecodeFloatPixels(image, width, height, levelsCount);
+}
+
+std::shared_ptr<Texture> ImageLoading::LoadImage(std::string filename) {
+    if (filename[0] != '/') {
+        filename = Core::baseDirectory + filename;
+    }
+    
+    // High dynamic range and compressed images keep their own formats
+    std::string extension = FileExtension(filename);
+    if (extension == "hdr") {
+        return LoadHDRImage(filename);
+    } else if (extension == "dds") {
+        return LoadDDSImage(filename);
+    }
+    
+    // Read the texels on demand when the texture cache is enabled
+    std::shared_ptr<Texture> cached = TextureCache::Instance().loadTexture(filename, TextureCache::RGBTexels);
+    if (cached) {
+        return cached;
+    }
+    
+    int width, height, levelsCount;
+    uint32_t* data = DecodeImage(filename, &width, &height, &levelsCount);
+    if (!data) {
+        return nullptr;
+    }
     
     std::shared_ptr<IntTexture> texture = std::make_shared<IntTexture>();
-    texture->setData(converted.width(), converted.height(), data);
+    texture->setData(width, height, data, levelsCount);
     
     return texture;
 }
@@ -40,31 +340,36 @@ std::shared_ptr<Texture> ImageLoading::LoadFloatImage(std::string filename) {
         filename = Core::baseDirectory + filename;
     }
     
-    QImage image(filename.c_str());
+    std::string extension = FileExtension(filename);
+    if (extension == "hdr") {
+        return LoadHDRImage(filename);
+    } else if (extension == "dds") {
+        return LoadDDSImage(filename);
+    }
     
+    std::shared_ptr<Texture> cached = TextureCache::Instance().loadTexture(filename, TextureCache::FloatTexels);
+    if (cached) {
+        return cached;
+    }
+    
+    QImage image(filename.c_str());
     if (image.isNull()) {
         return nullptr;
     }
     
-    QImage converted = image.convertToFormat(QImage::Format_ARGB32);
-    
-    // Copy image data to int array
-    int size = converted.byteCount() / (sizeof(uint32_t));
-    float* data = new float[size];
-    const uint32_t* bits = (const uint32_t*)converted.bits();
+    int width, height, levelsCount;
     
-    for (int i = 0; i < size; ++i) {
-        int pixel = bits[i];
-        const uint8_t* components = (const uint8_t*)&pixel;
-        vec3 value = vec3((float)components[2]/255.f,
-                          (float)components[1]/255.f,
-                          (float)components[0]/255.f
-                          );
-        data[i] = (value.x + value.y + value.z) / 3.f;
+    // Gray images are stored exactly with one byte per texel
+    if (image.allGray()) {
+        uint8_t* data = DecodeGrayImage(image, &width, &height, &levelsCount);
+        std::shared_ptr<ByteTexture> texture = std::make_shared<ByteTexture>();
+        texture->setData(width, height, data, levelsCount);
+        return texture;
     }
     
+    float* data = DecodeFloatPixels(image, &width, &height, &levelsCount);
     std::shared_ptr<FloatTexture> texture = std::make_shared<FloatTexture>();
-    texture->setData(converted.width(), converted.height(), data);
+    texture->setData(width, height, data, levelsCount);
     
     return texture;
-}
\ No newline at end of file
+}
@@ -15,6 +15,10 @@
 namespace ImageLoading {
     std::shared_ptr<Texture> LoadImage(std::string filename);
     std::shared_ptr<Texture> LoadFloatImage(std::string filename);
+    
+    // Decode an image file followed by its MIP levels, the caller owns the texels
+    uint32_t*   DecodeImage(const std::string& filename, int* width, int* height, int* levelsCount);
+    float*      DecodeFloatImage(const std::string& filename, int* width, int* height, int* levelsCount);
 };
 
 #endif /* defined(__CSE168_Rendering__ImageLoader__) */
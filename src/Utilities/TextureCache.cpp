@@ -0,0 +1,400 @@
+//
+//  TextureCache.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/11/14.
+//
+//
+
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThreadStorage>
+
+#include "Core/Intersection.h"
+#include "Utilities/ImageLoading.h"
+
+static const char       TextureCacheFileMagic[4] = {'T', 'I', 'L', 'E'};
+static const uint32_t   TextureCacheFileVersion = 1;
+
+// Hits are counted per thread and added to the shared counter by batches
+static const uint64_t   HitsBatchSize = 1024;
+
+static std::atomic<uint64_t> NextCachedTextureId(1);
+
+// Last tiles used by a thread
+struct ThreadTileCache {
+    static const int Size = 16;
+    
+    ThreadTileCache() : hits(0) {
+        for (int i = 0; i < Size; ++i) {
+            keys[i] = 0;
+        }
+    }
+    
+    uint64_t                                    keys[Size];
+    std::shared_ptr<const TextureCache::Tile>   tiles[Size];
+    uint64_t                                    hits;
+};
+
+static QThreadStorage<ThreadTileCache> ThreadTiles;
+
+TextureCache& TextureCache::Instance() {
+    static TextureCache cache;
+    return cache;
+}
+
+void TextureCache::Load(const rapidjson::Value& value) {
+    TextureCache& cache = Instance();
+    if (value.HasMember("tileSize")) {
+        cache.setTileSize(value["tileSize"].GetInt());
+    }
+    if (value.HasMember("memory")) {
+        // Budget given in MB
+        cache.setMemoryBudget((size_t)(value["memory"].GetDouble() * 1024 * 1024));
+    }
+    if (value.HasMember("directory")) {
+        std::string directory = value["directory"].GetString();
+        if (directory[0] != '/') {
+            directory = Core::baseDirectory + directory;
+        }
+        cache.setDirectory(directory);
+    }
+}
+
+TextureCache::TextureCache() :
+_directory(), _memoryBudget(256 * 1024 * 1024), _tileSize(64),
+_hits(0), _misses(0), _evictions(0), _loadedBytes(0) {
+    for (int i = 0; i < ShardsCount; ++i) {
+        _shards[i].size = 0;
+    }
+}
+
+TextureCache::~TextureCache() {
+    
+}
+
+bool TextureCache::isEnabled() const {
+    return !_directory.empty();
+}
+
+void TextureCache::setDirectory(const std::string& directory) {
+    if (!QDir().mkpath(directory.c_str())) {
+        std::cerr << "TextureCache error: cannot create directory \"" << directory << "\"" << std::endl;
+        return;
+    }
+    _directory = directory;
+}
+
+void TextureCache::setMemoryBudget(size_t bytes) {
+    _memoryBudget = bytes;
+}
+
+void TextureCache::setTileSize(int tileSize) {
+    _tileSize = std::max(tileSize, 1);
+}
+
+std::shared_ptr<Texture> TextureCache::loadTexture(const std::string& filename, TexelFormat format) {
+    QFileInfo info(filename.c_str());
+    if (!isEnabled() || !info.exists()) {
+        return nullptr;
+    }
+    
+    // The cache file is named after the image, its key tracks the image changes
+    std::string path = info.canonicalFilePath().toStdString();
+    uint64_t nameHash = Core::hash(path.data(), path.size());
+    nameHash = Core::hash(&format, sizeof(format), nameHash);
+    
+    qint64 size = info.size();
+    qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    uint64_t key = Core::hash(&size, sizeof(size), nameHash);
+    key = Core::hash(&modified, sizeof(modified), key);
+    key = Core::hash(&_tileSize, sizeof(_tileSize), key);
+    
+    std::stringstream cacheFilename;
+    cacheFilename << _directory << "/" << std::hex << nameHash << ".tiles";
+    
+    std::shared_ptr<CachedTexture> texture = std::make_shared<CachedTexture>();
+    if (texture->open(cacheFilename.str(), key)) {
+        return texture;
+    }
+    if (!_convert(filename, cacheFilename.str(), key, format) || !texture->open(cacheFilename.str(), key)) {
+        return nullptr;
+    }
+    return texture;
+}
+
+bool TextureCache::_convert(const std::string& filename, const std::string& cacheFilename,
+                            uint64_t key, TexelFormat format) const {
+    // Decode the image with its MIP levels, float values are stored as their bits
+    int width, height, levelsCount;
+    uint32_t* data = nullptr;
+    if (format == FloatTexels) {
+        data = (uint32_t*)ImageLoading::DecodeFloatImage(filename, &width, &height, &levelsCount);
+    } else {
+        data = ImageLoading::DecodeImage(filename, &width, &height, &levelsCount);
+    }
+    if (!data) {
+        return false;
+    }
+    
+    QFile file(cacheFilename.c_str());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "TextureCache error: cannot write file \"" << cacheFilename << "\"" << std::endl;
+        delete[] data;
+        return false;
+    }
+    
+    FileHeader header;
+    std::copy(TextureCacheFileMagic, TextureCacheFileMagic + 4, header.magic);
+    header.version = TextureCacheFileVersion;
+    header.key = key;
+    header.width = width;
+    header.height = height;
+    header.levelsCount = levelsCount;
+    header.tileSize = _tileSize;
+    header.format = format;
+    bool success = file.write((const char*)&header, sizeof(header)) == sizeof(header);
+    
+    // Write the tiles of each level in row order, tiles on the borders are padded
+    Tile tile(_tileSize*_tileSize);
+    const uint32_t* level = data;
+    for (int i = 0; success && i < levelsCount; ++i) {
+        int levelWidth = std::max(1, width >> i), levelHeight = std::max(1, height >> i);
+        for (int ty = 0; success && ty*_tileSize < levelHeight; ++ty) {
+            for (int tx = 0; success && tx*_tileSize < levelWidth; ++tx) {
+                for (int y = 0; y < _tileSize; ++y) {
+                    int sy = std::min(ty*_tileSize + y, levelHeight-1);
+                    for (int x = 0; x < _tileSize; ++x) {
+                        int sx = std::min(tx*_tileSize + x, levelWidth-1);
+                        tile[y*_tileSize + x] = level[sy*levelWidth + sx];
+                    }
+                }
+                qint64 tileBytes = tile.size() * sizeof(uint32_t);
+                success = file.write((const char*)tile.data(), tileBytes) == tileBytes;
+            }
+        }
+        level += levelWidth*levelHeight;
+    }
+    delete[] data;
+    
+    if (!success) {
+        std::cerr << "TextureCache error: cannot write file \"" << cacheFilename << "\"" << std::endl;
+        file.close();
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+const TextureCache::Tile* TextureCache::getTile(uint64_t key,
+                                                const std::function<std::shared_ptr<const Tile> ()>& load) {
+    ThreadTileCache& local = ThreadTiles.localData();
+    int localIndex = key % ThreadTileCache::Size;
+    if (local.keys[localIndex] == key) {
+        if (++local.hits == HitsBatchSize) {
+            _hits += local.hits;
+            local.hits = 0;
+        }
+        return local.tiles[localIndex].get();
+    }
+    
+    Shard& shard = _shards[Core::hash(&key, sizeof(key)) % ShardsCount];
+    std::shared_ptr<const Tile> tile;
+    {
+        QMutexLocker locker(&shard.mutex);
+        auto entry = shard.entries.find(key);
+        if (entry != shard.entries.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, entry->second);
+            tile = entry->second->second;
+        }
+    }
+    
+    if (tile) {
+        ++_hits;
+    } else {
+        // Read without holding the lock, another thread may load the same tile meanwhile
+        tile = load();
+        if (!tile) {
+            return nullptr;
+        }
+        size_t tileBytes = tile->size() * sizeof(uint32_t);
+        ++_misses;
+        _loadedBytes += tileBytes;
+        
+        QMutexLocker locker(&shard.mutex);
+        auto entry = shard.entries.find(key);
+        if (entry != shard.entries.end()) {
+            tile = entry->second->second;
+        } else {
+            shard.lru.push_front(std::make_pair(key, tile));
+            shard.entries[key] = shard.lru.begin();
+            shard.size += tileBytes;
+            
+            // Evict the least recently used tiles of the shard, threads may keep them a bit longer
+            size_t shardBudget = _memoryBudget / ShardsCount;
+            while (shard.size > shardBudget && shard.lru.size() > 1) {
+                shard.size -= shard.lru.back().second->size() * sizeof(uint32_t);
+                shard.entries.erase(shard.lru.back().first);
+                shard.lru.pop_back();
+                ++_evictions;
+            }
+        }
+    }
+    
+    local.keys[localIndex] = key;
+    local.tiles[localIndex] = tile;
+    return tile.get();
+}
+
+TextureCache::Statistics TextureCache::getStatistics() const {
+    Statistics statistics;
+    statistics.hits = _hits;
+    statistics.misses = _misses;
+    statistics.evictions = _evictions;
+    statistics.loadedBytes = _loadedBytes;
+    return statistics;
+}
+
+void TextureCache::printStatistics() const {
+    Statistics statistics = getStatistics();
+    uint64_t lookups = statistics.hits + statistics.misses;
+    float hitRate = lookups > 0 ? 100.f * statistics.hits / lookups : 0.f;
+    std::cout << "Texture cache: " << statistics.hits << " hits, " << statistics.misses << " misses ("
+    << hitRate << "% hit rate), " << statistics.evictions << " evictions, "
+    << statistics.loadedBytes / (1024*1024) << " MB read" << std::endl;
+}
+
+CachedTexture::CachedTexture() : ImageTexture(),
+_id(NextCachedTextureId++), _tileSize(0), _format(TextureCache::RGBTexels),
+_levelsFirstTile(), _levelsTilesX(), _file(), _fileMutex() {
+    
+}
+
+CachedTexture::~CachedTexture() {
+    
+}
+
+bool CachedTexture::open(const std::string& filename, uint64_t key) {
+    _file.setFileName(filename.c_str());
+    if (!_file.exists() || !_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    TextureCache::FileHeader header;
+    if (_file.read((char*)&header, sizeof(header)) != sizeof(header)
+        || !std::equal(TextureCacheFileMagic, TextureCacheFileMagic + 4, header.magic)
+        || header.version != TextureCacheFileVersion || header.key != key || header.tileSize == 0) {
+        _file.close();
+        return false;
+    }
+    
+    _tileSize = header.tileSize;
+    _format = (TextureCache::TexelFormat)header.format;
+    _setLevels(header.width, header.height, header.levelsCount);
+    
+    // Index of the first tile of each level
+    _levelsFirstTile.clear();
+    _levelsTilesX.clear();
+    uint_t tilesCount = 0;
+    for (const Level& level : _levels) {
+        int tilesX = (level.width + _tileSize-1) / _tileSize;
+        int tilesY = (level.height + _tileSize-1) / _tileSize;
+        _levelsFirstTile.push_back(tilesCount);
+        _levelsTilesX.push_back(tilesX);
+        tilesCount += tilesX*tilesY;
+    }
+    
+    qint64 tileBytes = (qint64)_tileSize*_tileSize*sizeof(uint32_t);
+    if ((qint64)sizeof(header) + tilesCount*tileBytes != _file.size()) {
+        _file.close();
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const TextureCache::Tile> CachedTexture::_loadTile(uint_t tile) const {
+    std::shared_ptr<TextureCache::Tile> data = std::make_shared<TextureCache::Tile>(_tileSize*_tileSize);
+    qint64 tileBytes = data->size() * sizeof(uint32_t);
+    
+    QMutexLocker locker(&_fileMutex);
+    if (!_file.seek(sizeof(TextureCache::FileHeader) + tile*tileBytes)
+        || _file.read((char*)data->data(), tileBytes) != tileBytes) {
+        std::cerr << "CachedTexture error: cannot read tile " << tile << std::endl;
+        return nullptr;
+    }
+    return data;
+}
+
+vec3 CachedTexture::_texel(const Level& level, int x, int y) const {
+    x %= level.width;
+    y %= level.height;
+    x = x < 0 ? x + level.width : x;
+    y = y < 0 ? y + level.height : y;
+    
+    // Tiles are keyed by texture and global tile index
+    int levelIndex = &level - _levels.data();
+    uint_t tile = (_levelsFirstTile[levelIndex]
+                   + (y / _tileSize) * _levelsTilesX[levelIndex] + x / _tileSize);
+    uint64_t key = (_id << 32) | tile;
+    const TextureCache::Tile* data = TextureCache::Instance().getTile(key, [&] {
+        return _loadTile(tile);
+    });
+    if (!data) {
+        return vec3(0.f);
+    }
+    
+    uint32_t texel = (*data)[(y % _tileSize) * _tileSize + x % _tileSize];
+    if (_format == TextureCache::FloatTexels) {
+        float value;
+        memcpy(&value, &texel, sizeof(value));
+        return vec3(value);
+    }
+    const uint8_t* components = (const uint8_t*)&texel;
+    return vec3((float)components[2]/255.f,
+                (float)components[1]/255.f,
+                (float)components[0]/255.f);
+}
+
+float CachedTexture::evaluateFloat(const vec2& pos) const {
+    vec3 value = evaluateVec3(pos);
+    return _format == TextureCache::FloatTexels ? value.x : length(value);
+}
+
+vec3 CachedTexture::evaluateVec3(const vec2& p) const {
+    if (_levels.empty()) {
+        return vec3(0.f);
+    }
+    vec2 pos = wrap(vec2(p.s, 1.f-p.t));
+    const Level& level = _levels[0];
+    return _texel(level, (int)(pos.x*level.width), (int)(pos.y*level.height));
+}
+
+float CachedTexture::evaluateFloat(const Intersection& intersection) const {
+    vec3 value = evaluateVec3(intersection);
+    return _format == TextureCache::FloatTexels ? value.x : length(value);
+}
+
+vec3 CachedTexture::evaluateVec3(const Intersection& intersection) const {
+    if (!_isFiltered(intersection)) {
+        return evaluateVec3(intersection.uv);
+    }
+    return _lookup(intersection);
+}
+
+void CachedTexture::evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const {
+    std::vector<vec3> colors(count);
+    evaluateVec3Batch(count, positions, colors.data());
+    for (uint_t i = 0; i < count; ++i) {
+        values[i] = _format == TextureCache::FloatTexels ? colors[i].x : length(colors[i]);
+    }
+}
+
+void CachedTexture::evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const {
+    _bilinearBatch(count, positions, values);
+}
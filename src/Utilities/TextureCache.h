@@ -0,0 +1,143 @@
+//
+//  TextureCache.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/11/14.
+//
+//
+
+#ifndef __CSE168_Rendering__TextureCache__
+#define __CSE168_Rendering__TextureCache__
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+
+#include <QFile>
+#include <QMutex>
+
+#include "Core/Core.h"
+#include "Core/Texture.h"
+
+/*
+ * Process-wide cache of texture tiles. Image files are converted once to a
+ * tiled and MIP mapped file in the cache directory, then their tiles are
+ * read on demand and kept within a memory budget, the least recently used
+ * ones being evicted first. The cache is split in independently locked
+ * shards, and each thread remembers its last tiles so most lookups don't lock.
+ */
+class TextureCache {
+public:
+    
+    enum TexelFormat {
+        RGBTexels = 0,
+        FloatTexels = 1
+    };
+    
+    // Texels of a tile, packed ARGB colors or float values
+    typedef std::vector<uint32_t> Tile;
+    
+    struct Statistics {
+        uint64_t    hits;
+        uint64_t    misses;
+        uint64_t    evictions;
+        uint64_t    loadedBytes;
+    };
+    
+    static TextureCache& Instance();
+    
+    // Configure the cache from the "textureCache" config entry
+    static void Load(const rapidjson::Value& value);
+    
+    bool    isEnabled() const;
+    void    setDirectory(const std::string& directory);
+    void    setMemoryBudget(size_t bytes);
+    void    setTileSize(int tileSize);
+    
+    // Cached texture of an image file, converted first when needed
+    std::shared_ptr<Texture> loadTexture(const std::string& filename, TexelFormat format);
+    
+    // Tile for the given key, loaded with load on a miss. The tile stays valid
+    // until the next call from the same thread
+    const Tile* getTile(uint64_t key, const std::function<std::shared_ptr<const Tile> ()>& load);
+    
+    Statistics  getStatistics() const;
+    void        printStatistics() const;
+    
+private:
+    friend class CachedTexture;
+    
+    static const int ShardsCount = 16;
+    
+    struct FileHeader {
+        char        magic[4];
+        uint32_t    version;
+        uint64_t    key;
+        uint32_t    width, height;
+        uint32_t    levelsCount;
+        uint32_t    tileSize;
+        uint32_t    format;
+    };
+    
+    struct Shard {
+        typedef std::list<std::pair<uint64_t, std::shared_ptr<const Tile>>> LRUList;
+        
+        QMutex                                          mutex;
+        LRUList                                         lru;
+        std::unordered_map<uint64_t, LRUList::iterator> entries;
+        size_t                                          size;
+    };
+    
+    TextureCache();
+    ~TextureCache();
+    
+    bool _convert(const std::string& filename, const std::string& cacheFilename,
+                  uint64_t key, TexelFormat format) const;
+    
+    std::string             _directory;
+    size_t                  _memoryBudget;
+    int                     _tileSize;
+    Shard                   _shards[ShardsCount];
+    std::atomic<uint64_t>   _hits;
+    std::atomic<uint64_t>   _misses;
+    std::atomic<uint64_t>   _evictions;
+    std::atomic<uint64_t>   _loadedBytes;
+};
+
+/*
+ * Image texture whose texels are read through the texture cache
+ */
+class CachedTexture : public ImageTexture {
+public:
+    
+    CachedTexture();
+    ~CachedTexture();
+    
+    // Open a tiled file, fails if it is missing or doesn't match the key
+    bool open(const std::string& filename, uint64_t key);
+    
+    virtual float evaluateFloat(const vec2& pos) const;
+    virtual vec3 evaluateVec3(const vec2& pos) const;
+    virtual float evaluateFloat(const Intersection& intersection) const;
+    virtual vec3 evaluateVec3(const Intersection& intersection) const;
+    virtual void evaluateFloatBatch(uint_t count, const vec2* positions, float* values) const;
+    virtual void evaluateVec3Batch(uint_t count, const vec2* positions, vec3* values) const;
+    
+protected:
+    virtual vec3 _texel(const Level& level, int x, int y) const;
+    
+private:
+    std::shared_ptr<const TextureCache::Tile> _loadTile(uint_t tile) const;
+    
+    uint64_t                    _id;
+    int                         _tileSize;
+    TextureCache::TexelFormat   _format;
+    std::vector<uint_t>         _levelsFirstTile;
+    std::vector<int>            _levelsTilesX;
+    mutable QFile               _file;
+    mutable QMutex              _fileMutex;
+};
+
+#endif /* defined(__CSE168_Rendering__TextureCache__) */
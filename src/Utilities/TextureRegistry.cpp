@@ -0,0 +1,140 @@
+//
+//  TextureRegistry.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/11/14.
+//
+//
+
+#include "TextureRegistry.h"
+
+#include <set>
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include "Utilities/ImageLoading.h"
+
+TextureRegistry& TextureRegistry::Instance() {
+    static TextureRegistry registry;
+    return registry;
+}
+
+TextureRegistry::TextureRegistry() : _mutex(), _textures() {
+    
+}
+
+TextureRegistry::~TextureRegistry() {
+    
+}
+
+std::string TextureRegistry::_key(const std::string& filename, TexelType type) const {
+    std::string path = filename;
+    if (!path.empty() && path[0] != '/') {
+        path = Core::baseDirectory + path;
+    }
+    // Resolve links and relative components, missing files keep their path
+    QFileInfo info(path.c_str());
+    std::string canonical = info.canonicalFilePath().toStdString();
+    if (canonical.empty()) {
+        canonical = info.absoluteFilePath().toStdString();
+    }
+    return canonical + (type == FloatTexels ? ":float" : ":color");
+}
+
+std::shared_ptr<Texture> TextureRegistry::_find(const std::string& key) {
+    QMutexLocker locker(&_mutex);
+    auto it = _textures.find(key);
+    if (it == _textures.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<Texture> texture = it->second.lock();
+    if (!texture) {
+        _textures.erase(it);
+    }
+    return texture;
+}
+
+std::shared_ptr<Texture> TextureRegistry::getTexture(const std::string& filename, TexelType type) {
+    if (filename.empty()) {
+        return nullptr;
+    }
+    std::string key = _key(filename, type);
+    std::shared_ptr<Texture> texture = _find(key);
+    if (texture) {
+        return texture;
+    }
+    
+    // Decode outside of the lock so other files can be loaded meanwhile
+    if (type == FloatTexels) {
+        texture = ImageLoading::LoadFloatImage(filename);
+    } else {
+        texture = ImageLoading::LoadImage(filename);
+    }
+    if (!texture) {
+        return nullptr;
+    }
+    
+    QMutexLocker locker(&_mutex);
+    // Keep the texture registered by another thread if it loaded the same file
+    std::weak_ptr<Texture>& entry = _textures[key];
+    std::shared_ptr<Texture> registered = entry.lock();
+    if (registered) {
+        return registered;
+    }
+    entry = texture;
+    return texture;
+}
+
+std::vector<std::shared_ptr<Texture>>
+TextureRegistry::prefetch(const std::vector<Request>& requests) {
+    std::vector<std::shared_ptr<Texture>> textures;
+    
+    // Keep one request per key, the registered textures are already loaded
+    std::vector<Request> misses;
+    std::set<std::string> keys;
+    for (const Request& request : requests) {
+        if (request.first.empty()) {
+            continue;
+        }
+        std::string key = _key(request.first, request.second);
+        if (!keys.insert(key).second) {
+            continue;
+        }
+        std::shared_ptr<Texture> texture = _find(key);
+        if (texture) {
+            textures.push_back(texture);
+        } else {
+            misses.push_back(request);
+        }
+    }
+    if (misses.empty()) {
+        return textures;
+    }
+    
+    // Load the misses in parallel
+    std::vector<std::shared_ptr<Texture>> loaded(misses.size());
+    Core::parallelFor(misses.size(), [&] (uint_t i) {
+        loaded[i] = getTexture(misses[i].first, misses[i].second);
+    });
+    for (const std::shared_ptr<Texture>& texture : loaded) {
+        if (texture) {
+            textures.push_back(texture);
+        }
+    }
+    return textures;
+}
+
+std::string TextureRegistry::getFilename(const std::shared_ptr<Texture>& texture) {
+    if (!texture) {
+        return std::string();
+    }
+    QMutexLocker locker(&_mutex);
+    for (const auto& entry : _textures) {
+        if (entry.second.lock() == texture) {
+            // Remove the texel type suffix of the key
+            return entry.first.substr(0, entry.first.rfind(':'));
+        }
+    }
+    return std::string();
+}
@@ -0,0 +1,59 @@
+//
+//  TextureRegistry.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/11/14.
+//
+//
+
+#ifndef __CSE168_Rendering__TextureRegistry__
+#define __CSE168_Rendering__TextureRegistry__
+
+#include <vector>
+#include <unordered_map>
+
+#include <QMutex>
+
+#include "Core/Core.h"
+#include "Core/Texture.h"
+
+/*
+ * Process-wide registry of the image textures loaded by the importers, so a
+ * file used by many materials is decoded and stored only once. Textures are
+ * keyed by canonical path and texel type, and only weakly referenced: they
+ * are released when no material uses them anymore.
+ */
+class TextureRegistry {
+public:
+    
+    enum TexelType {
+        ColorTexels = 0,
+        FloatTexels = 1
+    };
+    
+    typedef std::pair<std::string, TexelType> Request;
+    
+    static TextureRegistry& Instance();
+    
+    // Shared texture of an image file, loaded on a miss
+    std::shared_ptr<Texture> getTexture(const std::string& filename, TexelType type);
+    
+    // Load the missing textures of the requests in parallel. The returned
+    // textures must be kept alive until the requests are fetched
+    std::vector<std::shared_ptr<Texture>> prefetch(const std::vector<Request>& requests);
+    
+    // Canonical path of a registered texture, empty when it isn't registered
+    std::string getFilename(const std::shared_ptr<Texture>& texture);
+    
+private:
+    TextureRegistry();
+    ~TextureRegistry();
+    
+    std::string _key(const std::string& filename, TexelType type) const;
+    std::shared_ptr<Texture> _find(const std::string& key);
+    
+    QMutex                                                  _mutex;
+    std::unordered_map<std::string, std::weak_ptr<Texture>> _textures;
+};
+
+#endif /* defined(__CSE168_Rendering__TextureRegistry__) */
@@ -8,8 +8,12 @@
 
 #include "DensityVolume.h"
 
+#include <algorithm>
+
 #include "Core/Ray.h"
 
+static const Transform IdentityTransform;
+
 DensityVolume::DensityVolume() :
 Volume(), _parentNode(), _bounds(), _sigmaA(0.f), _sigmaS(0.f), _le(0.f), _g(0.f), _stepSize(1.f) {
     
@@ -52,28 +56,31 @@ AABB DensityVolume::getBoundingBox() const {
 }
 
 bool DensityVolume::intersectP(const Ray &ray, float *t0, float *t1) const {
-    Transform worldToObject = _parentNode ? Transform::Inverse(_parentNode->getTransform()) : Transform();
+    const Transform& worldToObject = _getWorldToObject();
     Ray volumeRay = worldToObject(ray);
     return _bounds.intersectP(volumeRay, t0, t1);
 }
 
 Spectrum DensityVolume::sigmaA(const vec3 &p) const {
-    Transform worldToObject = _parentNode ? Transform::Inverse(_parentNode->getTransform()) : Transform();
+    const Transform& worldToObject = _getWorldToObject();
     return density(worldToObject(p)) * _sigmaA;
 }
 
 Spectrum DensityVolume::sigmaS(const vec3 &p) const {
-    Transform worldToObject = _parentNode ? Transform::Inverse(_parentNode->getTransform()) : Transform();
+    const Transform& worldToObject = _getWorldToObject();
     return density(worldToObject(p)) * _sigmaS;
 }
 
 Spectrum DensityVolume::le(const vec3 &p) const {
-    Transform worldToObject = _parentNode ? Transform::Inverse(_parentNode->getTransform()) : Transform();
-    return density(worldToObject(p)) * _le;
+    return emission(_getWorldToObject()(p));
+}
+
+Spectrum DensityVolume::emission(const vec3& p) const {
+    return density(p) * _le;
 }
 
 float DensityVolume::phase(const vec3& p, const vec3& wi, const vec3& wo) const {
-    Transform worldToObject = _parentNode ? Transform::Inverse(_parentNode->getTransform()) : Transform();
+    const Transform& worldToObject = _getWorldToObject();
     if (!_bounds.intersectP(worldToObject(p))) {
         return 0.f;
     }
@@ -85,7 +92,7 @@ Spectrum DensityVolume::sigmaT(const vec3& p) const {
 }
 
 Spectrum DensityVolume::tau(const Ray& ray) const {
-    Transform worldToObject = _parentNode ? Transform::Inverse(_parentNode->getTransform()) : Transform();
+    const Transform& worldToObject = _getWorldToObject();
     Ray volumeRay = worldToObject(ray);
     
     float t0, t1;
@@ -95,19 +102,75 @@ Spectrum DensityVolume::tau(const Ray& ray) const {
     
     const float stepSize = this->stepSize();
     
-    Spectrum tau = 0.f;
-    
     // Add sampling offset
-    t0 += ((float)rand()/RAND_MAX)*stepSize;
+    float tfirst = t0 + ((float)rand()/RAND_MAX)*stepSize;
     
-    while (t0 < t1) {
-        tau += sigmaT(ray(t0)) * stepSize;
-        t0 = t0 + stepSize;
+    // Sample density along the ray in object space, steps falling in empty
+    // space are skipped but the others keep their position
+    std::vector<Segment> segments;
+    _getDensitySegments(volumeRay, t0, t1, segments);
+    float densitySum = 0.f;
+    for (const Segment& segment : segments) {
+        if (segment.maxSigmaT <= 0.f) {
+            continue;
+        }
+        int step = (int)std::max(0.f, ceilf((segment.t0 - tfirst) / stepSize));
+        float t = tfirst + step*stepSize;
+        while (t < segment.t1) {
+            densitySum += density(volumeRay(t));
+            t = tfirst + (++step)*stepSize;
+        }
     }
     
-    return tau;
+    return densitySum * stepSize * (_sigmaA + _sigmaS);
 }
 
 float DensityVolume::stepSize() const {
     return _stepSize;
-}
\ No newline at end of file
+}
+
+void DensityVolume::sampleSegment(const Ray& ray, float t0, float stepSize, uint_t count,
+                                  Sample* samples) const {
+    // Convert the ray once, the transform keeps distances along the ray
+    Ray volumeRay = _getWorldToObject()(ray);
+    Spectrum sigmaT = _sigmaA + _sigmaS;
+    for (uint_t i = 0; i < count; ++i) {
+        vec3 p = volumeRay(t0 + i*stepSize);
+        float d = density(p);
+        samples[i].sigmaS = d * _sigmaS;
+        samples[i].sigmaT = d * sigmaT;
+        samples[i].le = emission(p);
+    }
+}
+
+void DensityVolume::getSegments(const Ray& ray, float t0, float t1,
+                                std::vector<Segment>& segments) const {
+    segments.clear();
+    Ray volumeRay = _getWorldToObject()(ray);
+    float b0, b1;
+    if (!_bounds.intersectP(volumeRay, &b0, &b1)) {
+        return;
+    }
+    b0 = std::max(b0, t0);
+    b1 = std::min(b1, t1);
+    if (b0 >= b1) {
+        return;
+    }
+    _getDensitySegments(volumeRay, b0, b1, segments);
+    
+    // Scale the density bounds by the largest extinction coefficient
+    vec3 sigmaT = (_sigmaA + _sigmaS).getColor();
+    float maxSigmaT = std::max(sigmaT.x, std::max(sigmaT.y, sigmaT.z));
+    for (Segment& segment : segments) {
+        segment.maxSigmaT = maxSigmaT > 0.f ? segment.maxSigmaT * maxSigmaT : 0.f;
+    }
+}
+
+void DensityVolume::_getDensitySegments(const Ray& ray, float t0, float t1,
+                                        std::vector<Segment>& segments) const {
+    Volume::getSegments(ray, t0, t1, segments);
+}
+
+const Transform& DensityVolume::_getWorldToObject() const {
+    return _parentNode ? _parentNode->getInverseTransform() : IdentityTransform;
+}
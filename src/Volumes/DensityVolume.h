@@ -27,7 +27,9 @@ public:
     void setPhaseParameter(float g);
     void setStepSize(float stepSize);
     
+    // Density and emitted light at a point in object space
     virtual float density(const vec3& p) const = 0;
+    virtual Spectrum emission(const vec3& p) const;
     
     virtual AABB getBoundingBox() const;
     virtual bool intersectP(const Ray& ray, float* t0, float* t1) const;
@@ -38,8 +40,18 @@ public:
     virtual Spectrum sigmaT(const vec3& p) const;
     virtual Spectrum tau(const Ray& ray) const;
     virtual float stepSize() const;
+    virtual void sampleSegment(const Ray& ray, float t0, float stepSize, uint_t count,
+                               Sample* samples) const;
+    virtual void getSegments(const Ray& ray, float t0, float t1,
+                             std::vector<Segment>& segments) const;
     
 protected:
+    const Transform& _getWorldToObject() const;
+    
+    // Segments of an object space ray, maxSigmaT holding a bound of the density
+    virtual void _getDensitySegments(const Ray& ray, float t0, float t1,
+                                     std::vector<Segment>& segments) const;
+    
     std::shared_ptr<SceneNode>  _parentNode;
     AABB                        _bounds;
     Spectrum                    _sigmaA;
@@ -8,125 +8,488 @@
 
 #include "GridVolume.h"
 
-#include "Core/ConfigFileReader.h"
+#include <algorithm>
+
+#include "Core/JSONFileStream.h"
+#include "Core/Ray.h"
+
+static const char       GridFileMagic[4] = {'G', 'R', 'I', 'D'};
+static const uint32_t   GridFileVersion = 1;
+
+static float VoxelValue(const void* data, GridVolume::VoxelFormat format, uint_t index) {
+    if (format == GridVolume::HalfVoxels) {
+        return Core::halfToFloat(((const uint16_t*)data)[index]);
+    }
+    return ((const float*)data)[index];
+}
+
+bool GridVolume::ConvertToBinary(const std::string& jsonFilename, const std::string& filename,
+                                 VoxelFormat format) {
+    GridVolume grid;
+    if (!grid._loadJSON(jsonFilename)) {
+        return false;
+    }
+    return grid.saveData(filename, format);
+}
 
 GridVolume::GridVolume() :
-DensityVolume(), _sizeX(0), _sizeY(0), _sizeZ(0), _frames(), _density(nullptr), _temperature(nullptr) {
+DensityVolume(), _sizeX(0), _sizeY(0), _sizeZ(0), _format(FloatVoxels), _frames(), _file(),
+_density(nullptr), _temperature(nullptr) {
     
 }
 
 GridVolume::~GridVolume() {
-    for (const Frame& frame : _frames) {
-        if (frame.density) {
-            delete[] frame.density;
-        }
-        if (frame.temperature) {
-            delete[] frame.temperature;
-        }
+    _clear();
+}
+
+void GridVolume::_clear() {
+    if (_file.isOpen()) {
+        _file.close();
     }
+    _frames.clear();
+    _format = FloatVoxels;
+    _density = nullptr;
+    _temperature = nullptr;
 }
 
 bool GridVolume::loadData(const std::string& filename) {
-    // Import data
-    std::string contents;
-    if (!ConfigFileReader::LoadFileContents(filename, contents)) {
+    _clear();
+    
+    // Look for the binary header, fallback on the JSON format
+    QFile file(filename.c_str());
+    char magic[4];
+    bool binary = (file.open(QIODevice::ReadOnly)
+                   && file.read(magic, sizeof(magic)) == sizeof(magic)
+                   && std::equal(GridFileMagic, GridFileMagic + 4, magic));
+    file.close();
+    
+    if (!(binary ? _loadBinary(filename) : _loadJSON(filename))) {
+        _clear();
         return false;
     }
     
-    // Parse json file
-    rapidjson::Document json;
-    json.Parse<0>(contents.c_str());
-    if (json.HasParseError()) {
-        std::cerr << json.GetErrorOffset() << ": " << json.GetParseError() << std::endl;
-        std::cerr << contents.substr(json.GetErrorOffset(), 30) << std::endl;
+    setFrame(0);
+    
+    return true;
+}
+
+bool GridVolume::_loadBinary(const std::string& filename) {
+    _file.setFileName(filename.c_str());
+    if (!_file.open(QIODevice::ReadOnly)) {
+        std::cerr << "GridVolume import error: cannot open file \"" << filename << "\"" << std::endl;
         return false;
     }
     
-    if (!json.HasMember("size")) {
-        std::cerr << "GridVolume import error: no size specified" << std::endl;
+    FileHeader header;
+    if (_file.read((char*)&header, sizeof(header)) != sizeof(header)
+        || header.version != GridFileVersion
+        || (header.format != FloatVoxels && header.format != HalfVoxels)) {
+        std::cerr << "GridVolume import error: invalid grid file header" << std::endl;
         return false;
     }
-    if (!json.HasMember("frames")) {
-        std::cerr << "GridVolume import error: no frame specified" << std::endl;
+    
+    _sizeX = header.sizeX;
+    _sizeY = header.sizeY;
+    _sizeZ = header.sizeZ;
+    _format = (VoxelFormat)header.format;
+    
+    qint64 voxelsSize = (qint64)_sizeX*_sizeY*_sizeZ * (_format == HalfVoxels ? sizeof(uint16_t) : sizeof(float));
+    qint64 frameSize = voxelsSize * (header.hasTemperature ? 2 : 1);
+    qint64 dataSize = frameSize * header.framesCount;
+    if ((qint64)sizeof(header) + dataSize != _file.size()) {
+        std::cerr << "GridVolume import error: truncated grid file" << std::endl;
         return false;
     }
+    if (dataSize == 0) {
+        return true;
+    }
     
-    // Get size and actual data
-    const rapidjson::Value& sizeValue = json["size"];
+    // Map all the frames, pages are only read when the voxels are accessed
+    const uchar* data = _file.map(sizeof(header), dataSize);
+    if (!data) {
+        std::cerr << "GridVolume import error: cannot map file \"" << filename << "\"" << std::endl;
+        return false;
+    }
     
-    if (!sizeValue.IsArray() || sizeValue.Size() != 3) {
-        std::cerr << "GridVolume import error: invalid size, expected a 3D int vector" << std::endl;
+    _frames.reserve(header.framesCount);
+    for (uint_t i = 0; i < header.framesCount; ++i) {
+        const uchar* frameData = data + i*frameSize;
+        Frame f;
+        f.density = frameData;
+        f.temperature = header.hasTemperature ? frameData + voxelsSize : nullptr;
+        _frames.push_back(f);
+    }
+    
+    return true;
+}
+
+/*
+ * SAX handler reading the size and frames of a JSON grid file. Voxel values
+ * are appended to the frame arrays as they are parsed, so the file is never
+ * held in memory as a document.
+ */
+class GridJSONHandler {
+public:
+    
+    struct FrameValues {
+        std::vector<float>  density;
+        std::vector<float>  temperature;
+        bool                hasDensity;
+        bool                hasTemperature;
+    };
+    
+    GridJSONHandler() : size(), frames(), hasFrames(false), _contexts(), _key(), _expectKey(false) {
+        
+    }
+    
+    // Keys are reported as strings by rapidjson versions without Key events
+    bool Null() { return _value(0.0); }
+    bool Bool(bool b) { return _value(b ? 1.0 : 0.0); }
+    bool Int(int i) { return _value(i); }
+    bool Uint(unsigned i) { return _value(i); }
+    bool Int64(int64_t i) { return _value((double)i); }
+    bool Uint64(uint64_t i) { return _value((double)i); }
+    bool Double(double d) { return _value(d); }
+    bool String(const char* str, rapidjson::SizeType length, bool) {
+        if (_expectKey) {
+            return Key(str, length, true);
+        }
+        return _endValue();
+    }
+    bool Key(const char* str, rapidjson::SizeType length, bool) {
+        _key.assign(str, length);
+        _expectKey = false;
+        return true;
+    }
+    bool StartObject();
+    bool EndObject(rapidjson::SizeType) { _contexts.pop_back(); return _endValue(); }
+    bool StartArray();
+    bool EndArray(rapidjson::SizeType) { _contexts.pop_back(); return _endValue(); }
+    
+    std::vector<double>         size;
+    std::vector<FrameValues>    frames;
+    bool                        hasFrames;
+    
+private:
+    enum Context {
+        RootContext,
+        SizeContext,
+        FramesContext,
+        FrameContext,
+        DensityContext,
+        TemperatureContext,
+        OtherObjectContext,
+        OtherArrayContext
+    };
+    
+    bool _value(double v);
+    bool _endValue();
+    
+    std::vector<Context>    _contexts;
+    std::string             _key;
+    bool                    _expectKey;
+};
+
+bool GridJSONHandler::StartObject() {
+    if (_contexts.empty()) {
+        _contexts.push_back(RootContext);
+    } else if (_contexts.back() == FramesContext) {
+        FrameValues frame;
+        frame.hasDensity = false;
+        frame.hasTemperature = false;
+        frames.push_back(frame);
+        _contexts.push_back(FrameContext);
+    } else {
+        _contexts.push_back(OtherObjectContext);
+    }
+    _expectKey = true;
+    return true;
+}
+
+bool GridJSONHandler::StartArray() {
+    Context parent = _contexts.empty() ? OtherArrayContext : _contexts.back();
+    Context context = OtherArrayContext;
+    if (parent == RootContext && _key == "size") {
+        context = SizeContext;
+        size.clear();
+    } else if (parent == RootContext && _key == "frames") {
+        context = FramesContext;
+        hasFrames = true;
+    } else if (parent == FrameContext && (_key == "density" || _key == "temperature")) {
+        FrameValues& frame = frames.back();
+        bool density = (_key == "density");
+        context = density ? DensityContext : TemperatureContext;
+        (density ? frame.hasDensity : frame.hasTemperature) = true;
+        
+        // Allocate the frame array once when the size is already known
+        std::vector<float>& values = density ? frame.density : frame.temperature;
+        values.clear();
+        if (size.size() == 3) {
+            values.reserve((size_t)(size[0]*size[1]*size[2]));
+        }
+    }
+    _contexts.push_back(context);
+    _expectKey = false;
+    return true;
+}
+
+bool GridJSONHandler::_value(double v) {
+    if (!_contexts.empty()) {
+        switch (_contexts.back()) {
+            case SizeContext:
+                size.push_back(v);
+                break;
+            case DensityContext:
+                frames.back().density.push_back((float)v);
+                break;
+            case TemperatureContext:
+                frames.back().temperature.push_back((float)v);
+                break;
+            default:
+                break;
+        }
+    }
+    return _endValue();
+}
+
+bool GridJSONHandler::_endValue() {
+    // The next string of an object is a key
+    if (!_contexts.empty()) {
+        Context context = _contexts.back();
+        _expectKey = (context == RootContext || context == FrameContext
+                      || context == OtherObjectContext);
+    }
+    return true;
+}
+
+bool GridVolume::_loadJSON(const std::string& filename) {
+    JSONFileStream stream(filename);
+    if (!stream.isOpen()) {
+        std::cerr << "GridVolume import error: cannot open file \"" << filename << "\"" << std::endl;
         return false;
     }
     
-    _sizeX = sizeValue[0u].GetInt();
-    _sizeY = sizeValue[1u].GetInt();
-    _sizeZ = sizeValue[2u].GetInt();
+    // Parse json file while it is read
+    GridJSONHandler handler;
+    rapidjson::Reader reader;
+    if (!reader.Parse<0>(stream, handler)) {
+        std::cerr << "GridVolume import error: invalid JSON at offset " << reader.GetErrorOffset()
+        << std::endl;
+        std::cerr << stream.readAt(reader.GetErrorOffset(), 30) << std::endl;
+        return false;
+    }
     
-    const rapidjson::Value& framesValue = json["frames"];
-    if (!framesValue.IsArray()) {
-        std::cerr << "GridVolume import error: invalid frame array" << std::endl;
+    if (handler.size.empty()) {
+        std::cerr << "GridVolume import error: no size specified" << std::endl;
+        return false;
+    }
+    if (!handler.hasFrames) {
+        std::cerr << "GridVolume import error: no frame specified" << std::endl;
+        return false;
+    }
+    if (handler.size.size() != 3) {
+        std::cerr << "GridVolume import error: invalid size, expected a 3D int vector" << std::endl;
         return false;
     }
     
-    _frames.reserve(framesValue.Size());
+    _sizeX = (uint_t)handler.size[0];
+    _sizeY = (uint_t)handler.size[1];
+    _sizeZ = (uint_t)handler.size[2];
+    size_t voxelsCount = (size_t)_sizeX*_sizeY*_sizeZ;
     
-    for (int i = 0; i < framesValue.Size(); ++i) {
-        const rapidjson::Value& frameValue = framesValue[i];
-        
-        const rapidjson::Value& densityValue = frameValue["density"];
-        
-        if (!densityValue.IsArray() || densityValue.Size() != (_sizeX*_sizeY*_sizeZ)) {
+    _frames.reserve(handler.frames.size());
+    
+    for (GridJSONHandler::FrameValues& values : handler.frames) {
+        if (!values.hasDensity || values.density.size() != voxelsCount) {
             std::cerr << "GridVolume import error: invalid data, expected a float array of size x*y*z"
             << std::endl;
             return false;
         }
+        if (values.hasTemperature && values.temperature.size() != voxelsCount) {
+            std::cerr << "GridVolume import error: invalid temperature data, expected a float array of size x*y*z"
+            << std::endl;
+            return false;
+        }
         
         // Load data
-        float* density = new float[_sizeX*_sizeY*_sizeZ];
-        for (uint_t i = 0; i < _sizeX*_sizeY*_sizeZ; ++i) {
-            density[i] = densityValue[i].GetDouble();
-        }
+        Frame f;
+        f.density = nullptr;
+        f.temperature = nullptr;
+        f.densityGrid = std::make_shared<SparseGrid>();
+        f.densityGrid->build(_sizeX, _sizeY, _sizeZ, [&] (uint_t i) {
+            return values.density[i];
+        });
+        std::vector<float>().swap(values.density);
         
         // Load temperature data
-        float* temperature = nullptr;
-        if (frameValue.HasMember("temperature")) {
-            const rapidjson::Value& tempValue = frameValue["temperature"];
-            if (!tempValue.IsArray() || tempValue.Size() != (_sizeX*_sizeY*_sizeZ)) {
-                std::cerr << "GridVolume import error: invalid temperature data, expected a float array of size x*y*z"
-                << std::endl;
-                return false;
-            }
-            
-            // Load data
-            temperature = new float[_sizeX*_sizeY*_sizeZ];
-            for (uint_t i = 0; i < _sizeX*_sizeY*_sizeZ; ++i) {
-                temperature[i] = tempValue[i].GetDouble();
-            }
+        if (values.hasTemperature) {
+            f.temperatureGrid = std::make_shared<SparseGrid>();
+            f.temperatureGrid->build(_sizeX, _sizeY, _sizeZ, [&] (uint_t i) {
+                return values.temperature[i];
+            });
+            std::vector<float>().swap(values.temperature);
         }
-        Frame f;
-        f.density = density;
-        f.temperature = temperature;
         _frames.push_back(f);
     }
     
-    setFrame(0);
+    return true;
+}
+
+bool GridVolume::saveData(const std::string& filename, VoxelFormat format) const {
+    QFile file(filename.c_str());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "GridVolume error: cannot write file \"" << filename << "\"" << std::endl;
+        return false;
+    }
+    
+    FileHeader header;
+    std::copy(GridFileMagic, GridFileMagic + 4, header.magic);
+    header.version = GridFileVersion;
+    header.sizeX = _sizeX;
+    header.sizeY = _sizeY;
+    header.sizeZ = _sizeZ;
+    header.framesCount = _frames.size();
+    header.format = format;
+    header.hasTemperature = 0;
+    for (const Frame& frame : _frames) {
+        if (frame.temperature || frame.temperatureGrid) {
+            header.hasTemperature = 1;
+        }
+    }
+    
+    // Frames missing temperature data are written with zero voxels
+    uint_t voxelsCount = _sizeX*_sizeY*_sizeZ;
+    size_t voxelSize = (format == HalfVoxels ? sizeof(uint16_t) : sizeof(float));
+    std::vector<char> buffer(voxelsCount*voxelSize);
+    auto writeVoxels = [&] (const void* data, const SparseGrid* grid) {
+        for (uint_t i = 0; i < voxelsCount; ++i) {
+            float v = 0.f;
+            if (grid) {
+                v = grid->lookup(i % _sizeX, (i / _sizeX) % _sizeY, i / (_sizeX*_sizeY));
+            } else if (data) {
+                v = VoxelValue(data, _format, i);
+            }
+            if (format == HalfVoxels) {
+                ((uint16_t*)buffer.data())[i] = Core::floatToHalf(v);
+            } else {
+                ((float*)buffer.data())[i] = v;
+            }
+        }
+        return file.write(buffer.data(), buffer.size()) == (qint64)buffer.size();
+    };
     
+    bool success = file.write((const char*)&header, sizeof(header)) == sizeof(header);
+    for (uint_t i = 0; success && i < _frames.size(); ++i) {
+        const Frame& frame = _frames[i];
+        success = writeVoxels(frame.density, frame.densityGrid.get());
+        if (success && header.hasTemperature) {
+            success = writeVoxels(frame.temperature, frame.temperatureGrid.get());
+        }
+    }
+    if (!success) {
+        std::cerr << "GridVolume error: cannot write file \"" << filename << "\"" << std::endl;
+        file.close();
+        file.remove();
+        return false;
+    }
     return true;
 }
 
 void GridVolume::setFrame(int frame) {
+    if (_frames.empty()) {
+        return;
+    }
     frame -= 106;
-    Frame f = _frames[glm::clamp(frame, 0, (int)_frames.size()-1)];
-    _density = f.density;
-    _temperature = f.temperature;
+    Frame& f = _frames[glm::clamp(frame, 0, (int)_frames.size()-1)];
+    _buildFrameGrids(f);
+    _density = f.densityGrid.get();
+    _temperature = f.temperatureGrid.get();
+}
+
+void GridVolume::_buildFrameGrids(Frame& frame) {
+    // Mapped frames are converted the first time they are used
+    if (frame.density && !frame.densityGrid) {
+        frame.densityGrid = std::make_shared<SparseGrid>();
+        frame.densityGrid->build(_sizeX, _sizeY, _sizeZ, [&] (uint_t i) {
+            return VoxelValue(frame.density, _format, i);
+        });
+    }
+    if (frame.temperature && !frame.temperatureGrid) {
+        frame.temperatureGrid = std::make_shared<SparseGrid>();
+        frame.temperatureGrid->build(_sizeX, _sizeY, _sizeZ, [&] (uint_t i) {
+            return VoxelValue(frame.temperature, _format, i);
+        });
+    }
+}
+
+void GridVolume::_getDensitySegments(const Ray& ray, float t0, float t1,
+                                     std::vector<Segment>& segments) const {
+    segments.clear();
+    const SparseGrid* grid = _temperature ? _temperature : _density;
+    if (!grid) {
+        return;
+    }
+    
+    // Walk through the bricks crossed by the ray with a 3D DDA
+    ivec3 bricksCount(grid->getBricksCountX(), grid->getBricksCountY(), grid->getBricksCountZ());
+    vec3 brickSize = ((_bounds.max - _bounds.min) / vec3(_sizeX, _sizeY, _sizeZ)
+                      * (float)SparseGrid::BrickSize);
+    vec3 p = ray(t0);
+    ivec3 brick, step;
+    vec3 tNext, tDelta;
+    for (int i = 0; i < 3; ++i) {
+        brick[i] = clamp((int)floorf((p[i] - _bounds.min[i]) / brickSize[i]), 0, bricksCount[i]-1);
+        if (ray.direction[i] > 0.f) {
+            step[i] = 1;
+            tNext[i] = t0 + (_bounds.min[i] + (brick[i]+1)*brickSize[i] - p[i]) / ray.direction[i];
+            tDelta[i] = brickSize[i] / ray.direction[i];
+        } else if (ray.direction[i] < 0.f) {
+            step[i] = -1;
+            tNext[i] = t0 + (_bounds.min[i] + brick[i]*brickSize[i] - p[i]) / ray.direction[i];
+            tDelta[i] = -brickSize[i] / ray.direction[i];
+        } else {
+            step[i] = 0;
+            tNext[i] = INFINITY;
+            tDelta[i] = INFINITY;
+        }
+    }
+    
+    float t = t0;
+    while (t < t1) {
+        int axis = (tNext.x < tNext.y) ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+        float tEnd = std::min(tNext[axis], t1);
+        
+        // Density is read from the temperature grid, emission also needs the density grid
+        float maxDensity = (_temperature ?
+                            std::max(_temperature->getMaxValue(brick.x, brick.y, brick.z), 0.f) : 0.f);
+        bool emissive = _density && _density->getMaxValue(brick.x, brick.y, brick.z) > 0.f;
+        if (maxDensity > 0.f || emissive) {
+            // Merge with the previous brick when the bound is the same
+            if (!segments.empty() && segments.back().t1 == t && segments.back().maxSigmaT == maxDensity) {
+                segments.back().t1 = tEnd;
+            } else {
+                Segment segment;
+                segment.t0 = t;
+                segment.t1 = tEnd;
+                segment.maxSigmaT = maxDensity;
+                segments.push_back(segment);
+            }
+        }
+        
+        t = tEnd;
+        brick[axis] += step[axis];
+        if (brick[axis] < 0 || brick[axis] >= bricksCount[axis]) {
+            break;
+        }
+        tNext[axis] += tDelta[axis];
+    }
 }
 
 float GridVolume::density(const vec3& p) const {
     return dataAtPoint(_temperature, p);
 }
 
-float GridVolume::dataAtPoint(float *data, const vec3 &p) const {
+float GridVolume::dataAtPoint(const SparseGrid* grid, const vec3 &p) const {
     int nx = _sizeX, ny = _sizeY, nz = _sizeZ;
     
     if (!_bounds.intersectP(p)) {
@@ -142,10 +505,10 @@ float GridVolume::dataAtPoint(float *data, const vec3 &p) const {
     float dx = vox.x - vx, dy = vox.y - vy, dz = vox.z - vz;
     
     // Trilinearly interpolate density values to compute local density
-    float d00 = mix(gridData(data, vx, vy, vz),     gridData(data, vx+1, vy, vz), dx);
-    float d10 = mix(gridData(data, vx, vy+1, vz),   gridData(data, vx+1, vy+1, vz), dx);
-    float d01 = mix(gridData(data, vx, vy, vz+1),   gridData(data, vx+1, vy, vz+1), dx);
-    float d11 = mix(gridData(data, vx, vy+1, vz+1), gridData(data, vx+1, vy+1, vz+1), dx);
+    float d00 = mix(gridData(grid, vx, vy, vz),     gridData(grid, vx+1, vy, vz), dx);
+    float d10 = mix(gridData(grid, vx, vy+1, vz),   gridData(grid, vx+1, vy+1, vz), dx);
+    float d01 = mix(gridData(grid, vx, vy, vz+1),   gridData(grid, vx+1, vy, vz+1), dx);
+    float d11 = mix(gridData(grid, vx, vy+1, vz+1), gridData(grid, vx+1, vy+1, vz+1), dx);
     float d0 = mix(d00, d10, dy);
     float d1 = mix(d01, d11, dy);
     return mix(d0, d1, dz);
@@ -208,20 +571,15 @@ vec3 hsvToRGB(vec3 in) {
     return out;
 }
 
-float GridVolume::gridData(float* data, int x, int y, int z) const {
-    if (!data) {
+float GridVolume::gridData(const SparseGrid* grid, int x, int y, int z) const {
+    if (!grid) {
         return 0.f;
     }
-    
-    x = clamp(x, 0, (int)_sizeX-1);
-    y = clamp(y, 0, (int)_sizeY-1);
-    z = clamp(z, 0, (int)_sizeZ-1);
-    return data[z*_sizeX*_sizeY + y*_sizeX + x];
+    return grid->lookup(x, y, z);
 }
 
-Spectrum GridVolume::le(const vec3& p) const {
-    Transform worldToObject = _parentNode ? Transform::Inverse(_parentNode->getTransform()) : Transform();
-    float v = dataAtPoint(_temperature, worldToObject(p));
+Spectrum GridVolume::emission(const vec3& p) const {
+    float v = dataAtPoint(_temperature, p);
     float biais = -0.3f;
     v += biais;
     v = clamp(v, 0.f, 1.f);
@@ -241,7 +599,7 @@ Spectrum GridVolume::le(const vec3& p) const {
         colorValue = glm::mix(color1, color2, t);
     }
     
-    float d = dataAtPoint(_density, worldToObject(p));
+    float d = dataAtPoint(_density, p);
     d *= 10.f;
     d = glm::clamp(d, 0.f, 1.f);
     float t1 = 0.35f, t2 = 0.8f;
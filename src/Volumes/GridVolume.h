@@ -9,35 +9,79 @@
 #ifndef __CSE168_Rendering__GridVolume__
 #define __CSE168_Rendering__GridVolume__
 
+#include <vector>
+
+#include <QFile>
+
 #include "Core/Core.h"
 #include "Volumes/DensityVolume.h"
+#include "Volumes/SparseGrid.h"
 
+/*
+ * Voxel grid sequence, loaded either from a JSON file or from a binary grid
+ * file. Binary files are memory-mapped, so only the voxels of the frames
+ * actually selected by setFrame are paged in. Frames are stored as sparse
+ * brick grids, used to skip empty space when marching rays.
+ */
 class GridVolume : public DensityVolume {
 public:
     
+    enum VoxelFormat {
+        FloatVoxels = 0,
+        HalfVoxels = 1
+    };
+    
+    // Convert a JSON grid file to the binary grid format
+    static bool ConvertToBinary(const std::string& jsonFilename, const std::string& filename,
+                                VoxelFormat format=FloatVoxels);
+    
     GridVolume();
     virtual ~GridVolume();
     
+    // Load a binary grid file, or a JSON grid file when the binary header is missing
     bool loadData(const std::string& filename);
+    bool saveData(const std::string& filename, VoxelFormat format) const;
     void setFrame(int frame);
     
     virtual float density(const vec3& p) const;
-    virtual float dataAtPoint(float* data, const vec3& p) const;
+    virtual float dataAtPoint(const SparseGrid* grid, const vec3& p) const;
     
-    float gridData(float* data, int x, int y, int z) const;
+    float gridData(const SparseGrid* grid, int x, int y, int z) const;
     
-    virtual Spectrum le(const vec3& p) const;
+    virtual Spectrum emission(const vec3& p) const;
     
     struct Frame {
-        float*  density;
-        float*  temperature;
+        const void*                 density;
+        const void*                 temperature;
+        std::shared_ptr<SparseGrid> densityGrid;
+        std::shared_ptr<SparseGrid> temperatureGrid;
     };
     
+protected:
+    virtual void _getDensitySegments(const Ray& ray, float t0, float t1,
+                                     std::vector<Segment>& segments) const;
+    
 private:
-    uint_t              _sizeX, _sizeY, _sizeZ;
-    std::vector<Frame>  _frames;
-    float*              _density;
-    float*              _temperature;
+    struct FileHeader {
+        char        magic[4];
+        uint32_t    version;
+        uint32_t    sizeX, sizeY, sizeZ;
+        uint32_t    framesCount;
+        uint32_t    format;
+        uint32_t    hasTemperature;
+    };
+    
+    void _clear();
+    bool _loadBinary(const std::string& filename);
+    bool _loadJSON(const std::string& filename);
+    void _buildFrameGrids(Frame& frame);
+    
+    uint_t                          _sizeX, _sizeY, _sizeZ;
+    VoxelFormat                     _format;
+    std::vector<Frame>              _frames;
+    QFile                           _file;
+    const SparseGrid*               _density;
+    const SparseGrid*               _temperature;
 };
 
 #endif /* defined(__CSE168_Rendering__GridVolume__) */
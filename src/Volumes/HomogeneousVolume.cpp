@@ -8,6 +8,8 @@
 
 #include "HomogeneousVolume.h"
 
+#include <algorithm>
+
 HomogeneousVolume::HomogeneousVolume() : Volume(),
 _bounds(), _sigmaA(0.f), _sigmaS(0.f), _le(0.f), _g(0.f), _stepSize(1.f) {
     
@@ -95,4 +97,21 @@ Spectrum HomogeneousVolume::tau(const Ray& ray) const {
 
 float HomogeneousVolume::stepSize() const {
     return _stepSize;
-}
\ No newline at end of file
+}
+
+void HomogeneousVolume::getSegments(const Ray& ray, float t0, float t1,
+                                    std::vector<Segment>& segments) const {
+    segments.clear();
+    float b0, b1;
+    if (!_bounds.intersectP(ray, &b0, &b1)) {
+        return;
+    }
+    Segment segment;
+    segment.t0 = std::max(b0, t0);
+    segment.t1 = std::min(b1, t1);
+    vec3 sigmaT = (_sigmaA + _sigmaS).getColor();
+    segment.maxSigmaT = std::max(sigmaT.x, std::max(sigmaT.y, sigmaT.z));
+    if (segment.t0 < segment.t1) {
+        segments.push_back(segment);
+    }
+}
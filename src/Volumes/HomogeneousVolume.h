@@ -35,6 +35,8 @@ public:
     virtual Spectrum sigmaT(const vec3& p) const;
     virtual Spectrum tau(const Ray& ray) const;
     virtual float stepSize() const;
+    virtual void getSegments(const Ray& ray, float t0, float t1,
+                             std::vector<Segment>& segments) const;
     
 private:
     AABB        _bounds;
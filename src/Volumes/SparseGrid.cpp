@@ -0,0 +1,135 @@
+//
+//  SparseGrid.cpp
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/10/14.
+//
+//
+
+#include "SparseGrid.h"
+
+#include <algorithm>
+
+static const int BrickVoxelsCount = SparseGrid::BrickSize*SparseGrid::BrickSize*SparseGrid::BrickSize;
+
+SparseGrid::SparseGrid() :
+_sizeX(0), _sizeY(0), _sizeZ(0), _bricksX(0), _bricksY(0), _bricksZ(0),
+_bricks(), _values(), _minValues(), _maxValues(), _voxels() {
+    
+}
+
+SparseGrid::~SparseGrid() {
+    
+}
+
+void SparseGrid::build(uint_t sizeX, uint_t sizeY, uint_t sizeZ,
+                       const std::function<float (uint_t index)>& voxel) {
+    _sizeX = sizeX;
+    _sizeY = sizeY;
+    _sizeZ = sizeZ;
+    _bricksX = (sizeX + BrickSize-1) / BrickSize;
+    _bricksY = (sizeY + BrickSize-1) / BrickSize;
+    _bricksZ = (sizeZ + BrickSize-1) / BrickSize;
+    
+    uint_t bricksCount = _bricksX*_bricksY*_bricksZ;
+    _bricks.assign(bricksCount, -1);
+    _values.assign(bricksCount, 0.f);
+    _minValues.assign(bricksCount, 0.f);
+    _maxValues.assign(bricksCount, 0.f);
+    _voxels.clear();
+    
+    if (bricksCount == 0) {
+        return;
+    }
+    
+    auto dense = [&] (int x, int y, int z) {
+        x = clamp(x, 0, (int)_sizeX-1);
+        y = clamp(y, 0, (int)_sizeY-1);
+        z = clamp(z, 0, (int)_sizeZ-1);
+        return voxel(z*_sizeX*_sizeY + y*_sizeX + x);
+    };
+    
+    std::vector<float> brick(BrickVoxelsCount);
+    for (int bz = 0; bz < _bricksZ; ++bz) {
+        for (int by = 0; by < _bricksY; ++by) {
+            for (int bx = 0; bx < _bricksX; ++bx) {
+                uint_t brickIndex = _getBrickIndex(bx, by, bz);
+                
+                // Interpolation inside the brick reads one more voxel on each side
+                float minValue = INFINITY, maxValue = -INFINITY;
+                for (int z = -1; z <= BrickSize; ++z) {
+                    for (int y = -1; y <= BrickSize; ++y) {
+                        for (int x = -1; x <= BrickSize; ++x) {
+                            float v = dense(bx*BrickSize + x, by*BrickSize + y, bz*BrickSize + z);
+                            minValue = std::min(minValue, v);
+                            maxValue = std::max(maxValue, v);
+                            if (x >= 0 && y >= 0 && z >= 0
+                                && x < BrickSize && y < BrickSize && z < BrickSize) {
+                                brick[(z*BrickSize + y)*BrickSize + x] = v;
+                            }
+                        }
+                    }
+                }
+                _minValues[brickIndex] = minValue;
+                _maxValues[brickIndex] = maxValue;
+                
+                // Only store bricks that are not constant
+                auto range = std::minmax_element(brick.begin(), brick.end());
+                if (*range.first == *range.second) {
+                    _values[brickIndex] = *range.first;
+                } else {
+                    _bricks[brickIndex] = _voxels.size() / BrickVoxelsCount;
+                    _voxels.insert(_voxels.end(), brick.begin(), brick.end());
+                }
+            }
+        }
+    }
+    _voxels.shrink_to_fit();
+}
+
+float SparseGrid::lookup(int x, int y, int z) const {
+    if (_bricks.empty()) {
+        return 0.f;
+    }
+    x = clamp(x, 0, (int)_sizeX-1);
+    y = clamp(y, 0, (int)_sizeY-1);
+    z = clamp(z, 0, (int)_sizeZ-1);
+    uint_t brickIndex = _getBrickIndex(x / BrickSize, y / BrickSize, z / BrickSize);
+    int32_t brick = _bricks[brickIndex];
+    if (brick < 0) {
+        return _values[brickIndex];
+    }
+    x %= BrickSize;
+    y %= BrickSize;
+    z %= BrickSize;
+    return _voxels[brick*BrickVoxelsCount + (z*BrickSize + y)*BrickSize + x];
+}
+
+float SparseGrid::getMinValue(int bx, int by, int bz) const {
+    return _minValues[_getBrickIndex(bx, by, bz)];
+}
+
+float SparseGrid::getMaxValue(int bx, int by, int bz) const {
+    return _maxValues[_getBrickIndex(bx, by, bz)];
+}
+
+int SparseGrid::getBricksCountX() const {
+    return _bricksX;
+}
+
+int SparseGrid::getBricksCountY() const {
+    return _bricksY;
+}
+
+int SparseGrid::getBricksCountZ() const {
+    return _bricksZ;
+}
+
+size_t SparseGrid::getMemoryUsage() const {
+    return (_bricks.size() * sizeof(int32_t)
+            + (_values.size() + _minValues.size() + _maxValues.size() + _voxels.size()) * sizeof(float));
+}
+
+uint_t SparseGrid::_getBrickIndex(int bx, int by, int bz) const {
+    return (bz*_bricksY + by)*_bricksX + bx;
+}
@@ -0,0 +1,59 @@
+//
+//  SparseGrid.h
+//  CSE168_Rendering
+//
+//  Created by Gael Jochaud du Plessix on 6/10/14.
+//
+//
+
+#ifndef __CSE168_Rendering__SparseGrid__
+#define __CSE168_Rendering__SparseGrid__
+
+#include <vector>
+#include <functional>
+
+#include "Core/Core.h"
+
+/*
+ * Voxel grid split in bricks of BrickSize^3 voxels indexed by a dense top
+ * level. Bricks holding a single value (usually empty space) are not stored.
+ * Each brick keeps the range of values that trilinear interpolation can
+ * return inside it, so empty bricks can be skipped when marching.
+ */
+class SparseGrid {
+public:
+    
+    static const int BrickSize = 8;
+    
+    SparseGrid();
+    ~SparseGrid();
+    
+    // Build the grid from dense voxels, given by their index z*sizeX*sizeY + y*sizeX + x
+    void build(uint_t sizeX, uint_t sizeY, uint_t sizeZ,
+               const std::function<float (uint_t index)>& voxel);
+    
+    // Voxel value, coordinates are clamped to the grid
+    float lookup(int x, int y, int z) const;
+    
+    // Range of the interpolated values inside a brick
+    float getMinValue(int bx, int by, int bz) const;
+    float getMaxValue(int bx, int by, int bz) const;
+    
+    int     getBricksCountX() const;
+    int     getBricksCountY() const;
+    int     getBricksCountZ() const;
+    size_t  getMemoryUsage() const;
+    
+private:
+    uint_t  _getBrickIndex(int bx, int by, int bz) const;
+    
+    uint_t                  _sizeX, _sizeY, _sizeZ;
+    int                     _bricksX, _bricksY, _bricksZ;
+    std::vector<int32_t>    _bricks;
+    std::vector<float>      _values;
+    std::vector<float>      _minValues;
+    std::vector<float>      _maxValues;
+    std::vector<float>      _voxels;
+};
+
+#endif /* defined(__CSE168_Rendering__SparseGrid__) */
@@ -20,10 +20,29 @@
 #include <sstream>
 #include <iomanip>
 #include "Cameras/PerspectiveCamera.h"
+#include "Volumes/GridVolume.h"
+#include "Utilities/TextureCache.h"
+#include "Utilities/Benchmarks.h"
 
 int main(int argc, char* argv[]) {
+    // Convert a JSON grid volume to the binary grid format
+    if (argc >= 4 && std::string(argv[1]) == "--convert-grid") {
+        GridVolume::VoxelFormat format = GridVolume::FloatVoxels;
+        if (argc >= 5 && std::string(argv[4]) == "--half") {
+            format = GridVolume::HalfVoxels;
+        }
+        return GridVolume::ConvertToBinary(argv[2], argv[3], format) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    // Run a micro benchmark, with its own arguments
+    if (argc >= 3 && std::string(argv[1]) == "--benchmark") {
+        return Benchmarks::Run(argv[2], argc - 3, argv + 3) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
     if (argc <= 1) {
         std::cerr << "Usage: " << argv[0] << " filename" << std::endl;
+        std::cerr << "       " << argv[0] << " --convert-grid input.json output.grid [--half]" << std::endl;
+        std::cerr << "       " << argv[0] << " --benchmark textures [image]" << std::endl;
         return EXIT_FAILURE;
     }
     
@@ -121,6 +140,9 @@ int main(int argc, char* argv[]) {
             
             float elapsed = ((float)clock.elapsed()/1000.f);
             qDebug() << "Rendered frame" << frameNum << "/" << endFrame << "in" << elapsed << "s";
+            if (TextureCache::Instance().isEnabled()) {
+                TextureCache::Instance().printStatistics();
+            }
             
             ++frameNum;
         }
@@ -132,6 +154,9 @@ int main(int argc, char* argv[]) {
     if (image) {
         renderer->render(*scene, camera.get());
         image->writeToFile();
+        if (TextureCache::Instance().isEnabled()) {
+            TextureCache::Instance().printStatistics();
+        }
         return EXIT_SUCCESS;
     }
     